@@ -5,16 +5,30 @@ layout (local_size_x_id=1, local_size_y=1, local_size_z=1) in;
 #define TWO_PI 2.0 * 3.1415926535897932384626433832795
 #define BOUNCE_COEFFICIENT 0.8
 
-layout (push_constant) uniform Constants
+// EParticlePositionFormat
+#define POSITION_FORMAT_FLOAT32 0
+#define POSITION_FORMAT_QUANTIZED16 1
+
+struct EmitterProperties
 {
-	float dt;
-} g_PushConstant;
+	mat4 centeringRotMatrix;
+	vec4 position, direction;
+    vec2 particleSize;
+    float particleDuration, initialSpeed, spread;
+    uint particleCount;
+    float particlesPerSecond;
+    uint seed;
+    vec4 boundsMin, boundsExtent;
+};
 
+// Positions are either a vec4 or a quantized uvec2 per particle. Integrated particles always store float positions
 layout (binding = 0) buffer Positions
 {
-	vec4 positions[];
+	uint positionData[];
 } g_Positions;
 
+// Analytic emitters derive positions from the simulation time and do not store any motion
+#ifndef ANALYTIC
 layout (binding = 1) buffer Velocities
 {
 	vec4 velocities[];
@@ -24,15 +38,265 @@ layout (binding = 2) buffer Ages
 {
 	float ages[];
 } g_Ages;
+#endif
 
-layout (binding = 3) uniform EmitterProperties
+// Living particles inside the camera's frustum are appended to the visible list, which the renderer draws indirectly
+layout (binding = 4) writeonly buffer VisibleParticles
 {
-	mat4 centeringRotMatrix;
-	vec4 position, direction;
-    vec2 particleSize;
-    float particleDuration, initialSpeed, spread;
-    uint particleCount;
-} g_EmitterProperties;
+	uint indices[];
+} g_VisibleParticles;
+
+// VkDrawIndexedIndirectCommand, the instance count is reset before the dispatch and firstInstance is where the emitter's visible list starts
+struct DrawCommand
+{
+	uint indexCount;
+	uint instanceCount;
+	uint firstIndex;
+	int vertexOffset;
+	uint firstInstance;
+};
+
+layout (binding = 5) buffer DrawCommands
+{
+	DrawCommand commands[];
+} g_DrawCommands;
+
+shared uint s_VisibleCount;
+shared uint s_FirstVisible;
+
+#ifdef BATCHED
+// Every emitter of the batch is updated by one dispatch, the buffers are shared and each emitter owns a range of them
+struct BatchedEmitter
+{
+    EmitterProperties properties;
+    // Offsets into the shared buffers, velocities and ages are indexed by particle and positions by word
+    uint firstParticle;
+    uint firstPositionWord;
+    // Emitters own consecutive ranges of the dispatch's work groups
+    uint firstWorkGroup;
+    float time;
+    uint positionFormat;
+    uint drawCommand;
+    // Frame time plus the time the emitter's particles have to catch up with after moving from the CPU
+    float dt;
+};
+
+layout (push_constant) uniform Constants
+{
+	// Range of emitters covered by the dispatch
+	uint firstEmitter;
+	uint emitterCount;
+	// World space planes whose positive sides contain the camera's frustum
+	vec4 frustumPlanes[6];
+} g_PushConstant;
+
+layout (binding = 3) readonly buffer Emitters
+{
+	BatchedEmitter emitters[];
+} g_Emitters;
+
+// Loaded from the emitter owning the work group at the start of main
+EmitterProperties g_EmitterProperties;
+uint g_FirstParticle;
+uint g_FirstPositionWord;
+uint g_FirstWorkGroup;
+float g_Time;
+uint g_PositionFormat;
+uint g_DrawCommand;
+float g_Dt;
+
+// Finds the last emitter whose work groups start at or before this work group, emitters without particles own no work groups
+void loadEmitter()
+{
+    uint low = g_PushConstant.firstEmitter;
+    uint high = low + g_PushConstant.emitterCount - 1;
+    while (low < high) {
+        uint middle = (low + high + 1) / 2;
+        if (g_Emitters.emitters[middle].firstWorkGroup <= gl_WorkGroupID.x) {
+            low = middle;
+        } else {
+            high = middle - 1;
+        }
+    }
+
+    g_EmitterProperties = g_Emitters.emitters[low].properties;
+    g_FirstParticle = g_Emitters.emitters[low].firstParticle;
+    g_FirstPositionWord = g_Emitters.emitters[low].firstPositionWord;
+    g_FirstWorkGroup = g_Emitters.emitters[low].firstWorkGroup;
+    g_Time = g_Emitters.emitters[low].time;
+    g_PositionFormat = g_Emitters.emitters[low].positionFormat;
+    g_DrawCommand = g_Emitters.emitters[low].drawCommand;
+    g_Dt = g_Emitters.emitters[low].dt;
+}
+
+uint getParticleIndex()
+{
+    return (gl_WorkGroupID.x - g_FirstWorkGroup) * gl_WorkGroupSize.x + gl_LocalInvocationID.x;
+}
+#else
+layout (push_constant) uniform Constants
+{
+	float dt;
+	// Emitter's simulation time, only used when ANALYTIC is defined
+	float time;
+	uint positionFormat;
+	// World space planes whose positive sides contain the camera's frustum
+	vec4 frustumPlanes[6];
+} g_PushConstant;
+
+layout (binding = 3) uniform EmitterBuffer
+{
+	EmitterProperties g_EmitterProperties;
+};
+
+const uint g_FirstParticle = 0;
+const uint g_FirstPositionWord = 0;
+const uint g_DrawCommand = 0;
+float g_Time;
+uint g_PositionFormat;
+float g_Dt;
+
+void loadEmitter()
+{
+    g_Time = g_PushConstant.time;
+    g_PositionFormat = g_PushConstant.positionFormat;
+    g_Dt = g_PushConstant.dt;
+}
+
+uint getParticleIndex()
+{
+    return gl_GlobalInvocationID.x;
+}
+#endif
+
+vec3 loadPosition(uint particleIdx)
+{
+    uint firstWord = g_FirstPositionWord + 4 * particleIdx;
+    return uintBitsToFloat(uvec3(g_Positions.positionData[firstWord], g_Positions.positionData[firstWord + 1], g_Positions.positionData[firstWord + 2]));
+}
+
+void storePosition(uint particleIdx, vec3 position)
+{
+    if (g_PositionFormat == POSITION_FORMAT_QUANTIZED16) {
+        // 16 bits per axis relative to the emitter's bounds, see ParticlePositionPacker
+        uint firstWord = g_FirstPositionWord + 2 * particleIdx;
+        vec3 normalized = (position - g_EmitterProperties.boundsMin.xyz) / max(g_EmitterProperties.boundsExtent.xyz, vec3(1e-6));
+        g_Positions.positionData[firstWord] = packUnorm2x16(normalized.xy);
+        g_Positions.positionData[firstWord + 1] = packUnorm2x16(vec2(normalized.z, 0.0));
+    } else {
+        uint firstWord = g_FirstPositionWord + 4 * particleIdx;
+        uvec3 positionBits = floatBitsToUint(position);
+        g_Positions.positionData[firstWord] = positionBits.x;
+        g_Positions.positionData[firstWord + 1] = positionBits.y;
+        g_Positions.positionData[firstWord + 2] = positionBits.z;
+        g_Positions.positionData[firstWord + 3] = floatBitsToUint(1.0);
+    }
+}
+
+// A particle's quad spans particleSize along the camera's right and up vectors from its position
+bool isInFrustum(vec3 position)
+{
+    float radius = length(g_EmitterProperties.particleSize);
+    for (uint planeIdx = 0; planeIdx < 6; planeIdx++) {
+        vec4 plane = g_PushConstant.frustumPlanes[planeIdx];
+        if (dot(plane.xyz, position) + plane.w < -radius) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Appends the visible particles of the work group to the emitter's visible list with one atomic per work group.
+// Has to be reached by every invocation of the work group, a work group only covers particles of one emitter
+void appendVisibleParticle(uint particleIdx, bool visible)
+{
+    if (gl_LocalInvocationIndex == 0) {
+        s_VisibleCount = 0;
+    }
+    barrier();
+
+    uint localIdx = 0;
+    if (visible) {
+        localIdx = atomicAdd(s_VisibleCount, 1);
+    }
+    barrier();
+
+    if (gl_LocalInvocationIndex == 0 && s_VisibleCount > 0) {
+        s_FirstVisible = atomicAdd(g_DrawCommands.commands[g_DrawCommand].instanceCount, s_VisibleCount);
+    }
+    barrier();
+
+    if (visible) {
+        g_VisibleParticles.indices[g_DrawCommands.commands[g_DrawCommand].firstInstance + s_FirstVisible + localIdx] = particleIdx;
+    }
+}
+
+#ifdef ANALYTIC
+// Same counter-based generator as ParticleRandom, so that the CPU and the GPU spawn identical particles
+uint pcgHash(uint value)
+{
+    uint state = value * 747796405u + 2891336453u;
+    uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+uint createKey(uint seed, uint stream)
+{
+    return pcgHash(pcgHash(seed) + stream);
+}
+
+// Uniformly distributed in [0, 1)
+float generateFloat(uint key, uint counter)
+{
+    return float(pcgHash(pcgHash(counter) ^ key) >> 8u) * (1.0 / 16777216.0);
+}
+
+vec3 evaluateParticle(uint particleIdx)
+{
+    // Particle i is first spawned at i / particlesPerSecond and respawns every particleDuration seconds, each time as a new generation
+    float timeSinceFirstSpawn = max(0.0, g_Time - float(particleIdx) / g_EmitterProperties.particlesPerSecond);
+    uint generation = uint(timeSinceFirstSpawn / g_EmitterProperties.particleDuration);
+    float particleAge = timeSinceFirstSpawn - float(generation) * g_EmitterProperties.particleDuration;
+
+    // Randomized unit vector within a cone based on https://math.stackexchange.com/a/205589
+    uint key = createKey(g_EmitterProperties.seed, generation);
+    float minZ = cos(g_EmitterProperties.spread);
+    float z = minZ + (1.0 - minZ) * generateFloat(key, 2u * particleIdx);
+    float phi = TWO_PI * generateFloat(key, 2u * particleIdx + 1u);
+
+    float sqrtZInv = sqrt(max(0.0, 1.0 - z * z));
+    vec3 randVec = vec3(sqrtZInv * cos(phi), sqrtZInv * sin(phi), z);
+
+    vec3 particleDirection;
+    if (g_EmitterProperties.direction.xyz == vec3(0.0, 0.0, 1.0)) {
+        particleDirection = randVec;
+    } else {
+        particleDirection = vec3(g_EmitterProperties.centeringRotMatrix * vec4(randVec, 0.0));
+    }
+
+    // p = (0, -(gt^2)/2, 0) + V0*t + P0
+    float gt = -9.82 * particleAge;
+    vec3 V0 = particleDirection * g_EmitterProperties.initialSpeed;
+    return vec3(0.0, gt * particleAge * 0.5, 0.0) + V0 * particleAge + g_EmitterProperties.position.xyz;
+}
+
+void main()
+{
+    loadEmitter();
+    uint particleIdx = getParticleIndex();
+
+    // Invocations past the emitter's particles stay until the visible particles have been appended
+    bool visible = false;
+    if (particleIdx < g_EmitterProperties.particleCount) {
+        vec3 position = evaluateParticle(particleIdx);
+        storePosition(particleIdx, position);
+        visible = isInFrustum(position);
+    }
+
+    appendVisibleParticle(particleIdx, visible);
+}
+#else
 
 float rand1(float p, float minVal, float maxVal)
 {
@@ -42,7 +306,7 @@ float rand1(float p, float minVal, float maxVal)
     return minVal + (maxVal - minVal) * fract(p);
 }
 
-void createParticle(uint particleIdx, float particleAge)
+vec3 createParticle(uint particleIdx, float particleAge)
 {
     // Randomized unit vector within a cone based on https://math.stackexchange.com/a/205589
     float minZ = cos(g_EmitterProperties.spread);
@@ -72,29 +336,47 @@ void createParticle(uint particleIdx, float particleAge)
     float gt = -9.82 * particleAge;
     vec3 V0 = particleDirection * g_EmitterProperties.initialSpeed;
 
-    g_Velocities.velocities[particleIdx] = vec4(vec3(0.0, gt, 0.0) + V0, 0.0);
-    g_Positions.positions[particleIdx] = vec4(vec3(0.0, gt * particleAge * 0.5, 0.0) + V0 * particleAge + g_EmitterProperties.position.xyz, 1.0);
-    g_Ages.ages[particleIdx] = particleAge;
+    uint motionIdx = g_FirstParticle + particleIdx;
+    vec3 position = vec3(0.0, gt * particleAge * 0.5, 0.0) + V0 * particleAge + g_EmitterProperties.position.xyz;
+    g_Velocities.velocities[motionIdx] = vec4(vec3(0.0, gt, 0.0) + V0, 0.0);
+    storePosition(particleIdx, position);
+    g_Ages.ages[motionIdx] = particleAge;
+
+    return position;
 }
 
-void main()
+vec3 updateParticle(uint particleIdx, float dt)
 {
-    uint particleIdx = gl_GlobalInvocationID.x;
-    if (particleIdx >= g_EmitterProperties.particleCount) {
-        return;
-    }
-
-	float dt = g_PushConstant.dt;
-    float age = g_Ages.ages[particleIdx] + dt;
-
-    // Move particle
-    g_Positions.positions[particleIdx].xyz += g_Velocities.velocities[particleIdx].xyz * dt;
-    g_Velocities.velocities[particleIdx].y -= 9.82 * dt;
-    g_Ages.ages[particleIdx] = age;
+    uint motionIdx = g_FirstParticle + particleIdx;
+    float age = g_Ages.ages[motionIdx] + dt;
 
 	if (age > g_EmitterProperties.particleDuration) {
 		// Respawn old particle
 		float newParticleAge = age - g_EmitterProperties.particleDuration;
-        createParticle(particleIdx, newParticleAge);
+        return createParticle(particleIdx, newParticleAge);
 	}
+
+    // Move particle
+    vec3 position = loadPosition(particleIdx) + g_Velocities.velocities[motionIdx].xyz * dt;
+    storePosition(particleIdx, position);
+    g_Velocities.velocities[motionIdx].y -= 9.82 * dt;
+    g_Ages.ages[motionIdx] = age;
+
+    return position;
+}
+
+void main()
+{
+    loadEmitter();
+    uint particleIdx = getParticleIndex();
+
+    // Invocations past the emitter's particles stay until the visible particles have been appended
+    bool visible = false;
+    if (particleIdx < g_EmitterProperties.particleCount) {
+        vec3 position = updateParticle(particleIdx, g_Dt);
+        visible = isInFrustum(position);
+    }
+
+    appendVisibleParticle(particleIdx, visible);
 }
+#endif
@@ -1,6 +1,10 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
+// EParticlePositionFormat
+#define POSITION_FORMAT_FLOAT32 0
+#define POSITION_FORMAT_QUANTIZED16 1
+
 struct QuadVertex
 {
 	vec2 Position;
@@ -29,23 +33,57 @@ layout (binding = 2) uniform EmitterProperties
 {
 	mat4 centeringRotMatrix;
 	vec4 position, direction;
-    vec2 particleSize; // Only this variable is used in this shader
-    float particleDuration, initialSpeed, spread, particleCount;
+    vec2 particleSize;
+    float particleDuration, initialSpeed, spread;
+    uint particleCount;
+    float particlesPerSecond;
+    uint seed;
+    vec4 boundsMin, boundsExtent;
 } g_EmitterProperties;
 
+// Either a vec4 or a quantized uvec2 per particle, depending on the position format
 layout (binding = 3) buffer ParticlePositions
 {
-	vec4 positions[];
+	uint positionData[];
 } g_ParticlePositions;
 
+// Indices of the particles to draw, written by the update shader when particles are updated on the GPU
+layout (binding = 5) readonly buffer VisibleParticles
+{
+	uint indices[];
+} g_VisibleParticles;
+
+layout (push_constant) uniform Constants
+{
+	uint positionFormat;
+	// Non-zero when drawn indirectly, instances are then looked up in the visible list. The instance index starts at the draw's
+	// firstInstance, which is where the emitter's list starts
+	uint drawVisibleParticles;
+} g_PushConstant;
+
 layout (location = 0) out vec2 out_TexCoords;
 
+vec3 loadParticlePosition(uint particleIdx)
+{
+	if (g_PushConstant.positionFormat == POSITION_FORMAT_QUANTIZED16) {
+		// 16 bits per axis relative to the emitter's bounds, see ParticlePositionPacker
+		vec2 xy = unpackUnorm2x16(g_ParticlePositions.positionData[2 * particleIdx]);
+		float z = unpackUnorm2x16(g_ParticlePositions.positionData[2 * particleIdx + 1]).x;
+		return g_EmitterProperties.boundsMin.xyz + vec3(xy, z) * g_EmitterProperties.boundsExtent.xyz;
+	}
+
+	uint firstWord = 4 * particleIdx;
+	return uintBitsToFloat(uvec3(g_ParticlePositions.positionData[firstWord], g_ParticlePositions.positionData[firstWord + 1], g_ParticlePositions.positionData[firstWord + 2]));
+}
+
 void main()
 {
 	QuadVertex vertex = vertices[gl_VertexIndex];
 	vec2 vertexPosition = vertex.Position.xy;
 
-	vec4 worldPosition = g_ParticlePositions.positions[gl_InstanceIndex] +
+	uint particleIdx = g_PushConstant.drawVisibleParticles != 0 ? g_VisibleParticles.indices[gl_InstanceIndex] : gl_InstanceIndex;
+
+	vec4 worldPosition = vec4(loadParticlePosition(particleIdx), 1.0) +
 		g_CameraMatrices.Right 	* vertexPosition.x * g_EmitterProperties.particleSize.x +
 		g_CameraMatrices.Up 	* vertexPosition.y * g_EmitterProperties.particleSize.y;
 
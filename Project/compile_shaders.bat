@@ -32,6 +32,9 @@
 "tools/glslc.exe" -O -fshader-stage=vertex assets/shaders/particles/vertex.glsl -o assets/shaders/particles/vertex.spv
 "tools/glslc.exe" -O -fshader-stage=fragment assets/shaders/particles/fragment.glsl -o assets/shaders/particles/fragment.spv
 "tools/glslc.exe" -O -fshader-stage=compute assets/shaders/particles/update_cs.glsl -o assets/shaders/particles/update_cs.spv
+"tools/glslc.exe" -O -fshader-stage=compute -DANALYTIC assets/shaders/particles/update_cs.glsl -o assets/shaders/particles/update_analytic_cs.spv
+"tools/glslc.exe" -O -fshader-stage=compute -DBATCHED assets/shaders/particles/update_cs.glsl -o assets/shaders/particles/update_batched_cs.spv
+"tools/glslc.exe" -O -fshader-stage=compute -DBATCHED -DANALYTIC assets/shaders/particles/update_cs.glsl -o assets/shaders/particles/update_batched_analytic_cs.spv
 
 :: Shadow Map
 "tools/glslc.exe" -O -fshader-stage=vertex assets/shaders/shadowMapVertex.glsl -o assets/shaders/shadowMapVertex.spv
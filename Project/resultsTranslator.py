@@ -2,10 +2,13 @@ from dataclasses import dataclass
 import matplotlib.pyplot as plt
 import numpy as np
 import os
+import sys
 
 emitterCount    = 16
 frameCount      = 10000
 exePath         = ".\\Build\\bin\\Release-windows-x86_64\\VulkanProject\\VulkanProject.exe"
+# Worker counts to run when sweeping, 0 lets the application use one worker per core
+workerCounts    = [1, 2, 4, 6, 8, 12, 16]
 
 def plotLineGraphs(yArrays, xlim, labels, title):
     fig = plt.figure()
@@ -74,8 +77,8 @@ def calculateAverageUpdateTime(emitterTimes):
     average = totalDuration / (len(emitterTimes) * len(emitterTimes[0]))
     return average
 
-def startApplication(particleCount, multipleQueues):
-    command = "{} {} {} {} {}".format(exePath, emitterCount, frameCount, int(multipleQueues), float(particleCount))
+def startApplication(particleCount, multipleQueues, workerCount = 0):
+    command = "{} {} {} {} {} --workers {}".format(exePath, emitterCount, frameCount, int(multipleQueues), float(particleCount), workerCount)
     print("Executing following command:")
     print(command)
     err = os.system(command)
@@ -111,5 +114,31 @@ def main():
     plotLineGraphs(totalExecutionTimes, endParticleCount, plotLabels, "Total Execution Times")
 
 
+# Runs the application once per worker count and plots how the total and average update times scale
+def sweepWorkerCounts(particleCount):
+    averageUpdateTimes  = []
+    totalExecutionTimes = []
+
+    for workerCount in workerCounts:
+        startApplication(particleCount, True, workerCount)
+        results = readResultsFile()
+
+        averageUpdateTimes.append(calculateAverageUpdateTime(results["EmitterTimes"]))
+        totalExecutionTimes.append(results["TotalTime"])
+        print("Workers: {}, Total time: {} ms".format(workerCount, results["TotalTime"]))
+
+    for times, title in [(averageUpdateTimes, "Average Update Times"), (totalExecutionTimes, "Total Execution Times")]:
+        fig = plt.figure()
+        plt.plot(workerCounts, times, marker="o")
+        plt.ylabel("Time (ms)")
+        plt.xlabel("Worker Count")
+        fig.canvas.set_window_title(title)
+
+    plt.show()
+
 if __name__ == "__main__":
-    main()
+    # --sweep-workers [particle count] runs the worker count sweep instead of the particle count sweep
+    if len(sys.argv) > 1 and sys.argv[1] == "--sweep-workers":
+        sweepWorkerCounts(float(sys.argv[2]) if len(sys.argv) > 2 else 10000.0)
+    else:
+        main()
@@ -0,0 +1,378 @@
+#include "DeviceMemoryAllocatorBenchmark.h"
+
+#include "Vulkan/DeviceMemoryAllocatorVK.h"
+
+#include <chrono>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Memory types of the mock device, both heaps are small enough for the allocator to shrink its blocks to BENCHMARK_BLOCK_SIZE
+#define DEVICE_LOCAL_TYPE		0
+#define HOST_VISIBLE_TYPE		1
+#define BENCHMARK_HEAP_SIZE		MB(16)
+#define BENCHMARK_BLOCK_SIZE	MB(2)
+// Same as DEDICATED_IMAGE_SIZE in DeviceMemoryAllocatorVK.cpp
+#define BENCHMARK_DEDICATED_IMAGE_SIZE MB(16)
+
+// Hands out fake VkDeviceMemory handles, with host memory behind the host visible ones, and counts the calls the allocator makes
+struct MockMemory
+{
+	std::vector<uint8_t>	HostMemory;
+	bool					IsMapped;
+};
+
+static std::mutex g_MockLock;
+static std::unordered_map<VkDeviceMemory, MockMemory> g_MockMemory;
+static uint64_t g_NextMockHandle = 1;
+static uint32_t g_MockAllocateCount = 0;
+static uint32_t g_MockFreeCount = 0;
+
+static VKAPI_ATTR VkResult VKAPI_CALL mockAllocateMemory(VkDevice, const VkMemoryAllocateInfo* pAllocateInfo, const VkAllocationCallbacks*, VkDeviceMemory* pMemory)
+{
+	std::scoped_lock<std::mutex> lock(g_MockLock);
+
+	VkDeviceMemory memory = (VkDeviceMemory)(uintptr_t)g_NextMockHandle++;
+	MockMemory& mockMemory = g_MockMemory[memory];
+	mockMemory.IsMapped = false;
+	if (pAllocateInfo->memoryTypeIndex == HOST_VISIBLE_TYPE)
+	{
+		mockMemory.HostMemory.resize(pAllocateInfo->allocationSize);
+	}
+
+	g_MockAllocateCount++;
+	*pMemory = memory;
+	return VK_SUCCESS;
+}
+
+static VKAPI_ATTR void VKAPI_CALL mockFreeMemory(VkDevice, VkDeviceMemory memory, const VkAllocationCallbacks*)
+{
+	std::scoped_lock<std::mutex> lock(g_MockLock);
+
+	auto memoryItr = g_MockMemory.find(memory);
+	if (memoryItr == g_MockMemory.end())
+	{
+		LOG("FAILED: vkFreeMemory was called with memory that was not allocated");
+		return;
+	}
+
+	if (memoryItr->second.IsMapped)
+	{
+		LOG("FAILED: vkFreeMemory was called with memory that is still mapped");
+	}
+
+	g_MockMemory.erase(memoryItr);
+	g_MockFreeCount++;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL mockMapMemory(VkDevice, VkDeviceMemory memory, VkDeviceSize offset, VkDeviceSize, VkMemoryMapFlags, void** ppData)
+{
+	std::scoped_lock<std::mutex> lock(g_MockLock);
+
+	MockMemory& mockMemory = g_MockMemory.at(memory);
+	if (mockMemory.IsMapped || mockMemory.HostMemory.empty())
+	{
+		return VK_ERROR_MEMORY_MAP_FAILED;
+	}
+
+	mockMemory.IsMapped = true;
+	*ppData = mockMemory.HostMemory.data() + offset;
+	return VK_SUCCESS;
+}
+
+static VKAPI_ATTR void VKAPI_CALL mockUnmapMemory(VkDevice, VkDeviceMemory memory)
+{
+	std::scoped_lock<std::mutex> lock(g_MockLock);
+	g_MockMemory.at(memory).IsMapped = false;
+}
+
+static uint32_t getMockAllocateCount()
+{
+	std::scoped_lock<std::mutex> lock(g_MockLock);
+	return g_MockAllocateCount;
+}
+
+static uint32_t getMockFreeCount()
+{
+	std::scoped_lock<std::mutex> lock(g_MockLock);
+	return g_MockFreeCount;
+}
+
+static size_t getMockLiveMemoryCount()
+{
+	std::scoped_lock<std::mutex> lock(g_MockLock);
+	return g_MockMemory.size();
+}
+
+static DeviceMemoryAllocatorVK* createMockAllocator(VkDeviceSize bufferImageGranularity)
+{
+	VkPhysicalDeviceMemoryProperties memoryProperties = {};
+	memoryProperties.memoryHeapCount	= 2;
+	memoryProperties.memoryHeaps[0]		= { BENCHMARK_HEAP_SIZE, VK_MEMORY_HEAP_DEVICE_LOCAL_BIT };
+	memoryProperties.memoryHeaps[1]		= { BENCHMARK_HEAP_SIZE, 0 };
+	memoryProperties.memoryTypeCount	= 2;
+	memoryProperties.memoryTypes[DEVICE_LOCAL_TYPE]	= { VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0 };
+	memoryProperties.memoryTypes[HOST_VISIBLE_TYPE]	= { VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 1 };
+
+	const DeviceMemoryFunctionsVK functions = { mockAllocateMemory, mockFreeMemory, mockMapMemory, mockUnmapMemory };
+	return DBG_NEW DeviceMemoryAllocatorVK(VK_NULL_HANDLE, memoryProperties, bufferImageGranularity, functions);
+}
+
+static bool check(bool condition, const char* pDescription)
+{
+	LOG("%s: %s", condition ? "Passed" : "FAILED", pDescription);
+	return condition;
+}
+
+static bool allocate(DeviceMemoryAllocatorVK* pAllocator, VkDeviceSize size, VkDeviceSize alignment, uint32_t memoryTypeIndex, bool isImage, DeviceAllocationVK& allocation)
+{
+	VkMemoryRequirements memoryRequirements = {};
+	memoryRequirements.size				= size;
+	memoryRequirements.alignment		= alignment;
+	memoryRequirements.memoryTypeBits	= 1 << memoryTypeIndex;
+
+	allocation = {};
+	return pAllocator->allocate(memoryRequirements, memoryTypeIndex, isImage, allocation);
+}
+
+static bool checkBuddySplitAndMerge()
+{
+	bool passed = true;
+	DeviceMemoryAllocatorVK* pAllocator = createMockAllocator(1);
+	const uint32_t allocateCount = getMockAllocateCount();
+
+	// 1000 and 1024 bytes split the block down to two 1024 byte buddies, 300 bytes splits the next 2048 bytes into 512 byte buddies
+	DeviceAllocationVK allocations[3];
+	allocate(pAllocator, 1000, 256, DEVICE_LOCAL_TYPE, false, allocations[0]);
+	allocate(pAllocator, 1024, 256, DEVICE_LOCAL_TYPE, false, allocations[1]);
+	allocate(pAllocator, 300, 256, DEVICE_LOCAL_TYPE, false, allocations[2]);
+
+	passed &= check(getMockAllocateCount() - allocateCount == 1, "Suballocations share one block");
+	passed &= check(allocations[0].Memory == allocations[1].Memory && allocations[1].Memory == allocations[2].Memory, "Suballocations share one VkDeviceMemory");
+	passed &= check(allocations[0].MemorySize == BENCHMARK_BLOCK_SIZE, "Blocks shrink to fit eight in the heap");
+	passed &= check(allocations[0].Offset == 0 && allocations[1].Offset == 1024 && allocations[2].Offset == 2048, "Buddies are split from the start of the block");
+	passed &= check(pAllocator->getStatistics().SuballocatedBytes == 1024 + 1024 + 512, "Suballocations are rounded up to their buddy sizes");
+
+	pAllocator->free(allocations[1]);
+	pAllocator->free(allocations[0]);
+	pAllocator->free(allocations[2]);
+
+	// Half of the block only fits once every buddy has been merged back
+	DeviceAllocationVK halfBlock;
+	allocate(pAllocator, BENCHMARK_BLOCK_SIZE / 2, 256, DEVICE_LOCAL_TYPE, false, halfBlock);
+	passed &= check(halfBlock.pBlock != nullptr && halfBlock.Offset == 0, "Freed buddies merge back into the whole block");
+	passed &= check(getMockAllocateCount() - allocateCount == 1, "Merged block is reused without allocating another");
+
+	pAllocator->free(halfBlock);
+	SAFEDELETE(pAllocator);
+	return passed;
+}
+
+static bool checkAlignment()
+{
+	bool passed = true;
+	DeviceMemoryAllocatorVK* pAllocator = createMockAllocator(1);
+
+	const VkDeviceSize alignments[] = { 256, 512, 4096, 65536, 256, 1024 };
+	std::vector<DeviceAllocationVK> allocations(sizeof(alignments) / sizeof(alignments[0]));
+
+	bool aligned = true;
+	bool mappedAtOffset = true;
+	for (size_t allocationIdx = 0; allocationIdx < allocations.size(); allocationIdx++)
+	{
+		DeviceAllocationVK& allocation = allocations[allocationIdx];
+		allocate(pAllocator, 100, alignments[allocationIdx], HOST_VISIBLE_TYPE, false, allocation);
+		aligned &= allocation.Offset % alignments[allocationIdx] == 0 && allocation.Size == 100;
+
+		// Every suballocation points into the block's mapping at its own offset
+		const uint8_t* pBlockMemory = (const uint8_t*)allocations[0].pMappedMemory - allocations[0].Offset;
+		mappedAtOffset &= allocation.Memory == allocations[0].Memory && (uint8_t*)allocation.pMappedMemory == pBlockMemory + allocation.Offset;
+	}
+
+	passed &= check(aligned, "Offsets are multiples of the requested alignment");
+	passed &= check(mappedAtOffset, "Host visible suballocations are mapped at their offsets");
+
+	for (DeviceAllocationVK& allocation : allocations)
+	{
+		pAllocator->free(allocation);
+	}
+
+	SAFEDELETE(pAllocator);
+	return passed;
+}
+
+static bool checkSeparateImagePools()
+{
+	bool passed = true;
+
+	// A granularity larger than the smallest suballocation keeps buffers and images in separate blocks
+	DeviceMemoryAllocatorVK* pAllocator = createMockAllocator(1024);
+	DeviceAllocationVK buffer;
+	DeviceAllocationVK image;
+	allocate(pAllocator, 256, 256, DEVICE_LOCAL_TYPE, false, buffer);
+	allocate(pAllocator, 256, 256, DEVICE_LOCAL_TYPE, true, image);
+	passed &= check(buffer.Memory != image.Memory && pAllocator->getStatistics().BlockCount == 2, "Buffers and images get separate blocks when bufferImageGranularity is large");
+
+	pAllocator->free(buffer);
+	pAllocator->free(image);
+	SAFEDELETE(pAllocator);
+
+	// Otherwise they share one
+	pAllocator = createMockAllocator(1);
+	allocate(pAllocator, 256, 256, DEVICE_LOCAL_TYPE, false, buffer);
+	allocate(pAllocator, 256, 256, DEVICE_LOCAL_TYPE, true, image);
+	passed &= check(buffer.Memory == image.Memory && pAllocator->getStatistics().BlockCount == 1, "Buffers and images share blocks when bufferImageGranularity is small");
+
+	pAllocator->free(buffer);
+	pAllocator->free(image);
+	SAFEDELETE(pAllocator);
+	return passed;
+}
+
+static bool checkDedicatedThreshold()
+{
+	bool passed = true;
+	DeviceMemoryAllocatorVK* pAllocator = createMockAllocator(1);
+
+	DeviceAllocationVK halfBlock;
+	DeviceAllocationVK overHalfBlock;
+	DeviceAllocationVK largeImage;
+	DeviceAllocationVK smallImage;
+	allocate(pAllocator, BENCHMARK_BLOCK_SIZE / 2, 256, DEVICE_LOCAL_TYPE, false, halfBlock);
+	allocate(pAllocator, BENCHMARK_BLOCK_SIZE / 2 + 1, 256, DEVICE_LOCAL_TYPE, false, overHalfBlock);
+	allocate(pAllocator, BENCHMARK_DEDICATED_IMAGE_SIZE, 256, DEVICE_LOCAL_TYPE, true, largeImage);
+	allocate(pAllocator, 4096, 256, DEVICE_LOCAL_TYPE, true, smallImage);
+
+	passed &= check(halfBlock.pBlock != nullptr, "Resources of up to half a block are suballocated");
+	passed &= check(overHalfBlock.pBlock == nullptr && overHalfBlock.MemorySize == BENCHMARK_BLOCK_SIZE / 2 + 1, "Resources larger than half a block are dedicated");
+	passed &= check(largeImage.pBlock == nullptr && smallImage.pBlock != nullptr, "Images are dedicated from DEDICATED_IMAGE_SIZE");
+
+	DeviceMemoryStatisticsVK statistics = pAllocator->getStatistics();
+	passed &= check(statistics.DedicatedAllocationCount == 2 && statistics.DedicatedBytes == overHalfBlock.Size + largeImage.Size, "Dedicated allocations are counted");
+
+	const uint32_t freeCount = getMockFreeCount();
+	pAllocator->free(overHalfBlock);
+	pAllocator->free(largeImage);
+	passed &= check(getMockFreeCount() - freeCount == 2, "Freeing a dedicated allocation frees its memory");
+
+	pAllocator->free(halfBlock);
+	pAllocator->free(smallImage);
+	SAFEDELETE(pAllocator);
+	return passed;
+}
+
+static bool checkEmptyBlocks()
+{
+	bool passed = true;
+	DeviceMemoryAllocatorVK* pAllocator = createMockAllocator(1);
+
+	// Two halves fill the first block, the third allocation needs a second one
+	DeviceAllocationVK allocations[3];
+	for (DeviceAllocationVK& allocation : allocations)
+	{
+		allocate(pAllocator, BENCHMARK_BLOCK_SIZE / 2, 256, HOST_VISIBLE_TYPE, false, allocation);
+	}
+
+	passed &= check(pAllocator->getStatistics().BlockCount == 2 && allocations[0].Memory != allocations[2].Memory, "A full block makes the allocator create another");
+
+	const uint32_t freeCount = getMockFreeCount();
+	pAllocator->free(allocations[2]);
+	passed &= check(getMockFreeCount() - freeCount == 1 && pAllocator->getStatistics().BlockCount == 1, "Empty blocks are freed while the pool has others");
+
+	pAllocator->free(allocations[0]);
+	pAllocator->free(allocations[1]);
+	DeviceMemoryStatisticsVK statistics = pAllocator->getStatistics();
+	passed &= check(getMockFreeCount() - freeCount == 1 && statistics.BlockCount == 1 && statistics.SuballocationCount == 0, "The last empty block of a pool is kept");
+
+	SAFEDELETE(pAllocator);
+	passed &= check(getMockFreeCount() - freeCount == 2, "The allocator frees its kept blocks when destroyed");
+	return passed;
+}
+
+static void churn(DeviceMemoryAllocatorVK* pAllocator, uint32_t allocationCount, uint32_t seed, bool& passed)
+{
+	std::mt19937 randEngine(seed);
+	std::uniform_int_distribution<uint32_t> sizeRandomizer(1, 64 * 1024);
+	std::uniform_int_distribution<uint32_t> alignmentRandomizer(8, 12);
+	std::uniform_int_distribution<uint32_t> boolRandomizer(0, 1);
+
+	// Keeps a window of live allocations, so that blocks fill up, empty and get reused
+	std::vector<DeviceAllocationVK> allocations(64);
+	for (uint32_t allocationIdx = 0; allocationIdx < allocationCount; allocationIdx++)
+	{
+		DeviceAllocationVK& allocation = allocations[allocationIdx % allocations.size()];
+		pAllocator->free(allocation);
+
+		const VkDeviceSize alignment = VkDeviceSize(1) << alignmentRandomizer(randEngine);
+		const uint32_t memoryTypeIndex = boolRandomizer(randEngine) ? HOST_VISIBLE_TYPE : DEVICE_LOCAL_TYPE;
+		if (!allocate(pAllocator, sizeRandomizer(randEngine), alignment, memoryTypeIndex, boolRandomizer(randEngine) == 1, allocation) || allocation.Offset % alignment != 0)
+		{
+			passed = false;
+		}
+	}
+
+	for (DeviceAllocationVK& allocation : allocations)
+	{
+		pAllocator->free(allocation);
+	}
+}
+
+bool benchmarkDeviceMemoryAllocator(uint32_t allocationCount, uint32_t threadCount)
+{
+	LOG("DeviceMemoryAllocator checks, with a mock driver");
+
+	bool passed = true;
+	passed &= checkBuddySplitAndMerge();
+	passed &= checkAlignment();
+	passed &= checkSeparateImagePools();
+	passed &= checkDedicatedThreshold();
+	passed &= checkEmptyBlocks();
+	passed &= check(getMockLiveMemoryCount() == 0, "Every VkDeviceMemory was freed");
+
+	LOG("DeviceMemoryAllocator benchmark: %u allocations and frees on each of %u threads", allocationCount, threadCount);
+
+	DeviceMemoryAllocatorVK* pAllocator = createMockAllocator(1024);
+	const uint32_t allocateCount = getMockAllocateCount();
+
+	// Each thread writes its own result, vector<bool> would pack them into shared bytes
+	std::vector<uint8_t> threadsPassed(threadCount, 1);
+	std::vector<std::thread> threads;
+
+	auto startTime = std::chrono::high_resolution_clock::now();
+	for (uint32_t threadIdx = 0; threadIdx < threadCount; threadIdx++)
+	{
+		threads.emplace_back([pAllocator, allocationCount, threadIdx, &threadsPassed]()
+		{
+			bool threadPassed = true;
+			churn(pAllocator, allocationCount, 1337 + threadIdx, threadPassed);
+			threadsPassed[threadIdx] = threadPassed ? 1 : 0;
+		});
+	}
+
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+	double time = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+
+	const uint32_t driverAllocationCount = getMockAllocateCount() - allocateCount;
+	LOG("%.2f ms, %.1f allocations/ms, %u vkAllocateMemory calls", time, double(allocationCount) * double(threadCount) / time, driverAllocationCount);
+
+	bool churnPassed = true;
+	for (uint8_t threadPassed : threadsPassed)
+	{
+		churnPassed &= threadPassed == 1;
+	}
+
+	DeviceMemoryStatisticsVK statistics = pAllocator->getStatistics();
+	passed &= check(churnPassed, "Concurrent allocations succeed and are aligned");
+	passed &= check(statistics.SuballocationCount == 0 && statistics.DedicatedAllocationCount == 0 && statistics.SuballocatedBytes == 0, "Statistics return to zero once everything is freed");
+
+	SAFEDELETE(pAllocator);
+	passed &= check(getMockLiveMemoryCount() == 0, "Every VkDeviceMemory was freed");
+
+	LOG("DeviceMemoryAllocator checks %s", passed ? "passed" : "FAILED");
+	return passed;
+}
@@ -0,0 +1,6 @@
+#pragma once
+#include "Core/Core.h"
+
+// Checks DeviceMemoryAllocatorVK against a mock driver, then times allocationCount allocations and frees per thread on threadCount threads.
+// Returns false if a check failed
+bool benchmarkDeviceMemoryAllocator(uint32_t allocationCount, uint32_t threadCount);
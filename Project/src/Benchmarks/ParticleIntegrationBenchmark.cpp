@@ -0,0 +1,104 @@
+#include "ParticleIntegrationBenchmark.h"
+
+#include "Core/ParticleIntegrator.h"
+
+#include <chrono>
+#include <vector>
+#include <random>
+
+#define BENCHMARK_TIME_STEP (1.0f / 60.0f)
+
+struct ParticleArrays
+{
+	std::vector<glm::vec4> Positions;
+	std::vector<glm::vec4> Velocities;
+	std::vector<float> Ages;
+};
+
+// The integration loop used before the particles were stored as a structure of arrays
+static void integrateArrayOfStructures(ParticleArrays& particles, uint32_t particleCount, float dt)
+{
+	for (uint32_t particleIdx = 0; particleIdx < particleCount; particleIdx++)
+	{
+		particles.Positions[particleIdx] += particles.Velocities[particleIdx] * dt;
+		particles.Velocities[particleIdx].y -= 9.82f * dt;
+		particles.Ages[particleIdx] += dt;
+	}
+}
+
+static double toMilliseconds(std::chrono::high_resolution_clock::duration duration)
+{
+	return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+void benchmarkParticleIntegration(uint32_t particleCount, uint32_t frameCount)
+{
+	//Same starting particles for every kernel
+	ParticleArrays initialParticles;
+	initialParticles.Positions.resize(particleCount);
+	initialParticles.Velocities.resize(particleCount);
+	initialParticles.Ages.resize(particleCount);
+
+	std::mt19937 randEngine(1337);
+	std::uniform_real_distribution<float> randomizer(-5.0f, 5.0f);
+	for (uint32_t particleIdx = 0; particleIdx < particleCount; particleIdx++)
+	{
+		initialParticles.Positions[particleIdx]		= glm::vec4(randomizer(randEngine), randomizer(randEngine), randomizer(randEngine), 1.0f);
+		initialParticles.Velocities[particleIdx]	= glm::vec4(randomizer(randEngine), randomizer(randEngine), randomizer(randEngine), 0.0f);
+		initialParticles.Ages[particleIdx]			= float(particleIdx % 100) * 0.01f;
+	}
+
+	LOG("Particle integration benchmark: %u particles, %u frames, detected instruction set: %s", particleCount, frameCount,
+		ParticleIntegrator::getInstructionSetName(ParticleIntegrator::getInstructionSet()));
+	LOG("Kernel\t\tms/frame\tMParticles/s\tSpeedup\tMax error");
+
+	//Baseline
+	ParticleArrays referenceParticles = initialParticles;
+
+	auto startTime = std::chrono::high_resolution_clock::now();
+	for (uint32_t frame = 0; frame < frameCount; frame++)
+	{
+		integrateArrayOfStructures(referenceParticles, particleCount, BENCHMARK_TIME_STEP);
+	}
+	double referenceTime = toMilliseconds(std::chrono::high_resolution_clock::now() - startTime) / double(frameCount);
+
+	LOG("vec4 loop\t%.4f\t\t%.1f\t\t%.2fx\t-", referenceTime, double(particleCount) / (referenceTime * 1000.0), 1.0);
+
+	//Structure of arrays kernels
+	const EParticleInstructionSet instructionSets[] = { EParticleInstructionSet::SCALAR, EParticleInstructionSet::SSE, EParticleInstructionSet::AVX2 };
+	for (EParticleInstructionSet instructionSet : instructionSets)
+	{
+		const char* pName = ParticleIntegrator::getInstructionSetName(instructionSet);
+		if (!ParticleIntegrator::isSupported(instructionSet))
+		{
+			LOG("%s\t\tnot supported by this CPU", pName);
+			continue;
+		}
+
+		ParticleStorage storage;
+		storage.resize(particleCount);
+		for (uint32_t particleIdx = 0; particleIdx < particleCount; particleIdx++)
+		{
+			storage.setPosition(particleIdx, glm::vec3(initialParticles.Positions[particleIdx]));
+			storage.setVelocity(particleIdx, glm::vec3(initialParticles.Velocities[particleIdx]));
+			storage.ages[particleIdx] = initialParticles.Ages[particleIdx];
+		}
+
+		startTime = std::chrono::high_resolution_clock::now();
+		for (uint32_t frame = 0; frame < frameCount; frame++)
+		{
+			ParticleIntegrator::integrate(instructionSet, storage, 0, particleCount, BENCHMARK_TIME_STEP);
+		}
+		double kernelTime = toMilliseconds(std::chrono::high_resolution_clock::now() - startTime) / double(frameCount);
+
+		float maxError = 0.0f;
+		for (uint32_t particleIdx = 0; particleIdx < particleCount; particleIdx++)
+		{
+			glm::vec3 position(storage.positionsX[particleIdx], storage.positionsY[particleIdx], storage.positionsZ[particleIdx]);
+			maxError = std::max(maxError, glm::length(position - glm::vec3(referenceParticles.Positions[particleIdx])));
+			maxError = std::max(maxError, std::abs(storage.ages[particleIdx] - referenceParticles.Ages[particleIdx]));
+		}
+
+		LOG("%s\t\t%.4f\t\t%.1f\t\t%.2fx\t%g", pName, kernelTime, double(particleCount) / (kernelTime * 1000.0), referenceTime / kernelTime, maxError);
+	}
+}
@@ -0,0 +1,6 @@
+#pragma once
+#include "Core/Core.h"
+
+// Integrates particleCount particles for frameCount frames on the calling thread, with the previous vec4 array of structures loop
+// and with every structure of arrays kernel the CPU supports. Prints throughput, speedup and the largest difference from the vec4 loop
+void benchmarkParticleIntegration(uint32_t particleCount, uint32_t frameCount);
@@ -0,0 +1,108 @@
+#include "ParticlePositionBenchmark.h"
+
+#include "Core/ParticlePositionPacker.h"
+
+#include <chrono>
+#include <cstring>
+#include <vector>
+#include <random>
+
+// Bounds of the benchmark emitter in Application, speed 5.5 and duration 1
+#define BENCHMARK_MAX_DISTANCE 5.5f
+#define BENCHMARK_MAX_FALL (0.5f * 9.82f)
+
+static double toMilliseconds(std::chrono::high_resolution_clock::duration duration)
+{
+	return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+static glm::vec3 unpackQuantizedPosition(const glm::uvec2& packedPosition, const glm::vec3& boundsMin, const glm::vec3& boundsExtent)
+{
+	glm::vec3 normalized(float(packedPosition.x & 0xFFFFU), float(packedPosition.x >> 16U), float(packedPosition.y & 0xFFFFU));
+	for (int axis = 0; axis < 3; axis++)
+	{
+		normalized[axis] = boundsMin[axis] + normalized[axis] / QUANTIZED16_MAX * boundsExtent[axis];
+	}
+
+	return normalized;
+}
+
+static void logPackResult(const char* pFormatName, const char* pKernelName, std::chrono::high_resolution_clock::time_point startTime, std::chrono::high_resolution_clock::time_point endTime, uint32_t frameCount, size_t streamSize, float maxError)
+{
+	double packTime = toMilliseconds(endTime - startTime) / double(frameCount);
+	double megabytes = double(streamSize) / (1024.0 * 1024.0);
+	LOG("%s\t%s\t%.4f\t\t%.1f\t\t%.2f\t%g", pFormatName, pKernelName, packTime, megabytes, megabytes / (packTime * 1024.0 / 1000.0), maxError);
+}
+
+void benchmarkParticlePositions(uint32_t particleCount, uint32_t frameCount)
+{
+	const glm::vec3 boundsMin(-BENCHMARK_MAX_DISTANCE, -BENCHMARK_MAX_DISTANCE - BENCHMARK_MAX_FALL, -BENCHMARK_MAX_DISTANCE);
+	const glm::vec3 boundsExtent(2.0f * BENCHMARK_MAX_DISTANCE, 2.0f * BENCHMARK_MAX_DISTANCE + BENCHMARK_MAX_FALL, 2.0f * BENCHMARK_MAX_DISTANCE);
+
+	ParticleStorage storage;
+	storage.resize(particleCount, false);
+
+	std::mt19937 randEngine(1337);
+	std::uniform_real_distribution<float> randomizer(0.0f, 1.0f);
+	for (uint32_t particleIdx = 0; particleIdx < particleCount; particleIdx++)
+	{
+		glm::vec3 position;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			position[axis] = boundsMin[axis] + randomizer(randEngine) * boundsExtent[axis];
+		}
+
+		storage.setPosition(particleIdx, position);
+	}
+
+	LOG("Particle position benchmark: %u particles, %u frames", particleCount, frameCount);
+	LOG("Format\t\tKernel\tms/frame\tMB/frame\tGB/s\tMax error");
+
+	std::vector<uint8_t> floatStream(ParticlePositionPacker::getPackedSize(EParticlePositionFormat::FLOAT32) * particleCount);
+
+	auto startTime = std::chrono::high_resolution_clock::now();
+	for (uint32_t frame = 0; frame < frameCount; frame++)
+	{
+		ParticlePositionPacker::pack(EParticlePositionFormat::FLOAT32, storage, floatStream.data(), 0, particleCount, boundsMin, boundsExtent);
+	}
+	logPackResult("Float32\t", "Scalar", startTime, std::chrono::high_resolution_clock::now(), frameCount, floatStream.size(), 0.0f);
+
+	std::vector<glm::uvec2> quantizedStream(particleCount);
+	std::vector<glm::uvec2> scalarStream;
+
+	const EParticleInstructionSet instructionSets[] = { EParticleInstructionSet::SCALAR, EParticleInstructionSet::SSE, EParticleInstructionSet::AVX2 };
+	for (EParticleInstructionSet instructionSet : instructionSets)
+	{
+		if (!ParticleIntegrator::isSupported(instructionSet))
+		{
+			continue;
+		}
+
+		startTime = std::chrono::high_resolution_clock::now();
+		for (uint32_t frame = 0; frame < frameCount; frame++)
+		{
+			ParticlePositionPacker::packQuantized(instructionSet, storage, quantizedStream.data(), 0, particleCount, boundsMin, boundsExtent);
+		}
+		auto endTime = std::chrono::high_resolution_clock::now();
+
+		float maxError = 0.0f;
+		for (uint32_t particleIdx = 0; particleIdx < particleCount; particleIdx++)
+		{
+			glm::vec3 position = unpackQuantizedPosition(quantizedStream[particleIdx], boundsMin, boundsExtent);
+			glm::vec3 original(storage.positionsX[particleIdx], storage.positionsY[particleIdx], storage.positionsZ[particleIdx]);
+			maxError = std::max(maxError, glm::length(position - original));
+		}
+
+		logPackResult("Quantized16", ParticleIntegrator::getInstructionSetName(instructionSet), startTime, endTime, frameCount, quantizedStream.size() * sizeof(glm::uvec2), maxError);
+
+		// Every kernel has to produce the same stream
+		if (scalarStream.empty())
+		{
+			scalarStream = quantizedStream;
+		}
+		else if (memcmp(scalarStream.data(), quantizedStream.data(), scalarStream.size() * sizeof(glm::uvec2)) != 0)
+		{
+			LOG("--- %s kernel differs from the scalar kernel", ParticleIntegrator::getInstructionSetName(instructionSet));
+		}
+	}
+}
@@ -0,0 +1,6 @@
+#pragma once
+#include "Core/Core.h"
+
+// Packs particleCount positions frameCount times into every position format read by the shaders, as the CPU update does when writing
+// to the mapped positions buffers. Prints the time and bytes written per frame, and the largest position error of each format
+void benchmarkParticlePositions(uint32_t particleCount, uint32_t frameCount);
@@ -0,0 +1,105 @@
+#include "ParticleRespawnBenchmark.h"
+
+#include "Core/ParticleStorage.h"
+
+#include <chrono>
+
+#define BENCHMARK_TIME_STEP (1.0f / 60.0f)
+#define BENCHMARK_PARTICLE_DURATION 1.0f
+
+// Stands in for ParticleEmitter::createParticle, the cost of creating a particle is the same for both approaches
+static void respawnParticle(ParticleStorage& storage, uint32_t particleIdx, float particleAge)
+{
+	storage.setPosition(particleIdx, glm::vec3(0.0f));
+	storage.setVelocity(particleIdx, glm::vec3(0.0f, 5.0f, 0.0f));
+	storage.ages[particleIdx] = particleAge;
+}
+
+static void ageParticles(ParticleStorage& storage, uint32_t particleCount)
+{
+	for (uint32_t particleIdx = 0; particleIdx < particleCount; particleIdx++)
+	{
+		storage.ages[particleIdx] += BENCHMARK_TIME_STEP;
+	}
+}
+
+static double toMilliseconds(std::chrono::high_resolution_clock::duration duration)
+{
+	return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+void benchmarkParticleRespawn(uint32_t particleCount, uint32_t frameCount)
+{
+	//Steady state, particle 0 is the oldest and the ages are evenly spread over the particle duration
+	ParticleStorage initialStorage;
+	initialStorage.resize(particleCount);
+	for (uint32_t particleIdx = 0; particleIdx < particleCount; particleIdx++)
+	{
+		initialStorage.ages[particleIdx] = BENCHMARK_PARTICLE_DURATION * float(particleCount - particleIdx) / float(particleCount + 1);
+	}
+
+	LOG("Particle respawn benchmark: %u particles, %u frames", particleCount, frameCount);
+
+	//Before: every particle is checked every frame
+	ParticleStorage scanStorage = initialStorage;
+	uint64_t scanRespawnCount = 0;
+	double scanTime = 0.0;
+
+	for (uint32_t frame = 0; frame < frameCount; frame++)
+	{
+		ageParticles(scanStorage, particleCount);
+
+		auto startTime = std::chrono::high_resolution_clock::now();
+		for (uint32_t particleIdx = 0; particleIdx < particleCount; particleIdx++)
+		{
+			float newParticleAge = scanStorage.ages[particleIdx] - BENCHMARK_PARTICLE_DURATION;
+			if (newParticleAge < 0.0f)
+			{
+				continue;
+			}
+
+			respawnParticle(scanStorage, particleIdx, newParticleAge);
+			scanRespawnCount++;
+		}
+		scanTime += toMilliseconds(std::chrono::high_resolution_clock::now() - startTime);
+	}
+
+	//After: only the expired particles following the oldest one are touched
+	ParticleStorage ringStorage = initialStorage;
+	uint64_t ringRespawnCount = 0;
+	uint32_t oldestParticle = 0;
+	double ringTime = 0.0;
+
+	for (uint32_t frame = 0; frame < frameCount; frame++)
+	{
+		auto startTime = std::chrono::high_resolution_clock::now();
+		uint32_t expiredCount = ringStorage.countExpiredParticles(oldestParticle, particleCount, BENCHMARK_TIME_STEP, BENCHMARK_PARTICLE_DURATION);
+		ringTime += toMilliseconds(std::chrono::high_resolution_clock::now() - startTime);
+
+		//The emitter finds the expired particles before aging them and respawns them afterwards
+		ageParticles(ringStorage, particleCount);
+
+		startTime = std::chrono::high_resolution_clock::now();
+		for (uint32_t i = 0; i < expiredCount; i++)
+		{
+			uint32_t particleIdx = (oldestParticle + i) % particleCount;
+			respawnParticle(ringStorage, particleIdx, ringStorage.ages[particleIdx] - BENCHMARK_PARTICLE_DURATION);
+		}
+		ringTime += toMilliseconds(std::chrono::high_resolution_clock::now() - startTime);
+
+		oldestParticle = (oldestParticle + expiredCount) % particleCount;
+		ringRespawnCount += expiredCount;
+	}
+
+	bool isIdentical = scanRespawnCount == ringRespawnCount;
+	for (uint32_t particleIdx = 0; particleIdx < particleCount && isIdentical; particleIdx++)
+	{
+		isIdentical = scanStorage.ages[particleIdx] == ringStorage.ages[particleIdx];
+	}
+
+	const double respawnsPerFrame = double(ringRespawnCount) / double(frameCount);
+	LOG("Method\t\tms/frame\tRespawns/frame\tSpeedup");
+	LOG("Full scan\t%.4f\t\t%.1f\t\t%.2fx", scanTime / frameCount, double(scanRespawnCount) / double(frameCount), 1.0);
+	LOG("Age ring\t%.4f\t\t%.1f\t\t%.2fx", ringTime / frameCount, respawnsPerFrame, scanTime / ringTime);
+	LOG("Results are %s", isIdentical ? "identical" : "DIFFERENT");
+}
@@ -0,0 +1,6 @@
+#pragma once
+#include "Core/Core.h"
+
+// Finds and respawns expired particles for frameCount frames, by scanning every particle and by following the age-ordered ring from the
+// oldest particle. particleCount particles live for one second and a frame is 1/60 s, so 1/60 of the particles expire every frame
+void benchmarkParticleRespawn(uint32_t particleCount, uint32_t frameCount);
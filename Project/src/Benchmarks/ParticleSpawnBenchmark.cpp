@@ -0,0 +1,85 @@
+#include "ParticleSpawnBenchmark.h"
+
+#include "Core/ParticleRandom.h"
+
+#include "glm/gtc/quaternion.hpp"
+
+#include <chrono>
+#include <random>
+#include <vector>
+
+#define BENCHMARK_SPREAD (glm::quarter_pi<float>() / 1.3f)
+
+static double toMilliseconds(std::chrono::high_resolution_clock::duration duration)
+{
+	return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+void benchmarkParticleSpawn(uint32_t particleCount, uint32_t frameCount)
+{
+	//Same emitter direction as the benchmark emitters created by Application
+	const glm::vec3 zVec(0.0f, 0.0f, 1.0f);
+	const glm::vec3 direction = glm::normalize(glm::vec3(0.0f, 0.9f, 0.1f));
+	const glm::quat centeringRotQuat = glm::angleAxis(glm::angle(zVec, direction), glm::normalize(glm::cross(zVec, direction)));
+	const glm::mat3 spawnRotation = glm::mat3_cast(centeringRotQuat);
+
+	std::vector<float> directionsX(particleCount);
+	std::vector<float> directionsY(particleCount);
+	std::vector<float> directionsZ(particleCount);
+
+	LOG("Particle spawn benchmark: %u spawns per frame, %u frames", particleCount, frameCount);
+	LOG("Generator\t\tms/frame\tMSpawns/s\tSpeedup\tMax length error");
+
+	//Before: one engine, two distributions and a quaternion rotation per particle
+	std::mt19937 randEngine(1337);
+	std::uniform_real_distribution<float> zRandomizer(std::cos(BENCHMARK_SPREAD), 1.0f);
+	std::uniform_real_distribution<float> phiRandomizer(0.0f, glm::two_pi<float>());
+
+	auto startTime = std::chrono::high_resolution_clock::now();
+	for (uint32_t frame = 0; frame < frameCount; frame++)
+	{
+		for (uint32_t particleIdx = 0; particleIdx < particleCount; particleIdx++)
+		{
+			float z = zRandomizer(randEngine);
+			float phi = phiRandomizer(randEngine);
+			float sqrtZInv = std::sqrt(1.0f - z * z);
+
+			glm::vec3 particleDirection = centeringRotQuat * glm::vec3(sqrtZInv * std::cos(phi), sqrtZInv * std::sin(phi), z);
+			directionsX[particleIdx] = particleDirection.x;
+			directionsY[particleIdx] = particleDirection.y;
+			directionsZ[particleIdx] = particleDirection.z;
+		}
+	}
+	double referenceTime = toMilliseconds(std::chrono::high_resolution_clock::now() - startTime) / double(frameCount);
+
+	LOG("mt19937 + quaternion\t%.4f\t\t%.1f\t\t%.2fx\t-", referenceTime, double(particleCount) / (referenceTime * 1000.0), 1.0);
+
+	//After: counter-based streams sampled in batches
+	const EParticleInstructionSet instructionSets[] = { EParticleInstructionSet::SCALAR, EParticleInstructionSet::AVX2 };
+	for (EParticleInstructionSet instructionSet : instructionSets)
+	{
+		const char* pName = ParticleIntegrator::getInstructionSetName(instructionSet);
+		if (!ParticleIntegrator::isSupported(instructionSet))
+		{
+			LOG("%s\t\t\tnot supported by this CPU", pName);
+			continue;
+		}
+
+		startTime = std::chrono::high_resolution_clock::now();
+		for (uint32_t frame = 0; frame < frameCount; frame++)
+		{
+			uint32_t key = ParticleRandom::createKey(1337, frame);
+			ParticleRandom::sampleCone(instructionSet, key, 0, particleCount, std::cos(BENCHMARK_SPREAD), spawnRotation, directionsX.data(), directionsY.data(), directionsZ.data());
+		}
+		double batchTime = toMilliseconds(std::chrono::high_resolution_clock::now() - startTime) / double(frameCount);
+
+		float maxLengthError = 0.0f;
+		for (uint32_t particleIdx = 0; particleIdx < particleCount; particleIdx++)
+		{
+			float length = glm::length(glm::vec3(directionsX[particleIdx], directionsY[particleIdx], directionsZ[particleIdx]));
+			maxLengthError = std::max(maxLengthError, std::abs(length - 1.0f));
+		}
+
+		LOG("%s batch\t\t%.4f\t\t%.1f\t\t%.2fx\t%g", pName, batchTime, double(particleCount) / (batchTime * 1000.0), referenceTime / batchTime, maxLengthError);
+	}
+}
@@ -0,0 +1,6 @@
+#pragma once
+#include "Core/Core.h"
+
+// Samples spawn directions for particleCount particles per frame for frameCount frames, with std::mt19937 and a quaternion per particle
+// like ParticleEmitter used to, and with ParticleRandom::sampleCone on every instruction set the CPU supports
+void benchmarkParticleSpawn(uint32_t particleCount, uint32_t frameCount);
@@ -0,0 +1,170 @@
+#include "TaskDispatcherBenchmark.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <functional>
+
+// Small amount of ALU work so that the dispatcher overhead dominates, like the per-emitter update tasks
+static uint32_t simulateWork(uint32_t seed, uint32_t iterations)
+{
+	for (uint32_t i = 0; i < iterations; i++)
+	{
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+	}
+
+	return seed;
+}
+
+void benchmarkTaskDispatcher(uint32_t taskCount, uint32_t iterationsPerTask, const TaskDispatcherInfo& info)
+{
+	// waitForTasks runs tasks on the calling thread, so every run uses one thread more than its worker count. The default sweep stops
+	// when the workers and the calling thread occupy every hardware thread
+	const uint32_t hardwareThreadCount = std::max(2U, std::thread::hardware_concurrency());
+	const uint32_t defaultWorkerCount = std::min(hardwareThreadCount - 1, MAX_THREADS);
+	const uint32_t maxWorkerCount = info.WorkerCount > 0 ? std::min(info.WorkerCount, MAX_THREADS) : defaultWorkerCount;
+
+	LOG("TaskDispatcher benchmark: %u tasks, %u iterations per task", taskCount, iterationsPerTask);
+	LOG("Workers\tThreads\tTasks/s\t\tSpeedup");
+
+	std::vector<uint32_t> results(taskCount);
+
+	// Baseline: the tasks run one after another on the calling thread, without the dispatcher
+	auto startTime = std::chrono::high_resolution_clock::now();
+
+	for (uint32_t taskIndex = 0; taskIndex < taskCount; taskIndex++)
+	{
+		results[taskIndex] = simulateWork(taskIndex + 1, iterationsPerTask);
+	}
+
+	auto endTime = std::chrono::high_resolution_clock::now();
+	std::chrono::duration<double> seconds = endTime - startTime;
+
+	const double serialThroughput = double(taskCount) / seconds.count();
+	LOG("0\t1\t%.0f\t1.00x", serialThroughput);
+
+	for (uint32_t workerCount = 1; workerCount <= maxWorkerCount; workerCount++)
+	{
+		TaskDispatcherInfo sweepInfo = info;
+		sweepInfo.WorkerCount = workerCount;
+		TaskDispatcher::init(sweepInfo);
+
+		startTime = std::chrono::high_resolution_clock::now();
+
+		for (uint32_t taskIndex = 0; taskIndex < taskCount; taskIndex++)
+		{
+			uint32_t* pResult = &results[taskIndex];
+			TaskDispatcher::execute([pResult, taskIndex, iterationsPerTask]
+				{
+					*pResult = simulateWork(taskIndex + 1, iterationsPerTask);
+				});
+		}
+
+		TaskDispatcher::waitForTasks();
+
+		endTime = std::chrono::high_resolution_clock::now();
+		seconds = endTime - startTime;
+
+		TaskDispatcher::release();
+
+		const double throughput = double(taskCount) / seconds.count();
+		LOG("%u\t%u\t%.0f\t%.2fx", workerCount, workerCount + 1, throughput, throughput / serialThroughput);
+	}
+}
+
+void benchmarkTaskAllocations(uint32_t frameCount, uint32_t tasksPerFrame, const TaskDispatcherInfo& info)
+{
+	// More tasks than the arena has nodes, all queued at once so that the ring overflows into the heap fallback
+	const uint32_t overflowTasksPerFrame = TASK_ARENA_SIZE * 2;
+
+	LOG("TaskDispatcher allocation benchmark: %u frames, %u tasks per frame", frameCount, tasksPerFrame);
+
+	std::vector<uint32_t> results(std::max(tasksPerFrame, overflowTasksPerFrame));
+
+	// Captures about as much as the command buffer recording tasks in RenderingHandlerVK::render, too much for std::function's small buffer
+	auto createTask = [&results](uint32_t taskIndex)
+	{
+		uint32_t* pResult = &results[taskIndex];
+		uint64_t padding[4] = { taskIndex, taskIndex, taskIndex, taskIndex };
+		return [pResult, taskIndex, padding]
+		{
+			*pResult = simulateWork(taskIndex + 1 + uint32_t(padding[3]), 16);
+		};
+	};
+	typedef decltype(createTask(0)) BenchmarkTask;
+
+	// Before: every task was copied into a heap allocated std::function. std::function keeps small callables inside itself, so a target
+	// outside of the object was allocated as well
+	uint64_t functionAllocations = 0;
+	for (uint32_t frame = 0; frame < frameCount; frame++)
+	{
+		for (uint32_t taskIndex = 0; taskIndex < tasksPerFrame; taskIndex++)
+		{
+			// Plain new, like the dispatcher did before, rather than the debug DBG_NEW overload
+			std::function<void()>* pTask = new std::function<void()>(createTask(taskIndex));
+			functionAllocations++;
+
+			const uint8_t* pFunction = reinterpret_cast<const uint8_t*>(pTask);
+			const uint8_t* pTarget = reinterpret_cast<const uint8_t*>(pTask->target<BenchmarkTask>());
+			if (pTarget < pFunction || pTarget >= pFunction + sizeof(std::function<void()>))
+			{
+				functionAllocations++;
+			}
+
+			(*pTask)();
+			SAFEDELETE(pTask);
+		}
+	}
+
+	// After: tasks are stored inline in nodes from the task arena, the dispatcher counts the nodes and callables it has to allocate
+	TaskDispatcher::init(info);
+
+	TaskDispatcher::resetStatistics();
+	for (uint32_t frame = 0; frame < frameCount; frame++)
+	{
+		TaskGroup frameTasks;
+		for (uint32_t taskIndex = 0; taskIndex < tasksPerFrame; taskIndex++)
+		{
+			TaskDispatcher::execute(createTask(taskIndex), &frameTasks);
+		}
+
+		TaskDispatcher::waitForTasks(frameTasks);
+	}
+	const uint64_t taskAllocations = TaskDispatcher::getStatistics().HeapAllocations;
+
+	// Overflow: the tasks wait until all of them have been queued, so no node is released before the arena runs out
+	TaskDispatcher::resetStatistics();
+	for (uint32_t frame = 0; frame < frameCount; frame++)
+	{
+		std::atomic<bool> isQueued = false;
+
+		TaskGroup frameTasks;
+		for (uint32_t taskIndex = 0; taskIndex < overflowTasksPerFrame; taskIndex++)
+		{
+			TaskDispatcher::execute([&isQueued, task = createTask(taskIndex)]
+				{
+					while (!isQueued.load(std::memory_order_acquire))
+					{
+						std::this_thread::yield();
+					}
+
+					task();
+				}, &frameTasks);
+		}
+
+		isQueued.store(true, std::memory_order_release);
+		TaskDispatcher::waitForTasks(frameTasks);
+	}
+	const uint64_t overflowAllocations = TaskDispatcher::getStatistics().HeapAllocations;
+
+	TaskDispatcher::release();
+
+	LOG("std::function:\t\t%llu allocations (%.2f per frame)", (unsigned long long)functionAllocations, double(functionAllocations) / double(frameCount));
+	LOG("Task arena:\t\t%llu allocations (%.2f per frame)", (unsigned long long)taskAllocations, double(taskAllocations) / double(frameCount));
+	LOG("Arena overflow:\t%llu allocations (%.2f per frame, %u tasks queued at once in %u nodes)", (unsigned long long)overflowAllocations,
+		double(overflowAllocations) / double(frameCount), overflowTasksPerFrame, TASK_ARENA_SIZE);
+}
@@ -0,0 +1,11 @@
+#pragma once
+#include "Core/TaskDispatcher.h"
+
+// Measures task throughput of the TaskDispatcher for every worker count from 1 to info.WorkerCount, or one less than the hardware thread
+// count if it is 0. Speedups are relative to running the tasks serially on the calling thread, which also runs tasks while waiting.
+// The affinity settings in info are used for every run
+void benchmarkTaskDispatcher(uint32_t taskCount, uint32_t iterationsPerTask, const TaskDispatcherInfo& info);
+
+// Counts heap allocations per frame when dispatching tasks the way the renderer does, compared to copying them into std::function.
+// A second pass queues twice as many tasks as the arena holds before any of them may finish, to measure the heap fallback
+void benchmarkTaskAllocations(uint32_t frameCount, uint32_t tasksPerFrame, const TaskDispatcherInfo& info);
@@ -8,6 +8,8 @@ struct BufferParams
 	VkDeviceSize			SizeInBytes		= 0;
 	VkBufferUsageFlags		Usage			= 0;
 	VkMemoryPropertyFlags	MemoryProperty	= 0;
+	// Added to MemoryProperty when the device has a memory type with both, e.g. DEVICE_LOCAL for host visible buffers
+	VkMemoryPropertyFlags	PreferredMemoryProperty = 0;
 	bool					IsExclusive		= false;
 };
 
@@ -31,7 +31,7 @@ public:
 
 	virtual RenderingHandler* createRenderingHandler() = 0;
 	virtual IRenderer* createParticleRenderer(RenderingHandler* pRenderingHandler) = 0;
-	virtual ParticleEmitterHandler* createParticleEmitterHandler(bool renderingEnabled, uint32_t frameCount) = 0;
+	virtual ParticleEmitterHandler* createParticleEmitterHandler(bool renderingEnabled, uint32_t frameCount, bool batchedCompute) = 0;
 	virtual IImgui* createImgui() = 0;
 
 	virtual IScene* createScene(const RenderingHandler* pRenderingHandler) = 0;
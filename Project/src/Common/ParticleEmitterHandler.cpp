@@ -7,7 +7,9 @@
 ParticleEmitterHandler::ParticleEmitterHandler(bool renderingEnabled)
     :m_RenderingEnabled(renderingEnabled),
     m_pGraphicsContext(nullptr),
-    m_GPUComputed(false)
+    m_GPUComputed(false),
+    m_HybridScheduling(false),
+    m_FrustumCulling(true)
 {}
 
 ParticleEmitterHandler::~ParticleEmitterHandler()
@@ -33,6 +33,14 @@ public:
     bool gpuComputed() const { return m_GPUComputed; }
     virtual void toggleComputationDevice() = 0;
 
+    // When enabled, each emitter is assigned to the CPU or the GPU from the measured update costs of both devices
+    bool hybridScheduling() const { return m_HybridScheduling; }
+    virtual void setHybridScheduling(bool hybridScheduling) = 0;
+
+    // Whether GPU-updated particles outside the camera's frustum are left out when drawing
+    bool frustumCulling() const { return m_FrustumCulling; }
+    void setFrustumCulling(bool frustumCulling) { m_FrustumCulling = frustumCulling; }
+
 protected:
     IGraphicsContext* m_pGraphicsContext;
     RenderingHandler* m_pRenderingHandler;
@@ -42,8 +50,10 @@ protected:
 
     bool m_RenderingEnabled;
 
-    // Whether to use the GPU or the CPU for updating particle data
+    // Whether to use the GPU or the CPU for updating particle data. With hybrid scheduling, whether any emitter uses the GPU
     bool m_GPUComputed;
+    bool m_HybridScheduling;
+    bool m_FrustumCulling;
 
 private:
     virtual void initializeEmitter(ParticleEmitter* pEmitter) = 0;
@@ -0,0 +1,53 @@
+#pragma once
+#include <new>
+#include <vector>
+#include <cstddef>
+
+//Alignment of the arrays used by the SIMD kernels, one cache line so that a chunk never straddles two arrays' lines
+#define SIMD_ALIGNMENT 64
+
+//Allocator for std::vector that places the first element on an ALIGNMENT byte boundary
+template<typename T, size_t ALIGNMENT>
+class AlignedAllocator
+{
+public:
+	typedef T value_type;
+
+	template<typename U>
+	struct rebind
+	{
+		typedef AlignedAllocator<U, ALIGNMENT> other;
+	};
+
+	AlignedAllocator() noexcept = default;
+
+	template<typename U>
+	AlignedAllocator(const AlignedAllocator<U, ALIGNMENT>&) noexcept
+	{
+	}
+
+	T* allocate(size_t count)
+	{
+		return reinterpret_cast<T*>(::operator new(count * sizeof(T), std::align_val_t(ALIGNMENT)));
+	}
+
+	void deallocate(T* pMemory, size_t) noexcept
+	{
+		::operator delete(pMemory, std::align_val_t(ALIGNMENT));
+	}
+
+	template<typename U>
+	bool operator==(const AlignedAllocator<U, ALIGNMENT>&) const noexcept
+	{
+		return true;
+	}
+
+	template<typename U>
+	bool operator!=(const AlignedAllocator<U, ALIGNMENT>&) const noexcept
+	{
+		return false;
+	}
+};
+
+template<typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T, SIMD_ALIGNMENT>>;
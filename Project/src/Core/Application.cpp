@@ -18,7 +18,7 @@
 #include "Common/IInputHandler.h"
 #include "Common/IGraphicsContext.h"
 
-#include <thread>
+#include <algorithm>
 #include <chrono>
 #include <fstream>
 
@@ -30,6 +30,7 @@
 
 #include "Vulkan/CommandPoolVK.h"
 #include "Vulkan/DescriptorSetLayoutVK.h"
+#include "Vulkan/FrameSchedulerVK.h"
 #include "Vulkan/GraphicsContextVK.h"
 #include "Vulkan/RenderPassVK.h"
 #include "Vulkan/SwapChainVK.h"
@@ -77,14 +78,15 @@ Application::~Application()
 	s_pInstance = nullptr;
 }
 
-void Application::init(size_t emitterCount, size_t frameCount, bool useMultipleQueues, float particleCount)
+void Application::init(size_t emitterCount, size_t frameCount, bool useMultipleQueues, float particleCount, EParticleSimulation simulation, EParticlePositionFormat positionFormat, bool batchedCompute, const TaskDispatcherInfo& dispatcherInfo)
 {
 	LOG("Starting application");
-	LOG("Emitters: %d, Frames: %d, Use multiple queues: %d", emitterCount, frameCount, useMultipleQueues);
+	LOG("Emitters: %d, Frames: %d, Use multiple queues: %d, Analytic particles: %d, Quantized positions: %d, Batched compute: %d", emitterCount, frameCount, useMultipleQueues,
+		simulation == EParticleSimulation::ANALYTIC, positionFormat == EParticlePositionFormat::QUANTIZED16, batchedCompute);
 
 	m_MaxFrames = frameCount;
 
-	TaskDispatcher::init();
+	TaskDispatcher::init(dispatcherInfo);
 
 	// Create window
 	m_pWindow = IWindow::create("Hello Vulkan", 1440, 900);
@@ -98,7 +100,7 @@ void Application::init(size_t emitterCount, size_t frameCount, bool useMultipleQ
 	m_pContext = IGraphicsContext::create(m_pWindow, API::VULKAN, useMultipleQueues);
 
 	// Create particlehandler
-	m_pParticleEmitterHandler = m_pContext->createParticleEmitterHandler(RENDERING_ENABLED, (uint32_t)frameCount);
+	m_pParticleEmitterHandler = m_pContext->createParticleEmitterHandler(RENDERING_ENABLED, (uint32_t)frameCount, batchedCompute);
 	m_pParticleEmitterHandler->initialize(m_pContext, m_pRenderingHandler, &m_Camera);
 
 	// Switch to GPU
@@ -113,9 +115,13 @@ void Application::init(size_t emitterCount, size_t frameCount, bool useMultipleQ
 	emitterInfo.particlesPerSecond	= particleCount;
 	emitterInfo.spread				= glm::quarter_pi<float>() / 1.3f;
 	emitterInfo.pTexture			= m_pParticleTexture;
+	emitterInfo.simulation			= simulation;
+	emitterInfo.positionFormat		= positionFormat;
 
 	for (size_t emitterNr = 0; emitterNr < emitterCount; emitterNr++) {
 		emitterInfo.position.x = (float)emitterNr;
+		// Fixed seeds so that benchmark runs spawn the same particles
+		emitterInfo.seed = uint32_t(emitterNr + 1);
 		m_pParticleEmitterHandler->createEmitter(emitterInfo);
 	}
 
@@ -127,6 +133,7 @@ void Application::run()
 	GraphicsContextVK* pGraphicsContext	= reinterpret_cast<GraphicsContextVK*>(m_pContext);
 	SwapChainVK* pSwapChain				= pGraphicsContext->getSwapChain();
 	DeviceVK* pDevice					= pGraphicsContext->getDevice();
+	FrameSchedulerVK* pFrameScheduler	= pDevice->getFrameScheduler();
 
 	VkFenceCreateInfo fenceInfo = {};
 	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
@@ -135,14 +142,13 @@ void Application::run()
 	VkFence imageWaitFence = VK_NULL_HANDLE;
 	vkCreateFence(pDevice->getDevice(), &fenceInfo, nullptr, &imageWaitFence);
 
-	auto currentTime	= std::chrono::high_resolution_clock::now();
+	// The first frame is updated as if a 16 ms frame had passed before it, instead of sleeping for it
+	auto startTime		= std::chrono::high_resolution_clock::now();
+	auto currentTime	= startTime - std::chrono::milliseconds(16);
 	auto lastTime		= currentTime;
 
-	//HACK to get a non-null deltatime
-	std::this_thread::sleep_for(std::chrono::milliseconds(16));
-
-	auto startTime = std::chrono::high_resolution_clock::now();
-
+	// The CPU updates the next frame while the GPU executes the previous ones, up to MAX_FRAMES_IN_FLIGHT frames at once. Frames only wait
+	// for the frame that last used their resources
 	while (m_CurrentFrame++ < m_MaxFrames)
 	//while (true)
 	{
@@ -153,13 +159,14 @@ void Application::run()
 		std::chrono::duration<double, std::milli> deltatime = currentTime - lastTime;
 		double seconds = deltatime.count() / 1000.0;
 
+		pFrameScheduler->beginFrame();
 		update(seconds);
-
-		pDevice->wait();
+		pFrameScheduler->endFrame();
 		//pSwapChain->presentNoWait();
 	}
 
-	reinterpret_cast<GraphicsContextVK*>(m_pContext)->getDevice()->wait();
+	// The total time includes the GPU work of the frames still in flight, as it did when every frame waited for the device
+	pDevice->wait();
 
 	auto endTime = std::chrono::high_resolution_clock::now();
 	std::chrono::duration<double, std::milli> totalTime = endTime - startTime;
@@ -312,6 +319,23 @@ void Application::renderUI(double dt)
 				m_pParticleEmitterHandler->toggleComputationDevice();
 			}
 
+			// Each emitter is updated on the device that is estimated to finish the frame's updates the earliest
+			bool hybridScheduling = m_pParticleEmitterHandler->hybridScheduling();
+			if (ImGui::Checkbox("Hybrid CPU/GPU scheduling", &hybridScheduling)) {
+				m_pParticleEmitterHandler->setHybridScheduling(hybridScheduling);
+			}
+
+			if (m_pParticleEmitterHandler->hybridScheduling()) {
+				const std::vector<ParticleEmitter*>& emitters = m_pParticleEmitterHandler->getParticleEmitters();
+				size_t gpuEmitterCount = std::count_if(emitters.begin(), emitters.end(), [](const ParticleEmitter* pEmitter) { return pEmitter->isGPUComputed(); });
+				ImGui::Text("Emitters on the GPU: %u/%u", uint32_t(gpuEmitterCount), uint32_t(emitters.size()));
+			}
+
+			bool frustumCulling = m_pParticleEmitterHandler->frustumCulling();
+			if (ImGui::Checkbox("Frustum culling", &frustumCulling)) {
+				m_pParticleEmitterHandler->setFrustumCulling(frustumCulling);
+			}
+
 			std::vector<ParticleEmitter*> particleEmitters = m_pParticleEmitterHandler->getParticleEmitters();
 
 			// Emitter creation
@@ -326,6 +350,8 @@ void Application::renderUI(double dt)
 				m_NewEmitterInfo.spread = pLatestEmitter->getSpread();
 				m_NewEmitterInfo.particlesPerSecond = pLatestEmitter->getParticlesPerSecond();
 				m_NewEmitterInfo.particleDuration = pLatestEmitter->getParticleDuration();
+				m_NewEmitterInfo.simulation = pLatestEmitter->isAnalytic() ? EParticleSimulation::ANALYTIC : EParticleSimulation::INTEGRATED;
+				m_NewEmitterInfo.positionFormat = pLatestEmitter->getPositionFormat();
 			}
 
 			// Emitter selection
@@ -405,6 +431,16 @@ void Application::renderUI(double dt)
 				ImGui::InputFloat("Particles per second", &m_NewEmitterInfo.particlesPerSecond);
 				ImGui::Text("Emitted particles: %d", int(m_NewEmitterInfo.particlesPerSecond * m_NewEmitterInfo.particleDuration));
 
+				bool analytic = m_NewEmitterInfo.simulation == EParticleSimulation::ANALYTIC;
+				if (ImGui::Checkbox("Analytic", &analytic)) {
+					m_NewEmitterInfo.simulation = analytic ? EParticleSimulation::ANALYTIC : EParticleSimulation::INTEGRATED;
+				}
+
+				bool quantizedPositions = m_NewEmitterInfo.positionFormat == EParticlePositionFormat::QUANTIZED16;
+				if (ImGui::Checkbox("Quantized positions", &quantizedPositions)) {
+					m_NewEmitterInfo.positionFormat = quantizedPositions ? EParticlePositionFormat::QUANTIZED16 : EParticlePositionFormat::FLOAT32;
+				}
+
 				if (ImGui::Button("Create")) {
 					m_CreatingEmitter = false;
 					m_NewEmitterInfo.pTexture = m_pParticleTexture;
@@ -427,6 +463,65 @@ void Application::renderUI(double dt)
 		}
 		ImGui::End();
 
+		// Draw TaskDispatcher UI
+		ImGui::SetNextWindowSize(ImVec2(430, 450), ImGuiCond_FirstUseEver);
+		if (ImGui::Begin("Task Dispatcher", NULL))
+		{
+			const TaskDispatcherStatistics statistics = TaskDispatcher::getStatistics();
+			const double elapsedTime = std::max(statistics.ElapsedTime, 1.0);
+
+			ImGui::Text("Elapsed: %.1f ms", statistics.ElapsedTime);
+			ImGui::Text("Queue high-water mark: %llu", (unsigned long long)statistics.QueueHighWaterMark);
+			ImGui::Text("Heap allocations: %llu", (unsigned long long)statistics.HeapAllocations);
+
+			for (uint32_t i = 0; i < statistics.ThreadCount; i++)
+			{
+				const TaskThreadStatistics& thread = statistics.Threads[i];
+				if (i < statistics.WorkerCount)
+				{
+					ImGui::Text("Worker %u", i);
+				}
+				else
+				{
+					ImGui::Text("%s", i == statistics.WorkerCount ? "Main" : "Other threads");
+				}
+
+				ImGui::Text("  Busy: %.1f%%  Idle: %.1f%%  Tasks: %llu  Stolen: %llu", 100.0 * thread.BusyTime / elapsedTime, 100.0 * thread.IdleTime / elapsedTime,
+					(unsigned long long)thread.TasksExecuted, (unsigned long long)thread.TasksStolen);
+
+				if (thread.WaitCount > 0)
+				{
+					ImGui::Text("  Waits: %llu  Wait time: %.3f ms/wait  Wait spins: %llu", (unsigned long long)thread.WaitCount, thread.WaitTime / double(thread.WaitCount),
+						(unsigned long long)thread.WaitSpins);
+				}
+
+				if (thread.LockSpins > 0)
+				{
+					ImGui::Text("  Lock spins: %llu", (unsigned long long)thread.LockSpins);
+				}
+			}
+
+			ImGui::NewLine();
+			if (ImGui::Button("Reset"))
+			{
+				TaskDispatcher::resetStatistics();
+			}
+
+			ImGui::SameLine();
+			if (TaskDispatcher::isTracing())
+			{
+				if (ImGui::Button("Stop Trace"))
+				{
+					TaskDispatcher::endTrace("task_trace.json");
+				}
+			}
+			else if (ImGui::Button("Start Trace"))
+			{
+				TaskDispatcher::beginTrace();
+			}
+		}
+		ImGui::End();
+
 		// Draw Scene UI
 		m_pScene->renderUI();
 	}
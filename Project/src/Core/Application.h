@@ -17,6 +17,8 @@ class IInputHandler;
 class IGraphicsContext;
 class RenderingHandler;
 
+struct TaskDispatcherInfo;
+
 class Application : public CommonEventHandler
 {
 	struct ApplicationParameters
@@ -46,7 +48,7 @@ public:
 
 	DECL_NO_COPY(Application);
 
-	void init(size_t emitterCount, size_t frameCount, bool useMultipleQueues, float particleCount);
+	void init(size_t emitterCount, size_t frameCount, bool useMultipleQueues, float particleCount, EParticleSimulation simulation, EParticlePositionFormat positionFormat, bool batchedCompute, const TaskDispatcherInfo& dispatcherInfo);
 	void run();
 	void release();
 
@@ -77,6 +77,25 @@ void Camera::update()
 	}
 }
 
+void Camera::getFrustumPlanes(glm::vec4* pPlanes) const
+{
+	//Planes are sums of the view projection matrix's rows, glm::perspective maps depth to [-1, 1]
+	glm::mat4 viewProjection = glm::transpose(m_Projection * m_View);
+
+	pPlanes[0] = viewProjection[3] + viewProjection[0];
+	pPlanes[1] = viewProjection[3] - viewProjection[0];
+	pPlanes[2] = viewProjection[3] + viewProjection[1];
+	pPlanes[3] = viewProjection[3] - viewProjection[1];
+	pPlanes[4] = viewProjection[3] + viewProjection[2];
+	pPlanes[5] = viewProjection[3] - viewProjection[2];
+
+	//Normalized so that distances to the planes are in world units
+	for (uint32_t i = 0; i < 6; i++)
+	{
+		pPlanes[i] /= glm::length(glm::vec3(pPlanes[i]));
+	}
+}
+
 void Camera::calculateVectors()
 {
 	m_Right = glm::normalize(glm::cross(m_Direction, UP_VECTOR));
@@ -30,6 +30,9 @@ public:
 
 	void update();
 
+	// Fills pPlanes with the six world space planes of the view frustum, points p inside it have dot(plane.xyz, p) + plane.w >= 0
+	void getFrustumPlanes(glm::vec4* pPlanes) const;
+
 	const glm::mat4& getProjectionMat() const { return m_Projection; }
 	const glm::mat4& getProjectionInvMat() const { return m_ProjectionInv; }
 	const glm::mat4& getViewMat() const { return m_View; }
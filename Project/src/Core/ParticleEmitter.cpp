@@ -4,6 +4,9 @@
 
 #include "Common/IBuffer.h"
 #include "Common/IMesh.h"
+#include "Core/ParticleIntegrator.h"
+#include "Core/ParticleRandom.h"
+#include "Core/TaskDispatcher.h"
 #include "Vulkan/CommandBufferVK.h"
 #include "Vulkan/CommandPoolVK.h"
 #include "Vulkan/GraphicsContextVK.h"
@@ -11,6 +14,7 @@
 #include <algorithm>
 #include <math.h>
 #include <fstream>
+#include <random>
 
 ParticleEmitter::ParticleEmitter(const ParticleEmitterInfo& emitterInfo)
     :m_Position(glm::vec4(emitterInfo.position, 0.0f)),
@@ -23,23 +27,46 @@ ParticleEmitter::ParticleEmitter(const ParticleEmitterInfo& emitterInfo)
     m_pTexture(emitterInfo.pTexture),
     m_EmitterUpdated(false),
     m_EmitterAge(0.0f),
-    m_RandEngine(std::random_device()()),
-    m_ZRandomizer(std::cos(m_Spread), 1.0f),
-    m_PhiRandomizer(0.0f, glm::two_pi<float>()),
+    m_SimulationTime(0.0f),
+    m_CatchUpTime(0.0f),
+    m_ChunkCatchUpTime(0.0f),
+    m_Simulation(emitterInfo.simulation),
+    m_Seed(emitterInfo.seed != 0 ? emitterInfo.seed : std::random_device()()),
+    m_UpdateCount(0),
+    m_SpawnKey(0),
+    m_OldestParticle(0),
+    m_ExpiredBegin(0),
+    m_ExpiredCount(0),
+    m_FirstNewParticle(0),
     m_pDescriptorSetCompute(nullptr),
     m_pDescriptorSetRender(nullptr),
     m_pPositionsBuffer(nullptr),
     m_pVelocitiesBuffer(nullptr),
     m_pAgesBuffer(nullptr),
     m_pEmitterBuffer(nullptr),
+    m_pVisibleIndicesBuffer(nullptr),
+    m_pDrawBuffer(nullptr),
+    m_OwnsParticleBuffers(true),
+    m_PositionsOffset(0),
+    m_FirstMotionParticle(0),
+    m_FirstVisibleParticle(0),
+    m_DrawCommandOffset(0),
+    m_MappedParticleCapacity(0),
+    m_pPositionsDestination(nullptr),
+    m_PositionFormat(emitterInfo.positionFormat),
+    m_GPUComputed(false),
     m_pProfiler(nullptr)
 {
     for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
         m_ppCommandPools[i] = nullptr;
         m_ppCommandBuffers[i] = nullptr;
+        m_ppMappedPositionsBuffers[i] = nullptr;
+        m_ppMappedPositions[i] = nullptr;
+        m_ppDescriptorSetsRenderMapped[i] = nullptr;
     }
 
     createCenteringQuaternion();
+    getPositionBounds(m_PositionBoundsMin, m_PositionBoundsExtent);
 }
 
 ParticleEmitter::~ParticleEmitter()
@@ -48,16 +75,22 @@ ParticleEmitter::~ParticleEmitter()
 
     for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
         SAFEDELETE(m_ppCommandPools[i]);
+        SAFEDELETE(m_ppMappedPositionsBuffers[i]);
+    }
+
+    if (m_OwnsParticleBuffers) {
+        SAFEDELETE(m_pPositionsBuffer);
+        SAFEDELETE(m_pVelocitiesBuffer);
+        SAFEDELETE(m_pAgesBuffer);
+        SAFEDELETE(m_pVisibleIndicesBuffer);
+        SAFEDELETE(m_pDrawBuffer);
     }
 
-    SAFEDELETE(m_pPositionsBuffer);
-    SAFEDELETE(m_pVelocitiesBuffer);
-    SAFEDELETE(m_pAgesBuffer);
     SAFEDELETE(m_pEmitterBuffer);
     SAFEDELETE(m_pProfiler);
 }
 
-bool ParticleEmitter::initialize(IGraphicsContext* pGraphicsContext, uint32_t frameCount, uint32_t computeQueueIndex)
+bool ParticleEmitter::initialize(IGraphicsContext* pGraphicsContext, uint32_t frameCount, uint32_t computeQueueIndex, bool createParticleBuffers)
 {
     m_ComputeQueueIndex = computeQueueIndex;
 
@@ -70,22 +103,113 @@ bool ParticleEmitter::initialize(IGraphicsContext* pGraphicsContext, uint32_t fr
 
     createProfiler(pGraphicsContext, frameCount);
 
-    return createBuffers(pGraphicsContext);
+    return createBuffers(pGraphicsContext, createParticleBuffers);
 }
 
 void ParticleEmitter::update(float dt)
 {
-    ageEmitter(dt);
-    moveParticles(dt);
-    respawnOldParticles();
+    beginUpdate(dt);
+
+    TaskDispatcher::parallelFor(0, getChunkCount(), 1, [&](uint32_t chunkBegin, uint32_t chunkEnd) {
+        for (uint32_t chunkIdx = chunkBegin; chunkIdx < chunkEnd; chunkIdx++) {
+            updateChunk(chunkIdx, dt);
+        }
+    });
 }
 
 void ParticleEmitter::updateGPU(float dt)
 {
     ageEmitter(dt);
+    updatePositionBounds();
     // The rest is performed by the particle emitter handler
 }
 
+void ParticleEmitter::beginUpdate(float dt, void* pMappedPositions)
+{
+    uint32_t oldParticleCount = getParticleCount();
+    m_pPositionsDestination = pMappedPositions;
+    updatePositionBounds();
+
+    m_ChunkCatchUpTime = m_CatchUpTime;
+    m_CatchUpTime = 0.0f;
+
+    ageEmitter(dt);
+    m_UpdateCount++;
+    m_SpawnKey = ParticleRandom::createKey(m_Seed, m_UpdateCount);
+
+    if (isAnalytic()) {
+        return;
+    }
+
+    // Find the particles expiring during this update, the particles added to the ring by ageEmitter are all new
+    if (m_OldestParticle >= oldParticleCount) {
+        m_OldestParticle = 0;
+    }
+
+    m_ExpiredBegin = m_OldestParticle;
+    m_ExpiredCount = m_ParticleStorage.countExpiredParticles(m_OldestParticle, oldParticleCount, dt + m_ChunkCatchUpTime, m_ParticleDuration);
+    m_FirstNewParticle = oldParticleCount;
+
+    if (oldParticleCount > 0) {
+        m_OldestParticle = (m_OldestParticle + m_ExpiredCount) % oldParticleCount;
+    }
+}
+
+void ParticleEmitter::updateChunk(uint32_t chunkIdx, float dt)
+{
+    uint32_t chunkBegin = chunkIdx * PARTICLE_CHUNK_SIZE;
+    uint32_t chunkEnd = std::min(chunkBegin + PARTICLE_CHUNK_SIZE, getParticleCount());
+
+    if (isAnalytic()) {
+        evaluateParticles(chunkBegin, chunkEnd);
+    } else {
+        moveParticles(chunkBegin, chunkEnd, dt + m_ChunkCatchUpTime);
+        respawnOldParticles(chunkBegin, chunkEnd);
+    }
+
+    // Written while the chunk is still in the cache
+    uint32_t mappedEnd = std::min(chunkEnd, m_MappedParticleCapacity);
+    if (m_pPositionsDestination != nullptr && chunkBegin < mappedEnd) {
+        uint8_t* pChunkDestination = reinterpret_cast<uint8_t*>(m_pPositionsDestination) + chunkBegin * ParticlePositionPacker::getPackedSize(m_PositionFormat);
+        ParticlePositionPacker::pack(m_PositionFormat, m_ParticleStorage, pChunkDestination, chunkBegin, mappedEnd, m_PositionBoundsMin, m_PositionBoundsExtent);
+    }
+}
+
+void ParticleEmitter::setParticles(const glm::vec4* pPositions, const glm::vec4* pVelocities, const float* pAges, uint32_t particleCount, uint32_t livingCount, float catchUpTime)
+{
+    m_CatchUpTime = catchUpTime;
+
+    if (isAnalytic()) {
+        return;
+    }
+
+    // The storage may have been resized while the particles were read back
+    particleCount = std::min(particleCount, uint32_t(m_ParticleStorage.size()));
+    livingCount = std::min(livingCount, particleCount);
+
+    m_ParticleStorage.unpackPositions(pPositions, 0, particleCount);
+    m_ParticleStorage.unpackVelocities(pVelocities, 0, particleCount);
+    std::copy_n(pAges, particleCount, m_ParticleStorage.ages.begin());
+
+    // The GPU does not keep the ring ordered from index 0, the oldest particle is the next one to expire
+    const float* pOldestAge = std::max_element(pAges, pAges + livingCount);
+    m_OldestParticle = uint32_t(pOldestAge - pAges);
+
+    // Particles spawned after the read back, or that did not fit in the GPU buffers. Their ages are set to what they were when the
+    // particles were read back, so that the catch-up time moves them like the others
+    uint32_t spawnEnd = std::min(getParticleCount(), uint32_t(m_ParticleStorage.size()));
+    for (uint32_t particleIdx = livingCount; particleIdx < spawnEnd; particleIdx++) {
+        m_ParticleStorage.ages[particleIdx] = std::max(0.0f, m_EmitterAge - catchUpTime - particleIdx / m_ParticlesPerSecond);
+    }
+
+    spawnParticles(livingCount, std::max(livingCount, spawnEnd));
+}
+
+uint32_t ParticleEmitter::getChunkCount() const
+{
+    return (getParticleCount() + PARTICLE_CHUNK_SIZE - 1) / PARTICLE_CHUNK_SIZE;
+}
+
 void ParticleEmitter::createEmitterBuffer(EmitterBuffer& emitterBuffer)
 {
     emitterBuffer.position = glm::vec4(m_Position, 1.0f);
@@ -96,6 +220,61 @@ void ParticleEmitter::createEmitterBuffer(EmitterBuffer& emitterBuffer)
     emitterBuffer.initialSpeed = m_InitialSpeed;
     emitterBuffer.spread = m_Spread;
     emitterBuffer.particleCount = getParticleCount();
+    emitterBuffer.particlesPerSecond = m_ParticlesPerSecond;
+    emitterBuffer.seed = m_Seed;
+
+    emitterBuffer.boundsMin = glm::vec4(m_PositionBoundsMin, 0.0f);
+    emitterBuffer.boundsExtent = glm::vec4(m_PositionBoundsExtent, 0.0f);
+}
+
+void ParticleEmitter::getPositionBounds(glm::vec3& boundsMin, glm::vec3& boundsExtent) const
+{
+    // p = (0, -(gt^2)/2, 0) + V0*t + P0, where |V0| is the initial speed and t is at most the particle duration
+    float maxDistance = m_InitialSpeed * m_ParticleDuration;
+    float maxFall = 0.5f * 9.82f * m_ParticleDuration * m_ParticleDuration;
+
+    boundsMin = m_Position - glm::vec3(maxDistance, maxDistance + maxFall, maxDistance);
+    boundsExtent = glm::vec3(2.0f * maxDistance, 2.0f * maxDistance + maxFall, 2.0f * maxDistance);
+}
+
+void ParticleEmitter::setParticleBuffers(IBuffer* pPositionsBuffer, IBuffer* pVelocitiesBuffer, IBuffer* pAgesBuffer, uint64_t positionsOffset, uint32_t firstMotionParticle)
+{
+    if (m_OwnsParticleBuffers) {
+        SAFEDELETE(m_pPositionsBuffer);
+        SAFEDELETE(m_pVelocitiesBuffer);
+        SAFEDELETE(m_pAgesBuffer);
+        SAFEDELETE(m_pVisibleIndicesBuffer);
+        SAFEDELETE(m_pDrawBuffer);
+        m_OwnsParticleBuffers = false;
+    }
+
+    m_pPositionsBuffer = pPositionsBuffer;
+    m_pVelocitiesBuffer = pVelocitiesBuffer;
+    m_pAgesBuffer = pAgesBuffer;
+    m_PositionsOffset = positionsOffset;
+    m_FirstMotionParticle = firstMotionParticle;
+}
+
+void ParticleEmitter::setDrawBuffers(IBuffer* pVisibleIndicesBuffer, IBuffer* pDrawBuffer, uint32_t firstVisibleParticle, uint64_t drawCommandOffset)
+{
+    m_pVisibleIndicesBuffer = pVisibleIndicesBuffer;
+    m_pDrawBuffer = pDrawBuffer;
+    m_FirstVisibleParticle = firstVisibleParticle;
+    m_DrawCommandOffset = drawCommandOffset;
+}
+
+void ParticleEmitter::createDrawCommand(VkDrawIndexedIndirectCommand& drawCommand) const
+{
+    drawCommand.indexCount = PARTICLE_QUAD_INDEX_COUNT;
+    drawCommand.instanceCount = 0;
+    drawCommand.firstIndex = 0;
+    drawCommand.vertexOffset = 0;
+    drawCommand.firstInstance = m_FirstVisibleParticle;
+}
+
+uint32_t ParticleEmitter::getMappedParticleCount() const
+{
+    return std::min(getParticleCount(), m_MappedParticleCapacity);
 }
 
 uint32_t ParticleEmitter::getParticleCount() const
@@ -148,55 +327,111 @@ void ParticleEmitter::setParticleDuration(float particleDuration)
 
 void ParticleEmitter::setSpread(float spread)
 {
-    m_ZRandomizer = std::uniform_real_distribution<float>(std::cos(spread), 1.0f);
     m_Spread = spread;
     m_EmitterUpdated = true;
 }
 
-bool ParticleEmitter::createBuffers(IGraphicsContext* pGraphicsContext)
+bool ParticleEmitter::createBuffers(IGraphicsContext* pGraphicsContext, bool createParticleBuffers)
 {
     size_t particleCount = size_t(m_ParticlesPerSecond * m_ParticleDuration);
+    m_MappedParticleCapacity = uint32_t(particleCount);
 
     // Create particle buffers
     BufferParams bufferParams = {};
     bufferParams.IsExclusive = true;
     bufferParams.MemoryProperty = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
     bufferParams.Usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
-    bufferParams.SizeInBytes = particleCount * sizeof(glm::vec4);
+    bufferParams.SizeInBytes = particleCount * ParticlePositionPacker::getPackedSize(getGPUPositionFormat());
 
-    m_pPositionsBuffer = pGraphicsContext->createBuffer();
-    if (!m_pPositionsBuffer->init(bufferParams)) {
-        LOG("Failed to create particle positions buffer");
-        return false;
-    }
-    else
-    {
-        m_pPositionsBuffer->setName("Position Buffer");
-    }
+    if (createParticleBuffers) {
+        m_pPositionsBuffer = pGraphicsContext->createBuffer();
+        if (!m_pPositionsBuffer->init(bufferParams)) {
+            LOG("Failed to create particle positions buffer");
+            return false;
+        }
+        else
+        {
+            m_pPositionsBuffer->setName("Position Buffer");
+        }
 
-    m_pVelocitiesBuffer = pGraphicsContext->createBuffer();
-    if (!m_pVelocitiesBuffer->init(bufferParams)) {
-        LOG("Failed to create particle velocities buffer");
-        return false;
-    }
-    else
-    {
-        m_pVelocitiesBuffer->setName("Velocity Buffer");
-    }
+        // Analytic particles have no state besides their positions
+        if (!isAnalytic()) {
+            bufferParams.SizeInBytes = particleCount * sizeof(glm::vec4);
+
+            m_pVelocitiesBuffer = pGraphicsContext->createBuffer();
+            if (!m_pVelocitiesBuffer->init(bufferParams)) {
+                LOG("Failed to create particle velocities buffer");
+                return false;
+            }
+            else
+            {
+                m_pVelocitiesBuffer->setName("Velocity Buffer");
+            }
+
+            bufferParams.SizeInBytes = particleCount * sizeof(float);
+
+            m_pAgesBuffer = pGraphicsContext->createBuffer();
+            if (!m_pAgesBuffer->init(bufferParams)) {
+                LOG("Failed to create particle ages buffer");
+                return false;
+            }
+            else
+            {
+                m_pAgesBuffer->setName("Age Buffer");
+            }
+        }
 
-    bufferParams.SizeInBytes = particleCount * sizeof(float);
+        // Written by the update shader and read by the renderer
+        bufferParams.Usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+        bufferParams.SizeInBytes = particleCount * sizeof(uint32_t);
 
-    m_pAgesBuffer = pGraphicsContext->createBuffer();
-    if (!m_pAgesBuffer->init(bufferParams)) {
-        LOG("Failed to create particle ages buffer");
-        return false;
+        m_pVisibleIndicesBuffer = pGraphicsContext->createBuffer();
+        if (!m_pVisibleIndicesBuffer->init(bufferParams)) {
+            LOG("Failed to create visible particle indices buffer");
+            return false;
+        }
+        else
+        {
+            m_pVisibleIndicesBuffer->setName("Visible Indices Buffer");
+        }
+
+        bufferParams.Usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+        bufferParams.SizeInBytes = sizeof(VkDrawIndexedIndirectCommand);
+
+        m_pDrawBuffer = pGraphicsContext->createBuffer();
+        if (!m_pDrawBuffer->init(bufferParams)) {
+            LOG("Failed to create particle draw buffer");
+            return false;
+        }
+        else
+        {
+            m_pDrawBuffer->setName("Particle Draw Buffer");
+        }
     }
-    else
-    {
-        m_pAgesBuffer->setName("Age Buffer");
+
+    // Create mapped positions buffers, device local memory is preferred since the GPU reads them every frame
+    bufferParams.Usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    bufferParams.MemoryProperty = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+    bufferParams.PreferredMemoryProperty = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    bufferParams.SizeInBytes = particleCount * ParticlePositionPacker::getPackedSize(m_PositionFormat);
+
+    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        m_ppMappedPositionsBuffers[i] = pGraphicsContext->createBuffer();
+        if (!m_ppMappedPositionsBuffers[i]->init(bufferParams)) {
+            LOG("Failed to create mapped particle positions buffer");
+            return false;
+        }
+        else
+        {
+            m_ppMappedPositionsBuffers[i]->setName("Mapped Position Buffer");
+        }
+
+        m_ppMappedPositionsBuffers[i]->map((void**)&m_ppMappedPositions[i]);
     }
 
     // Create emitter buffer
+    bufferParams.MemoryProperty = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    bufferParams.PreferredMemoryProperty = 0;
     bufferParams.Usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
     bufferParams.SizeInBytes = sizeof(EmitterBuffer);
 
@@ -250,6 +485,8 @@ void ParticleEmitter::createProfiler(IGraphicsContext* pGraphicsContext, uint32_
 
 void ParticleEmitter::ageEmitter(float dt)
 {
+    m_SimulationTime += dt;
+
     if (m_EmitterAge < m_ParticleDuration) {
         uint32_t oldParticleCount = getParticleCount();
         m_EmitterAge += dt;
@@ -261,75 +498,128 @@ void ParticleEmitter::ageEmitter(float dt)
     }
 }
 
-void ParticleEmitter::moveParticles(float dt)
+void ParticleEmitter::moveParticles(uint32_t begin, uint32_t end, float dt)
 {
-    std::vector<glm::vec4>& positions = m_ParticleStorage.positions;
-    std::vector<glm::vec4>& velocities = m_ParticleStorage.velocities;
-    std::vector<float>& ages = m_ParticleStorage.ages;
-
-    size_t particleCount = getParticleCount();
-
-    for (size_t particleIdx = 0; particleIdx < particleCount; particleIdx++) {
-        positions[particleIdx] += velocities[particleIdx] * dt;
-        velocities[particleIdx].y -= 9.82f * dt;
-        ages[particleIdx] += dt;
-    }
+    ParticleIntegrator::integrate(m_ParticleStorage, begin, end, dt);
 }
 
-void ParticleEmitter::respawnOldParticles()
+void ParticleEmitter::respawnOldParticles(uint32_t begin, uint32_t end)
 {
-    std::vector<float>& ages = m_ParticleStorage.ages;
+    AlignedVector<float>& ages = m_ParticleStorage.ages;
 
-    size_t particleCount = getParticleCount();
+    // Parts of the chunk holding expired particles, the expired range can wrap around the end of the ring
+    uint32_t expiredEnd = m_ExpiredBegin + m_ExpiredCount;
+    uint32_t ringSize = m_FirstNewParticle;
+    uint32_t wrappedEnd = expiredEnd > ringSize ? expiredEnd - ringSize : 0;
 
-    /*
-        TODO: Optimize respawning, dead pixels are grouped up, no need to iterate through the entire particle storage
-        Three cases of particles grouping up: (d=dead, a=alive)
-        (front) daaaaaadd (back)
-        (front) aaaaaaddd (back)
-        (front) dddaaaaaa (back)
-    */
-    for (size_t particleIdx = 0; particleIdx < particleCount; particleIdx++) {
-        float newParticleAge = ages[particleIdx] - m_ParticleDuration;
-        if (newParticleAge < 0.0f) {
-            continue;
+    uint32_t expiredRanges[2][2] = {
+        { std::max(begin, m_ExpiredBegin), std::min(end, std::min(expiredEnd, ringSize)) },
+        { begin, std::min(end, wrappedEnd) }
+    };
+
+    for (const uint32_t* pRange : expiredRanges) {
+        for (uint32_t particleIdx = pRange[0]; particleIdx < pRange[1]; particleIdx++) {
+            ages[particleIdx] -= m_ParticleDuration;
         }
 
-        createParticle(particleIdx, newParticleAge);
+        spawnParticles(pRange[0], pRange[1]);
+    }
+
+    // Particle i is first spawned when the emitter is i / particlesPerSecond seconds old
+    uint32_t newBegin = std::max(begin, m_FirstNewParticle);
+    for (uint32_t particleIdx = newBegin; particleIdx < end; particleIdx++) {
+        ages[particleIdx] = std::max(0.0f, m_EmitterAge - particleIdx / m_ParticlesPerSecond);
     }
+
+    spawnParticles(newBegin, end);
 }
 
-void ParticleEmitter::createParticle(size_t particleIdx, float particleAge)
+void ParticleEmitter::spawnParticles(uint32_t begin, uint32_t end)
 {
-    glm::vec3 particleDirection = m_Direction;
+    const AlignedVector<float>& ages = m_ParticleStorage.ages;
+
+    // Randomized unit vectors within a cone based on https://math.stackexchange.com/a/205589, rotated so that the center of the cone is aligned with the emitter
+    float directionsX[PARTICLE_SPAWN_BATCH_SIZE];
+    float directionsY[PARTICLE_SPAWN_BATCH_SIZE];
+    float directionsZ[PARTICLE_SPAWN_BATCH_SIZE];
+    float minZ = std::cos(m_Spread);
+
+    for (uint32_t batchBegin = begin; batchBegin < end; batchBegin += PARTICLE_SPAWN_BATCH_SIZE) {
+        uint32_t batchSize = std::min(end - batchBegin, PARTICLE_SPAWN_BATCH_SIZE);
+        ParticleRandom::sampleCone(m_SpawnKey, batchBegin, batchSize, minZ, m_SpawnRotation, directionsX, directionsY, directionsZ);
+
+        /*
+            a = (0, -g, 0)
+            v = (0, -gt, 0) + V0
+            p = (0, -(gt^2)/2, 0) + V0*t + P0
+        */
+        for (uint32_t i = 0; i < batchSize; i++) {
+            uint32_t particleIdx = batchBegin + i;
+            float particleAge = ages[particleIdx];
+
+            float gt = -9.82f * particleAge;
+            glm::vec3 V0 = glm::vec3(directionsX[i], directionsY[i], directionsZ[i]) * m_InitialSpeed;
+            m_ParticleStorage.setVelocity(particleIdx, glm::vec3(0.0f, gt, 0.0f) + V0);
+            m_ParticleStorage.setPosition(particleIdx, glm::vec3(0.0f, gt * particleAge * 0.5f, 0.0f) + V0 * particleAge + m_Position);
+        }
+    }
+}
 
-    // Randomized unit vector within a cone based on https://math.stackexchange.com/a/205589
-    float z = m_ZRandomizer(m_RandEngine);
-    float phi = m_PhiRandomizer(m_RandEngine);
+void ParticleEmitter::evaluateParticles(uint32_t begin, uint32_t end)
+{
+    /*
+        Particle i is first spawned at i / particlesPerSecond and respawns every particleDuration seconds. Every respawn is a new generation
+        with its own random stream, in which the particle's direction is picked by its index. A batch holds at most two generations,
+        since later particles were first spawned later, and each run of particles sharing a generation is sampled together
+    */
+    float directionsX[PARTICLE_SPAWN_BATCH_SIZE];
+    float directionsY[PARTICLE_SPAWN_BATCH_SIZE];
+    float directionsZ[PARTICLE_SPAWN_BATCH_SIZE];
+    float particleAges[PARTICLE_SPAWN_BATCH_SIZE];
+    uint32_t generations[PARTICLE_SPAWN_BATCH_SIZE];
+    float minZ = std::cos(m_Spread);
+
+    for (uint32_t batchBegin = begin; batchBegin < end; batchBegin += PARTICLE_SPAWN_BATCH_SIZE) {
+        uint32_t batchSize = std::min(end - batchBegin, PARTICLE_SPAWN_BATCH_SIZE);
+
+        for (uint32_t i = 0; i < batchSize; i++) {
+            float timeSinceFirstSpawn = std::max(0.0f, m_SimulationTime - float(batchBegin + i) / m_ParticlesPerSecond);
+            generations[i] = uint32_t(timeSinceFirstSpawn / m_ParticleDuration);
+            particleAges[i] = timeSinceFirstSpawn - float(generations[i]) * m_ParticleDuration;
+        }
 
-    float sqrtZInv = std::sqrt(1.0f - z * z);
+        uint32_t runEnd = 0;
+        for (uint32_t runBegin = 0; runBegin < batchSize; runBegin = runEnd) {
+            runEnd = runBegin + 1;
+            while (runEnd < batchSize && generations[runEnd] == generations[runBegin]) {
+                runEnd++;
+            }
 
-    // Randomized vector given that the cone is centered around (0,0,1)
-    glm::vec3 randVec(sqrtZInv * std::cos(phi), sqrtZInv * std::sin(phi), z);
+            uint32_t generationKey = ParticleRandom::createKey(m_Seed, generations[runBegin]);
+            ParticleRandom::sampleCone(generationKey, batchBegin + runBegin, runEnd - runBegin, minZ, m_SpawnRotation,
+                directionsX + runBegin, directionsY + runBegin, directionsZ + runBegin);
+        }
 
-    if (m_Direction == m_ZVec) {
-        particleDirection = randVec;
-    } else {
-        // Rotate the random vector so that the center of the cone is aligned with the emitter
-        particleDirection = m_CenteringRotQuat * randVec;
+        // p = (0, -(gt^2)/2, 0) + V0*t + P0
+        for (uint32_t i = 0; i < batchSize; i++) {
+            float particleAge = particleAges[i];
+            float gt = -9.82f * particleAge;
+            glm::vec3 V0 = glm::vec3(directionsX[i], directionsY[i], directionsZ[i]) * m_InitialSpeed;
+            m_ParticleStorage.setPosition(batchBegin + i, glm::vec3(0.0f, gt * particleAge * 0.5f, 0.0f) + V0 * particleAge + m_Position);
+        }
     }
+}
 
-    /*
-        a = (0, -g, 0)
-        v = (0, -gt, 0) + V0
-        p = (0, -(gt^2)/2, 0) + V0*t + P0
-    */
+void ParticleEmitter::updatePositionBounds()
+{
+    glm::vec3 boundsMin, boundsExtent;
+    getPositionBounds(boundsMin, boundsExtent);
 
-    float gt = -9.82f * particleAge;
-    glm::vec3 V0 = particleDirection * m_InitialSpeed;
-    m_ParticleStorage.velocities[particleIdx] = glm::vec4(glm::vec3(0.0f, gt, 0.0f) + V0, 0.0f);
-    m_ParticleStorage.positions[particleIdx] = glm::vec4(glm::vec3(0.0f, gt * particleAge * 0.5f, 0.0f) + V0 * particleAge + m_Position, 1.0f);
-    m_ParticleStorage.ages[particleIdx] = particleAge;
+    if (boundsMin != m_PositionBoundsMin || boundsExtent != m_PositionBoundsExtent) {
+        m_PositionBoundsMin = boundsMin;
+        m_PositionBoundsExtent = boundsExtent;
+        m_EmitterUpdated = true;
+    }
 }
 
 void ParticleEmitter::createCenteringQuaternion()
@@ -338,19 +628,23 @@ void ParticleEmitter::createCenteringQuaternion()
 
     float angle = glm::angle(m_ZVec, m_Direction);
     m_CenteringRotQuat = glm::angleAxis(angle, axis);
+
+    // The axis is undefined when the emitter already points along the z axis
+    m_SpawnRotation = (m_Direction == m_ZVec) ? glm::mat3(1.0f) : glm::mat3_cast(m_CenteringRotQuat);
 }
 
 void ParticleEmitter::resizeParticleStorage(size_t newSize)
 {
-    size_t oldSize = m_ParticleStorage.positions.size();
+    size_t oldSize = m_ParticleStorage.size();
+    m_ParticleStorage.resize(newSize, !isAnalytic());
 
-    m_ParticleStorage.positions.resize(newSize);
-    m_ParticleStorage.velocities.resize(newSize);
-    m_ParticleStorage.ages.resize(newSize);
+    if (isAnalytic()) {
+        return;
+    }
 
     // Set the particle ages so that the first particle will respawn after the first update
     float spawnRateReciprocal = 1.0f / m_ParticlesPerSecond;
-    std::vector<float>& ages = m_ParticleStorage.ages;
+    AlignedVector<float>& ages = m_ParticleStorage.ages;
 
     for (size_t i = oldSize; i < newSize; i++) {
         ages[i] = m_ParticleDuration - i * spawnRateReciprocal;
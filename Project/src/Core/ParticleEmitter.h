@@ -5,10 +5,16 @@
 #include "glm/glm.hpp"
 
 #include "Common/IGraphicsContext.h"
+#include "Core/ParticlePositionPacker.h"
 #include "Vulkan/ProfilerVK.h"
 #include "Vulkan/VulkanCommon.h"
 
-#include <random>
+// Particles per CPU update chunk, a multiple of PARTICLE_SIMD_WIDTH. Chunks are the unit of work scheduled on the TaskDispatcher
+#define PARTICLE_CHUNK_SIZE 4096U
+// Particles whose random directions are sampled together when spawning
+#define PARTICLE_SPAWN_BATCH_SIZE 256U
+// Indices of the quad every particle is drawn as, see ParticleRendererVK::createQuadMesh
+#define PARTICLE_QUAD_INDEX_COUNT 6U
 
 class Camera;
 class IBuffer;
@@ -17,6 +23,12 @@ class IGraphicsContext;
 class IMesh;
 class ITexture2D;
 
+enum class EParticleSimulation : uint32_t
+{
+    INTEGRATED  = 0,    // Positions, velocities and ages are stored and stepped every frame
+    ANALYTIC    = 1     // Positions are evaluated from the seed and the spawn time every frame, velocities and ages are not stored
+};
+
 struct ParticleEmitterInfo {
     glm::vec3 position, direction;
     glm::vec2 particleSize;
@@ -24,6 +36,10 @@ struct ParticleEmitterInfo {
     // The angle by which spawned particles' directions can diverge from the emitter's direction, [0,pi], where pi means particles can be fired in any direction
     float spread;
     ITexture2D* pTexture;
+    // Seeds the random streams used for spawning particles, 0 picks a random seed
+    uint32_t seed;
+    EParticleSimulation simulation;
+    EParticlePositionFormat positionFormat;
 };
 
 struct EmitterBuffer {
@@ -32,11 +48,11 @@ struct EmitterBuffer {
     glm::vec2 particleSize;
     float particleDuration, initialSpeed, spread;
     uint32_t particleCount;
-};
-
-struct ParticleStorage {
-    std::vector<glm::vec4> positions, velocities;
-    std::vector<float> ages;
+    // Used by analytic emitters
+    float particlesPerSecond;
+    uint32_t seed;
+    // Box containing every particle, quantized positions are relative to it
+    glm::vec4 boundsMin, boundsExtent;
 };
 
 class CommandBufferVK;
@@ -48,16 +64,28 @@ public:
     ParticleEmitter(const ParticleEmitterInfo& emitterInfo);
     ~ParticleEmitter();
 
-    bool initialize(IGraphicsContext* pGraphicsContext, uint32_t frameCount, uint32_t computeQueueIndex);
+    // Batched emitters do not create their own GPU particle buffers, the batch assigns them ranges of shared buffers with setParticleBuffers
+    bool initialize(IGraphicsContext* pGraphicsContext, uint32_t frameCount, uint32_t computeQueueIndex, bool createParticleBuffers = true);
 
     void update(float dt);
     void updateGPU(float dt);
 
+    // The CPU update split into chunks, so that the chunks of several emitters can be scheduled together.
+    // beginUpdate is called once per frame, then every chunk is updated once, in any order and on any thread.
+    // When pMappedPositions is set, every chunk also writes its positions there in the emitter's position format
+    void beginUpdate(float dt, void* pMappedPositions = nullptr);
+    void updateChunk(uint32_t chunkIdx, float dt);
+    uint32_t getChunkCount() const;
+
     CommandBufferVK* getCommandBuffer(uint32_t frameIndex)  { return m_ppCommandBuffers[frameIndex]; }
     CommandPoolVK* getCommandPool(uint32_t frameIndex)      { return m_ppCommandPools[frameIndex]; }
     ProfilerVK* getProfiler()                               { return m_pProfiler; }
 
     const ParticleStorage& getParticleStorage() const { return m_ParticleStorage; }
+    // Replaces the first particleCount particles with particles read back from the GPU, ordered as in the GPU buffers. Particles from
+    // livingCount onwards had not been spawned when they were read back and are spawned again. The particles were read back catchUpTime
+    // seconds ago, see setCatchUpTime
+    void setParticles(const glm::vec4* pPositions, const glm::vec4* pVelocities, const float* pAges, uint32_t particleCount, uint32_t livingCount, float catchUpTime);
     void createEmitterBuffer(EmitterBuffer& emitterBuffer);
 
     uint32_t getParticleCount() const;
@@ -69,6 +97,16 @@ public:
     float getParticlesPerSecond() const { return m_ParticlesPerSecond; }
     float getParticleDuration() const { return m_ParticleDuration; }
     float getSpread() const { return m_Spread; }
+    // Seconds since the emitter started, unlike the emitter age it keeps increasing after the emitter is full
+    float getSimulationTime() const { return m_SimulationTime; }
+    bool isAnalytic() const { return m_Simulation == EParticleSimulation::ANALYTIC; }
+    // Format of the mapped positions buffers written by the CPU
+    EParticlePositionFormat getPositionFormat() const { return m_PositionFormat; }
+    // Format of the positions buffer written by the compute shader. Integrated particles keep full precision there, since it is
+    // also their state, and rounding it every update would accumulate errors
+    EParticlePositionFormat getGPUPositionFormat() const { return isAnalytic() ? m_PositionFormat : EParticlePositionFormat::FLOAT32; }
+    // Every particle is within the distance it can travel during its lifetime from the emitter
+    void getPositionBounds(glm::vec3& boundsMin, glm::vec3& boundsExtent) const;
 
     void setPosition(const glm::vec3& position);
     void setDirection(const glm::vec3& direction);
@@ -82,27 +120,71 @@ public:
     IDescriptorSet* getDescriptorSetRender() { return m_pDescriptorSetRender; }
     void setDescriptorSetCompute(IDescriptorSet* pDescriptorSet)    { m_pDescriptorSetCompute = pDescriptorSet; }
     void setDescriptorSetRender(IDescriptorSet* pDescriptorSet)     { m_pDescriptorSetRender = pDescriptorSet; }
+    // Render descriptor sets reading the mapped positions buffers, used while particles are updated on the CPU
+    IDescriptorSet* getDescriptorSetRenderMapped(uint32_t frameIndex)                       { return m_ppDescriptorSetsRenderMapped[frameIndex]; }
+    void setDescriptorSetRenderMapped(uint32_t frameIndex, IDescriptorSet* pDescriptorSet)  { m_ppDescriptorSetsRenderMapped[frameIndex] = pDescriptorSet; }
+
+    // The positions start getPositionsOffset() bytes into the positions buffer, velocities and ages start at particle getFirstMotionParticle()
+    void setParticleBuffers(IBuffer* pPositionsBuffer, IBuffer* pVelocitiesBuffer, IBuffer* pAgesBuffer, uint64_t positionsOffset, uint32_t firstMotionParticle);
+    uint64_t getPositionsOffset() const         { return m_PositionsOffset; }
+    uint64_t getPositionsSize() const           { return m_MappedParticleCapacity * ParticlePositionPacker::getPackedSize(getGPUPositionFormat()); }
+    uint32_t getFirstMotionParticle() const     { return m_FirstMotionParticle; }
+    uint64_t getVelocitiesOffset() const        { return m_FirstMotionParticle * sizeof(glm::vec4); }
+    uint64_t getAgesOffset() const              { return m_FirstMotionParticle * sizeof(float); }
+
+    // The update shader appends the visible particles to the visible indices buffer from particle getFirstVisibleParticle() onwards,
+    // and counts them in the draw command at getDrawCommandOffset() of the draw buffer. Set by batches along with the particle buffers
+    void setDrawBuffers(IBuffer* pVisibleIndicesBuffer, IBuffer* pDrawBuffer, uint32_t firstVisibleParticle, uint64_t drawCommandOffset);
+    uint32_t getFirstVisibleParticle() const    { return m_FirstVisibleParticle; }
+    uint64_t getDrawCommandOffset() const       { return m_DrawCommandOffset; }
+    // The draw command as it is before the update shader counts the visible particles
+    void createDrawCommand(VkDrawIndexedIndirectCommand& drawCommand) const;
 
     IBuffer* getPositionsBuffer()       { return m_pPositionsBuffer; }
     IBuffer* getVelocitiesBuffer()      { return m_pVelocitiesBuffer; }
     IBuffer* getAgesBuffer()            { return m_pAgesBuffer; }
+    IBuffer* getVisibleIndicesBuffer()  { return m_pVisibleIndicesBuffer; }
+    IBuffer* getDrawBuffer()            { return m_pDrawBuffer; }
     IBuffer* getEmitterBuffer()         { return m_pEmitterBuffer; }
+    IBuffer* getMappedPositionsBuffer(uint32_t frameIndex)  { return m_ppMappedPositionsBuffers[frameIndex]; }
+    void* getMappedPositions(uint32_t frameIndex)           { return m_ppMappedPositions[frameIndex]; }
+    // The GPU buffers are sized when the emitter is initialized, particles added later are not written to them
+    uint32_t getMappedParticleCount() const;
+    uint32_t getParticleCapacity() const { return m_MappedParticleCapacity; }
     ITexture2D* getParticleTexture()    { return m_pTexture; }
 
     inline uint32_t getComputeQueueIndex() { return m_ComputeQueueIndex; }
+    // The emitter handler moves emitters between compute queues to balance them
+    void setComputeQueueIndex(uint32_t computeQueueIndex) { m_ComputeQueueIndex = computeQueueIndex; }
+
+    // Whether the particles are updated on the GPU or on the CPU, the emitter handler decides which device updates each emitter
+    bool isGPUComputed() const { return m_GPUComputed; }
+    void setGPUComputed(bool gpuComputed) { m_GPUComputed = gpuComputed; }
+
+    // Seconds the particles lag behind the emitter after moving to another device, since the old device kept updating them while they
+    // were copied. The next update moves the particles by dt plus the catch-up time, while the emitter itself only ages by dt.
+    // The CPU update applies and clears it, the GPU update is given it by the emitter handler
+    float getCatchUpTime() const { return m_CatchUpTime; }
+    void setCatchUpTime(float catchUpTime) { m_CatchUpTime = catchUpTime; }
 
     // Whether or not the emitter's settings (above) have been changed during the current frame
     bool m_EmitterUpdated;
 
 private:
-    bool createBuffers(IGraphicsContext* pGraphicsContext);
+    bool createBuffers(IGraphicsContext* pGraphicsContext, bool createParticleBuffers);
     bool createCommandBuffers(IGraphicsContext* pGraphicsContext);
     void createProfiler(IGraphicsContext* pGraphicsContext, uint32_t frameCount);
 
     void ageEmitter(float dt);
-    void moveParticles(float dt);
-    void respawnOldParticles();
-    void createParticle(size_t particleIdx, float particleAge);
+    void moveParticles(uint32_t begin, uint32_t end, float dt);
+    void respawnOldParticles(uint32_t begin, uint32_t end);
+    // Computes the positions of particles [begin, end) from their spawn times, used instead of moving and respawning by analytic emitters
+    void evaluateParticles(uint32_t begin, uint32_t end);
+    // Spawns particles [begin, end) as if they were spawned as many seconds ago as their age
+    void spawnParticles(uint32_t begin, uint32_t end);
+
+    // The bounds are only changed at the start of an update, so that every chunk quantizes positions with the bounds sent to the GPU
+    void updatePositionBounds();
 
     // Calculate rotation quaternion for spawning new particles in the desired direction
     void createCenteringQuaternion();
@@ -120,20 +202,36 @@ private:
     glm::vec2 m_ParticleSize;
     float m_ParticleDuration, m_InitialSpeed, m_ParticlesPerSecond, m_Spread;
 
-    // Resources for generating random spread for particle directions
-    std::mt19937 m_RandEngine;
-    std::uniform_real_distribution<float> m_ZRandomizer;
-    std::uniform_real_distribution<float> m_PhiRandomizer;
+    // Resources for generating random spread for particle directions. Every update has its own random stream, keyed by
+    // the emitter's seed and the update count, in which a spawned particle's direction is picked by its index
+    uint32_t m_Seed;
+    uint32_t m_UpdateCount;
+    uint32_t m_SpawnKey;
 
     const glm::vec3 m_ZVec = glm::vec3(0.0f, 0.0f, 1.0f);
     // Random directions for particle are centered around (0,0,1), this quaternion centers them around the emitter's direction
     glm::quat m_CenteringRotQuat;
+    glm::mat3 m_SpawnRotation;
 
     ParticleStorage m_ParticleStorage;
+
+    // The storage is a ring ordered by age, see ParticleStorage::countExpiredParticles
+    uint32_t m_OldestParticle;
+    // Set by beginUpdate for the chunks of the current update. Particles [m_ExpiredBegin, m_ExpiredBegin + m_ExpiredCount) expire,
+    // wrapping around at m_FirstNewParticle. Particles from m_FirstNewParticle onwards are spawned for the first time
+    uint32_t m_ExpiredBegin;
+    uint32_t m_ExpiredCount;
+    uint32_t m_FirstNewParticle;
     ITexture2D* m_pTexture;
 
     // The amount of time since the emitter started emitting particles. Used for spawning particles.
     float m_EmitterAge;
+    float m_SimulationTime;
+    float m_CatchUpTime;
+    // Set by beginUpdate for the chunks of the current update
+    float m_ChunkCatchUpTime;
+
+    EParticleSimulation m_Simulation;
 
     IDescriptorSet* m_pDescriptorSetCompute;
     IDescriptorSet* m_pDescriptorSetRender;
@@ -143,6 +241,26 @@ private:
     IBuffer* m_pVelocitiesBuffer;
     IBuffer* m_pAgesBuffer;
     IBuffer* m_pEmitterBuffer;
+    IBuffer* m_pVisibleIndicesBuffer;
+    IBuffer* m_pDrawBuffer;
+    // False when the particle and draw buffers are shared by a batch of emitters
+    bool m_OwnsParticleBuffers;
+    uint64_t m_PositionsOffset;
+    uint32_t m_FirstMotionParticle;
+    uint32_t m_FirstVisibleParticle;
+    uint64_t m_DrawCommandOffset;
+
+    // Host visible positions buffers that stay mapped, one per frame in flight. The CPU update writes positions straight into the one
+    // used by the frame being rendered, which avoids copying them through a staging buffer
+    IBuffer* m_ppMappedPositionsBuffers[MAX_FRAMES_IN_FLIGHT];
+    void* m_ppMappedPositions[MAX_FRAMES_IN_FLIGHT];
+    IDescriptorSet* m_ppDescriptorSetsRenderMapped[MAX_FRAMES_IN_FLIGHT];
+    uint32_t m_MappedParticleCapacity;
+    // Set by beginUpdate for the chunks of the current update
+    void* m_pPositionsDestination;
+    EParticlePositionFormat m_PositionFormat;
+    glm::vec3 m_PositionBoundsMin, m_PositionBoundsExtent;
 
     uint32_t m_ComputeQueueIndex;
+    bool m_GPUComputed;
 };
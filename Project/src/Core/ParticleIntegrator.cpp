@@ -0,0 +1,174 @@
+#include "ParticleIntegrator.h"
+
+#include "Core/SIMD.h"
+
+#define GRAVITY 9.82f
+
+/*
+    p += v * dt
+    v.y -= g * dt
+    age += dt
+    The SIMD kernels do the same operations in the same order (no FMA), so all kernels produce identical results
+*/
+static void integrateScalar(ParticleStorage& storage, uint32_t begin, uint32_t end, float dt)
+{
+    float* pPositionsX = storage.positionsX.data();
+    float* pPositionsY = storage.positionsY.data();
+    float* pPositionsZ = storage.positionsZ.data();
+    float* pVelocitiesX = storage.velocitiesX.data();
+    float* pVelocitiesY = storage.velocitiesY.data();
+    float* pVelocitiesZ = storage.velocitiesZ.data();
+    float* pAges = storage.ages.data();
+
+    const float gravityStep = GRAVITY * dt;
+
+    for (uint32_t particleIdx = begin; particleIdx < end; particleIdx++) {
+        pPositionsX[particleIdx] += pVelocitiesX[particleIdx] * dt;
+        pPositionsY[particleIdx] += pVelocitiesY[particleIdx] * dt;
+        pPositionsZ[particleIdx] += pVelocitiesZ[particleIdx] * dt;
+        pVelocitiesY[particleIdx] -= gravityStep;
+        pAges[particleIdx] += dt;
+    }
+}
+
+#ifdef SIMD_X86
+TARGET_SSE static void integrateSSE(ParticleStorage& storage, uint32_t begin, uint32_t end, float dt)
+{
+    float* pPositionsX = storage.positionsX.data();
+    float* pPositionsY = storage.positionsY.data();
+    float* pPositionsZ = storage.positionsZ.data();
+    float* pVelocitiesX = storage.velocitiesX.data();
+    float* pVelocitiesY = storage.velocitiesY.data();
+    float* pVelocitiesZ = storage.velocitiesZ.data();
+    float* pAges = storage.ages.data();
+
+    const __m128 timeStep = _mm_set1_ps(dt);
+    const __m128 gravityStep = _mm_set1_ps(GRAVITY * dt);
+
+    // Unaligned loads cost nothing extra on aligned addresses, and let callers pass any range
+    uint32_t particleIdx = begin;
+    for (; particleIdx + 4 <= end; particleIdx += 4) {
+        __m128 velocityX = _mm_loadu_ps(pVelocitiesX + particleIdx);
+        __m128 velocityY = _mm_loadu_ps(pVelocitiesY + particleIdx);
+        __m128 velocityZ = _mm_loadu_ps(pVelocitiesZ + particleIdx);
+
+        _mm_storeu_ps(pPositionsX + particleIdx, _mm_add_ps(_mm_loadu_ps(pPositionsX + particleIdx), _mm_mul_ps(velocityX, timeStep)));
+        _mm_storeu_ps(pPositionsY + particleIdx, _mm_add_ps(_mm_loadu_ps(pPositionsY + particleIdx), _mm_mul_ps(velocityY, timeStep)));
+        _mm_storeu_ps(pPositionsZ + particleIdx, _mm_add_ps(_mm_loadu_ps(pPositionsZ + particleIdx), _mm_mul_ps(velocityZ, timeStep)));
+        _mm_storeu_ps(pVelocitiesY + particleIdx, _mm_sub_ps(velocityY, gravityStep));
+        _mm_storeu_ps(pAges + particleIdx, _mm_add_ps(_mm_loadu_ps(pAges + particleIdx), timeStep));
+    }
+
+    integrateScalar(storage, particleIdx, end, dt);
+}
+
+TARGET_AVX2 static void integrateAVX2(ParticleStorage& storage, uint32_t begin, uint32_t end, float dt)
+{
+    float* pPositionsX = storage.positionsX.data();
+    float* pPositionsY = storage.positionsY.data();
+    float* pPositionsZ = storage.positionsZ.data();
+    float* pVelocitiesX = storage.velocitiesX.data();
+    float* pVelocitiesY = storage.velocitiesY.data();
+    float* pVelocitiesZ = storage.velocitiesZ.data();
+    float* pAges = storage.ages.data();
+
+    const __m256 timeStep = _mm256_set1_ps(dt);
+    const __m256 gravityStep = _mm256_set1_ps(GRAVITY * dt);
+
+    uint32_t particleIdx = begin;
+    for (; particleIdx + 8 <= end; particleIdx += 8) {
+        __m256 velocityX = _mm256_loadu_ps(pVelocitiesX + particleIdx);
+        __m256 velocityY = _mm256_loadu_ps(pVelocitiesY + particleIdx);
+        __m256 velocityZ = _mm256_loadu_ps(pVelocitiesZ + particleIdx);
+
+        _mm256_storeu_ps(pPositionsX + particleIdx, _mm256_add_ps(_mm256_loadu_ps(pPositionsX + particleIdx), _mm256_mul_ps(velocityX, timeStep)));
+        _mm256_storeu_ps(pPositionsY + particleIdx, _mm256_add_ps(_mm256_loadu_ps(pPositionsY + particleIdx), _mm256_mul_ps(velocityY, timeStep)));
+        _mm256_storeu_ps(pPositionsZ + particleIdx, _mm256_add_ps(_mm256_loadu_ps(pPositionsZ + particleIdx), _mm256_mul_ps(velocityZ, timeStep)));
+        _mm256_storeu_ps(pVelocitiesY + particleIdx, _mm256_sub_ps(velocityY, gravityStep));
+        _mm256_storeu_ps(pAges + particleIdx, _mm256_add_ps(_mm256_loadu_ps(pAges + particleIdx), timeStep));
+    }
+
+    integrateScalar(storage, particleIdx, end, dt);
+}
+#endif
+
+void ParticleIntegrator::integrate(ParticleStorage& storage, uint32_t begin, uint32_t end, float dt)
+{
+    integrate(getInstructionSet(), storage, begin, end, dt);
+}
+
+void ParticleIntegrator::integrate(EParticleInstructionSet instructionSet, ParticleStorage& storage, uint32_t begin, uint32_t end, float dt)
+{
+    ASSERT(isSupported(instructionSet));
+
+    switch (instructionSet) {
+#ifdef SIMD_X86
+    case EParticleInstructionSet::AVX2:
+        integrateAVX2(storage, begin, end, dt);
+        return;
+    case EParticleInstructionSet::SSE:
+        integrateSSE(storage, begin, end, dt);
+        return;
+#endif
+    default:
+        integrateScalar(storage, begin, end, dt);
+        return;
+    }
+}
+
+bool ParticleIntegrator::isSupported(EParticleInstructionSet instructionSet)
+{
+    return uint32_t(instructionSet) <= uint32_t(getInstructionSet());
+}
+
+EParticleInstructionSet ParticleIntegrator::getInstructionSet()
+{
+    static const EParticleInstructionSet instructionSet = detectInstructionSet();
+    return instructionSet;
+}
+
+const char* ParticleIntegrator::getInstructionSetName(EParticleInstructionSet instructionSet)
+{
+    switch (instructionSet) {
+    case EParticleInstructionSet::AVX2: return "AVX2";
+    case EParticleInstructionSet::SSE:  return "SSE";
+    default:                            return "Scalar";
+    }
+}
+
+EParticleInstructionSet ParticleIntegrator::detectInstructionSet()
+{
+#if defined(SIMD_X86) && defined(_MSC_VER)
+    int cpuInfo[4] = {};
+    __cpuid(cpuInfo, 0);
+    const int highestLeaf = cpuInfo[0];
+
+    __cpuid(cpuInfo, 1);
+    const bool hasSSE2 = (cpuInfo[3] & (1 << 26)) != 0;
+    if (!hasSSE2) {
+        return EParticleInstructionSet::SCALAR;
+    }
+
+    // AVX needs both the CPU and the OS, which has to save the YMM registers on context switches
+    const bool hasAVX = (cpuInfo[2] & (1 << 28)) != 0;
+    const bool osSavesYMM = (cpuInfo[2] & (1 << 27)) != 0 && (_xgetbv(0) & 0x6) == 0x6;
+    if (highestLeaf < 7 || !hasAVX || !osSavesYMM) {
+        return EParticleInstructionSet::SSE;
+    }
+
+    __cpuidex(cpuInfo, 7, 0);
+    const bool hasAVX2 = (cpuInfo[1] & (1 << 5)) != 0;
+    return hasAVX2 ? EParticleInstructionSet::AVX2 : EParticleInstructionSet::SSE;
+#elif defined(SIMD_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return EParticleInstructionSet::AVX2;
+    } else if (__builtin_cpu_supports("sse2")) {
+        return EParticleInstructionSet::SSE;
+    }
+
+    return EParticleInstructionSet::SCALAR;
+#else
+    return EParticleInstructionSet::SCALAR;
+#endif
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "Core/Core.h"
+#include "Core/ParticleStorage.h"
+
+// Widest SIMD kernel, ranges handed to the integrator should start at multiples of this to keep the loads aligned
+#define PARTICLE_SIMD_WIDTH 8U
+
+enum class EParticleInstructionSet : uint32_t
+{
+    SCALAR  = 0,
+    SSE     = 1,    // 4 particles per instruction
+    AVX2    = 2     // 8 particles per instruction
+};
+
+class ParticleIntegrator
+{
+public:
+    DECL_STATIC_CLASS(ParticleIntegrator);
+
+    // Moves particles [begin, end) along their velocities, applies gravity and ages them.
+    // Uses the widest instruction set supported by the CPU, detected the first time the integrator is used
+    static void integrate(ParticleStorage& storage, uint32_t begin, uint32_t end, float dt);
+    // Forces a specific kernel, the instruction set has to be supported
+    static void integrate(EParticleInstructionSet instructionSet, ParticleStorage& storage, uint32_t begin, uint32_t end, float dt);
+
+    static bool isSupported(EParticleInstructionSet instructionSet);
+    static EParticleInstructionSet getInstructionSet();
+    static const char* getInstructionSetName(EParticleInstructionSet instructionSet);
+
+private:
+    static EParticleInstructionSet detectInstructionSet();
+};
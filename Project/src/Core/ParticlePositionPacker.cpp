@@ -0,0 +1,140 @@
+#include "ParticlePositionPacker.h"
+
+#include "Core/SIMD.h"
+
+// Maps the bounds to [0, 65535] per axis, an empty axis maps every position to 0
+static glm::vec3 getQuantizationScale(const glm::vec3& boundsExtent)
+{
+    glm::vec3 scale;
+    for (int axis = 0; axis < 3; axis++) {
+        scale[axis] = boundsExtent[axis] > 0.0f ? QUANTIZED16_MAX / boundsExtent[axis] : 0.0f;
+    }
+
+    return scale;
+}
+
+// Rounds by adding 0.5 and truncating, instead of the SIMD default of rounding to even, so that every kernel gives the same result
+static FORCEINLINE uint32_t quantize(float position, float boundsMin, float scale)
+{
+    float quantized = std::min(std::max((position - boundsMin) * scale, 0.0f), QUANTIZED16_MAX);
+    return uint32_t(quantized + 0.5f);
+}
+
+static void packQuantizedScalar(const ParticleStorage& storage, glm::uvec2* pDestination, uint32_t begin, uint32_t end, const glm::vec3& boundsMin, const glm::vec3& scale)
+{
+    for (uint32_t particleIdx = begin; particleIdx < end; particleIdx++) {
+        uint32_t x = quantize(storage.positionsX[particleIdx], boundsMin.x, scale.x);
+        uint32_t y = quantize(storage.positionsY[particleIdx], boundsMin.y, scale.y);
+        uint32_t z = quantize(storage.positionsZ[particleIdx], boundsMin.z, scale.z);
+        pDestination[particleIdx - begin] = glm::uvec2(x | (y << 16U), z);
+    }
+}
+
+#ifdef SIMD_X86
+TARGET_SSE static FORCEINLINE __m128i quantizeSSE(const float* pPositions, __m128 boundsMin, __m128 scale)
+{
+    __m128 quantized = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(pPositions), boundsMin), scale);
+    quantized = _mm_min_ps(_mm_max_ps(quantized, _mm_setzero_ps()), _mm_set1_ps(QUANTIZED16_MAX));
+    return _mm_cvttps_epi32(_mm_add_ps(quantized, _mm_set1_ps(0.5f)));
+}
+
+TARGET_SSE static void packQuantizedSSE(const ParticleStorage& storage, glm::uvec2* pDestination, uint32_t begin, uint32_t end, const glm::vec3& boundsMin, const glm::vec3& scale)
+{
+    const float* pPositionsX = storage.positionsX.data();
+    const float* pPositionsY = storage.positionsY.data();
+    const float* pPositionsZ = storage.positionsZ.data();
+
+    const __m128 boundsMinX = _mm_set1_ps(boundsMin.x), boundsMinY = _mm_set1_ps(boundsMin.y), boundsMinZ = _mm_set1_ps(boundsMin.z);
+    const __m128 scaleX = _mm_set1_ps(scale.x), scaleY = _mm_set1_ps(scale.y), scaleZ = _mm_set1_ps(scale.z);
+
+    uint32_t particleIdx = begin;
+    for (; particleIdx + 4 <= end; particleIdx += 4) {
+        __m128i x = quantizeSSE(pPositionsX + particleIdx, boundsMinX, scaleX);
+        __m128i y = quantizeSSE(pPositionsY + particleIdx, boundsMinY, scaleY);
+        __m128i z = quantizeSSE(pPositionsZ + particleIdx, boundsMinZ, scaleZ);
+        __m128i xy = _mm_or_si128(x, _mm_slli_epi32(y, 16));
+
+        // Interleave into (xy, z) pairs
+        __m128i* pPacked = reinterpret_cast<__m128i*>(pDestination + (particleIdx - begin));
+        _mm_storeu_si128(pPacked, _mm_unpacklo_epi32(xy, z));
+        _mm_storeu_si128(pPacked + 1, _mm_unpackhi_epi32(xy, z));
+    }
+
+    packQuantizedScalar(storage, pDestination + (particleIdx - begin), particleIdx, end, boundsMin, scale);
+}
+
+TARGET_AVX2 static FORCEINLINE __m256i quantizeAVX2(const float* pPositions, __m256 boundsMin, __m256 scale)
+{
+    __m256 quantized = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(pPositions), boundsMin), scale);
+    quantized = _mm256_min_ps(_mm256_max_ps(quantized, _mm256_setzero_ps()), _mm256_set1_ps(QUANTIZED16_MAX));
+    return _mm256_cvttps_epi32(_mm256_add_ps(quantized, _mm256_set1_ps(0.5f)));
+}
+
+TARGET_AVX2 static void packQuantizedAVX2(const ParticleStorage& storage, glm::uvec2* pDestination, uint32_t begin, uint32_t end, const glm::vec3& boundsMin, const glm::vec3& scale)
+{
+    const float* pPositionsX = storage.positionsX.data();
+    const float* pPositionsY = storage.positionsY.data();
+    const float* pPositionsZ = storage.positionsZ.data();
+
+    const __m256 boundsMinX = _mm256_set1_ps(boundsMin.x), boundsMinY = _mm256_set1_ps(boundsMin.y), boundsMinZ = _mm256_set1_ps(boundsMin.z);
+    const __m256 scaleX = _mm256_set1_ps(scale.x), scaleY = _mm256_set1_ps(scale.y), scaleZ = _mm256_set1_ps(scale.z);
+
+    uint32_t particleIdx = begin;
+    for (; particleIdx + 8 <= end; particleIdx += 8) {
+        __m256i x = quantizeAVX2(pPositionsX + particleIdx, boundsMinX, scaleX);
+        __m256i y = quantizeAVX2(pPositionsY + particleIdx, boundsMinY, scaleY);
+        __m256i z = quantizeAVX2(pPositionsZ + particleIdx, boundsMinZ, scaleZ);
+        __m256i xy = _mm256_or_si256(x, _mm256_slli_epi32(y, 16));
+
+        // The unpacks work within 128-bit lanes, low holds particles 0, 1, 4, 5 and high holds 2, 3, 6, 7
+        __m256i low = _mm256_unpacklo_epi32(xy, z);
+        __m256i high = _mm256_unpackhi_epi32(xy, z);
+
+        __m256i* pPacked = reinterpret_cast<__m256i*>(pDestination + (particleIdx - begin));
+        _mm256_storeu_si256(pPacked, _mm256_permute2x128_si256(low, high, 0x20));
+        _mm256_storeu_si256(pPacked + 1, _mm256_permute2x128_si256(low, high, 0x31));
+    }
+
+    packQuantizedScalar(storage, pDestination + (particleIdx - begin), particleIdx, end, boundsMin, scale);
+}
+#endif
+
+void ParticlePositionPacker::pack(EParticlePositionFormat format, const ParticleStorage& storage, void* pDestination, uint32_t begin, uint32_t end, const glm::vec3& boundsMin, const glm::vec3& boundsExtent)
+{
+    if (format == EParticlePositionFormat::QUANTIZED16) {
+        packQuantized(storage, reinterpret_cast<glm::uvec2*>(pDestination), begin, end, boundsMin, boundsExtent);
+    } else {
+        storage.packPositions(reinterpret_cast<glm::vec4*>(pDestination), begin, end);
+    }
+}
+
+void ParticlePositionPacker::packQuantized(const ParticleStorage& storage, glm::uvec2* pDestination, uint32_t begin, uint32_t end, const glm::vec3& boundsMin, const glm::vec3& boundsExtent)
+{
+    packQuantized(ParticleIntegrator::getInstructionSet(), storage, pDestination, begin, end, boundsMin, boundsExtent);
+}
+
+void ParticlePositionPacker::packQuantized(EParticleInstructionSet instructionSet, const ParticleStorage& storage, glm::uvec2* pDestination, uint32_t begin, uint32_t end, const glm::vec3& boundsMin, const glm::vec3& boundsExtent)
+{
+    ASSERT(ParticleIntegrator::isSupported(instructionSet));
+
+    glm::vec3 scale = getQuantizationScale(boundsExtent);
+
+    switch (instructionSet) {
+#ifdef SIMD_X86
+    case EParticleInstructionSet::AVX2:
+        packQuantizedAVX2(storage, pDestination, begin, end, boundsMin, scale);
+        return;
+    case EParticleInstructionSet::SSE:
+        packQuantizedSSE(storage, pDestination, begin, end, boundsMin, scale);
+        return;
+#endif
+    default:
+        packQuantizedScalar(storage, pDestination, begin, end, boundsMin, scale);
+        return;
+    }
+}
+
+size_t ParticlePositionPacker::getPackedSize(EParticlePositionFormat format)
+{
+    return format == EParticlePositionFormat::QUANTIZED16 ? sizeof(glm::uvec2) : sizeof(glm::vec4);
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "Core/Core.h"
+#include "Core/ParticleIntegrator.h"
+
+// Largest value of a quantized axis
+#define QUANTIZED16_MAX 65535.0f
+
+// Layout of the position streams read by the shaders
+enum class EParticlePositionFormat : uint32_t
+{
+    FLOAT32     = 0,    // vec4 per particle, 16 bytes
+    QUANTIZED16 = 1     // 16 bits per axis relative to the emitter's bounds, packed as uvec2(x | y << 16, z), 8 bytes
+};
+
+/*
+    Writes particle positions into the streams uploaded to the GPU. Quantized positions are accurate to boundsExtent / 131070 per axis,
+    positions outside of the bounds are clamped to them.
+    Picks its kernel like ParticleIntegrator, every kernel gives identical results
+*/
+class ParticlePositionPacker
+{
+public:
+    DECL_STATIC_CLASS(ParticlePositionPacker);
+
+    // Packs particles [begin, end) to pDestination, which holds the first packed particle
+    static void pack(EParticlePositionFormat format, const ParticleStorage& storage, void* pDestination, uint32_t begin, uint32_t end, const glm::vec3& boundsMin, const glm::vec3& boundsExtent);
+
+    static void packQuantized(const ParticleStorage& storage, glm::uvec2* pDestination, uint32_t begin, uint32_t end, const glm::vec3& boundsMin, const glm::vec3& boundsExtent);
+    // Forces a specific kernel, the instruction set has to be supported
+    static void packQuantized(EParticleInstructionSet instructionSet, const ParticleStorage& storage, glm::uvec2* pDestination, uint32_t begin, uint32_t end, const glm::vec3& boundsMin, const glm::vec3& boundsExtent);
+
+    static size_t getPackedSize(EParticlePositionFormat format);
+};
@@ -0,0 +1,217 @@
+#include "ParticleRandom.h"
+
+#include "Core/SIMD.h"
+
+#include "glm/gtc/constants.hpp"
+
+// PCG hash constants, see Jarzynski and Olano, "Hash Functions for GPU Rendering"
+#define PCG_MULTIPLIER 747796405U
+#define PCG_INCREMENT 2891336453U
+#define PCG_OUTPUT_MULTIPLIER 277803737U
+
+// Polynomial coefficients for sin and cos on [-pi/4, pi/4]
+#define SIN_C3 (-1.0f / 6.0f)
+#define SIN_C5 (1.0f / 120.0f)
+#define SIN_C7 (-1.0f / 5040.0f)
+#define COS_C2 (-1.0f / 2.0f)
+#define COS_C4 (1.0f / 24.0f)
+#define COS_C6 (-1.0f / 720.0f)
+#define COS_C8 (1.0f / 40320.0f)
+
+static FORCEINLINE uint32_t hash(uint32_t value)
+{
+    uint32_t state = value * PCG_MULTIPLIER + PCG_INCREMENT;
+    uint32_t word = ((state >> ((state >> 28U) + 4U)) ^ state) * PCG_OUTPUT_MULTIPLIER;
+    return (word >> 22U) ^ word;
+}
+
+// The top 24 bits as a float in [0, 1)
+static FORCEINLINE float toUnitFloat(uint32_t bits)
+{
+    return float(bits >> 8U) * (1.0f / 16777216.0f);
+}
+
+/*
+    cos(2 * pi * u) and sin(2 * pi * u) for u in [0, 1). u is split into the nearest quarter turn and an angle within [-pi/4, pi/4],
+    where short polynomials are accurate to about 1e-7. Avoids calling std::sin and std::cos, which can not be vectorized
+*/
+static FORCEINLINE void sinCosTurn(float u, float& sinOut, float& cosOut)
+{
+    float turns = u * 4.0f;
+    float quadrant = std::floor(turns + 0.5f);
+    float angle = (turns - quadrant) * glm::half_pi<float>();
+    float angleSquared = angle * angle;
+
+    float sinAngle = angle * (1.0f + angleSquared * (SIN_C3 + angleSquared * (SIN_C5 + angleSquared * SIN_C7)));
+    float cosAngle = 1.0f + angleSquared * (COS_C2 + angleSquared * (COS_C4 + angleSquared * (COS_C6 + angleSquared * COS_C8)));
+
+    // Rotate by the quarter turns: (cos, sin) -> (-sin, cos) -> (-cos, -sin) -> (sin, -cos)
+    uint32_t quarterTurns = uint32_t(int32_t(quadrant)) & 3U;
+    float swappedCos = (quarterTurns & 1U) ? sinAngle : cosAngle;
+    float swappedSin = (quarterTurns & 1U) ? cosAngle : sinAngle;
+    cosOut = ((quarterTurns + 1U) & 2U) ? -swappedCos : swappedCos;
+    sinOut = (quarterTurns & 2U) ? -swappedSin : swappedSin;
+}
+
+static void fillFloatsScalar(uint32_t key, uint32_t counterBegin, uint32_t count, float* pValues)
+{
+    for (uint32_t i = 0; i < count; i++) {
+        pValues[i] = ParticleRandom::generateFloat(key, counterBegin + i);
+    }
+}
+
+static void sampleConeScalar(uint32_t key, uint32_t counterBegin, uint32_t count, float minZ, const glm::mat3& rotation, float* pX, float* pY, float* pZ)
+{
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t counter = 2U * (counterBegin + i);
+        float z = minZ + (1.0f - minZ) * ParticleRandom::generateFloat(key, counter);
+
+        float sinPhi, cosPhi;
+        sinCosTurn(ParticleRandom::generateFloat(key, counter + 1U), sinPhi, cosPhi);
+
+        float radius = std::sqrt(std::max(0.0f, 1.0f - z * z));
+        float x = radius * cosPhi;
+        float y = radius * sinPhi;
+
+        pX[i] = rotation[0][0] * x + rotation[1][0] * y + rotation[2][0] * z;
+        pY[i] = rotation[0][1] * x + rotation[1][1] * y + rotation[2][1] * z;
+        pZ[i] = rotation[0][2] * x + rotation[1][2] * y + rotation[2][2] * z;
+    }
+}
+
+#ifdef SIMD_X86
+TARGET_AVX2 static FORCEINLINE __m256i hashAVX2(__m256i value)
+{
+    __m256i state = _mm256_add_epi32(_mm256_mullo_epi32(value, _mm256_set1_epi32(int32_t(PCG_MULTIPLIER))), _mm256_set1_epi32(int32_t(PCG_INCREMENT)));
+    __m256i shift = _mm256_add_epi32(_mm256_srli_epi32(state, 28), _mm256_set1_epi32(4));
+    __m256i word = _mm256_mullo_epi32(_mm256_xor_si256(_mm256_srlv_epi32(state, shift), state), _mm256_set1_epi32(int32_t(PCG_OUTPUT_MULTIPLIER)));
+    return _mm256_xor_si256(_mm256_srli_epi32(word, 22), word);
+}
+
+TARGET_AVX2 static FORCEINLINE __m256 generateFloatsAVX2(__m256i key, __m256i counters)
+{
+    __m256i bits = hashAVX2(_mm256_xor_si256(hashAVX2(counters), key));
+    return _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(bits, 8)), _mm256_set1_ps(1.0f / 16777216.0f));
+}
+
+TARGET_AVX2 static void fillFloatsAVX2(uint32_t key, uint32_t counterBegin, uint32_t count, float* pValues)
+{
+    const __m256i keys = _mm256_set1_epi32(int32_t(key));
+    const __m256i laneOffsets = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+    uint32_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i counters = _mm256_add_epi32(_mm256_set1_epi32(int32_t(counterBegin + i)), laneOffsets);
+        _mm256_storeu_ps(pValues + i, generateFloatsAVX2(keys, counters));
+    }
+
+    fillFloatsScalar(key, counterBegin + i, count - i, pValues + i);
+}
+
+TARGET_AVX2 static void sampleConeAVX2(uint32_t key, uint32_t counterBegin, uint32_t count, float minZ, const glm::mat3& rotation, float* pX, float* pY, float* pZ)
+{
+    const __m256i keys = _mm256_set1_epi32(int32_t(key));
+    const __m256i laneOffsets = _mm256_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14);
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i two = _mm256_set1_epi32(2);
+    const __m256i three = _mm256_set1_epi32(3);
+    const __m256 signBit = _mm256_set1_ps(-0.0f);
+
+    const __m256 minZs = _mm256_set1_ps(minZ);
+    const __m256 zRange = _mm256_set1_ps(1.0f - minZ);
+
+    for (uint32_t i = 0; i + 8 <= count; i += 8) {
+        __m256i counters = _mm256_add_epi32(_mm256_set1_epi32(int32_t(2U * (counterBegin + i))), laneOffsets);
+
+        __m256 z = _mm256_add_ps(minZs, _mm256_mul_ps(zRange, generateFloatsAVX2(keys, counters)));
+        __m256 u = generateFloatsAVX2(keys, _mm256_add_epi32(counters, one));
+
+        // Same steps as sinCosTurn
+        __m256 turns = _mm256_mul_ps(u, _mm256_set1_ps(4.0f));
+        __m256 quadrant = _mm256_floor_ps(_mm256_add_ps(turns, _mm256_set1_ps(0.5f)));
+        __m256 angle = _mm256_mul_ps(_mm256_sub_ps(turns, quadrant), _mm256_set1_ps(glm::half_pi<float>()));
+        __m256 angleSquared = _mm256_mul_ps(angle, angle);
+
+        __m256 sinAngle = _mm256_add_ps(_mm256_set1_ps(SIN_C5), _mm256_mul_ps(angleSquared, _mm256_set1_ps(SIN_C7)));
+        sinAngle = _mm256_add_ps(_mm256_set1_ps(SIN_C3), _mm256_mul_ps(angleSquared, sinAngle));
+        sinAngle = _mm256_add_ps(_mm256_set1_ps(1.0f), _mm256_mul_ps(angleSquared, sinAngle));
+        sinAngle = _mm256_mul_ps(angle, sinAngle);
+
+        __m256 cosAngle = _mm256_add_ps(_mm256_set1_ps(COS_C6), _mm256_mul_ps(angleSquared, _mm256_set1_ps(COS_C8)));
+        cosAngle = _mm256_add_ps(_mm256_set1_ps(COS_C4), _mm256_mul_ps(angleSquared, cosAngle));
+        cosAngle = _mm256_add_ps(_mm256_set1_ps(COS_C2), _mm256_mul_ps(angleSquared, cosAngle));
+        cosAngle = _mm256_add_ps(_mm256_set1_ps(1.0f), _mm256_mul_ps(angleSquared, cosAngle));
+
+        __m256i quarterTurns = _mm256_and_si256(_mm256_cvttps_epi32(quadrant), three);
+        __m256 isSwapped = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(quarterTurns, one), one));
+        __m256 swappedCos = _mm256_blendv_ps(cosAngle, sinAngle, isSwapped);
+        __m256 swappedSin = _mm256_blendv_ps(sinAngle, cosAngle, isSwapped);
+
+        __m256 negateCos = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(_mm256_add_epi32(quarterTurns, one), two), two));
+        __m256 negateSin = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(quarterTurns, two), two));
+        __m256 cosPhi = _mm256_xor_ps(swappedCos, _mm256_and_ps(negateCos, signBit));
+        __m256 sinPhi = _mm256_xor_ps(swappedSin, _mm256_and_ps(negateSin, signBit));
+
+        __m256 radius = _mm256_sqrt_ps(_mm256_max_ps(_mm256_setzero_ps(), _mm256_sub_ps(_mm256_set1_ps(1.0f), _mm256_mul_ps(z, z))));
+        __m256 x = _mm256_mul_ps(radius, cosPhi);
+        __m256 y = _mm256_mul_ps(radius, sinPhi);
+
+        __m256 rotatedX = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(rotation[0][0]), x), _mm256_mul_ps(_mm256_set1_ps(rotation[1][0]), y)), _mm256_mul_ps(_mm256_set1_ps(rotation[2][0]), z));
+        __m256 rotatedY = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(rotation[0][1]), x), _mm256_mul_ps(_mm256_set1_ps(rotation[1][1]), y)), _mm256_mul_ps(_mm256_set1_ps(rotation[2][1]), z));
+        __m256 rotatedZ = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(rotation[0][2]), x), _mm256_mul_ps(_mm256_set1_ps(rotation[1][2]), y)), _mm256_mul_ps(_mm256_set1_ps(rotation[2][2]), z));
+
+        _mm256_storeu_ps(pX + i, rotatedX);
+        _mm256_storeu_ps(pY + i, rotatedY);
+        _mm256_storeu_ps(pZ + i, rotatedZ);
+    }
+
+    uint32_t tailBegin = count & ~7U;
+    sampleConeScalar(key, counterBegin + tailBegin, count - tailBegin, minZ, rotation, pX + tailBegin, pY + tailBegin, pZ + tailBegin);
+}
+#endif
+
+uint32_t ParticleRandom::createKey(uint32_t seed, uint32_t stream)
+{
+    return hash(hash(seed) + stream);
+}
+
+uint32_t ParticleRandom::generate(uint32_t key, uint32_t counter)
+{
+    return hash(hash(counter) ^ key);
+}
+
+float ParticleRandom::generateFloat(uint32_t key, uint32_t counter)
+{
+    return toUnitFloat(generate(key, counter));
+}
+
+void ParticleRandom::fillFloats(uint32_t key, uint32_t counterBegin, uint32_t count, float* pValues)
+{
+#ifdef SIMD_X86
+    if (ParticleIntegrator::getInstructionSet() == EParticleInstructionSet::AVX2) {
+        fillFloatsAVX2(key, counterBegin, count, pValues);
+        return;
+    }
+#endif
+
+    fillFloatsScalar(key, counterBegin, count, pValues);
+}
+
+void ParticleRandom::sampleCone(uint32_t key, uint32_t counterBegin, uint32_t count, float minZ, const glm::mat3& rotation, float* pX, float* pY, float* pZ)
+{
+    sampleCone(ParticleIntegrator::getInstructionSet(), key, counterBegin, count, minZ, rotation, pX, pY, pZ);
+}
+
+void ParticleRandom::sampleCone(EParticleInstructionSet instructionSet, uint32_t key, uint32_t counterBegin, uint32_t count, float minZ, const glm::mat3& rotation, float* pX, float* pY, float* pZ)
+{
+    ASSERT(ParticleIntegrator::isSupported(instructionSet));
+
+#ifdef SIMD_X86
+    if (instructionSet == EParticleInstructionSet::AVX2) {
+        sampleConeAVX2(key, counterBegin, count, minZ, rotation, pX, pY, pZ);
+        return;
+    }
+#endif
+
+    sampleConeScalar(key, counterBegin, count, minZ, rotation, pX, pY, pZ);
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "Core/Core.h"
+#include "Core/ParticleIntegrator.h"
+
+/*
+    Counter-based random numbers for spawning particles. Value i of a stream is a hash of the stream's key and i,
+    so any range of values can be generated independently, on any thread and in SIMD lanes.
+    The batched functions pick their kernel like ParticleIntegrator and give identical results on every instruction set
+*/
+class ParticleRandom
+{
+public:
+    DECL_STATIC_CLASS(ParticleRandom);
+
+    static uint32_t createKey(uint32_t seed, uint32_t stream);
+
+    static uint32_t generate(uint32_t key, uint32_t counter);
+    // Uniformly distributed in [0, 1)
+    static float generateFloat(uint32_t key, uint32_t counter);
+    // Fills pValues with generateFloat(key, counterBegin + i) for i in [0, count)
+    static void fillFloats(uint32_t key, uint32_t counterBegin, uint32_t count, float* pValues);
+
+    // Unit vectors uniformly distributed within the cone around (0,0,1) where z >= minZ, multiplied by rotation.
+    // Direction i uses the counters 2 * (counterBegin + i) and 2 * (counterBegin + i) + 1
+    static void sampleCone(uint32_t key, uint32_t counterBegin, uint32_t count, float minZ, const glm::mat3& rotation, float* pX, float* pY, float* pZ);
+    // Forces a specific kernel, the instruction set has to be supported. There is no SSE kernel, SSE2 lacks 32-bit multiplies and variable shifts
+    static void sampleCone(EParticleInstructionSet instructionSet, uint32_t key, uint32_t counterBegin, uint32_t count, float minZ, const glm::mat3& rotation, float* pX, float* pY, float* pZ);
+};
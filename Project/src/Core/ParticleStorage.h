@@ -0,0 +1,89 @@
+#pragma once
+
+#include "glm/glm.hpp"
+
+#include "Core/AlignedAllocator.h"
+
+// Particles are stored as a structure of arrays so that the integrator can process several particles per instruction.
+// Every array is SIMD_ALIGNMENT aligned
+struct ParticleStorage {
+    AlignedVector<float> positionsX, positionsY, positionsZ;
+    AlignedVector<float> velocitiesX, velocitiesY, velocitiesZ;
+    AlignedVector<float> ages;
+
+    size_t size() const { return positionsX.size(); }
+
+    // Velocities and ages are only needed by particles that are integrated, not by analytically evaluated ones
+    void resize(size_t newSize, bool storeMotion = true)
+    {
+        size_t motionSize = storeMotion ? newSize : 0;
+
+        positionsX.resize(newSize);
+        positionsY.resize(newSize);
+        positionsZ.resize(newSize);
+        velocitiesX.resize(motionSize);
+        velocitiesY.resize(motionSize);
+        velocitiesZ.resize(motionSize);
+        ages.resize(motionSize);
+    }
+
+    void setPosition(size_t particleIdx, const glm::vec3& position)
+    {
+        positionsX[particleIdx] = position.x;
+        positionsY[particleIdx] = position.y;
+        positionsZ[particleIdx] = position.z;
+    }
+
+    void setVelocity(size_t particleIdx, const glm::vec3& velocity)
+    {
+        velocitiesX[particleIdx] = velocity.x;
+        velocitiesY[particleIdx] = velocity.y;
+        velocitiesZ[particleIdx] = velocity.z;
+    }
+
+    // Every particle of an emitter lives equally long, so particles expire in the order they were spawned and the storage is used as a ring.
+    // Counts the particles from the oldest one onwards, wrapping around at particleCount, that will be at least maxAge old after aging by dt.
+    // Only the expired particles and the first living one are read
+    uint32_t countExpiredParticles(uint32_t oldestParticle, uint32_t particleCount, float dt, float maxAge) const
+    {
+        uint32_t expiredCount = 0;
+        uint32_t particleIdx = oldestParticle;
+
+        while (expiredCount < particleCount && ages[particleIdx] + dt >= maxAge) {
+            expiredCount++;
+            particleIdx = (particleIdx + 1 == particleCount) ? 0 : particleIdx + 1;
+        }
+
+        return expiredCount;
+    }
+
+    // Interleaves particles [begin, end) into the vec4 layout read by the shaders, w is 1 for positions and 0 for velocities
+    void packPositions(glm::vec4* pDestination, size_t begin, size_t end) const
+    {
+        for (size_t particleIdx = begin; particleIdx < end; particleIdx++) {
+            pDestination[particleIdx - begin] = glm::vec4(positionsX[particleIdx], positionsY[particleIdx], positionsZ[particleIdx], 1.0f);
+        }
+    }
+
+    void packVelocities(glm::vec4* pDestination, size_t begin, size_t end) const
+    {
+        for (size_t particleIdx = begin; particleIdx < end; particleIdx++) {
+            pDestination[particleIdx - begin] = glm::vec4(velocitiesX[particleIdx], velocitiesY[particleIdx], velocitiesZ[particleIdx], 0.0f);
+        }
+    }
+
+    // Reverses packPositions and packVelocities, w is ignored
+    void unpackPositions(const glm::vec4* pSource, size_t begin, size_t end)
+    {
+        for (size_t particleIdx = begin; particleIdx < end; particleIdx++) {
+            setPosition(particleIdx, glm::vec3(pSource[particleIdx - begin]));
+        }
+    }
+
+    void unpackVelocities(const glm::vec4* pSource, size_t begin, size_t end)
+    {
+        for (size_t particleIdx = begin; particleIdx < end; particleIdx++) {
+            setVelocity(particleIdx, glm::vec3(pSource[particleIdx - begin]));
+        }
+    }
+};
@@ -0,0 +1,17 @@
+#pragma once
+
+// Intrinsics and per-function target attributes for the SIMD kernels, which are selected at runtime
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+    #define SIMD_X86
+    #include <immintrin.h>
+
+    // MSVC emits any intrinsic without extra flags, GCC and Clang need the target enabled per function
+    #ifdef _MSC_VER
+        #include <intrin.h>
+        #define TARGET_SSE
+        #define TARGET_AVX2
+    #else
+        #define TARGET_SSE __attribute__((target("sse2")))
+        #define TARGET_AVX2 __attribute__((target("avx2")))
+    #endif
+#endif
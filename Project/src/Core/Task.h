@@ -0,0 +1,135 @@
+#pragma once
+#include "Core.h"
+
+#include <new>
+#include <cstddef>
+#include <utility>
+#include <type_traits>
+
+//Callables up to this size are stored inside the task, larger ones are heap allocated
+#define TASK_INLINE_SIZE 64
+
+/*
+	Move-only replacement for std::function<void()> with a larger small buffer,
+	so that the lambdas dispatched every frame never touch the heap
+*/
+class Task
+{
+	struct Operations
+	{
+		void(*pInvoke)(void* pStorage);
+		void(*pMove)(void* pDst, void* pSrc);
+		void(*pDestroy)(void* pStorage);
+	};
+
+public:
+	//True if the callable is stored inside the task, false if emplacing it allocates
+	template<typename Function>
+	static constexpr bool IS_INLINE = (sizeof(Function) <= TASK_INLINE_SIZE) && (alignof(Function) <= alignof(std::max_align_t)) && std::is_nothrow_move_constructible<Function>::value;
+
+	Task()
+		: m_pOperations(nullptr)
+	{
+	}
+
+	template<typename Function, typename = typename std::enable_if<!std::is_same<typename std::decay<Function>::type, Task>::value>::type>
+	Task(Function&& function)
+		: m_pOperations(nullptr)
+	{
+		emplace(std::forward<Function>(function));
+	}
+
+	Task(Task&& other) noexcept
+		: m_pOperations(nullptr)
+	{
+		*this = std::move(other);
+	}
+
+	~Task()
+	{
+		reset();
+	}
+
+	Task(const Task&) = delete;
+	Task& operator=(const Task&) = delete;
+
+	Task& operator=(Task&& other) noexcept
+	{
+		if (this != &other)
+		{
+			reset();
+			if (other.m_pOperations)
+			{
+				other.m_pOperations->pMove(m_Storage, other.m_Storage);
+				m_pOperations = other.m_pOperations;
+				other.m_pOperations = nullptr;
+			}
+		}
+
+		return *this;
+	}
+
+	template<typename Function>
+	void emplace(Function&& function)
+	{
+		typedef typename std::decay<Function>::type FunctionType;
+
+		reset();
+		if constexpr (IS_INLINE<FunctionType>)
+		{
+			new(m_Storage) FunctionType(std::forward<Function>(function));
+			m_pOperations = &s_InlineOperations<FunctionType>;
+		}
+		else
+		{
+			*reinterpret_cast<FunctionType**>(m_Storage) = DBG_NEW FunctionType(std::forward<Function>(function));
+			m_pOperations = &s_HeapOperations<FunctionType>;
+		}
+	}
+
+	void reset()
+	{
+		if (m_pOperations)
+		{
+			m_pOperations->pDestroy(m_Storage);
+			m_pOperations = nullptr;
+		}
+	}
+
+	FORCEINLINE void operator()()
+	{
+		ASSERT(m_pOperations);
+		m_pOperations->pInvoke(m_Storage);
+	}
+
+	FORCEINLINE explicit operator bool() const
+	{
+		return m_pOperations != nullptr;
+	}
+
+private:
+	template<typename Function>
+	static constexpr Operations s_InlineOperations =
+	{
+		[](void* pStorage) { (*reinterpret_cast<Function*>(pStorage))(); },
+		[](void* pDst, void* pSrc)
+		{
+			Function* pFunction = reinterpret_cast<Function*>(pSrc);
+			new(pDst) Function(std::move(*pFunction));
+			pFunction->~Function();
+		},
+		[](void* pStorage) { reinterpret_cast<Function*>(pStorage)->~Function(); }
+	};
+
+	template<typename Function>
+	static constexpr Operations s_HeapOperations =
+	{
+		[](void* pStorage) { (**reinterpret_cast<Function**>(pStorage))(); },
+		[](void* pDst, void* pSrc) { *reinterpret_cast<Function**>(pDst) = *reinterpret_cast<Function**>(pSrc); },
+		[](void* pStorage) { delete *reinterpret_cast<Function**>(pStorage); }
+	};
+
+private:
+	alignas(std::max_align_t) unsigned char m_Storage[TASK_INLINE_SIZE];
+	const Operations* m_pOperations;
+};
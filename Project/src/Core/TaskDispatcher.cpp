@@ -1,26 +1,120 @@
 #include "TaskDispatcher.h"
 
+#include <chrono>
+#include <fstream>
 #include <algorithm>
 
-std::vector<std::thread>			TaskDispatcher::s_Threads;
-std::mutex							TaskDispatcher::s_EventMutex;
-std::atomic<uint64_t>				TaskDispatcher::s_FinishedFence;
-std::condition_variable				TaskDispatcher::s_WakeCondition;
-std::queue<std::function<void()>>	TaskDispatcher::s_TaskQueue;
-uint64_t							TaskDispatcher::s_CurrentFence = 0;
-Spinlock							TaskDispatcher::s_QueueLock;
-bool								TaskDispatcher::s_RunWorkers = true;
+#ifdef _WIN32
+	#define NOMINMAX
+	#define WIN32_LEAN_AND_MEAN
+	#include <Windows.h>
+#else
+	#include <pthread.h>
+	#include <sched.h>
+#endif
 
-bool TaskDispatcher::init()
+std::vector<std::thread>							TaskDispatcher::s_Threads;
+TaskDispatcher::TaskNode							TaskDispatcher::s_TaskArena[TASK_ARENA_SIZE];
+std::atomic<uint32_t>								TaskDispatcher::s_NextArenaNode = 0;
+WorkStealingDeque<TaskDispatcher::TaskNode, TASK_DEQUE_CAPACITY>	TaskDispatcher::s_Deques[MAX_DEQUES];
+uint32_t											TaskDispatcher::s_DequeCount = 0;
+thread_local uint32_t								TaskDispatcher::s_ThreadIndex = INVALID_THREAD_INDEX;
+std::queue<TaskDispatcher::TaskNode*>				TaskDispatcher::s_InjectionQueue;
+Spinlock											TaskDispatcher::s_InjectionLock;
+std::queue<TaskDispatcher::TaskNode*>				TaskDispatcher::s_BackgroundQueue;
+Spinlock											TaskDispatcher::s_BackgroundLock;
+std::atomic<int64_t>								TaskDispatcher::s_QueuedBackgroundTasks = 0;
+std::atomic<uint32_t>								TaskDispatcher::s_ActiveBackgroundTasks = 0;
+uint32_t											TaskDispatcher::s_MaxBackgroundWorkers = 1;
+std::mutex											TaskDispatcher::s_EventMutex;
+std::condition_variable								TaskDispatcher::s_WakeCondition;
+std::atomic<int64_t>								TaskDispatcher::s_QueuedTasks = 0;
+std::atomic<uint32_t>								TaskDispatcher::s_SleepingWorkers = 0;
+std::mutex											TaskDispatcher::s_WaitMutex;
+std::condition_variable								TaskDispatcher::s_WaitCondition;
+std::atomic<uint32_t>								TaskDispatcher::s_ParkedWaiters = 0;
+TaskDispatcher::ThreadCounters						TaskDispatcher::s_ThreadCounters[MAX_COUNTER_SLOTS];
+std::atomic<uint64_t>								TaskDispatcher::s_QueueHighWaterMark = 0;
+std::atomic<uint64_t>								TaskDispatcher::s_HeapAllocations = 0;
+uint64_t											TaskDispatcher::s_StatisticsStart = 0;
+uint64_t											TaskDispatcher::s_TraceStart = 0;
+std::atomic<bool>									TaskDispatcher::s_IsTracing = false;
+std::atomic<uint64_t>								TaskDispatcher::s_FinishedFence = 0;
+std::atomic<uint64_t>								TaskDispatcher::s_CurrentFence = 0;
+std::atomic<bool>									TaskDispatcher::s_RunWorkers = true;
+
+bool TaskDispatcher::init(const TaskDispatcherInfo& info)
 {
-	const uint32_t numThreads = std::min(std::max(1U, std::thread::hardware_concurrency()), MAX_THREADS);
+	const uint32_t coreCount = std::max(1U, std::thread::hardware_concurrency());
+	const bool reserveMainCore = (info.MainThreadCore >= 0 && uint32_t(info.MainThreadCore) < coreCount);
+	if (info.MainThreadCore >= 0 && !reserveMainCore)
+	{
+		LOG("TaskManager: Main thread core %d does not exist, there are %u cores", info.MainThreadCore, coreCount);
+	}
+
+	uint32_t workerCount = info.WorkerCount;
+	if (workerCount == 0)
+	{
+		workerCount = info.WorkerCores.empty() ? coreCount : uint32_t(info.WorkerCores.size());
+		if (reserveMainCore && info.WorkerCores.empty())
+		{
+			workerCount = std::max(1U, workerCount - 1);
+		}
+	}
+
+	const uint32_t numThreads = std::min(workerCount, MAX_THREADS);
 
-	LOG("TaskManager: Starting up %u threads", numThreads);
+	uint32_t maxBackgroundWorkers = info.MaxBackgroundWorkers;
+	if (maxBackgroundWorkers == 0)
+	{
+		maxBackgroundWorkers = std::max(1U, numThreads / 2);
+	}
+
+	s_MaxBackgroundWorkers = std::min(maxBackgroundWorkers, numThreads);
+
+	LOG("TaskManager: Starting up %u threads, at most %u running background tasks", numThreads, s_MaxBackgroundWorkers);
+
+	//The last deque belongs to the thread calling init
+	s_DequeCount	= numThreads + 1;
+	s_ThreadIndex	= numThreads;
+
+	resetStatistics();
+
+	//Without explicit worker cores, workers may run on any core except the reserved one
+	std::vector<uint32_t> workerCores;
+	if (reserveMainCore)
+	{
+		if (!setThreadAffinity(getCurrentThreadHandle(), { uint32_t(info.MainThreadCore) }))
+		{
+			LOG("TaskManager: Failed to pin the main thread to core %d", info.MainThreadCore);
+		}
+
+		for (uint32_t core = 0; core < coreCount; core++)
+		{
+			if (core != uint32_t(info.MainThreadCore))
+			{
+				workerCores.push_back(core);
+			}
+		}
+	}
 
 	s_RunWorkers = true;
 	for (uint32_t i = 0; i < numThreads; i++)
 	{
-		s_Threads.emplace_back(taskThread);
+		s_Threads.emplace_back(taskThread, i);
+
+		if (!info.WorkerCores.empty())
+		{
+			const uint32_t core = info.WorkerCores[i % info.WorkerCores.size()];
+			if (!setThreadAffinity(s_Threads.back().native_handle(), { core }))
+			{
+				LOG("TaskManager: Failed to pin worker %u to core %u", i, core);
+			}
+		}
+		else if (!workerCores.empty())
+		{
+			setThreadAffinity(s_Threads.back().native_handle(), workerCores);
+		}
 	}
 
 	return true;
@@ -28,69 +122,633 @@ bool TaskDispatcher::init()
 
 void TaskDispatcher::release()
 {
-	s_RunWorkers = false;
+	waitForTasks();
+
+	{
+		std::scoped_lock<std::mutex> lock(s_EventMutex);
+		s_RunWorkers = false;
+	}
 	s_WakeCondition.notify_all();
 
-	waitForTasks();
 	for (std::thread& thread : s_Threads)
 	{
 		thread.join();
 	}
+
+	s_Threads.clear();
+	s_DequeCount	= 0;
+	s_ThreadIndex	= INVALID_THREAD_INDEX;
+
+	s_IsTracing = false;
+	for (ThreadCounters& counters : s_ThreadCounters)
+	{
+		delete[] counters.pTraceEvents;
+		counters.pTraceEvents = nullptr;
+	}
 }
 
-void TaskDispatcher::execute(const std::function<void()>& task)
+TaskDispatcherStatistics TaskDispatcher::getStatistics()
 {
-	s_CurrentFence++;
+	constexpr double NANO_TO_MILLI = 1.0 / 1000000.0;
 
+	TaskDispatcherStatistics statistics = {};
+	statistics.WorkerCount			= getWorkerCount();
+	statistics.ThreadCount			= statistics.WorkerCount + 2;
+	statistics.QueueHighWaterMark	= s_QueueHighWaterMark.load(std::memory_order_relaxed);
+	statistics.HeapAllocations		= s_HeapAllocations.load(std::memory_order_relaxed);
+	statistics.ElapsedTime			= double(getTime() - s_StatisticsStart) * NANO_TO_MILLI;
+
+	for (uint32_t i = 0; i < statistics.ThreadCount; i++)
 	{
-		std::scoped_lock<Spinlock> lock(s_QueueLock);
-		s_TaskQueue.push(task);
-		s_WakeCondition.notify_one();
+		//The last entry combines all threads without a deque
+		const ThreadCounters& counters = s_ThreadCounters[i + 1 < statistics.ThreadCount ? i : MAX_DEQUES];
+		TaskThreadStatistics& thread = statistics.Threads[i];
+
+		thread.TasksExecuted	= counters.TasksExecuted.load(std::memory_order_relaxed);
+		thread.TasksStolen		= counters.TasksStolen.load(std::memory_order_relaxed);
+		thread.BusyTime			= double(counters.BusyTime.load(std::memory_order_relaxed)) * NANO_TO_MILLI;
+		thread.IdleTime			= double(counters.IdleTime.load(std::memory_order_relaxed)) * NANO_TO_MILLI;
+		thread.WaitTime			= double(counters.WaitTime.load(std::memory_order_relaxed)) * NANO_TO_MILLI;
+		thread.WaitCount		= counters.WaitCount.load(std::memory_order_relaxed);
+		thread.WaitSpins		= counters.WaitSpins.load(std::memory_order_relaxed);
+		thread.LockSpins		= counters.LockSpins.load(std::memory_order_relaxed);
+	}
+
+	return statistics;
+}
+
+void TaskDispatcher::resetStatistics()
+{
+	for (ThreadCounters& counters : s_ThreadCounters)
+	{
+		counters.TasksExecuted	= 0;
+		counters.TasksStolen	= 0;
+		counters.BusyTime		= 0;
+		counters.IdleTime		= 0;
+		counters.WaitTime		= 0;
+		counters.WaitCount		= 0;
+		counters.WaitSpins		= 0;
+		counters.LockSpins		= 0;
+	}
+
+	s_QueueHighWaterMark	= 0;
+	s_HeapAllocations		= 0;
+	s_StatisticsStart		= getTime();
+}
+
+void TaskDispatcher::beginTrace()
+{
+	//Threads without a deque share counters and are not traced
+	for (uint32_t i = 0; i < MAX_DEQUES; i++)
+	{
+		ThreadCounters& counters = s_ThreadCounters[i];
+		if (!counters.pTraceEvents)
+		{
+			counters.pTraceEvents = DBG_NEW TraceEvent[TRACE_EVENTS_PER_THREAD];
+		}
+
+		counters.TraceEventCount = 0;
+	}
+
+	s_TraceStart = getTime();
+	s_IsTracing.store(true, std::memory_order_release);
+}
+
+bool TaskDispatcher::endTrace(const std::string& fileName)
+{
+	s_IsTracing = false;
+
+	std::ofstream file;
+	file.open(fileName, std::ios::out | std::ios::trunc);
+	if (!file.is_open())
+	{
+		LOG("TaskManager: Failed to open '%s' for writing the trace", fileName.c_str());
+		return false;
+	}
+
+	static const char* s_pEventNames[] = { "Frame critical task", "Background task", "waitForTasks" };
+
+	const uint32_t workerCount = getWorkerCount();
+	bool isFirstEvent = true;
+
+	file << "{\"traceEvents\":[";
+	for (uint32_t threadIndex = 0; threadIndex <= workerCount; threadIndex++)
+	{
+		const ThreadCounters& counters = s_ThreadCounters[threadIndex];
+
+		const std::string threadName = threadIndex < workerCount ? "Worker " + std::to_string(threadIndex) : "Main";
+		file << (isFirstEvent ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << threadIndex << ",\"args\":{\"name\":\"" << threadName << "\"}}";
+		isFirstEvent = false;
+
+		if (!counters.pTraceEvents)
+		{
+			continue;
+		}
+
+		const uint32_t eventCount = std::min(counters.TraceEventCount.load(std::memory_order_acquire), TRACE_EVENTS_PER_THREAD);
+		for (uint32_t i = 0; i < eventCount; i++)
+		{
+			const TraceEvent& event = counters.pTraceEvents[i];
+
+			//Timestamps are in microseconds
+			const double start		= double(event.Start - s_TraceStart) / 1000.0;
+			const double duration	= double(event.Duration) / 1000.0;
+			file << ",\n{\"name\":\"" << s_pEventNames[uint32_t(event.Type)] << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << threadIndex << ",\"ts\":" << start << ",\"dur\":" << duration << "}";
+		}
+
+		if (counters.TraceEventCount.load(std::memory_order_relaxed) > TRACE_EVENTS_PER_THREAD)
+		{
+			LOG("TaskManager: Thread %u recorded more than %u events, the trace is incomplete", threadIndex, TRACE_EVENTS_PER_THREAD);
+		}
 	}
+	file << "\n]}\n";
+	file.close();
+
+	LOG("TaskManager: Wrote trace to '%s'", fileName.c_str());
+	return true;
+}
+
+
+TaskDispatcher::TaskNode* TaskDispatcher::allocateNode()
+{
+	//Nodes are released in roughly the order they were taken, so the next slots in the ring are most likely free
+	const uint32_t start = s_NextArenaNode.fetch_add(1, std::memory_order_relaxed);
+	for (uint32_t i = 0; i < TASK_ARENA_SEARCH_LENGTH; i++)
+	{
+		TaskNode* pNode = &s_TaskArena[(start + i) % TASK_ARENA_SIZE];
+		if (!pNode->IsUsed.load(std::memory_order_relaxed) && !pNode->IsUsed.exchange(true, std::memory_order_acquire))
+		{
+			return pNode;
+		}
+	}
+
+	//The arena is full, the node is deleted when the task has run
+	s_HeapAllocations.fetch_add(1, std::memory_order_relaxed);
+	TaskNode* pNode = DBG_NEW TaskNode();
+	pNode->IsUsed = true;
+	return pNode;
+}
+
+void TaskDispatcher::freeNode(TaskNode* pNode)
+{
+	pNode->Function.reset();
+	pNode->pGroup = nullptr;
+
+	if (pNode >= s_TaskArena && pNode < s_TaskArena + TASK_ARENA_SIZE)
+	{
+		pNode->IsUsed.store(false, std::memory_order_release);
+	}
+	else
+	{
+		SAFEDELETE(pNode);
+	}
+}
+
+void TaskDispatcher::submit(TaskNode* pNode)
+{
+	s_CurrentFence++;
+	if (pNode->pGroup)
+	{
+		pNode->pGroup->m_PendingTasks.fetch_add(1);
+	}
+
+	pushTask(pNode);
 }
 
 void TaskDispatcher::waitForTasks()
 {
-	while (!isFinished())
+	helpUntil([] { return isFinished(); });
+}
+
+void TaskDispatcher::waitForTasks(const TaskGroup& group)
+{
+	helpUntil([&group] { return group.isFinished(); });
+}
+
+void TaskDispatcher::pushTask(TaskNode* pNode)
+{
+	if (pNode->Priority == ETaskPriority::BACKGROUND)
+	{
+		lockQueue(s_BackgroundLock);
+		s_BackgroundQueue.push(pNode);
+		s_BackgroundLock.unlock();
+
+		s_QueuedBackgroundTasks.fetch_add(1);
+		updateQueueHighWaterMark();
+		wakeWorker();
+		return;
+	}
+
+	const uint32_t threadIndex = s_ThreadIndex;
+	if (threadIndex == INVALID_THREAD_INDEX || !s_Deques[threadIndex].push(pNode))
 	{
-		poll();
+		lockQueue(s_InjectionLock);
+		s_InjectionQueue.push(pNode);
+		s_InjectionLock.unlock();
 	}
+
+	s_QueuedTasks.fetch_add(1);
+	updateQueueHighWaterMark();
+	wakeWorker();
 }
 
-bool TaskDispatcher::poptask(std::function<void()>& task)
+TaskDispatcher::TaskNode* TaskDispatcher::popTask(uint32_t threadIndex, bool allowBackground)
 {
-	std::scoped_lock<Spinlock> lock(s_QueueLock);
-	if (!s_TaskQueue.empty())
+	//Counts the frame critical tasks this thread has run since it last ran a background task
+	thread_local uint32_t criticalStreak = 0;
+
+	TaskNode* pNode = nullptr;
+	if (allowBackground && criticalStreak >= BACKGROUND_STARVATION_LIMIT)
 	{
-		task = s_TaskQueue.front();
-		s_TaskQueue.pop();
+		pNode = popBackgroundTask();
+		if (pNode)
+		{
+			criticalStreak = 0;
+			return pNode;
+		}
+	}
 
-		return true;
+	pNode = popCriticalTask(threadIndex);
+	if (pNode)
+	{
+		criticalStreak++;
+		return pNode;
+	}
+
+	if (allowBackground)
+	{
+		pNode = popBackgroundTask();
+		criticalStreak = 0;
+	}
+
+	return pNode;
+}
+
+TaskDispatcher::TaskNode* TaskDispatcher::popCriticalTask(uint32_t threadIndex)
+{
+	//Threads that were not started by the dispatcher, or init, do not own a deque
+	TaskNode* pNode = nullptr;
+	if (threadIndex != INVALID_THREAD_INDEX)
+	{
+		pNode = s_Deques[threadIndex].pop();
+		if (pNode)
+		{
+			return pNode;
+		}
+	}
+
+	if (s_InjectionLock.try_lock())
+	{
+		if (!s_InjectionQueue.empty())
+		{
+			pNode = s_InjectionQueue.front();
+			s_InjectionQueue.pop();
+		}
+
+		s_InjectionLock.unlock();
+	}
+
+	if (pNode)
+	{
+		return pNode;
+	}
+
+	pNode = stealTask(threadIndex);
+	if (pNode)
+	{
+		getThreadCounters().TasksStolen.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	return pNode;
+}
+
+TaskDispatcher::TaskNode* TaskDispatcher::popBackgroundTask()
+{
+	if (s_QueuedBackgroundTasks.load(std::memory_order_relaxed) <= 0)
+	{
+		return nullptr;
+	}
+
+	//Reserve one of the background workers before taking the task
+	uint32_t activeTasks = s_ActiveBackgroundTasks.load(std::memory_order_relaxed);
+	do
+	{
+		if (activeTasks >= s_MaxBackgroundWorkers)
+		{
+			return nullptr;
+		}
+	} while (!s_ActiveBackgroundTasks.compare_exchange_weak(activeTasks, activeTasks + 1));
+
+	TaskNode* pNode = nullptr;
+	lockQueue(s_BackgroundLock);
+	if (!s_BackgroundQueue.empty())
+	{
+		pNode = s_BackgroundQueue.front();
+		s_BackgroundQueue.pop();
+	}
+	s_BackgroundLock.unlock();
+
+	if (pNode)
+	{
+		s_QueuedBackgroundTasks.fetch_sub(1);
+	}
+	else
+	{
+		s_ActiveBackgroundTasks.fetch_sub(1);
+	}
+
+	return pNode;
+}
+
+TaskDispatcher::TaskNode* TaskDispatcher::stealTask(uint32_t threadIndex)
+{
+	//Xorshift, start at a random victim so that thieves spread out
+	thread_local uint32_t seed = 0x9E3779B9U ^ (threadIndex * 0x85EBCA6BU);
+	seed ^= seed << 13;
+	seed ^= seed >> 17;
+	seed ^= seed << 5;
+
+	const uint32_t dequeCount = s_DequeCount;
+	if (dequeCount == 0)
+	{
+		return nullptr;
+	}
+
+	const uint32_t start = seed % dequeCount;
+	for (uint32_t i = 0; i < dequeCount; i++)
+	{
+		const uint32_t victim = (start + i) % dequeCount;
+		if (victim == threadIndex)
+		{
+			continue;
+		}
+
+		TaskNode* pNode = s_Deques[victim].steal();
+		if (pNode)
+		{
+			return pNode;
+		}
+	}
+
+	return nullptr;
+}
+
+void TaskDispatcher::runTask(TaskNode* pNode)
+{
+	const bool isBackground = (pNode->Priority == ETaskPriority::BACKGROUND);
+	if (!isBackground)
+	{
+		s_QueuedTasks.fetch_sub(1, std::memory_order_relaxed);
+	}
+
+	const uint64_t startTime = getTime();
+
+	//Destroy the captures before the group finishes, they may reference the waiting thread's stack
+	TaskGroup* pGroup = pNode->pGroup;
+	pNode->Function();
+	freeNode(pNode);
+
+	const uint64_t endTime = getTime();
+
+	ThreadCounters& counters = getThreadCounters();
+	counters.TasksExecuted.fetch_add(1, std::memory_order_relaxed);
+	counters.BusyTime.fetch_add(endTime - startTime, std::memory_order_relaxed);
+	recordTraceEvent(counters, isBackground ? ETraceEvent::BACKGROUND_TASK : ETraceEvent::CRITICAL_TASK, startTime, endTime);
+
+	if (isBackground)
+	{
+		//Frees up a background worker, hand it to the next waiting background task
+		s_ActiveBackgroundTasks.fetch_sub(1);
+		if (s_QueuedBackgroundTasks.load() > 0)
+		{
+			wakeWorker();
+		}
+	}
+
+	if (pGroup)
+	{
+		pGroup->m_PendingTasks.fetch_sub(1);
+	}
+
+	s_FinishedFence.fetch_add(1);
+
+	//Sequentially consistent so that either a parking waiter sees the finished task, or we see the waiter
+	if (s_ParkedWaiters.load() > 0)
+	{
+		std::scoped_lock<std::mutex> lock(s_WaitMutex);
+		s_WaitCondition.notify_all();
+	}
+}
+
+bool TaskDispatcher::claimChunk(std::atomic<uint32_t>& cursor, uint32_t end, uint32_t grainSize, uint32_t threadCount, uint32_t& chunkBegin, uint32_t& chunkEnd)
+{
+	uint32_t current = cursor.load(std::memory_order_relaxed);
+	while (current < end)
+	{
+		//Guided scheduling, take half of an even share of what is left so that the last chunks are small enough to balance the threads
+		const uint32_t remaining	= end - current;
+		const uint32_t chunkSize	= std::min(remaining, std::max(grainSize, remaining / (2 * threadCount)));
+		if (cursor.compare_exchange_weak(current, current + chunkSize, std::memory_order_relaxed))
+		{
+			chunkBegin	= current;
+			chunkEnd	= current + chunkSize;
+			return true;
+		}
 	}
 
 	return false;
 }
 
-void TaskDispatcher::poll()
+template<typename Predicate>
+void TaskDispatcher::helpUntil(Predicate isDone)
 {
-	s_WakeCondition.notify_one();
-	std::this_thread::yield();
+	const uint32_t threadIndex = s_ThreadIndex;
+	ThreadCounters& counters = getThreadCounters();
+	const uint64_t startTime = getTime();
+
+	uint32_t spinCount = 0;
+	while (!isDone())
+	{
+		TaskNode* pNode = popTask(threadIndex, false);
+		if (pNode)
+		{
+			runTask(pNode);
+			spinCount = 0;
+		}
+		else if (spinCount < WAIT_SPIN_COUNT)
+		{
+			spinCount++;
+			counters.WaitSpins.fetch_add(1, std::memory_order_relaxed);
+			std::this_thread::yield();
+		}
+		else
+		{
+			//Nothing left to steal, the remaining tasks are running on other threads. Wake up when one of them finishes
+			const uint64_t parkTime = getTime();
+			{
+				std::unique_lock<std::mutex> lock(s_WaitMutex);
+				s_ParkedWaiters.fetch_add(1);
+				s_WaitCondition.wait(lock, [&isDone] { return isDone() || s_QueuedTasks.load() > 0; });
+				s_ParkedWaiters.fetch_sub(1);
+			}
+			counters.IdleTime.fetch_add(getTime() - parkTime, std::memory_order_relaxed);
+
+			spinCount = 0;
+		}
+	}
+
+	const uint64_t endTime = getTime();
+	counters.WaitTime.fetch_add(endTime - startTime, std::memory_order_relaxed);
+	counters.WaitCount.fetch_add(1, std::memory_order_relaxed);
+	recordTraceEvent(counters, ETraceEvent::WAIT, startTime, endTime);
+}
+
+TaskDispatcher::ThreadCounters& TaskDispatcher::getThreadCounters()
+{
+	const uint32_t threadIndex = s_ThreadIndex;
+	return s_ThreadCounters[threadIndex == INVALID_THREAD_INDEX ? MAX_DEQUES : threadIndex];
 }
 
-void TaskDispatcher::taskThread()
+void TaskDispatcher::lockQueue(Spinlock& lock)
 {
+	uint64_t spinCount = 0;
+	while (!lock.try_lock())
+	{
+		spinCount++;
+	}
+
+	if (spinCount > 0)
+	{
+		getThreadCounters().LockSpins.fetch_add(spinCount, std::memory_order_relaxed);
+	}
+}
+
+void TaskDispatcher::updateQueueHighWaterMark()
+{
+	const int64_t queuedTasks = s_QueuedTasks.load(std::memory_order_relaxed) + s_QueuedBackgroundTasks.load(std::memory_order_relaxed);
+	if (queuedTasks <= 0)
+	{
+		return;
+	}
+
+	uint64_t highWaterMark = s_QueueHighWaterMark.load(std::memory_order_relaxed);
+	while (uint64_t(queuedTasks) > highWaterMark && !s_QueueHighWaterMark.compare_exchange_weak(highWaterMark, uint64_t(queuedTasks), std::memory_order_relaxed));
+}
+
+void TaskDispatcher::recordTraceEvent(ThreadCounters& counters, ETraceEvent type, uint64_t start, uint64_t end)
+{
+	if (!s_IsTracing.load(std::memory_order_acquire) || !counters.pTraceEvents)
+	{
+		return;
+	}
+
+	const uint32_t eventIndex = counters.TraceEventCount.load(std::memory_order_relaxed);
+	if (eventIndex < TRACE_EVENTS_PER_THREAD)
+	{
+		TraceEvent& event = counters.pTraceEvents[eventIndex];
+		event.Start		= start;
+		event.Duration	= end - start;
+		event.Type		= type;
+	}
+
+	//Keeps counting past the end so that endTrace can tell that events were dropped
+	counters.TraceEventCount.store(eventIndex + 1, std::memory_order_release);
+}
+
+uint64_t TaskDispatcher::getTime()
+{
+	return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now().time_since_epoch()).count());
+}
+
+bool TaskDispatcher::setThreadAffinity(std::thread::native_handle_type thread, const std::vector<uint32_t>& cores)
+{
+	const uint32_t coreCount = std::max(1U, std::thread::hardware_concurrency());
+	for (uint32_t core : cores)
+	{
+		if (core >= coreCount)
+		{
+			LOG("TaskManager: Core %u does not exist, there are %u cores", core, coreCount);
+			return false;
+		}
+	}
+
+#ifdef _WIN32
+	//Affinity masks only cover the first processor group
+	DWORD_PTR mask = 0;
+	for (uint32_t core : cores)
+	{
+		if (core >= sizeof(DWORD_PTR) * 8)
+		{
+			return false;
+		}
+
+		mask |= DWORD_PTR(1) << core;
+	}
+
+	return SetThreadAffinityMask(thread, mask) != 0;
+#else
+	cpu_set_t cpuSet;
+	CPU_ZERO(&cpuSet);
+	for (uint32_t core : cores)
+	{
+		CPU_SET(core, &cpuSet);
+	}
+
+	return pthread_setaffinity_np(thread, sizeof(cpu_set_t), &cpuSet) == 0;
+#endif
+}
+
+std::thread::native_handle_type TaskDispatcher::getCurrentThreadHandle()
+{
+#ifdef _WIN32
+	return GetCurrentThread();
+#else
+	return pthread_self();
+#endif
+}
+
+bool TaskDispatcher::hasRunnableTasks()
+{
+	//Queued background tasks can not run while the background workers are all busy
+	return s_QueuedTasks.load() > 0 || (s_QueuedBackgroundTasks.load() > 0 && s_ActiveBackgroundTasks.load() < s_MaxBackgroundWorkers);
+}
+
+void TaskDispatcher::wakeWorker()
+{
+	//Sequentially consistent so that either a worker going to sleep sees the new task, or we see the sleeping worker
+	if (s_SleepingWorkers.load() > 0)
+	{
+		std::scoped_lock<std::mutex> lock(s_EventMutex);
+		s_WakeCondition.notify_one();
+	}
+}
+
+void TaskDispatcher::taskThread(uint32_t threadIndex)
+{
+	s_ThreadIndex = threadIndex;
+
 	while (shouldRunWorker())
 	{
-		std::function<void()> task;
-		if (poptask(task))
+		TaskNode* pNode = popTask(threadIndex, true);
+		if (pNode)
+		{
+			runTask(pNode);
+		}
+		else if (!hasRunnableTasks())
 		{
-			task();
-			s_FinishedFence.fetch_add(1);
+			const uint64_t sleepTime = getTime();
+			{
+				std::unique_lock<std::mutex> lock(s_EventMutex);
+				s_SleepingWorkers.fetch_add(1);
+				s_WakeCondition.wait(lock, [] { return hasRunnableTasks() || !shouldRunWorker(); });
+				s_SleepingWorkers.fetch_sub(1);
+			}
+			getThreadCounters().IdleTime.fetch_add(getTime() - sleepTime, std::memory_order_relaxed);
 		}
 		else
 		{
-			std::unique_lock<std::mutex> lock(s_EventMutex);
-			s_WakeCondition.wait(lock);
+			//Tasks are queued but we lost the race for them, try again
+			std::this_thread::yield();
 		}
 	}
 
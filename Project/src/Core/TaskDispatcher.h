@@ -1,7 +1,10 @@
 #pragma once
+#include "Task.h"
 #include "Spinlock.h"
+#include "WorkStealingDeque.h"
 
 #include <queue>
+#include <string>
 #include <mutex>
 #include <vector>
 #include <atomic>
@@ -10,23 +13,239 @@
 #include <condition_variable>
 
 #define MAX_THREADS 16U
+#define TASK_DEQUE_CAPACITY 4096U
+//Tasks are taken from a ring of preallocated nodes, large enough for everything dispatched during a frame
+#define TASK_ARENA_SIZE 1024U
+#define TASK_ARENA_SEARCH_LENGTH 16U
+//A worker that has run this many frame critical tasks in a row takes a background task first, if one is waiting
+#define BACKGROUND_STARVATION_LIMIT 32U
+//Number of failed attempts to find a task before a waiting thread parks
+#define WAIT_SPIN_COUNT 64U
+//Number of task and wait events each thread can record while a trace is running, later events are dropped
+#define TRACE_EVENTS_PER_THREAD 16384U
+
+enum class ETaskPriority : uint32_t
+{
+	FRAME_CRITICAL	= 0,	//Work the current frame waits for, e.g. command buffer recording
+	BACKGROUND		= 1		//Streaming and loading, e.g. texture decoding. Runs on a limited number of workers
+};
+
+struct TaskDispatcherInfo
+{
+	//0 uses one worker per hardware thread, minus the main thread's core if it is reserved. Clamped to MAX_THREADS
+	uint32_t WorkerCount			= 0;
+	//0 lets background tasks occupy at most half of the workers
+	uint32_t MaxBackgroundWorkers	= 0;
+	//Core the thread calling init is pinned to, workers will not be scheduled on it. -1 disables pinning
+	int32_t MainThreadCore			= -1;
+	//Worker i is pinned to WorkerCores[i % size]. Empty lets the OS schedule the workers
+	std::vector<uint32_t> WorkerCores;
+};
+
+//Times are in milliseconds
+struct TaskThreadStatistics
+{
+	uint64_t TasksExecuted	= 0;
+	uint64_t TasksStolen	= 0;
+	double BusyTime			= 0.0;
+	//Time spent asleep or parked because there was nothing to run
+	double IdleTime			= 0.0;
+	//Time spent in waitForTasks, including running tasks while waiting
+	double WaitTime			= 0.0;
+	uint64_t WaitCount		= 0;
+	//Failed attempts to find a task in waitForTasks before parking
+	uint64_t WaitSpins		= 0;
+	//Failed attempts to take the injection or background queue locks
+	uint64_t LockSpins		= 0;
+};
+
+struct TaskDispatcherStatistics
+{
+	//Workers first, then the thread that called init, then all other threads combined
+	TaskThreadStatistics Threads[MAX_THREADS + 2];
+	uint32_t ThreadCount		= 0;
+	uint32_t WorkerCount		= 0;
+	//Most tasks queued at the same time, both lanes combined
+	uint64_t QueueHighWaterMark	= 0;
+	//Task nodes allocated because the arena was full, and callables too large to be stored inside their task
+	uint64_t HeapAllocations	= 0;
+	//Time since the statistics were reset
+	double ElapsedTime			= 0.0;
+};
+
+//Counts the unfinished tasks submitted with it, so that a caller can wait for its own tasks only
+class TaskGroup
+{
+	friend class TaskDispatcher;
+
+public:
+	TaskGroup()
+		: m_PendingTasks(0)
+	{
+	}
+
+	~TaskGroup() = default;
+
+	DECL_NO_COPY(TaskGroup);
+
+	FORCEINLINE bool isFinished() const
+	{
+		return m_PendingTasks.load() == 0;
+	}
+
+private:
+	std::atomic<uint32_t> m_PendingTasks;
+};
 
 class TaskDispatcher
 {
+	struct TaskNode
+	{
+		Task Function;
+		TaskGroup* pGroup = nullptr;
+		ETaskPriority Priority = ETaskPriority::FRAME_CRITICAL;
+		std::atomic<bool> IsUsed = false;
+	};
+
+	enum class ETraceEvent : uint32_t
+	{
+		CRITICAL_TASK	= 0,
+		BACKGROUND_TASK	= 1,
+		WAIT			= 2
+	};
+
+	struct TraceEvent
+	{
+		uint64_t Start;
+		uint64_t Duration;
+		ETraceEvent Type;
+	};
+
+	//Written by one thread only, except for the slot shared by threads that do not own a deque
+	struct alignas(CACHE_LINE_SIZE) ThreadCounters
+	{
+		std::atomic<uint64_t> TasksExecuted = 0;
+		std::atomic<uint64_t> TasksStolen	= 0;
+		std::atomic<uint64_t> BusyTime		= 0;
+		std::atomic<uint64_t> IdleTime		= 0;
+		std::atomic<uint64_t> WaitTime		= 0;
+		std::atomic<uint64_t> WaitCount		= 0;
+		std::atomic<uint64_t> WaitSpins		= 0;
+		std::atomic<uint64_t> LockSpins		= 0;
+
+		TraceEvent* pTraceEvents = nullptr;
+		std::atomic<uint32_t> TraceEventCount = 0;
+	};
+
+	//One deque per worker plus one for the thread that called init
+	static constexpr uint32_t MAX_DEQUES = MAX_THREADS + 1;
+	static constexpr uint32_t INVALID_THREAD_INDEX = UINT32_MAX;
+	//Counters for threads without a deque are shared
+	static constexpr uint32_t MAX_COUNTER_SLOTS = MAX_DEQUES + 1;
+
 public:
 	DECL_STATIC_CLASS(TaskDispatcher);
 
-	static bool init();
+	static bool init(const TaskDispatcherInfo& info = {});
 	static void release();
 
-	//Excutes a task in a seperate thread
-	static void execute(const std::function<void()>& task);
-	//Makes sure that all queued up tasks have been completed
+	//Excutes a task in a seperate thread. If a group is given it has to outlive the task
+	template<typename Function>
+	static void execute(Function&& function, TaskGroup* pGroup = nullptr, ETaskPriority priority = ETaskPriority::FRAME_CRITICAL)
+	{
+		if constexpr (!Task::IS_INLINE<typename std::decay<Function>::type>)
+		{
+			s_HeapAllocations.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		TaskNode* pNode = allocateNode();
+		pNode->Function.emplace(std::forward<Function>(function));
+		pNode->pGroup	= pGroup;
+		pNode->Priority	= priority;
+		submit(pNode);
+	}
+
+	//Calls function(chunkBegin, chunkEnd) for chunks covering [begin, end) and returns when all of them are done.
+	//Chunks start large and shrink towards grainSize as the range runs out, the calling thread takes part
+	template<typename Function>
+	static void parallelFor(uint32_t begin, uint32_t end, uint32_t grainSize, const Function& function)
+	{
+		if (begin >= end)
+		{
+			return;
+		}
+
+		grainSize = std::max(grainSize, 1U);
+		const uint32_t threadCount	= getWorkerCount() + 1;
+		const uint32_t chunkCount	= (end - begin + grainSize - 1) / grainSize;
+		const uint32_t taskCount	= std::min(threadCount, chunkCount) - 1;
+		if (taskCount == 0)
+		{
+			function(begin, end);
+			return;
+		}
+
+		std::atomic<uint32_t> cursor = begin;
+		auto runChunks = [&]
+		{
+			uint32_t chunkBegin = 0;
+			uint32_t chunkEnd	= 0;
+			while (claimChunk(cursor, end, grainSize, threadCount, chunkBegin, chunkEnd))
+			{
+				function(chunkBegin, chunkEnd);
+			}
+		};
+
+		TaskGroup chunkTasks;
+		for (uint32_t i = 0; i < taskCount; i++)
+		{
+			execute([&runChunks] { runChunks(); }, &chunkTasks);
+		}
+
+		runChunks();
+		waitForTasks(chunkTasks);
+	}
+
+	//Combines reduceRange(chunkBegin, chunkEnd) of every chunk in [begin, end) with combine(a, b), starting from identity.
+	//The order the chunks are combined in varies, so combine should be associative and commutative
+	template<typename T, typename ReduceFunction, typename CombineFunction>
+	static T parallelReduce(uint32_t begin, uint32_t end, uint32_t grainSize, const T& identity, const ReduceFunction& reduceRange, const CombineFunction& combine)
+	{
+		T result = identity;
+		Spinlock resultLock;
+
+		parallelFor(begin, end, grainSize, [&](uint32_t chunkBegin, uint32_t chunkEnd)
+			{
+				T partial = reduceRange(chunkBegin, chunkEnd);
+
+				std::scoped_lock<Spinlock> lock(resultLock);
+				result = combine(result, partial);
+			});
+
+		return result;
+	}
+
+	//Makes sure that all queued up tasks have been completed. The calling thread runs queued tasks while waiting
 	static void waitForTasks();
+	//Makes sure that all tasks submitted with the group have been completed, other tasks may still be running
+	static void waitForTasks(const TaskGroup& group);
+
+	//Counters are gathered all the time, the trace only records events between beginTrace and endTrace
+	static TaskDispatcherStatistics getStatistics();
+	static void resetStatistics();
+
+	static void beginTrace();
+	//Writes the events recorded since beginTrace as a chrome://tracing JSON file
+	static bool endTrace(const std::string& fileName);
+
+	static FORCEINLINE bool isTracing()
+	{
+		return s_IsTracing.load(std::memory_order_relaxed);
+	}
 
 	static FORCEINLINE bool isFinished()
 	{
-		return (s_CurrentFence <= s_FinishedFence.load());
+		return (s_CurrentFence.load() <= s_FinishedFence.load());
 	}
 
 	static FORCEINLINE bool shouldRunWorker()
@@ -34,24 +253,86 @@ public:
 		return s_RunWorkers;
 	}
 
+	static FORCEINLINE uint32_t getWorkerCount()
+	{
+		return uint32_t(s_Threads.size());
+	}
+
 private:
-	static bool poptask(std::function<void()>& task);
-	static void poll();
+	static TaskNode* allocateNode();
+	static void freeNode(TaskNode* pNode);
+
+	static void submit(TaskNode* pNode);
+	static void pushTask(TaskNode* pNode);
+	//Background tasks are only taken by workers, threads waiting for a frame should not get stuck in a long load
+	static TaskNode* popTask(uint32_t threadIndex, bool allowBackground);
+	static TaskNode* popCriticalTask(uint32_t threadIndex);
+	static TaskNode* popBackgroundTask();
+	static TaskNode* stealTask(uint32_t threadIndex);
+	static void runTask(TaskNode* pNode);
+
+	//Claims the next chunk of a parallelFor, returns false when the range is exhausted
+	static bool claimChunk(std::atomic<uint32_t>& cursor, uint32_t end, uint32_t grainSize, uint32_t threadCount, uint32_t& chunkBegin, uint32_t& chunkEnd);
+
+	//Runs queued tasks until isDone returns true, spins and then parks when there is nothing to run
+	template<typename Predicate>
+	static void helpUntil(Predicate isDone);
+
+	static ThreadCounters& getThreadCounters();
+	static void lockQueue(Spinlock& lock);
+	static void updateQueueHighWaterMark();
+	static void recordTraceEvent(ThreadCounters& counters, ETraceEvent type, uint64_t start, uint64_t end);
+	static uint64_t getTime();
+
+	//Returns false if the cores are invalid or the OS refused, the thread is then left unpinned
+	static bool setThreadAffinity(std::thread::native_handle_type thread, const std::vector<uint32_t>& cores);
+	static std::thread::native_handle_type getCurrentThreadHandle();
+
+	static bool hasRunnableTasks();
+	static void wakeWorker();
 
-	static void taskThread();
+	static void taskThread(uint32_t threadIndex);
 
 private:
 	static std::vector<std::thread> s_Threads;
 
-	static std::queue<std::function<void()>> s_TaskQueue;
-	static Spinlock s_QueueLock;
-	
+	static TaskNode s_TaskArena[TASK_ARENA_SIZE];
+	static std::atomic<uint32_t> s_NextArenaNode;
+
+	static WorkStealingDeque<TaskNode, TASK_DEQUE_CAPACITY> s_Deques[MAX_DEQUES];
+	static uint32_t s_DequeCount;
+	static thread_local uint32_t s_ThreadIndex;
+
+	//Used by threads without a deque and when a deque is full
+	static std::queue<TaskNode*> s_InjectionQueue;
+	static Spinlock s_InjectionLock;
+
+	//Background lane, first in first out
+	static std::queue<TaskNode*> s_BackgroundQueue;
+	static Spinlock s_BackgroundLock;
+	static std::atomic<int64_t> s_QueuedBackgroundTasks;
+	static std::atomic<uint32_t> s_ActiveBackgroundTasks;
+	static uint32_t s_MaxBackgroundWorkers;
+
 	static std::mutex s_EventMutex;
 	static std::condition_variable s_WakeCondition;
-	
+	static std::atomic<int64_t> s_QueuedTasks;
+	static std::atomic<uint32_t> s_SleepingWorkers;
+
+	//Threads parked in waitForTasks, woken up when a task finishes
+	static std::mutex s_WaitMutex;
+	static std::condition_variable s_WaitCondition;
+	static std::atomic<uint32_t> s_ParkedWaiters;
+
+	static ThreadCounters s_ThreadCounters[MAX_COUNTER_SLOTS];
+	static std::atomic<uint64_t> s_QueueHighWaterMark;
+	static std::atomic<uint64_t> s_HeapAllocations;
+	static uint64_t s_StatisticsStart;
+	static uint64_t s_TraceStart;
+	static std::atomic<bool> s_IsTracing;
+
 	static std::atomic<uint64_t> s_FinishedFence;
-	static uint64_t s_CurrentFence;
-	
-	static bool s_RunWorkers;
-};
+	static std::atomic<uint64_t> s_CurrentFence;
 
+	static std::atomic<bool> s_RunWorkers;
+};
@@ -0,0 +1,119 @@
+#pragma once
+#include "Core.h"
+
+#include <atomic>
+
+#define CACHE_LINE_SIZE 64
+
+/*
+	Fixed size Chase-Lev deque, see "Correct and Efficient Work-Stealing for Weak Memory Models" (Le et al. 2013).
+	The owning thread pushes and pops at the bottom, any other thread may steal from the top.
+*/
+template<typename T, uint32_t CAPACITY>
+class WorkStealingDeque
+{
+	static_assert((CAPACITY & (CAPACITY - 1)) == 0, "WorkStealingDeque capacity has to be a power of two");
+
+public:
+	WorkStealingDeque()
+		: m_Top(0),
+		m_Bottom(0)
+	{
+		for (uint32_t i = 0; i < CAPACITY; i++)
+		{
+			m_Items[i].store(nullptr, std::memory_order_relaxed);
+		}
+	}
+
+	~WorkStealingDeque() = default;
+
+	DECL_NO_COPY(WorkStealingDeque);
+
+	//Owner only. Returns false if the deque is full
+	bool push(T* pItem)
+	{
+		const int64_t bottom	= m_Bottom.load(std::memory_order_relaxed);
+		const int64_t top		= m_Top.load(std::memory_order_acquire);
+		if (bottom - top >= int64_t(CAPACITY))
+		{
+			return false;
+		}
+
+		m_Items[bottom & MASK].store(pItem, std::memory_order_relaxed);
+		m_Bottom.store(bottom + 1, std::memory_order_release);
+		return true;
+	}
+
+	//Owner only
+	T* pop()
+	{
+		const int64_t bottom = m_Bottom.load(std::memory_order_relaxed) - 1;
+		m_Bottom.store(bottom, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t top = m_Top.load(std::memory_order_relaxed);
+
+		if (top > bottom)
+		{
+			//Empty
+			m_Bottom.store(bottom + 1, std::memory_order_relaxed);
+			return nullptr;
+		}
+
+		T* pItem = m_Items[bottom & MASK].load(std::memory_order_relaxed);
+		if (top == bottom)
+		{
+			//Last item, race against thieves
+			if (!m_Top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			{
+				pItem = nullptr;
+			}
+
+			m_Bottom.store(bottom + 1, std::memory_order_relaxed);
+		}
+
+		return pItem;
+	}
+
+	//Any thread
+	T* steal()
+	{
+		int64_t top = m_Top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		const int64_t bottom = m_Bottom.load(std::memory_order_acquire);
+
+		if (top >= bottom)
+		{
+			return nullptr;
+		}
+
+		T* pItem = m_Items[top & MASK].load(std::memory_order_relaxed);
+		if (!m_Top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+		{
+			//Lost the race to another thief or the owner
+			return nullptr;
+		}
+
+		return pItem;
+	}
+
+	//Approximate, only valid as a hint when called from other threads than the owner
+	FORCEINLINE uint32_t size() const
+	{
+		const int64_t bottom	= m_Bottom.load(std::memory_order_relaxed);
+		const int64_t top		= m_Top.load(std::memory_order_relaxed);
+		return bottom > top ? uint32_t(bottom - top) : 0;
+	}
+
+	FORCEINLINE bool empty() const
+	{
+		return size() == 0;
+	}
+
+private:
+	static constexpr int64_t MASK = int64_t(CAPACITY) - 1;
+
+	//Thieves and the owner touch different ends, keep them on separate cache lines
+	alignas(CACHE_LINE_SIZE) std::atomic<int64_t> m_Top;
+	alignas(CACHE_LINE_SIZE) std::atomic<int64_t> m_Bottom;
+	alignas(CACHE_LINE_SIZE) std::atomic<T*> m_Items[CAPACITY];
+};
@@ -4,8 +4,9 @@
 BufferVK::BufferVK(DeviceVK* pDevice)
 	: m_pDevice(pDevice),
 	m_Buffer(VK_NULL_HANDLE),
-	m_Memory(VK_NULL_HANDLE),
+	m_Allocation(),
 	m_Params(),
+	m_MemoryProperties(0),
 	m_IsMapped(false)
 {
 }
@@ -23,11 +24,7 @@ BufferVK::~BufferVK()
 		m_Buffer = VK_NULL_HANDLE;
 	}
 
-	if (m_Memory != VK_NULL_HANDLE)
-	{
-		vkFreeMemory(m_pDevice->getDevice(), m_Memory, nullptr);
-		m_Memory = VK_NULL_HANDLE;
-	}
+	m_pDevice->getMemoryAllocator()->free(m_Allocation);
 
 	m_pDevice = nullptr;
 }
@@ -66,15 +63,28 @@ bool BufferVK::init(const BufferParams& params)
 	VkMemoryRequirements memRequirements = {};
 	vkGetBufferMemoryRequirements(m_pDevice->getDevice(), m_Buffer, &memRequirements);
 
-	VkMemoryAllocateInfo allocInfo = {};
-	allocInfo.sType				= VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.pNext				= nullptr;
-	allocInfo.allocationSize	= memRequirements.size;
-	allocInfo.memoryTypeIndex	= findMemoryType(m_pDevice->getPhysicalDevice(), memRequirements.memoryTypeBits, params.MemoryProperty);
+	uint32_t memoryTypeIndex = UINT32_MAX;
+	if (params.PreferredMemoryProperty != 0)
+	{
+		memoryTypeIndex = findMemoryType(m_pDevice->getPhysicalDevice(), memRequirements.memoryTypeBits, params.MemoryProperty | params.PreferredMemoryProperty);
+	}
+
+	if (memoryTypeIndex == UINT32_MAX)
+	{
+		memoryTypeIndex = findMemoryType(m_pDevice->getPhysicalDevice(), memRequirements.memoryTypeBits, params.MemoryProperty);
+	}
+
+	if (!m_pDevice->getMemoryAllocator()->allocate(memRequirements, memoryTypeIndex, false, m_Allocation))
+	{
+		LOG("Failed to allocate memory for buffer");
+		return false;
+	}
 
-	VK_CHECK_RESULT_RETURN_FALSE(vkAllocateMemory(m_pDevice->getDevice(), &allocInfo, nullptr, &m_Memory), "Failed to allocate memory for buffer");
+	VkPhysicalDeviceMemoryProperties memProperties = {};
+	vkGetPhysicalDeviceMemoryProperties(m_pDevice->getPhysicalDevice(), &memProperties);
+	m_MemoryProperties = memProperties.memoryTypes[memoryTypeIndex].propertyFlags;
 
-	vkBindBufferMemory(m_pDevice->getDevice(), m_Buffer, m_Memory, 0);
+	VK_CHECK_RESULT_RETURN_FALSE(vkBindBufferMemory(m_pDevice->getDevice(), m_Buffer, m_Allocation.Memory, m_Allocation.Offset), "Failed to bind buffer memory");
 	D_LOG("--- Buffer: Vulkan Allocated '%d' bytes for buffer", memRequirements.size);
 
 	static uint32_t num = 0;
@@ -88,19 +98,42 @@ void BufferVK::map(void** ppMappedMemory)
 {
 	assert((ppMappedMemory != nullptr) && (m_Params.MemoryProperty & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT));
 
-	if (!m_IsMapped)
-	{
-		VK_CHECK_RESULT(vkMapMemory(m_pDevice->getDevice(), m_Memory, 0, m_Params.SizeInBytes, 0, ppMappedMemory), "MapMemory Failed");
-		m_IsMapped = true;
-	}
+	// Host visible memory stays mapped by the allocator, as the VkDeviceMemory is shared with other buffers
+	m_IsMapped = true;
+	(*ppMappedMemory) = m_Allocation.pMappedMemory;
 }
 
 void BufferVK::unmap()
 {
-	vkUnmapMemory(m_pDevice->getDevice(), m_Memory);
 	m_IsMapped = false;
 }
 
+void BufferVK::flush(uint64_t offset, uint64_t sizeInBytes)
+{
+	assert(m_IsMapped);
+
+	if ((m_MemoryProperties & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) || sizeInBytes == 0)
+	{
+		return;
+	}
+
+	// Flushed ranges have to start and end at multiples of the atom size, or end at the end of the memory. Rounding may flush parts of
+	// neighbouring buffers, which does not change their contents
+	const VkDeviceSize atomSize = m_pDevice->getNonCoherentAtomSize();
+	const VkDeviceSize memoryOffset = m_Allocation.Offset + offset;
+	const VkDeviceSize rangeBegin = (memoryOffset / atomSize) * atomSize;
+	const VkDeviceSize rangeEnd = ((memoryOffset + sizeInBytes + atomSize - 1) / atomSize) * atomSize;
+
+	VkMappedMemoryRange memoryRange = {};
+	memoryRange.sType	= VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+	memoryRange.pNext	= nullptr;
+	memoryRange.memory	= m_Allocation.Memory;
+	memoryRange.offset	= rangeBegin;
+	memoryRange.size	= rangeEnd >= m_Allocation.MemorySize ? VK_WHOLE_SIZE : rangeEnd - rangeBegin;
+
+	VK_CHECK_RESULT(vkFlushMappedMemoryRanges(m_pDevice->getDevice(), 1, &memoryRange), "Failed to flush mapped buffer memory");
+}
+
 void BufferVK::setName(const char* pName)
 {
 	m_pDevice->setVulkanObjectName(pName, (uint64_t)m_Buffer, VK_OBJECT_TYPE_BUFFER);
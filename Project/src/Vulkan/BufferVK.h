@@ -1,6 +1,7 @@
 #pragma once
 #include "Common/IBuffer.h"
 
+#include "DeviceMemoryAllocatorVK.h"
 #include "VulkanCommon.h"
 
 class DeviceVK;
@@ -17,18 +18,24 @@ public:
 	
 	virtual void map(void** ppMappedMemory) override;
 	virtual void unmap() override;
+	// Makes host writes to a mapped range visible to the device, does nothing for coherent memory
+	void flush(uint64_t offset, uint64_t sizeInBytes);
 
 	virtual void setName(const char* pName) override;
 
 	virtual uint64_t getSizeInBytes() const override;
 	
 	VkBuffer getBuffer() const { return m_Buffer; }
+	VkMemoryPropertyFlags getMemoryProperties() const { return m_MemoryProperties; }
 
 private:
 	DeviceVK* m_pDevice;
 	VkBuffer m_Buffer;
-	VkDeviceMemory m_Memory;
+	// Usually a part of a larger VkDeviceMemory shared with other resources
+	DeviceAllocationVK m_Allocation;
 	BufferParams m_Params;
+	// Properties of the memory type that was picked, may include more than requested
+	VkMemoryPropertyFlags m_MemoryProperties;
 	bool m_IsMapped;
 };
 
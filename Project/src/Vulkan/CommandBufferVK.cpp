@@ -59,6 +59,11 @@ void CommandBufferVK::reset(bool waitForFence)
 	m_pStagingBuffer->reset();
 }
 
+bool CommandBufferVK::isFinished() const
+{
+	return vkGetFenceStatus(m_pDevice->getDevice(), m_Fence) == VK_SUCCESS;
+}
+
 void CommandBufferVK::updateBuffer(BufferVK* pDestination, uint64_t destinationOffset, const void* pSource, uint64_t sizeInBytes)
 {
 	VkDeviceSize offset = m_pStagingBuffer->getCurrentOffset();
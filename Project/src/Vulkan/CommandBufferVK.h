@@ -23,6 +23,8 @@ public:
 	DECL_NO_COPY(CommandBufferVK);
 
 	void reset(bool waitForFence);
+	// Polls the fence without waiting, true when the last submission has finished executing
+	bool isFinished() const;
 
 	void updateBuffer(BufferVK* pDestination, uint64_t destinationOffset, const void* pSource, uint64_t sizeInBytes);
 	void copyBuffer(BufferVK* pSource, uint64_t sourceOffset, BufferVK* pDestination, uint64_t destinationOffset, uint64_t sizeInBytes);
@@ -58,6 +60,11 @@ public:
 		vkCmdPipelineBarrier(m_CommandBuffer, srcStage, dstStage, 0, 0, nullptr, 0, nullptr, imageMemoryBarrierCount, pImageMemoryBarriers);
 	}
 
+	FORCEINLINE void fillBuffer(BufferVK* pDestination, uint64_t destinationOffset, uint64_t sizeInBytes, uint32_t data)
+	{
+		vkCmdFillBuffer(m_CommandBuffer, pDestination->getBuffer(), destinationOffset, sizeInBytes, data);
+	}
+
 	FORCEINLINE void bufferMemoryBarrier(VkPipelineStageFlags srcStage, VkPipelineStageFlags dstStage, uint32_t bufferMemoryBarrierCount, const VkBufferMemoryBarrier* pBufferMemoryBarriers)
 	{
 		vkCmdPipelineBarrier(m_CommandBuffer, srcStage, dstStage, 0, 0, nullptr, bufferMemoryBarrierCount, pBufferMemoryBarriers, 0, nullptr);
@@ -156,6 +163,11 @@ public:
 		vkCmdDrawIndexed(m_CommandBuffer, indexCount, instanceCount, firstIndex, vertexOffset, firstInstance);
 	}
 
+	FORCEINLINE void drawIndexedIndirect(const BufferVK* pBuffer, VkDeviceSize offset, uint32_t drawCount, uint32_t stride)
+	{
+		vkCmdDrawIndexedIndirect(m_CommandBuffer, pBuffer->getBuffer(), offset, drawCount, stride);
+	}
+
 	FORCEINLINE void executeSecondary(CommandBufferVK* pSecondary)
 	{
 		VkCommandBuffer secondaryBuffer = pSecondary->getCommandBuffer();
@@ -33,6 +33,11 @@ void DescriptorSetVK::writeStorageBufferDescriptor(const BufferVK* pBuffer, uint
     writeBufferDescriptor(pBuffer, binding, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
 }
 
+void DescriptorSetVK::writeStorageBufferDescriptor(const BufferVK* pBuffer, uint32_t binding, VkDeviceSize offset, VkDeviceSize range)
+{
+    writeBufferDescriptor(pBuffer, binding, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, offset, range);
+}
+
 void DescriptorSetVK::writeCombinedImageDescriptors(const ImageViewVK* const * ppImageViews, const SamplerVK* const * ppSamplers, uint32_t count, uint32_t binding)
 {
     ASSERT(ppSamplers != nullptr);
@@ -77,14 +82,14 @@ void DescriptorSetVK::writeAccelerationStructureDescriptor(VkAccelerationStructu
 	vkUpdateDescriptorSets(m_pDevice->getDevice(), 1, &accelerationStructureWrite, 0, nullptr);
 }
 
-void DescriptorSetVK::writeBufferDescriptor(const BufferVK* pBuffer, uint32_t binding, VkDescriptorType bufferType)
+void DescriptorSetVK::writeBufferDescriptor(const BufferVK* pBuffer, uint32_t binding, VkDescriptorType bufferType, VkDeviceSize offset, VkDeviceSize range)
 {
     ASSERT(pBuffer != nullptr);
 
     VkDescriptorBufferInfo bufferInfo = {};
     bufferInfo.buffer	= pBuffer->getBuffer();
-    bufferInfo.offset	= 0;
-    bufferInfo.range	= VK_WHOLE_SIZE;
+    bufferInfo.offset	= offset;
+    bufferInfo.range	= range;
 
     VkWriteDescriptorSet descriptorBufferWrite = {};
     descriptorBufferWrite.sType             = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
@@ -20,6 +20,8 @@ public:
 
     void writeUniformBufferDescriptor(const BufferVK* pBuffer, uint32_t binding);
     void writeStorageBufferDescriptor(const BufferVK* pBuffer, uint32_t binding);
+    // Binds part of the buffer, offset has to be a multiple of the device's minStorageBufferOffsetAlignment
+    void writeStorageBufferDescriptor(const BufferVK* pBuffer, uint32_t binding, VkDeviceSize offset, VkDeviceSize range);
 	void writeCombinedImageDescriptors(const ImageViewVK* const * ppImageViews, const SamplerVK* const * ppSamplers, uint32_t count, uint32_t binding);
     void writeSampledImageDescriptor(const ImageViewVK* pImageView, uint32_t binding);
 	void writeStorageImageDescriptor(const ImageViewVK* pImageView, uint32_t binding);
@@ -27,9 +29,10 @@ public:
 	
     VkDescriptorSet getDescriptorSet() const { return m_DescriptorSet; }
     const DescriptorCounts& getDescriptorCounts() const { return m_DescriptorCounts; }
+    DescriptorPoolVK* getDescriptorPool() const { return m_pDescriptorPool; }
 
 private:
-    void writeBufferDescriptor(const BufferVK* pBuffer, uint32_t binding, VkDescriptorType descriptorType);
+    void writeBufferDescriptor(const BufferVK* pBuffer, uint32_t binding, VkDescriptorType descriptorType, VkDeviceSize offset = 0, VkDeviceSize range = VK_WHOLE_SIZE);
     void writeImageDescriptors(const ImageViewVK* const * ppImageViews, const SamplerVK* const * ppSamplers, uint32_t count, uint32_t binding, VkImageLayout layout, VkDescriptorType descriptorType);
 
 private:
@@ -0,0 +1,358 @@
+#include "DeviceMemoryAllocatorVK.h"
+
+#include <algorithm>
+#include <mutex>
+
+// Size of the blocks the resources are suballocated from, heaps smaller than eight blocks use smaller blocks
+#define BLOCK_SIZE					MB(64)
+// Smallest suballocation, requests are rounded up to a power of two no smaller than this
+#define MIN_SUBALLOCATION_SIZE		256
+// Images at least this large get their own allocation, render targets and large textures would otherwise take up most of a block
+#define DEDICATED_IMAGE_SIZE		MB(16)
+
+DeviceMemoryBlockVK::DeviceMemoryBlockVK(VkDeviceMemory memory, VkDeviceSize size, void* pMappedMemory, uint32_t memoryTypeIndex, uint32_t poolIndex)
+	: m_Memory(memory),
+	m_Size(size),
+	m_pMappedMemory(pMappedMemory),
+	m_MemoryTypeIndex(memoryTypeIndex),
+	m_PoolIndex(poolIndex),
+	m_FreeOffsets(),
+	m_AllocationCount(0)
+{
+	uint32_t levelCount = 1;
+	while ((size >> levelCount) >= MIN_SUBALLOCATION_SIZE)
+	{
+		levelCount++;
+	}
+
+	m_FreeOffsets.resize(levelCount);
+	m_FreeOffsets[0].insert(0);
+}
+
+bool DeviceMemoryBlockVK::allocate(VkDeviceSize size, VkDeviceSize alignment, DeviceAllocationVK& allocation)
+{
+	const VkDeviceSize buddySize = getBuddySize(size, alignment);
+	if (buddySize > m_Size)
+	{
+		return false;
+	}
+
+	uint32_t level = 0;
+	while (getLevelSize(level + 1) >= buddySize && level + 1 < uint32_t(m_FreeOffsets.size()))
+	{
+		level++;
+	}
+
+	// Find the smallest free suballocation that fits, and split it until it is the requested size
+	uint32_t freeLevel = level;
+	while (m_FreeOffsets[freeLevel].empty())
+	{
+		if (freeLevel == 0)
+		{
+			return false;
+		}
+
+		freeLevel--;
+	}
+
+	const VkDeviceSize offset = *m_FreeOffsets[freeLevel].begin();
+	m_FreeOffsets[freeLevel].erase(offset);
+
+	while (freeLevel < level)
+	{
+		freeLevel++;
+		m_FreeOffsets[freeLevel].insert(offset + getLevelSize(freeLevel));
+	}
+
+	// Every suballocation starts at a multiple of its size, which is a multiple of the alignment
+	allocation.Memory			= m_Memory;
+	allocation.Offset			= offset;
+	allocation.Size				= size;
+	allocation.MemorySize		= m_Size;
+	allocation.pMappedMemory	= m_pMappedMemory != nullptr ? (uint8_t*)m_pMappedMemory + offset : nullptr;
+	allocation.pBlock			= this;
+	allocation.BuddyLevel		= level;
+
+	m_AllocationCount++;
+	return true;
+}
+
+void DeviceMemoryBlockVK::free(const DeviceAllocationVK& allocation)
+{
+	VkDeviceSize offset = allocation.Offset;
+	uint32_t level = allocation.BuddyLevel;
+
+	// Merge with the buddy for as long as it is free
+	while (level > 0)
+	{
+		const VkDeviceSize buddyOffset = offset ^ getLevelSize(level);
+
+		auto buddyItr = m_FreeOffsets[level].find(buddyOffset);
+		if (buddyItr == m_FreeOffsets[level].end())
+		{
+			break;
+		}
+
+		m_FreeOffsets[level].erase(buddyItr);
+		offset = std::min(offset, buddyOffset);
+		level--;
+	}
+
+	m_FreeOffsets[level].insert(offset);
+	m_AllocationCount--;
+}
+
+VkDeviceSize DeviceMemoryBlockVK::getBuddySize(VkDeviceSize size, VkDeviceSize alignment)
+{
+	// Vulkan alignments are powers of two, so a power of two size no smaller than the alignment is aligned at multiples of itself
+	const VkDeviceSize minSize = std::max<VkDeviceSize>(std::max(size, alignment), MIN_SUBALLOCATION_SIZE);
+
+	VkDeviceSize buddySize = MIN_SUBALLOCATION_SIZE;
+	while (buddySize < minSize)
+	{
+		buddySize <<= 1;
+	}
+
+	return buddySize;
+}
+
+DeviceMemoryAllocatorVK::DeviceMemoryAllocatorVK(VkDevice device, const VkPhysicalDeviceMemoryProperties& memoryProperties, VkDeviceSize bufferImageGranularity,
+	const DeviceMemoryFunctionsVK& functions)
+	: m_Device(device),
+	m_MemoryProperties(memoryProperties),
+	m_Functions(functions),
+	m_SeparateImagePools(bufferImageGranularity > MIN_SUBALLOCATION_SIZE),
+	m_Statistics({})
+{
+}
+
+DeviceMemoryAllocatorVK::~DeviceMemoryAllocatorVK()
+{
+	if (m_Statistics.SuballocationCount > 0 || m_Statistics.DedicatedAllocationCount > 0)
+	{
+		LOG("--- DeviceMemoryAllocator: %u suballocations and %u dedicated allocations were not freed", m_Statistics.SuballocationCount, m_Statistics.DedicatedAllocationCount);
+	}
+
+	for (std::vector<DeviceMemoryBlockVK*>& blocks : m_BlockPools)
+	{
+		for (DeviceMemoryBlockVK* pBlock : blocks)
+		{
+			destroyBlock(pBlock);
+		}
+
+		blocks.clear();
+	}
+}
+
+bool DeviceMemoryAllocatorVK::allocate(const VkMemoryRequirements& memoryRequirements, uint32_t memoryTypeIndex, bool isImage, DeviceAllocationVK& allocation)
+{
+	if (memoryTypeIndex >= m_MemoryProperties.memoryTypeCount)
+	{
+		LOG("--- DeviceMemoryAllocator: No memory type supports the requested properties");
+		return false;
+	}
+
+	const VkDeviceSize buddySize = DeviceMemoryBlockVK::getBuddySize(memoryRequirements.size, memoryRequirements.alignment);
+	const bool dedicated = buddySize > getBlockSize(memoryTypeIndex) / 2 || (isImage && memoryRequirements.size >= DEDICATED_IMAGE_SIZE);
+	if (dedicated)
+	{
+		return allocateDedicated(memoryRequirements.size, memoryTypeIndex, allocation);
+	}
+
+	std::vector<DeviceMemoryBlockVK*>& blocks = m_BlockPools[getPoolIndex(memoryTypeIndex, isImage)];
+	{
+		std::scoped_lock<Spinlock> lock(m_Lock);
+		for (DeviceMemoryBlockVK* pBlock : blocks)
+		{
+			if (pBlock->allocate(memoryRequirements.size, memoryRequirements.alignment, allocation))
+			{
+				m_Statistics.SuballocationCount++;
+				m_Statistics.RequestedBytes		+= memoryRequirements.size;
+				m_Statistics.SuballocatedBytes	+= buddySize;
+				return true;
+			}
+		}
+	}
+
+	// The block is allocated without holding the lock, so other threads keep suballocating while the driver allocates
+	DeviceMemoryBlockVK* pBlock = createBlock(memoryTypeIndex, isImage);
+	if (pBlock == nullptr)
+	{
+		// The heap may not fit another block, but could still fit the resource
+		return allocateDedicated(memoryRequirements.size, memoryTypeIndex, allocation);
+	}
+
+	std::scoped_lock<Spinlock> lock(m_Lock);
+
+	blocks.push_back(pBlock);
+	pBlock->allocate(memoryRequirements.size, memoryRequirements.alignment, allocation);
+
+	m_Statistics.BlockCount++;
+	m_Statistics.BlockBytes			+= pBlock->getSize();
+	m_Statistics.SuballocationCount++;
+	m_Statistics.RequestedBytes		+= memoryRequirements.size;
+	m_Statistics.SuballocatedBytes	+= buddySize;
+	return true;
+}
+
+void DeviceMemoryAllocatorVK::free(DeviceAllocationVK& allocation)
+{
+	if (allocation.Memory == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	DeviceMemoryBlockVK* pBlock = allocation.pBlock;
+	if (pBlock == nullptr)
+	{
+		if (allocation.pMappedMemory != nullptr)
+		{
+			m_Functions.pUnmapMemory(m_Device, allocation.Memory);
+		}
+
+		m_Functions.pFreeMemory(m_Device, allocation.Memory, nullptr);
+
+		std::scoped_lock<Spinlock> lock(m_Lock);
+		m_Statistics.DedicatedAllocationCount--;
+		m_Statistics.DedicatedBytes -= allocation.Size;
+	}
+	else
+	{
+		DeviceMemoryBlockVK* pEmptyBlock = nullptr;
+		{
+			std::scoped_lock<Spinlock> lock(m_Lock);
+			pBlock->free(allocation);
+
+			m_Statistics.SuballocationCount--;
+			m_Statistics.RequestedBytes		-= allocation.Size;
+			m_Statistics.SuballocatedBytes	-= pBlock->getSize() >> allocation.BuddyLevel;
+
+			// Empty blocks are released, except for the last block of each pool so that freeing and allocating again does not reallocate it
+			std::vector<DeviceMemoryBlockVK*>& blocks = m_BlockPools[pBlock->getPoolIndex()];
+			if (pBlock->isEmpty() && blocks.size() > 1)
+			{
+				blocks.erase(std::find(blocks.begin(), blocks.end(), pBlock));
+				m_Statistics.BlockCount--;
+				m_Statistics.BlockBytes -= pBlock->getSize();
+				pEmptyBlock = pBlock;
+			}
+		}
+
+		// The block is out of its pool, so no other thread can reach it while it is released
+		if (pEmptyBlock != nullptr)
+		{
+			destroyBlock(pEmptyBlock);
+		}
+	}
+
+	allocation = {};
+}
+
+DeviceMemoryStatisticsVK DeviceMemoryAllocatorVK::getStatistics()
+{
+	std::scoped_lock<Spinlock> lock(m_Lock);
+	return m_Statistics;
+}
+
+void DeviceMemoryAllocatorVK::logStatistics()
+{
+	DeviceMemoryStatisticsVK statistics = getStatistics();
+
+	LOG("--- DeviceMemoryAllocator: %u blocks of %llu bytes hold %u suballocations of %llu bytes (%llu bytes requested), %u dedicated allocations of %llu bytes",
+		statistics.BlockCount, (unsigned long long)statistics.BlockBytes, statistics.SuballocationCount, (unsigned long long)statistics.SuballocatedBytes,
+		(unsigned long long)statistics.RequestedBytes, statistics.DedicatedAllocationCount, (unsigned long long)statistics.DedicatedBytes);
+}
+
+bool DeviceMemoryAllocatorVK::allocateDedicated(VkDeviceSize size, uint32_t memoryTypeIndex, DeviceAllocationVK& allocation)
+{
+	VkMemoryAllocateInfo allocInfo = {};
+	allocInfo.sType				= VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.pNext				= nullptr;
+	allocInfo.allocationSize	= size;
+	allocInfo.memoryTypeIndex	= memoryTypeIndex;
+
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VK_CHECK_RESULT_RETURN_FALSE(m_Functions.pAllocateMemory(m_Device, &allocInfo, nullptr, &memory), "--- DeviceMemoryAllocator: Failed to allocate dedicated memory");
+
+	void* pMappedMemory = nullptr;
+	if (isHostVisible(memoryTypeIndex))
+	{
+		VK_CHECK_RESULT(m_Functions.pMapMemory(m_Device, memory, 0, VK_WHOLE_SIZE, 0, &pMappedMemory), "--- DeviceMemoryAllocator: Failed to map dedicated memory");
+	}
+
+	allocation.Memory			= memory;
+	allocation.Offset			= 0;
+	allocation.Size				= size;
+	allocation.MemorySize		= size;
+	allocation.pMappedMemory	= pMappedMemory;
+	allocation.pBlock			= nullptr;
+	allocation.BuddyLevel		= 0;
+
+	std::scoped_lock<Spinlock> lock(m_Lock);
+	m_Statistics.DedicatedAllocationCount++;
+	m_Statistics.DedicatedBytes += size;
+	return true;
+}
+
+DeviceMemoryBlockVK* DeviceMemoryAllocatorVK::createBlock(uint32_t memoryTypeIndex, bool isImage)
+{
+	const VkDeviceSize blockSize = getBlockSize(memoryTypeIndex);
+
+	VkMemoryAllocateInfo allocInfo = {};
+	allocInfo.sType				= VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.pNext				= nullptr;
+	allocInfo.allocationSize	= blockSize;
+	allocInfo.memoryTypeIndex	= memoryTypeIndex;
+
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	if (m_Functions.pAllocateMemory(m_Device, &allocInfo, nullptr, &memory) != VK_SUCCESS)
+	{
+		LOG("--- DeviceMemoryAllocator: Failed to allocate a block of %llu bytes", (unsigned long long)blockSize);
+		return nullptr;
+	}
+
+	// Host visible blocks stay mapped, as a VkDeviceMemory can only be mapped once and its suballocations are mapped independently
+	void* pMappedMemory = nullptr;
+	if (isHostVisible(memoryTypeIndex))
+	{
+		VK_CHECK_RESULT(m_Functions.pMapMemory(m_Device, memory, 0, VK_WHOLE_SIZE, 0, &pMappedMemory), "--- DeviceMemoryAllocator: Failed to map block");
+	}
+
+	D_LOG("--- DeviceMemoryAllocator: Allocated a block of %llu bytes of memory type %u", (unsigned long long)blockSize, memoryTypeIndex);
+	return DBG_NEW DeviceMemoryBlockVK(memory, blockSize, pMappedMemory, memoryTypeIndex, getPoolIndex(memoryTypeIndex, isImage));
+}
+
+void DeviceMemoryAllocatorVK::destroyBlock(DeviceMemoryBlockVK* pBlock)
+{
+	if (pBlock->getMappedMemory() != nullptr)
+	{
+		m_Functions.pUnmapMemory(m_Device, pBlock->getMemory());
+	}
+
+	m_Functions.pFreeMemory(m_Device, pBlock->getMemory(), nullptr);
+	SAFEDELETE(pBlock);
+}
+
+uint32_t DeviceMemoryAllocatorVK::getPoolIndex(uint32_t memoryTypeIndex, bool isImage) const
+{
+	return (m_SeparateImagePools && isImage) ? VK_MAX_MEMORY_TYPES + memoryTypeIndex : memoryTypeIndex;
+}
+
+VkDeviceSize DeviceMemoryAllocatorVK::getBlockSize(uint32_t memoryTypeIndex) const
+{
+	const VkDeviceSize heapSize = m_MemoryProperties.memoryHeaps[m_MemoryProperties.memoryTypes[memoryTypeIndex].heapIndex].size;
+
+	// Blocks are powers of two so that they split evenly into buddies
+	VkDeviceSize blockSize = BLOCK_SIZE;
+	while (blockSize > MIN_SUBALLOCATION_SIZE && blockSize * 8 > heapSize)
+	{
+		blockSize >>= 1;
+	}
+
+	return blockSize;
+}
+
+bool DeviceMemoryAllocatorVK::isHostVisible(uint32_t memoryTypeIndex) const
+{
+	return (m_MemoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0;
+}
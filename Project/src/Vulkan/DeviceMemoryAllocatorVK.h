@@ -0,0 +1,133 @@
+#pragma once
+#include <unordered_set>
+#include <vector>
+
+#include "Core/Spinlock.h"
+
+#include "VulkanCommon.h"
+
+class DeviceMemoryBlockVK;
+
+// The Vulkan functions the allocator calls, so that they can be replaced, for example by a mock vkAllocateMemory
+struct DeviceMemoryFunctionsVK
+{
+	PFN_vkAllocateMemory	pAllocateMemory;
+	PFN_vkFreeMemory		pFreeMemory;
+	PFN_vkMapMemory			pMapMemory;
+	PFN_vkUnmapMemory		pUnmapMemory;
+
+	static DeviceMemoryFunctionsVK getVulkanFunctions()
+	{
+		return { vkAllocateMemory, vkFreeMemory, vkMapMemory, vkUnmapMemory };
+	}
+};
+
+struct DeviceAllocationVK
+{
+	VkDeviceMemory	Memory;
+	VkDeviceSize	Offset;
+	VkDeviceSize	Size;
+	// Size of the whole VkDeviceMemory, which is shared with other allocations unless the allocation is dedicated
+	VkDeviceSize	MemorySize;
+	// Points at Offset, nullptr unless the memory is host visible
+	void*			pMappedMemory;
+
+	// nullptr for dedicated allocations
+	DeviceMemoryBlockVK*	pBlock;
+	uint32_t				BuddyLevel;
+};
+
+struct DeviceMemoryStatisticsVK
+{
+	uint32_t		BlockCount;
+	uint32_t		DedicatedAllocationCount;
+	uint32_t		SuballocationCount;
+	// Bytes allocated from the driver
+	VkDeviceSize	BlockBytes;
+	VkDeviceSize	DedicatedBytes;
+	// Bytes requested by the suballocations, and the bytes they take up in the blocks once rounded up to their buddy sizes
+	VkDeviceSize	RequestedBytes;
+	VkDeviceSize	SuballocatedBytes;
+};
+
+/*
+	Suballocates buffers and images from large blocks of device memory, so that vkAllocateMemory is called once per block instead of once
+	per resource. Each block is split with a buddy allocator, which aligns every suballocation to its power of two size. Linear and optimal
+	resources are kept in separate blocks when bufferImageGranularity is larger than the smallest suballocation, so that they never share
+	a granularity page. Large images and resources that would take up most of a block get dedicated allocations
+*/
+class DeviceMemoryAllocatorVK
+{
+public:
+	DeviceMemoryAllocatorVK(VkDevice device, const VkPhysicalDeviceMemoryProperties& memoryProperties, VkDeviceSize bufferImageGranularity,
+		const DeviceMemoryFunctionsVK& functions);
+	~DeviceMemoryAllocatorVK();
+
+	DECL_NO_COPY(DeviceMemoryAllocatorVK);
+
+	// Images are expected to use optimal tiling, and buffers are linear
+	bool allocate(const VkMemoryRequirements& memoryRequirements, uint32_t memoryTypeIndex, bool isImage, DeviceAllocationVK& allocation);
+	void free(DeviceAllocationVK& allocation);
+
+	DeviceMemoryStatisticsVK getStatistics();
+	void logStatistics();
+
+private:
+	bool allocateDedicated(VkDeviceSize size, uint32_t memoryTypeIndex, DeviceAllocationVK& allocation);
+	DeviceMemoryBlockVK* createBlock(uint32_t memoryTypeIndex, bool isImage);
+	void destroyBlock(DeviceMemoryBlockVK* pBlock);
+
+	uint32_t getPoolIndex(uint32_t memoryTypeIndex, bool isImage) const;
+	VkDeviceSize getBlockSize(uint32_t memoryTypeIndex) const;
+	bool isHostVisible(uint32_t memoryTypeIndex) const;
+
+private:
+	VkDevice m_Device;
+	VkPhysicalDeviceMemoryProperties m_MemoryProperties;
+	DeviceMemoryFunctionsVK m_Functions;
+	bool m_SeparateImagePools;
+
+	// Blocks of each memory type, twice as many pools when images and buffers are kept apart
+	std::vector<DeviceMemoryBlockVK*> m_BlockPools[VK_MAX_MEMORY_TYPES * 2];
+	DeviceMemoryStatisticsVK m_Statistics;
+	// Guards the pools and the statistics, and is never held while calling the driver
+	Spinlock m_Lock;
+};
+
+// A VkDeviceMemory split into power of two sized suballocations, which are merged with their buddies when freed
+class DeviceMemoryBlockVK
+{
+public:
+	DeviceMemoryBlockVK(VkDeviceMemory memory, VkDeviceSize size, void* pMappedMemory, uint32_t memoryTypeIndex, uint32_t poolIndex);
+	~DeviceMemoryBlockVK() = default;
+
+	DECL_NO_COPY(DeviceMemoryBlockVK);
+
+	bool allocate(VkDeviceSize size, VkDeviceSize alignment, DeviceAllocationVK& allocation);
+	void free(const DeviceAllocationVK& allocation);
+
+	bool isEmpty() const { return m_AllocationCount == 0; }
+
+	VkDeviceMemory	getMemory() const			{ return m_Memory; }
+	VkDeviceSize	getSize() const				{ return m_Size; }
+	void*			getMappedMemory() const		{ return m_pMappedMemory; }
+	uint32_t		getMemoryTypeIndex() const	{ return m_MemoryTypeIndex; }
+	uint32_t		getPoolIndex() const		{ return m_PoolIndex; }
+
+	// Size of the suballocations that a request of the size and alignment is rounded up to
+	static VkDeviceSize getBuddySize(VkDeviceSize size, VkDeviceSize alignment);
+
+private:
+	VkDeviceSize getLevelSize(uint32_t level) const { return m_Size >> level; }
+
+private:
+	VkDeviceMemory m_Memory;
+	VkDeviceSize m_Size;
+	void* m_pMappedMemory;
+	uint32_t m_MemoryTypeIndex;
+	uint32_t m_PoolIndex;
+
+	// Offsets of the free suballocations of each level, level 0 is the whole block and every level halves the size
+	std::vector<std::unordered_set<VkDeviceSize>> m_FreeOffsets;
+	uint32_t m_AllocationCount;
+};
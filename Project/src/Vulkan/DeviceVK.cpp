@@ -8,6 +8,8 @@
 #include "InstanceVK.h"
 #include "CopyHandlerVK.h"
 #include "CommandBufferVK.h"
+#include "DeviceMemoryAllocatorVK.h"
+#include "FrameSchedulerVK.h"
 
 #define GET_DEVICE_PROC_ADDR(device, function_name) if ((function_name = reinterpret_cast<PFN_##function_name>(vkGetDeviceProcAddr(device, #function_name))) == nullptr) { LOG("--- Vulkan: Failed to load DeviceFunction '%s'", #function_name); }
 
@@ -19,12 +21,17 @@ DeviceVK::DeviceVK()
 	m_ComputeQueues(VK_NULL_HANDLE),
 	m_TransferQueues(VK_NULL_HANDLE),
 	m_PresentQueue(VK_NULL_HANDLE),
+	m_pPresentQueueState(nullptr),
 	m_NextGraphicsQueue(0),
 	m_NextTransferQueue(0),
 	m_NextComputeQueue(0),
 	m_DeviceLimits({}),
+	m_DeviceUUID(),
+	m_DriverVersion(0),
 	m_RayTracingProperties({}),
 	m_pCopyHandler(),
+	m_pFrameScheduler(nullptr),
+	m_pMemoryAllocator(nullptr),
 	vkCreateAccelerationStructureNV(),
 	vkDestroyAccelerationStructureNV(),
 	vkBindAccelerationStructureMemoryNV(),
@@ -34,7 +41,11 @@ DeviceVK::DeviceVK()
 	vkCreateRayTracingPipelinesNV(),
 	vkGetRayTracingShaderGroupHandlesNV(),
 	vkCmdTraceRaysNV(),
-	m_UseMultipleQueues(true)
+#ifdef VK_KHR_timeline_semaphore
+	vkWaitSemaphoresKHR(),
+#endif
+	m_UseMultipleQueues(true),
+	m_TimelineSemaphoresSupported(false)
 {
 }
 
@@ -56,9 +67,20 @@ bool DeviceVK::finalize(InstanceVK* pInstance, bool useMultipleQueues)
 
 	registerExtensionFunctions();
 
+	if (!createTimelineSemaphores())
+		return false;
+
+	VkPhysicalDeviceMemoryProperties memoryProperties = {};
+	vkGetPhysicalDeviceMemoryProperties(m_PhysicalDevice, &memoryProperties);
+	m_pMemoryAllocator = DBG_NEW DeviceMemoryAllocatorVK(m_Device, memoryProperties, m_DeviceLimits.bufferImageGranularity, DeviceMemoryFunctionsVK::getVulkanFunctions());
+
 	m_pCopyHandler = DBG_NEW CopyHandlerVK(this);
 	m_pCopyHandler->init();
 
+	m_pFrameScheduler = DBG_NEW FrameSchedulerVK(this);
+	if (!m_pFrameScheduler->init())
+		return false;
+
 	std::cout << "--- Device: Vulkan Device created successfully!" << std::endl;
 	return true;
 }
@@ -70,6 +92,27 @@ void DeviceVK::release()
 		vkDeviceWaitIdle(m_Device);
 
 		SAFEDELETE(m_pCopyHandler);
+		SAFEDELETE(m_pFrameScheduler);
+
+		// Every buffer and image has been released by now, so the statistics show what was left allocated
+		if (m_pMemoryAllocator)
+		{
+			m_pMemoryAllocator->logStatistics();
+			SAFEDELETE(m_pMemoryAllocator);
+		}
+
+		for (QueueStateVK* pQueueState : m_UniqueQueueStates)
+		{
+			if (pQueueState->TimelineSemaphore != VK_NULL_HANDLE)
+			{
+				vkDestroySemaphore(m_Device, pQueueState->TimelineSemaphore, nullptr);
+			}
+
+			SAFEDELETE(pQueueState);
+		}
+
+		m_QueueStates.clear();
+		m_UniqueQueueStates.clear();
 
 		vkDestroyDevice(m_Device, nullptr);
 		m_Device = VK_NULL_HANDLE;
@@ -88,84 +131,245 @@ void DeviceVK::addOptionalExtension(const char* extensionName)
 
 void DeviceVK::executeGraphics(CommandBufferVK* pCommandBuffer, const VkSemaphore* pWaitSemaphore, const VkPipelineStageFlags* pWaitStages, uint32_t waitSemaphoreCount, const VkSemaphore* pSignalSemaphores, uint32_t signalSemaphoreCount, uint32_t queueIndex)
 {
-	std::scoped_lock<Spinlock> lock(m_GraphicsLock);
-	executeCommandBuffer(m_GraphicsQueues[queueIndex], pCommandBuffer, pWaitSemaphore, pWaitStages, waitSemaphoreCount, pSignalSemaphores, signalSemaphoreCount);
+	executeCommandBuffers(m_GraphicsQueues[queueIndex], m_GraphicsQueueStates[queueIndex], &pCommandBuffer, 1, pWaitSemaphore, pWaitStages, waitSemaphoreCount, pSignalSemaphores, signalSemaphoreCount);
 }
 
 void DeviceVK::executeCompute(CommandBufferVK* pCommandBuffer, const VkSemaphore* pWaitSemaphore, const VkPipelineStageFlags* pWaitStages, uint32_t waitSemaphoreCount, const VkSemaphore* pSignalSemaphores, uint32_t signalSemaphoreCount, uint32_t queueIndex)
 {
-	std::scoped_lock<Spinlock> lock(m_ComputeLock);
-	executeCommandBuffer(m_ComputeQueues[queueIndex], pCommandBuffer, pWaitSemaphore, pWaitStages, waitSemaphoreCount, pSignalSemaphores, signalSemaphoreCount);
+	executeCommandBuffers(m_ComputeQueues[queueIndex], m_ComputeQueueStates[queueIndex], &pCommandBuffer, 1, pWaitSemaphore, pWaitStages, waitSemaphoreCount, pSignalSemaphores, signalSemaphoreCount);
 }
 
 void DeviceVK::executeTransfer(CommandBufferVK* pCommandBuffer, const VkSemaphore* pWaitSemaphore, const VkPipelineStageFlags* pWaitStages, uint32_t waitSemaphoreCount, const VkSemaphore* pSignalSemaphores, uint32_t signalSemaphoreCount, uint32_t queueIndex)
 {
-	std::scoped_lock<Spinlock> lock(m_TransferLock);
-	executeCommandBuffer(m_TransferQueues[queueIndex], pCommandBuffer, pWaitSemaphore, pWaitStages, waitSemaphoreCount, pSignalSemaphores, signalSemaphoreCount);
+	executeCommandBuffers(m_TransferQueues[queueIndex], m_TransferQueueStates[queueIndex], &pCommandBuffer, 1, pWaitSemaphore, pWaitStages, waitSemaphoreCount, pSignalSemaphores, signalSemaphoreCount);
 }
 
-void DeviceVK::waitGraphics()
+void DeviceVK::executeGraphics(CommandBufferVK* const* ppCommandBuffers, uint32_t commandBufferCount, const VkSemaphore* pWaitSemaphore, const VkPipelineStageFlags* pWaitStages, uint32_t waitSemaphoreCount, const VkSemaphore* pSignalSemaphores, uint32_t signalSemaphoreCount, uint32_t queueIndex)
+{
+	executeCommandBuffers(m_GraphicsQueues[queueIndex], m_GraphicsQueueStates[queueIndex], ppCommandBuffers, commandBufferCount, pWaitSemaphore, pWaitStages, waitSemaphoreCount, pSignalSemaphores, signalSemaphoreCount);
+}
+
+void DeviceVK::executeCompute(CommandBufferVK* const* ppCommandBuffers, uint32_t commandBufferCount, const VkSemaphore* pWaitSemaphore, const VkPipelineStageFlags* pWaitStages, uint32_t waitSemaphoreCount, const VkSemaphore* pSignalSemaphores, uint32_t signalSemaphoreCount, uint32_t queueIndex)
+{
+	executeCommandBuffers(m_ComputeQueues[queueIndex], m_ComputeQueueStates[queueIndex], ppCommandBuffers, commandBufferCount, pWaitSemaphore, pWaitStages, waitSemaphoreCount, pSignalSemaphores, signalSemaphoreCount);
+}
+
+void DeviceVK::executeTransfer(CommandBufferVK* const* ppCommandBuffers, uint32_t commandBufferCount, const VkSemaphore* pWaitSemaphore, const VkPipelineStageFlags* pWaitStages, uint32_t waitSemaphoreCount, const VkSemaphore* pSignalSemaphores, uint32_t signalSemaphoreCount, uint32_t queueIndex)
+{
+	executeCommandBuffers(m_TransferQueues[queueIndex], m_TransferQueueStates[queueIndex], ppCommandBuffers, commandBufferCount, pWaitSemaphore, pWaitStages, waitSemaphoreCount, pSignalSemaphores, signalSemaphoreCount);
+}
+
+void DeviceVK::executeCompute(CommandBufferVK* const* ppCommandBuffers, uint32_t commandBufferCount, const TimelineWaitVK* pTimelineWaits, uint32_t timelineWaitCount, uint32_t queueIndex)
 {
-	std::scoped_lock<Spinlock> lock(m_GraphicsLock);
-	for (VkQueue queue : m_GraphicsQueues) {
-		vkQueueWaitIdle(queue);
+	executeCommandBuffers(m_ComputeQueues[queueIndex], m_ComputeQueueStates[queueIndex], ppCommandBuffers, commandBufferCount, nullptr, nullptr, 0, nullptr, 0, pTimelineWaits, timelineWaitCount);
+}
+
+VkResult DeviceVK::present(const VkPresentInfoKHR& presentInfo)
+{
+	std::scoped_lock<Spinlock> lock(m_pPresentQueueState->Lock);
+	return vkQueuePresentKHR(m_PresentQueue, &presentInfo);
+}
+
+void DeviceVK::getSubmittedTimelineValues(std::vector<uint64_t>& values)
+{
+	values.resize(m_UniqueQueueStates.size());
+
+	for (size_t i = 0; i < m_UniqueQueueStates.size(); i++)
+	{
+		std::scoped_lock<Spinlock> lock(m_UniqueQueueStates[i]->Lock);
+		values[i] = m_UniqueQueueStates[i]->SubmittedValue;
 	}
 }
 
-void DeviceVK::waitCompute()
+void DeviceVK::waitForTimelineValues(const std::vector<uint64_t>& values)
 {
-	std::scoped_lock<Spinlock> lock(m_ComputeLock);
-	for (VkQueue queue : m_ComputeQueues) {
-		vkQueueWaitIdle(queue);
+#ifdef VK_KHR_timeline_semaphore
+	if (m_TimelineSemaphoresSupported)
+	{
+		std::vector<VkSemaphore> semaphores(m_UniqueQueueStates.size());
+		for (size_t i = 0; i < m_UniqueQueueStates.size(); i++)
+		{
+			semaphores[i] = m_UniqueQueueStates[i]->TimelineSemaphore;
+		}
+
+		VkSemaphoreWaitInfoKHR waitInfo = {};
+		waitInfo.sType			= VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR;
+		waitInfo.pNext			= nullptr;
+		waitInfo.flags			= 0;
+		waitInfo.semaphoreCount	= uint32_t(semaphores.size());
+		waitInfo.pSemaphores	= semaphores.data();
+		waitInfo.pValues		= values.data();
+
+		VkResult result = vkWaitSemaphoresKHR(m_Device, &waitInfo, UINT64_MAX);
+		VK_CHECK_RESULT(result, "vkWaitSemaphores failed");
+		return;
 	}
+#endif
+
+	// Without timeline semaphores, the submissions can not be told apart
+	wait();
 }
 
-void DeviceVK::waitTransfer()
+void DeviceVK::signalQueueFences(const VkFence* pFences)
 {
-	std::scoped_lock<Spinlock> lock(m_TransferLock);
-	for (VkQueue queue : m_TransferQueues) {
-		vkQueueWaitIdle(queue);
+	for (size_t i = 0; i < m_UniqueQueueStates.size(); i++)
+	{
+		QueueStateVK* pQueueState = m_UniqueQueueStates[i];
+
+		std::scoped_lock<Spinlock> lock(pQueueState->Lock);
+		VkResult result = vkQueueSubmit(pQueueState->Queue, 0, nullptr, pFences[i]);
+		VK_CHECK_RESULT(result, "vkQueueSubmit failed");
 	}
 }
 
-void DeviceVK::executeCommandBuffer(VkQueue queue, CommandBufferVK* pCommandBuffer, const VkSemaphore* pWaitSemaphore, const VkPipelineStageFlags* pWaitStages,
-	uint32_t waitSemaphoreCount, const VkSemaphore* pSignalSemaphores, uint32_t signalSemaphoreCount)
+TimelineWaitVK DeviceVK::getComputeTimelineValue(uint32_t queueIndex)
+{
+	QueueStateVK* pQueueState = m_ComputeQueueStates[queueIndex];
+
+	std::scoped_lock<Spinlock> lock(pQueueState->Lock);
+	return { pQueueState->TimelineSemaphore, pQueueState->SubmittedValue };
+}
+
+void DeviceVK::waitGraphics()
 {
+	waitQueues(m_GraphicsQueues, m_GraphicsQueueStates);
+}
+
+void DeviceVK::waitCompute()
+{
+	waitQueues(m_ComputeQueues, m_ComputeQueueStates);
+}
+
+void DeviceVK::waitTransfer()
+{
+	waitQueues(m_TransferQueues, m_TransferQueueStates);
+}
+
+void DeviceVK::executeCommandBuffers(VkQueue queue, QueueStateVK* pQueueState, CommandBufferVK* const* ppCommandBuffers, uint32_t commandBufferCount, const VkSemaphore* pWaitSemaphore,
+	const VkPipelineStageFlags* pWaitStages, uint32_t waitSemaphoreCount, const VkSemaphore* pSignalSemaphores, uint32_t signalSemaphoreCount,
+	const TimelineWaitVK* pTimelineWaits, uint32_t timelineWaitCount)
+{
+	if (commandBufferCount == 0)
+	{
+		return;
+	}
+
+	std::vector<VkCommandBuffer> commandBuffers(commandBufferCount);
+	for (uint32_t i = 0; i < commandBufferCount; i++)
+	{
+		commandBuffers[i] = ppCommandBuffers[i]->getCommandBuffer();
+	}
+
+	// Timeline waits follow the binary semaphores, which ignore their values
+	std::vector<VkSemaphore> waitSemaphores(pWaitSemaphore, pWaitSemaphore + waitSemaphoreCount);
+	std::vector<VkPipelineStageFlags> waitStages(pWaitStages, pWaitStages + waitSemaphoreCount);
+	std::vector<uint64_t> waitValues(waitSemaphoreCount, 0);
+
+	// Every submission also signals the queue's timeline semaphore
+	std::vector<VkSemaphore> signalSemaphores(pSignalSemaphores, pSignalSemaphores + signalSemaphoreCount);
+	std::vector<uint64_t> signalValues(signalSemaphoreCount, 0);
+
 	//Submit
 	VkSubmitInfo submitInfo = {};
 	submitInfo.sType				= VK_STRUCTURE_TYPE_SUBMIT_INFO;
 	submitInfo.pNext				= nullptr;
-	submitInfo.waitSemaphoreCount	= waitSemaphoreCount;
-	submitInfo.pWaitSemaphores		= pWaitSemaphore;
-	submitInfo.pWaitDstStageMask	= pWaitStages;
+	submitInfo.pCommandBuffers		= commandBuffers.data();
+	submitInfo.commandBufferCount	= commandBufferCount;
+
+	std::scoped_lock<Spinlock> lock(pQueueState->Lock);
+
+#ifdef VK_KHR_timeline_semaphore
+	VkTimelineSemaphoreSubmitInfoKHR timelineInfo = {};
+	if (pQueueState->TimelineSemaphore != VK_NULL_HANDLE)
+	{
+		for (uint32_t i = 0; i < timelineWaitCount; i++)
+		{
+			waitSemaphores.push_back(pTimelineWaits[i].Semaphore);
+			waitStages.push_back(VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+			waitValues.push_back(pTimelineWaits[i].Value);
+		}
+
+		signalSemaphores.push_back(pQueueState->TimelineSemaphore);
+		signalValues.push_back(++pQueueState->SubmittedValue);
 
-	VkCommandBuffer commandBuffers[] = { pCommandBuffer->getCommandBuffer() };
-	submitInfo.pCommandBuffers		= commandBuffers;
-	submitInfo.commandBufferCount	= 1;
-	submitInfo.signalSemaphoreCount = signalSemaphoreCount;
-	submitInfo.pSignalSemaphores	= pSignalSemaphores;
+		timelineInfo.sType						= VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+		timelineInfo.pNext						= nullptr;
+		timelineInfo.waitSemaphoreValueCount	= uint32_t(waitValues.size());
+		timelineInfo.pWaitSemaphoreValues		= waitValues.data();
+		timelineInfo.signalSemaphoreValueCount	= uint32_t(signalValues.size());
+		timelineInfo.pSignalSemaphoreValues		= signalValues.data();
+		submitInfo.pNext						= &timelineInfo;
+	}
+#endif
+
+	submitInfo.waitSemaphoreCount	= uint32_t(waitSemaphores.size());
+	submitInfo.pWaitSemaphores		= waitSemaphores.data();
+	submitInfo.pWaitDstStageMask	= waitStages.data();
+	submitInfo.signalSemaphoreCount = uint32_t(signalSemaphores.size());
+	submitInfo.pSignalSemaphores	= signalSemaphores.data();
 
-	VkResult result = vkQueueSubmit(queue, 1, &submitInfo, pCommandBuffer->getFence());
+	VkResult result = vkQueueSubmit(queue, 1, &submitInfo, ppCommandBuffers[0]->getFence());
 	VK_CHECK_RESULT(result, "vkQueueSubmit failed");
+
+	// A submission signals a single fence. The other command buffers' fences are signaled by empty submissions, which signal once all work
+	// submitted before them has finished
+	for (uint32_t i = 1; i < commandBufferCount; i++)
+	{
+		result = vkQueueSubmit(queue, 0, nullptr, ppCommandBuffers[i]->getFence());
+		VK_CHECK_RESULT(result, "vkQueueSubmit failed");
+	}
 }
 
-void DeviceVK::getQueues(const char* pObjectName, const QueueIndices& queueIndices, std::vector<VkQueue>& queues)
+void DeviceVK::waitQueues(const std::vector<VkQueue>& queues, const std::vector<QueueStateVK*>& queueStates)
+{
+	for (size_t i = 0; i < queues.size(); i++)
+	{
+		std::scoped_lock<Spinlock> lock(queueStates[i]->Lock);
+		vkQueueWaitIdle(queues[i]);
+	}
+}
+
+void DeviceVK::getQueues(const char* pObjectName, const QueueIndices& queueIndices, std::vector<VkQueue>& queues, std::vector<QueueStateVK*>& queueStates)
 {
 	queues.resize(queueIndices.QueueCount);
+	queueStates.resize(queueIndices.QueueCount);
 
 	for (uint32_t queueIndex = 0; queueIndex < queueIndices.QueueCount; queueIndex++) {
 		vkGetDeviceQueue(m_Device, queueIndices.FamilyIndex, queueIndex, &queues[queueIndex]);
 		setVulkanObjectName(pObjectName, (uint64_t)queues[queueIndex], VK_OBJECT_TYPE_QUEUE);
+
+		QueueStateVK*& pQueueState = m_QueueStates[queues[queueIndex]];
+		if (pQueueState == nullptr) {
+			pQueueState = DBG_NEW QueueStateVK();
+			pQueueState->Queue				= queues[queueIndex];
+			pQueueState->TimelineSemaphore	= VK_NULL_HANDLE;
+			pQueueState->SubmittedValue		= 0;
+			m_UniqueQueueStates.push_back(pQueueState);
+		}
+
+		queueStates[queueIndex] = pQueueState;
 	}
 }
 
 void DeviceVK::wait()
 {
+	// vkDeviceWaitIdle requires every queue to be externally synchronized, worker threads may be submitting. The locks are taken in the
+	// same order by every caller, and no other path holds more than one queue lock at a time
+	for (QueueStateVK* pQueueState : m_UniqueQueueStates)
+	{
+		pQueueState->Lock.lock();
+	}
+
 	VkResult result = vkDeviceWaitIdle(m_Device);
 	if (result != VK_SUCCESS)
 	{
 		LOG("vkDeviceWaitIdle failed");
 	}
+
+	for (auto queueStateItr = m_UniqueQueueStates.rbegin(); queueStateItr != m_UniqueQueueStates.rend(); queueStateItr++)
+	{
+		(*queueStateItr)->Lock.unlock();
+	}
 }
 
 void DeviceVK::setVulkanObjectName(const char* pName, uint64_t objectHandle, VkObjectType type)
@@ -228,10 +432,34 @@ bool DeviceVK::initPhysicalDevice()
 	setEnabledExtensions();
 	m_DeviceQueueFamilyIndices = findQueueFamilies(m_PhysicalDevice);
 
-	// Save device's limits
-	VkPhysicalDeviceProperties deviceProperties;
-	vkGetPhysicalDeviceProperties(m_PhysicalDevice, &deviceProperties);
-	m_DeviceLimits = deviceProperties.limits;
+	// Save device's limits and identity
+	if (m_pInstance->isExtensionEnabled(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME) && m_pInstance->vkGetPhysicalDeviceProperties2KHR != nullptr)
+	{
+		VkPhysicalDeviceIDPropertiesKHR idProperties = {};
+		idProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES_KHR;
+
+		VkPhysicalDeviceProperties2KHR deviceProperties2 = {};
+		deviceProperties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2_KHR;
+		deviceProperties2.pNext = &idProperties;
+		m_pInstance->vkGetPhysicalDeviceProperties2KHR(m_PhysicalDevice, &deviceProperties2);
+
+		m_DeviceLimits = deviceProperties2.properties.limits;
+		m_DriverVersion = deviceProperties2.properties.driverVersion;
+		std::memcpy(m_DeviceUUID, idProperties.deviceUUID, VK_UUID_SIZE);
+	}
+	else
+	{
+		VkPhysicalDeviceProperties deviceProperties = {};
+		vkGetPhysicalDeviceProperties(m_PhysicalDevice, &deviceProperties);
+
+		m_DeviceLimits = deviceProperties.limits;
+		m_DriverVersion = deviceProperties.driverVersion;
+
+		// Without the device UUID, the vendor and device IDs identify the device well enough for caches keyed on it
+		std::memset(m_DeviceUUID, 0, VK_UUID_SIZE);
+		std::memcpy(m_DeviceUUID, &deviceProperties.vendorID, sizeof(uint32_t));
+		std::memcpy(m_DeviceUUID + sizeof(uint32_t), &deviceProperties.deviceID, sizeof(uint32_t));
+	}
 
 	return true;
 }
@@ -274,6 +502,18 @@ bool DeviceVK::initLogicalDevice()
 
 	createInfo.pEnabledFeatures = &deviceFeatures;
 
+#ifdef VK_KHR_timeline_semaphore
+	VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timelineSemaphoreFeatures = {};
+	timelineSemaphoreFeatures.sType				= VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+	timelineSemaphoreFeatures.pNext				= nullptr;
+	timelineSemaphoreFeatures.timelineSemaphore	= VK_TRUE;
+
+	if (m_ExtensionsStatus[VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME])
+	{
+		createInfo.pNext = &timelineSemaphoreFeatures;
+	}
+#endif
+
 	createInfo.enabledExtensionCount = static_cast<uint32_t>(m_EnabledExtensions.size());
 	createInfo.ppEnabledExtensionNames = m_EnabledExtensions.data();
 
@@ -295,13 +535,15 @@ bool DeviceVK::initLogicalDevice()
 	}
 
 	//Retrive queues
-	getQueues("Graphics Queue", m_DeviceQueueFamilyIndices.GraphicsQueues.value(), m_GraphicsQueues);
-	getQueues("Compute Queue", m_DeviceQueueFamilyIndices.ComputeQueues.value(), m_ComputeQueues);
-	getQueues("Transfer Queue", m_DeviceQueueFamilyIndices.TransferQueues.value(), m_TransferQueues);
+	getQueues("Graphics Queue", m_DeviceQueueFamilyIndices.GraphicsQueues.value(), m_GraphicsQueues, m_GraphicsQueueStates);
+	getQueues("Compute Queue", m_DeviceQueueFamilyIndices.ComputeQueues.value(), m_ComputeQueues, m_ComputeQueueStates);
+	getQueues("Transfer Queue", m_DeviceQueueFamilyIndices.TransferQueues.value(), m_TransferQueues, m_TransferQueueStates);
 
 	std::vector<VkQueue> presentQueue;
-	getQueues("Present Queue", m_DeviceQueueFamilyIndices.PresentQueues.value(), presentQueue);
-	m_PresentQueue = presentQueue.front();
+	std::vector<QueueStateVK*> presentQueueState;
+	getQueues("Present Queue", m_DeviceQueueFamilyIndices.PresentQueues.value(), presentQueue, presentQueueState);
+	m_PresentQueue			= presentQueue.front();
+	m_pPresentQueueState	= presentQueueState.front();
 
 	return true;
 }
@@ -368,6 +610,16 @@ void DeviceVK::setEnabledExtensions()
 
 	std::set<std::string> optionalExtensions(m_RequestedOptionalExtensions.begin(), m_RequestedOptionalExtensions.end());
 
+#ifdef VK_KHR_timeline_semaphore
+	// The instance targets Vulkan 1.0, where timeline semaphores depend on an instance extension that is only enabled if it is available
+	if (!m_pInstance->isExtensionEnabled(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME) && optionalExtensions.erase(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME) > 0)
+	{
+		std::cerr << "--- Device: Optional Extension [ " << VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME << " ] requires [ "
+			<< VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME << " ] on the instance!" << std::endl;
+		m_ExtensionsStatus[VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME] = false;
+	}
+#endif
+
 	for (const auto& extension : m_AvailabeExtensions)
 	{
 		if (optionalExtensions.erase(extension.extensionName) > 0)
@@ -433,6 +685,50 @@ void DeviceVK::registerExtensionFunctions()
 	{
 		std::cerr << "--- Device: Failed to intialize [ VK_NV_ray_tracing ] function pointers!" << std::endl;
 	}
+
+#ifdef VK_KHR_timeline_semaphore
+	if (m_ExtensionsStatus[VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME])
+	{
+		GET_DEVICE_PROC_ADDR(m_Device, vkWaitSemaphoresKHR);
+		m_TimelineSemaphoresSupported = vkWaitSemaphoresKHR != nullptr;
+	}
+#endif
+
+	if (m_TimelineSemaphoresSupported)
+	{
+		std::cout << "--- Device: Successfully intialized [ VK_KHR_timeline_semaphore ] function pointers!" << std::endl;
+	}
+	else
+	{
+		std::cerr << "--- Device: Timeline semaphores not supported, frames in flight are tracked with per-queue fences" << std::endl;
+	}
+}
+
+bool DeviceVK::createTimelineSemaphores()
+{
+#ifdef VK_KHR_timeline_semaphore
+	if (m_TimelineSemaphoresSupported)
+	{
+		VkSemaphoreTypeCreateInfoKHR typeInfo = {};
+		typeInfo.sType			= VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR;
+		typeInfo.pNext			= nullptr;
+		typeInfo.semaphoreType	= VK_SEMAPHORE_TYPE_TIMELINE_KHR;
+		typeInfo.initialValue	= 0;
+
+		VkSemaphoreCreateInfo semaphoreInfo = {};
+		semaphoreInfo.sType	= VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		semaphoreInfo.pNext	= &typeInfo;
+		semaphoreInfo.flags	= 0;
+
+		for (QueueStateVK* pQueueState : m_UniqueQueueStates)
+		{
+			VK_CHECK_RESULT_RETURN_FALSE(vkCreateSemaphore(m_Device, &semaphoreInfo, nullptr, &pQueueState->TimelineSemaphore), "Create Timeline Semaphore Failed");
+			setVulkanObjectName("Queue Timeline Semaphore", (uint64_t)pQueueState->TimelineSemaphore, VK_OBJECT_TYPE_SEMAPHORE);
+		}
+	}
+#endif
+
+	return true;
 }
 
 QueueIndices DeviceVK::getQueueFamilyIndex(VkQueueFlagBits queueFlags, const std::vector<VkQueueFamilyProperties>& queueFamilies)
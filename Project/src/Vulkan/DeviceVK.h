@@ -9,7 +9,9 @@
 
 class InstanceVK;
 class CopyHandlerVK;
+class DeviceMemoryAllocatorVK;
 class CommandBufferVK;
+class FrameSchedulerVK;
 
 struct QueueIndices {
 	bool operator<(const QueueIndices& other) const {
@@ -20,6 +22,23 @@ struct QueueIndices {
 	uint32_t QueueCount;
 };
 
+// Submission state of a VkQueue. Queue families can be the same family, so the state is shared by every alias of the queue
+struct QueueStateVK
+{
+	VkQueue Queue;
+	Spinlock Lock;
+	// Signaled with SubmittedValue by the queue's latest submission, VK_NULL_HANDLE without timeline semaphore support
+	VkSemaphore TimelineSemaphore;
+	uint64_t SubmittedValue;
+};
+
+// A value on a queue's timeline semaphore that a submission to another queue can wait for
+struct TimelineWaitVK
+{
+	VkSemaphore Semaphore;
+	uint64_t Value;
+};
+
 struct QueueFamilyIndices
 {
 	std::optional<QueueIndices> GraphicsQueues;
@@ -54,6 +73,30 @@ public:
 	void executeTransfer(CommandBufferVK* pCommandBuffer, const VkSemaphore* pWaitSemaphore, const VkPipelineStageFlags* pWaitStages,
 		uint32_t waitSemaphoreCount, const VkSemaphore* pSignalSemaphores, uint32_t signalSemaphoreCount, uint32_t queueIndex = 0);
 
+	// Submits the command buffers in one batch, in order. The semaphores are waited on before the first command buffer and signaled after the last
+	void executeGraphics(CommandBufferVK* const* ppCommandBuffers, uint32_t commandBufferCount, const VkSemaphore* pWaitSemaphore, const VkPipelineStageFlags* pWaitStages,
+		uint32_t waitSemaphoreCount, const VkSemaphore* pSignalSemaphores, uint32_t signalSemaphoreCount, uint32_t queueIndex = 0);
+	void executeCompute(CommandBufferVK* const* ppCommandBuffers, uint32_t commandBufferCount, const VkSemaphore* pWaitSemaphore, const VkPipelineStageFlags* pWaitStages,
+		uint32_t waitSemaphoreCount, const VkSemaphore* pSignalSemaphores, uint32_t signalSemaphoreCount, uint32_t queueIndex = 0);
+	void executeTransfer(CommandBufferVK* const* ppCommandBuffers, uint32_t commandBufferCount, const VkSemaphore* pWaitSemaphore, const VkPipelineStageFlags* pWaitStages,
+		uint32_t waitSemaphoreCount, const VkSemaphore* pSignalSemaphores, uint32_t signalSemaphoreCount, uint32_t queueIndex = 0);
+	// Submits the command buffers in one batch once other queues have reached the timeline values, e.g. when work moves between queues.
+	// Requires timeline semaphore support
+	void executeCompute(CommandBufferVK* const* ppCommandBuffers, uint32_t commandBufferCount, const TimelineWaitVK* pTimelineWaits, uint32_t timelineWaitCount, uint32_t queueIndex);
+
+	VkResult present(const VkPresentInfoKHR& presentInfo);
+
+	// Timeline values signaled by the latest submission to each queue, in the same order for every call
+	void getSubmittedTimelineValues(std::vector<uint64_t>& values);
+	// Waits for every queue to reach its value, values from getSubmittedTimelineValues
+	void waitForTimelineValues(const std::vector<uint64_t>& values);
+	// Signals each queue's fence once the work submitted to the queue so far has finished, fences in the order of the timeline values.
+	// Used to track frames without timeline semaphore support
+	void signalQueueFences(const VkFence* pFences);
+	// Value signaled by the latest submission to the compute queue. The semaphore is VK_NULL_HANDLE without timeline semaphore support
+	TimelineWaitVK getComputeTimelineValue(uint32_t queueIndex);
+	uint32_t getUniqueQueueCount() const { return uint32_t(m_UniqueQueueStates.size()); }
+
 	void waitGraphics();
 	void waitCompute();
 	void waitTransfer();
@@ -65,15 +108,26 @@ public:
 	VkDevice			getDevice() const			{ return m_Device; }
 	VkQueue				getPresentQueue() const		{ return m_PresentQueue; }
 	CopyHandlerVK*		getCopyHandler() const		{ return m_pCopyHandler; }
+	FrameSchedulerVK*	getFrameScheduler() const	{ return m_pFrameScheduler; }
+	DeviceMemoryAllocatorVK* getMemoryAllocator() const { return m_pMemoryAllocator; }
 
 	const QueueFamilyIndices& getQueueFamilyIndices() const { return m_DeviceQueueFamilyIndices; }
 	bool hasUniqueQueueFamilyIndices() const;
 
 	void getMaxComputeWorkGroupSize(uint32_t pWorkGroupSize[3]);
+	uint32_t getMaxComputeWorkGroupInvocations() const { return m_DeviceLimits.maxComputeWorkGroupInvocations; };
 	float getTimestampPeriod() const { return m_DeviceLimits.timestampPeriod; };
+	VkDeviceSize getNonCoherentAtomSize() const { return m_DeviceLimits.nonCoherentAtomSize; };
+	VkDeviceSize getMinStorageBufferOffsetAlignment() const { return m_DeviceLimits.minStorageBufferOffsetAlignment; };
 
 	const VkPhysicalDeviceRayTracingPropertiesNV& getRayTracingProperties() const { return m_RayTracingProperties; }
 	bool supportsRayTracing() const { return m_ExtensionsStatus.at(VK_NV_RAY_TRACING_EXTENSION_NAME); }
+	bool supportsTimelineSemaphores() const { return m_TimelineSemaphoresSupported; }
+
+	// Identifies the physical device across runs, VK_UUID_SIZE bytes. Holds the vendor and device IDs when the instance lacks
+	// VK_KHR_get_physical_device_properties2
+	const uint8_t* getDeviceUUID() const { return m_DeviceUUID; }
+	uint32_t getDriverVersion() const { return m_DriverVersion; }
 
 private:
 	bool initPhysicalDevice();
@@ -85,11 +139,14 @@ private:
 	QueueFamilyIndices findQueueFamilies(VkPhysicalDevice physicalDevice);
 
 	void registerExtensionFunctions();
+	bool createTimelineSemaphores();
 
-	void executeCommandBuffer(VkQueue queue, CommandBufferVK* pCommandBuffer, const VkSemaphore* pWaitSemaphore, const VkPipelineStageFlags* pWaitStages,
-		uint32_t waitSemaphoreCount, const VkSemaphore* pSignalSemaphores, uint32_t signalSemaphoreCount);
+	void executeCommandBuffers(VkQueue queue, QueueStateVK* pQueueState, CommandBufferVK* const* ppCommandBuffers, uint32_t commandBufferCount, const VkSemaphore* pWaitSemaphore,
+		const VkPipelineStageFlags* pWaitStages, uint32_t waitSemaphoreCount, const VkSemaphore* pSignalSemaphores, uint32_t signalSemaphoreCount,
+		const TimelineWaitVK* pTimelineWaits = nullptr, uint32_t timelineWaitCount = 0);
+	void waitQueues(const std::vector<VkQueue>& queues, const std::vector<QueueStateVK*>& queueStates);
 
-	void getQueues(const char* pObjectName, const QueueIndices& queueIndices, std::vector<VkQueue>& queues);
+	void getQueues(const char* pObjectName, const QueueIndices& queueIndices, std::vector<VkQueue>& queues, std::vector<QueueStateVK*>& queueStates);
 
 private:
 	static QueueIndices getQueueFamilyIndex(VkQueueFlagBits queueFlags, const std::vector<VkQueueFamilyProperties>& queueFamilies);
@@ -101,19 +158,24 @@ private:
 	QueueFamilyIndices m_DeviceQueueFamilyIndices;
 
 	std::vector<VkQueue> m_GraphicsQueues;
+	std::vector<QueueStateVK*> m_GraphicsQueueStates;
 	uint32_t m_NextGraphicsQueue;
 
 	std::vector<VkQueue> m_ComputeQueues;
+	std::vector<QueueStateVK*> m_ComputeQueueStates;
 	uint32_t m_NextComputeQueue;
 
 	std::vector<VkQueue> m_TransferQueues;
+	std::vector<QueueStateVK*> m_TransferQueueStates;
 	uint32_t m_NextTransferQueue;
 
 	VkQueue m_PresentQueue;
+	QueueStateVK* m_pPresentQueueState;
 
-	Spinlock m_ComputeLock;
-	Spinlock m_GraphicsLock;
-	Spinlock m_TransferLock;
+	// Submissions to a queue have to be externally synchronized, so every VkQueue has its own lock
+	std::unordered_map<VkQueue, QueueStateVK*> m_QueueStates;
+	// Every queue state once, in the order of the timeline values
+	std::vector<QueueStateVK*> m_UniqueQueueStates;
 
 	std::vector<const char*> m_RequestedRequiredExtensions;
 	std::vector<const char*> m_RequestedOptionalExtensions;
@@ -123,13 +185,18 @@ private:
 
 	InstanceVK* m_pInstance;
 	CopyHandlerVK* m_pCopyHandler;
+	FrameSchedulerVK* m_pFrameScheduler;
+	DeviceMemoryAllocatorVK* m_pMemoryAllocator;
 
 	VkPhysicalDeviceLimits m_DeviceLimits;
+	uint8_t m_DeviceUUID[VK_UUID_SIZE];
+	uint32_t m_DriverVersion;
 
 	//Extensions
 	VkPhysicalDeviceRayTracingPropertiesNV m_RayTracingProperties;
 
 	bool m_UseMultipleQueues;
+	bool m_TimelineSemaphoresSupported;
 
 public:
 	//Extension Function Pointers
@@ -142,5 +209,9 @@ public:
 	PFN_vkCreateRayTracingPipelinesNV					vkCreateRayTracingPipelinesNV;
 	PFN_vkGetRayTracingShaderGroupHandlesNV				vkGetRayTracingShaderGroupHandlesNV;
 	PFN_vkCmdTraceRaysNV								vkCmdTraceRaysNV;
+
+#ifdef VK_KHR_timeline_semaphore
+	PFN_vkWaitSemaphoresKHR								vkWaitSemaphoresKHR;
+#endif
 };
 
@@ -0,0 +1,96 @@
+#include "FrameSchedulerVK.h"
+#include "DeviceVK.h"
+
+FrameSchedulerVK::FrameSchedulerVK(DeviceVK* pDevice)
+	: m_pDevice(pDevice),
+	m_FrameIndex(0)
+{
+}
+
+FrameSchedulerVK::~FrameSchedulerVK()
+{
+	for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+	{
+		for (VkFence fence : m_FrameFences[i])
+		{
+			vkDestroyFence(m_pDevice->getDevice(), fence, nullptr);
+		}
+	}
+}
+
+bool FrameSchedulerVK::init()
+{
+	if (m_pDevice->supportsTimelineSemaphores())
+	{
+		return true;
+	}
+
+	// The fences of frames that have not been used yet are signaled, so that beginning them does not wait
+	VkFenceCreateInfo fenceInfo = {};
+	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+	for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+	{
+		m_FrameFences[i].resize(m_pDevice->getUniqueQueueCount(), VK_NULL_HANDLE);
+
+		for (VkFence& fence : m_FrameFences[i])
+		{
+			VK_CHECK_RESULT_RETURN_FALSE(vkCreateFence(m_pDevice->getDevice(), &fenceInfo, nullptr, &fence), "Create Fence for FrameScheduler Failed");
+		}
+	}
+
+	return true;
+}
+
+void FrameSchedulerVK::beginFrame()
+{
+	waitForFrame(getFrameInFlightIndex());
+
+	std::vector<VkFence>& frameFences = m_FrameFences[getFrameInFlightIndex()];
+	if (!frameFences.empty())
+	{
+		vkResetFences(m_pDevice->getDevice(), uint32_t(frameFences.size()), frameFences.data());
+	}
+}
+
+void FrameSchedulerVK::endFrame()
+{
+	const uint32_t frameInFlightIndex = getFrameInFlightIndex();
+
+	if (m_pDevice->supportsTimelineSemaphores())
+	{
+		m_pDevice->getSubmittedTimelineValues(m_FrameValues[frameInFlightIndex]);
+	}
+	else
+	{
+		m_pDevice->signalQueueFences(m_FrameFences[frameInFlightIndex].data());
+	}
+
+	m_FrameIndex++;
+}
+
+void FrameSchedulerVK::waitForFrames()
+{
+	if (m_FrameIndex > 0)
+	{
+		// Queues finish their work in submission order, so the latest frame finishing means every earlier frame has finished
+		waitForFrame(uint32_t((m_FrameIndex - 1) % MAX_FRAMES_IN_FLIGHT));
+	}
+}
+
+void FrameSchedulerVK::waitForFrame(uint32_t frameInFlightIndex)
+{
+	// Frames in flight that have not been used yet have nothing to wait for
+	const std::vector<uint64_t>& frameValues = m_FrameValues[frameInFlightIndex];
+	if (!frameValues.empty())
+	{
+		m_pDevice->waitForTimelineValues(frameValues);
+	}
+
+	const std::vector<VkFence>& frameFences = m_FrameFences[frameInFlightIndex];
+	if (!frameFences.empty())
+	{
+		vkWaitForFences(m_pDevice->getDevice(), uint32_t(frameFences.size()), frameFences.data(), VK_TRUE, UINT64_MAX);
+	}
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <vector>
+
+#include "VulkanCommon.h"
+
+class DeviceVK;
+
+/*
+	Lets up to MAX_FRAMES_IN_FLIGHT frames execute at once. Every submission signals its queue's timeline semaphore with the next value,
+	and each frame records the values every queue has reached when it ends. Before a frame reuses the resources of the frame
+	MAX_FRAMES_IN_FLIGHT frames earlier, the CPU waits for exactly that frame's values instead of for the whole device to idle.
+	Without timeline semaphore support, each frame signals a fence per queue instead
+*/
+class FrameSchedulerVK
+{
+public:
+	FrameSchedulerVK(DeviceVK* pDevice);
+	~FrameSchedulerVK();
+
+	DECL_NO_COPY(FrameSchedulerVK);
+
+	bool init();
+
+	// Waits for the frame that last used the frame in flight index to finish on every queue
+	void beginFrame();
+	// Records the work that has been submitted to each queue during the frame
+	void endFrame();
+	// Waits for every frame that has ended
+	void waitForFrames();
+
+	uint64_t getFrameIndex() const			{ return m_FrameIndex; }
+	uint32_t getFrameInFlightIndex() const	{ return uint32_t(m_FrameIndex % MAX_FRAMES_IN_FLIGHT); }
+
+private:
+	void waitForFrame(uint32_t frameInFlightIndex);
+
+private:
+	DeviceVK* m_pDevice;
+
+	// Timeline values of every queue when each frame in flight ended
+	std::vector<uint64_t> m_FrameValues[MAX_FRAMES_IN_FLIGHT];
+	// Fences of every queue for each frame in flight, only used without timeline semaphores
+	std::vector<VkFence> m_FrameFences[MAX_FRAMES_IN_FLIGHT];
+	uint64_t m_FrameIndex;
+};
@@ -68,6 +68,9 @@ void GraphicsContextVK::init()
 	m_Device.addOptionalExtension(VK_KHR_GET_MEMORY_REQUIREMENTS_2_EXTENSION_NAME);
 	//m_Device.addOptionalExtension(VK_KHR_MAINTENANCE3_EXTENSION_NAME);
 	m_Device.addOptionalExtension(VK_NV_RAY_TRACING_EXTENSION_NAME);
+#ifdef VK_KHR_timeline_semaphore
+	m_Device.addOptionalExtension(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+#endif
 
 	m_Device.finalize(&m_Instance, m_UseMultipleQueues);
 
@@ -86,9 +89,9 @@ IRenderer* GraphicsContextVK::createParticleRenderer(RenderingHandler* pRenderin
 	return DBG_NEW ParticleRendererVK(this, reinterpret_cast<RenderingHandlerVK*>(pRenderingHandler));
 }
 
-ParticleEmitterHandler* GraphicsContextVK::createParticleEmitterHandler(bool renderingEnabled, uint32_t frameCount)
+ParticleEmitterHandler* GraphicsContextVK::createParticleEmitterHandler(bool renderingEnabled, uint32_t frameCount, bool batchedCompute)
 {
-	return DBG_NEW ParticleEmitterHandlerVK(renderingEnabled, frameCount, m_UseMultipleQueues);
+	return DBG_NEW ParticleEmitterHandlerVK(renderingEnabled, frameCount, m_UseMultipleQueues, batchedCompute);
 }
 
 IImgui* GraphicsContextVK::createImgui()
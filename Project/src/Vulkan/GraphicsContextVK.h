@@ -21,7 +21,7 @@ public:
 
 	virtual RenderingHandler* createRenderingHandler() override;
 	virtual IRenderer* createParticleRenderer(RenderingHandler* pRenderingHandler) override;
-	virtual ParticleEmitterHandler* createParticleEmitterHandler(bool renderingEnabled, uint32_t frameCount) override;
+	virtual ParticleEmitterHandler* createParticleEmitterHandler(bool renderingEnabled, uint32_t frameCount, bool batchedCompute) override;
 	virtual IImgui* createImgui() override;
 
 	virtual IScene* createScene(const RenderingHandler* pRenderingHandler) override;
@@ -4,7 +4,7 @@
 ImageVK::ImageVK(VkImage image, VkFormat format)
 	: m_pDevice(nullptr),
 	m_Image(image),
-	m_Memory(VK_NULL_HANDLE),
+	m_Allocation(),
 	m_Params()
 {
 	m_Params.Format = format;
@@ -13,7 +13,7 @@ ImageVK::ImageVK(VkImage image, VkFormat format)
 ImageVK::ImageVK(DeviceVK* pDevice)
 	: m_pDevice(pDevice),
 	m_Image(VK_NULL_HANDLE),
-	m_Memory(VK_NULL_HANDLE),
+	m_Allocation(),
 	m_Params()
 {
 }
@@ -29,11 +29,7 @@ ImageVK::~ImageVK()
 			m_Image = VK_NULL_HANDLE;
 		}
 
-		if (m_Memory != VK_NULL_HANDLE)
-		{
-			vkFreeMemory(m_pDevice->getDevice(), m_Memory, nullptr);
-			m_Memory = VK_NULL_HANDLE;
-		}
+		m_pDevice->getMemoryAllocator()->free(m_Allocation);
 	}
 }
 
@@ -63,17 +59,17 @@ bool ImageVK::init(const ImageParams& params)
 	VkMemoryRequirements memRequirements;
 	vkGetImageMemoryRequirements(m_pDevice->getDevice(), m_Image, &memRequirements);
 
-	VkMemoryAllocateInfo allocInfo = {};
-	allocInfo.sType				= VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.allocationSize	= memRequirements.size;
-	allocInfo.memoryTypeIndex	= findMemoryType(m_pDevice->getPhysicalDevice(), memRequirements.memoryTypeBits, params.MemoryProperty);
-
-	VK_CHECK_RESULT_RETURN_FALSE(vkAllocateMemory(m_pDevice->getDevice(), &allocInfo, nullptr, &m_Memory), "Failed to allocate image memory");
+	const uint32_t memoryTypeIndex = findMemoryType(m_pDevice->getPhysicalDevice(), memRequirements.memoryTypeBits, params.MemoryProperty);
+	if (!m_pDevice->getMemoryAllocator()->allocate(memRequirements, memoryTypeIndex, true, m_Allocation))
+	{
+		LOG("Failed to allocate image memory");
+		return false;
+	}
 
 	m_Params = params;
 	D_LOG("--- Image: Allocated '%d' bytes for image", memRequirements.size);
 
-	VK_CHECK_RESULT_RETURN_FALSE(vkBindImageMemory(m_pDevice->getDevice(), m_Image, m_Memory, 0), "Failed to bind image memory");
+	VK_CHECK_RESULT_RETURN_FALSE(vkBindImageMemory(m_pDevice->getDevice(), m_Image, m_Allocation.Memory, m_Allocation.Offset), "Failed to bind image memory");
 
 	return true;
 }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Common/IImage.h"
+#include "DeviceMemoryAllocatorVK.h"
 #include "VulkanCommon.h"
 
 class DeviceVK;
@@ -38,6 +39,6 @@ public:
 private:
 	DeviceVK* m_pDevice;
 	VkImage m_Image;
-	VkDeviceMemory m_Memory;
+	DeviceAllocationVK m_Allocation;
 	ImageParams m_Params;
 };
\ No newline at end of file
@@ -14,6 +14,7 @@ InstanceVK::InstanceVK() :
 	vkSetDebugUtilsObjectNameEXT(nullptr),
 	vkDestroyDebugUtilsMessengerEXT(nullptr),
 	vkCreateDebugUtilsMessengerEXT(nullptr),
+	vkGetPhysicalDeviceProperties2KHR(nullptr),
 	m_DebugMessenger(VK_NULL_HANDLE)
 {
 }
@@ -182,6 +183,12 @@ bool InstanceVK::validationLayersSupported()
 	return true;
 }
 
+bool InstanceVK::isExtensionEnabled(const char* extensionName) const
+{
+	auto extension = m_ExtensionsStatus.find(extensionName);
+	return extension != m_ExtensionsStatus.end() && extension->second;
+}
+
 bool InstanceVK::setEnabledExtensions()
 {
 	retriveAvailableExtensions();
@@ -278,6 +285,11 @@ void InstanceVK::registerExtensionFunctions()
 	{
 		LOG("--- Instance: Failed to intialize [ %s ] function pointers", VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
 	}
+
+	if (m_ExtensionsStatus[VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME])
+	{
+		GET_INSTANCE_PROC_ADDR(m_Instance, vkGetPhysicalDeviceProperties2KHR);
+	}
 }
 
 VkBool32 InstanceVK::DebugCallback(
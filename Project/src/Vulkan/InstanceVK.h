@@ -23,6 +23,8 @@ public:
 	
 	//GETTERS
 	bool							validationLayersEnabled()	{ return m_ValidationLayersEnabled; }
+	// Required or optional extension that was enabled when the instance was created
+	bool							isExtensionEnabled(const char* extensionName) const;
 
 	VkInstance						getInstance()				{ return m_Instance; }
 	const std::vector<const char*>& getValidationLayers()		{ return m_ValidationLayers; }
@@ -68,5 +70,7 @@ public:
 	PFN_vkSetDebugUtilsObjectNameEXT	vkSetDebugUtilsObjectNameEXT;
 	PFN_vkDestroyDebugUtilsMessengerEXT vkDestroyDebugUtilsMessengerEXT;
 	PFN_vkCreateDebugUtilsMessengerEXT	vkCreateDebugUtilsMessengerEXT;
+	// nullptr unless VK_KHR_get_physical_device_properties2 is enabled, the core entry point needs a Vulkan 1.1 instance
+	PFN_vkGetPhysicalDeviceProperties2KHR vkGetPhysicalDeviceProperties2KHR;
 };
 
@@ -0,0 +1,466 @@
+#include "ParticleBatchVK.h"
+
+#include "Core/ParticlePositionPacker.h"
+#include "Vulkan/BufferVK.h"
+#include "Vulkan/CommandBufferVK.h"
+#include "Vulkan/CommandPoolVK.h"
+#include "Vulkan/DescriptorPoolVK.h"
+#include "Vulkan/DescriptorSetLayoutVK.h"
+#include "Vulkan/DescriptorSetVK.h"
+#include "Vulkan/GraphicsContextVK.h"
+#include "Vulkan/PipelineLayoutVK.h"
+#include "Vulkan/PipelineVK.h"
+
+#include <algorithm>
+#include <fstream>
+
+// Compute shader bindings, see ParticleEmitterHandlerVK
+#define POSITIONS_BINDING   	0
+#define VELOCITIES_BINDING  	1
+#define AGES_BINDING        	2
+#define EMITTERS_BINDING     	3
+#define VISIBLE_BINDING     	4
+#define DRAW_BINDING        	5
+
+// Smallest size of a shared buffer, which also keeps buffers that no emitter uses yet valid
+#define MIN_SHARED_BUFFER_SIZE	65536U
+#define MIN_EMITTER_CAPACITY	16U
+
+ParticleBatchVK::ParticleBatchVK(GraphicsContextVK* pGraphicsContext, uint32_t computeQueueIndex)
+	:m_pGraphicsContext(pGraphicsContext),
+	m_pProfiler(nullptr),
+	m_pDescriptorPool(nullptr),
+	m_pDescriptorSetLayout(nullptr),
+	m_pPipelineLayout(nullptr),
+	m_pPipeline(nullptr),
+	m_pAnalyticPipeline(nullptr),
+	m_IntegratedEmitterCount(0),
+	m_pPositionsBuffer(nullptr),
+	m_pVelocitiesBuffer(nullptr),
+	m_pAgesBuffer(nullptr),
+	m_PositionsSize(0),
+	m_MotionParticleCount(0),
+	m_pVisibleIndicesBuffer(nullptr),
+	m_pDrawCommandsBuffer(nullptr),
+	m_VisibleParticleCount(0),
+	m_EmitterCapacity(0),
+	m_WorkGroupSize(0),
+	m_ComputeQueueIndex(computeQueueIndex)
+{
+	for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+		m_ppCommandPools[i] = nullptr;
+		m_ppCommandBuffers[i] = nullptr;
+		m_ppDescriptorSets[i] = nullptr;
+		m_ppEmittersBuffers[i] = nullptr;
+		m_ppMappedEmitters[i] = nullptr;
+	}
+}
+
+ParticleBatchVK::~ParticleBatchVK()
+{
+	if (m_pProfiler != nullptr) {
+		saveTimestampsToFile();
+	}
+
+	for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+		SAFEDELETE(m_ppCommandPools[i]);
+		SAFEDELETE(m_ppEmittersBuffers[i]);
+	}
+
+	SAFEDELETE(m_pPositionsBuffer);
+	SAFEDELETE(m_pVelocitiesBuffer);
+	SAFEDELETE(m_pAgesBuffer);
+	SAFEDELETE(m_pVisibleIndicesBuffer);
+	SAFEDELETE(m_pDrawCommandsBuffer);
+	SAFEDELETE(m_pProfiler);
+}
+
+bool ParticleBatchVK::init(DescriptorPoolVK* pDescriptorPool, DescriptorSetLayoutVK* pDescriptorSetLayout, PipelineLayoutVK* pPipelineLayout,
+	PipelineVK* pPipeline, PipelineVK* pAnalyticPipeline, uint32_t workGroupSize, uint32_t frameCount)
+{
+	m_pDescriptorPool		= pDescriptorPool;
+	m_pDescriptorSetLayout	= pDescriptorSetLayout;
+	m_pPipelineLayout		= pPipelineLayout;
+	m_pPipeline				= pPipeline;
+	m_pAnalyticPipeline		= pAnalyticPipeline;
+	m_WorkGroupSize			= workGroupSize;
+
+	m_pProfiler = DBG_NEW ProfilerVK("Batched Particles Update", m_pGraphicsContext->getDevice(), 2u * frameCount);
+
+	return createCommandBuffers() && createDescriptorSets();
+}
+
+bool ParticleBatchVK::addEmitter(ParticleEmitter* pEmitter)
+{
+	// Every emitter gets a range, even an empty one, since the renderer binds it. The ranges are aligned so that they can be bound on their own
+	const uint64_t alignment = m_pGraphicsContext->getDevice()->getMinStorageBufferOffsetAlignment();
+	uint64_t positionsOffset = ((m_PositionsSize + alignment - 1) / alignment) * alignment;
+	uint64_t positionsSize = std::max(pEmitter->getPositionsSize(), alignment);
+	uint32_t motionParticleCount = pEmitter->isAnalytic() ? 0 : pEmitter->getParticleCapacity();
+
+	if (!reserveParticleBuffers(positionsOffset + positionsSize, m_MotionParticleCount + motionParticleCount, m_VisibleParticleCount + pEmitter->getParticleCapacity())) {
+		LOG("Failed to grow batched particle buffers");
+		return false;
+	}
+
+	if (!reserveEmitters(uint32_t(m_Emitters.size()) + 1)) {
+		LOG("Failed to grow batched emitters buffers");
+		return false;
+	}
+
+	pEmitter->setParticleBuffers(m_pPositionsBuffer, m_pVelocitiesBuffer, m_pAgesBuffer, positionsOffset, m_MotionParticleCount);
+	m_PositionsSize = positionsOffset + positionsSize;
+	m_MotionParticleCount += motionParticleCount;
+
+	uint64_t drawCommandOffset = m_DrawCommands.size() * sizeof(VkDrawIndexedIndirectCommand);
+	pEmitter->setDrawBuffers(m_pVisibleIndicesBuffer, m_pDrawCommandsBuffer, m_VisibleParticleCount, drawCommandOffset);
+	m_VisibleParticleCount += pEmitter->getParticleCapacity();
+
+	m_DrawCommands.emplace_back();
+	pEmitter->createDrawCommand(m_DrawCommands.back());
+
+	if (pEmitter->isAnalytic()) {
+		m_Emitters.push_back(pEmitter);
+	} else {
+		m_Emitters.insert(m_Emitters.begin() + m_IntegratedEmitterCount, pEmitter);
+		m_IntegratedEmitterCount++;
+	}
+
+	return true;
+}
+
+void ParticleBatchVK::update(float dt, uint32_t frameIndex, const glm::vec4* pFrustumPlanes, const TimelineWaitVK& renderedFrameWait)
+{
+	CommandBufferVK* pCommandBuffer = m_ppCommandBuffers[frameIndex];
+
+	// Waits for the frame's previous update, which also read the frame's emitter array
+	pCommandBuffer->reset(true);
+	m_ppCommandPools[frameIndex]->reset();
+
+	pCommandBuffer->begin(nullptr, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+
+	m_pProfiler->reset(frameIndex, pCommandBuffer);
+	m_pProfiler->beginFrame(pCommandBuffer);
+
+	// The shared buffers are used by every frame in flight, and the previous frame's update may still be running on the batch's queue. Its
+	// dispatches have to finish reading and counting into them before they are overwritten. The rendered frame's draws are on another queue,
+	// the submission waits for them
+	VkMemoryBarrier previousUpdateBarrier = {};
+	previousUpdateBarrier.sType			= VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	previousUpdateBarrier.srcAccessMask	= VK_ACCESS_SHADER_WRITE_BIT;
+	previousUpdateBarrier.dstAccessMask	= VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	pCommandBuffer->pipelineBarrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0, 1, &previousUpdateBarrier, 0, nullptr, 0, nullptr);
+
+	// The update shader counts every emitter's visible particles from 0
+	if (!m_DrawCommands.empty()) {
+		pCommandBuffer->updateBuffer(m_pDrawCommandsBuffer, 0, m_DrawCommands.data(), m_DrawCommands.size() * sizeof(VkDrawIndexedIndirectCommand));
+	}
+
+	// Integrated and analytic emitters are dispatched separately, each dispatch numbers its work groups from 0
+	BatchedEmitter* pBatchedEmitters = m_ppMappedEmitters[frameIndex];
+	uint32_t pWorkGroupCounts[2] = { 0, 0 };
+
+	for (uint32_t emitterIdx = 0; emitterIdx < uint32_t(m_Emitters.size()); emitterIdx++) {
+		ParticleEmitter* pEmitter = m_Emitters[emitterIdx];
+		pEmitter->updateGPU(dt);
+
+		// Particles that have just moved from the CPU catch up with their emitter
+		const float catchUpTime = pEmitter->getCatchUpTime();
+		pEmitter->setCatchUpTime(0.0f);
+
+		EmitterBuffer emitterBuffer = {};
+		pEmitter->createEmitterBuffer(emitterBuffer);
+
+		// The renderer reads the emitter's own uniform buffer
+		if (pEmitter->m_EmitterUpdated) {
+			BufferVK* pEmitterBuffer = reinterpret_cast<BufferVK*>(pEmitter->getEmitterBuffer());
+			pCommandBuffer->updateBuffer(pEmitterBuffer, 0, &emitterBuffer, sizeof(EmitterBuffer));
+
+			pEmitter->m_EmitterUpdated = false;
+		}
+
+		// Particles beyond the emitter's capacity have no room in the shared buffers
+		uint32_t particleCount = pEmitter->getMappedParticleCount();
+		uint32_t& workGroupCount = pWorkGroupCounts[pEmitter->isAnalytic() ? 1 : 0];
+
+		BatchedEmitter& batchedEmitter		= pBatchedEmitters[emitterIdx];
+		batchedEmitter.properties			= emitterBuffer;
+		batchedEmitter.properties.particleCount = particleCount;
+		batchedEmitter.firstParticle		= pEmitter->getFirstMotionParticle();
+		batchedEmitter.firstPositionWord	= uint32_t(pEmitter->getPositionsOffset() / sizeof(uint32_t));
+		batchedEmitter.firstWorkGroup		= workGroupCount;
+		batchedEmitter.time					= pEmitter->getSimulationTime();
+		batchedEmitter.positionFormat		= uint32_t(pEmitter->getGPUPositionFormat());
+		batchedEmitter.drawCommand			= uint32_t(pEmitter->getDrawCommandOffset() / sizeof(VkDrawIndexedIndirectCommand));
+		batchedEmitter.dt					= dt + catchUpTime;
+
+		workGroupCount += (particleCount + m_WorkGroupSize - 1) / m_WorkGroupSize;
+	}
+
+	m_ppEmittersBuffers[frameIndex]->flush(0, m_Emitters.size() * sizeof(BatchedEmitter));
+
+	// Makes the reset draw commands and the updated emitter buffers visible to the update shader
+	VkMemoryBarrier memoryBarrier = {};
+	memoryBarrier.sType			= VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	memoryBarrier.srcAccessMask	= VK_ACCESS_TRANSFER_WRITE_BIT;
+	memoryBarrier.dstAccessMask	= VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	pCommandBuffer->pipelineBarrier(VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+	// Both pipelines share the layout, so the descriptor set stays bound when switching pipelines
+	pCommandBuffer->bindDescriptorSet(VK_PIPELINE_BIND_POINT_COMPUTE, m_pPipelineLayout, 0, 1, &m_ppDescriptorSets[frameIndex], 0, nullptr);
+
+	PipelineVK* ppPipelines[2]		= { m_pPipeline, m_pAnalyticPipeline };
+	uint32_t pFirstEmitters[2]		= { 0, m_IntegratedEmitterCount };
+	uint32_t pEmitterCounts[2]		= { m_IntegratedEmitterCount, uint32_t(m_Emitters.size()) - m_IntegratedEmitterCount };
+
+	for (uint32_t dispatchIdx = 0; dispatchIdx < 2; dispatchIdx++) {
+		if (pWorkGroupCounts[dispatchIdx] == 0) {
+			continue;
+		}
+
+		pCommandBuffer->bindPipeline(ppPipelines[dispatchIdx]);
+
+		BatchedPushConstant pushConstant = { pFirstEmitters[dispatchIdx], pEmitterCounts[dispatchIdx] };
+		std::copy_n(pFrustumPlanes, 6, pushConstant.frustumPlanes);
+		pCommandBuffer->pushConstants(m_pPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(BatchedPushConstant), (const void*)&pushConstant);
+
+		pCommandBuffer->dispatch(glm::u32vec3(pWorkGroupCounts[dispatchIdx], 1, 1));
+	}
+
+	m_pProfiler->endFrame();
+	pCommandBuffer->end();
+
+	const uint32_t timelineWaitCount = renderedFrameWait.Semaphore != VK_NULL_HANDLE ? 1 : 0;
+	m_pGraphicsContext->getDevice()->executeCompute(&pCommandBuffer, 1, &renderedFrameWait, timelineWaitCount, m_ComputeQueueIndex);
+}
+
+bool ParticleBatchVK::createCommandBuffers()
+{
+	DeviceVK* pDevice = m_pGraphicsContext->getDevice();
+
+	const uint32_t computeQueueIndex = pDevice->getQueueFamilyIndices().ComputeQueues.value().FamilyIndex;
+	for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+		m_ppCommandPools[i] = DBG_NEW CommandPoolVK(pDevice, computeQueueIndex);
+
+		if (!m_ppCommandPools[i]->init()) {
+			return false;
+		}
+
+		m_ppCommandBuffers[i] = m_ppCommandPools[i]->allocateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+		if (m_ppCommandBuffers[i] == nullptr) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool ParticleBatchVK::createDescriptorSets()
+{
+	for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+		m_ppDescriptorSets[i] = m_pDescriptorPool->allocDescriptorSet(m_pDescriptorSetLayout);
+		if (m_ppDescriptorSets[i] == nullptr) {
+			LOG("Failed to create descriptor set for particle batch");
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool ParticleBatchVK::reserveParticleBuffers(uint64_t positionsSize, uint32_t motionParticleCount, uint32_t visibleParticleCount)
+{
+	const uint64_t velocitiesSize = motionParticleCount * sizeof(glm::vec4);
+	const uint64_t agesSize = motionParticleCount * sizeof(float);
+	const uint64_t visibleIndicesSize = visibleParticleCount * sizeof(uint32_t);
+
+	bool growPositions	= m_pPositionsBuffer == nullptr || positionsSize > m_pPositionsBuffer->getSizeInBytes();
+	bool growVelocities	= m_pVelocitiesBuffer == nullptr || velocitiesSize > m_pVelocitiesBuffer->getSizeInBytes();
+	bool growAges		= m_pAgesBuffer == nullptr || agesSize > m_pAgesBuffer->getSizeInBytes();
+	bool growVisible	= m_pVisibleIndicesBuffer == nullptr || visibleIndicesSize > m_pVisibleIndicesBuffer->getSizeInBytes();
+
+	if (!growPositions && !growVelocities && !growAges && !growVisible) {
+		return true;
+	}
+
+	// The buffers may be in use by the frames in flight
+	m_pGraphicsContext->getDevice()->wait();
+
+	if (growPositions && !growBuffer(&m_pPositionsBuffer, positionsSize, m_PositionsSize, "Batched Position Buffer")) {
+		return false;
+	}
+
+	if (growVelocities && !growBuffer(&m_pVelocitiesBuffer, velocitiesSize, m_MotionParticleCount * sizeof(glm::vec4), "Batched Velocity Buffer")) {
+		return false;
+	}
+
+	if (growAges && !growBuffer(&m_pAgesBuffer, agesSize, m_MotionParticleCount * sizeof(float), "Batched Age Buffer")) {
+		return false;
+	}
+
+	// Visible lists are rewritten by every update, so they are not copied
+	if (growVisible && !growBuffer(&m_pVisibleIndicesBuffer, visibleIndicesSize, 0, "Batched Visible Indices Buffer")) {
+		return false;
+	}
+
+	// The emitters' ranges are kept, but their render descriptor sets still read the old buffers
+	for (ParticleEmitter* pEmitter : m_Emitters) {
+		pEmitter->setParticleBuffers(m_pPositionsBuffer, m_pVelocitiesBuffer, m_pAgesBuffer, pEmitter->getPositionsOffset(), pEmitter->getFirstMotionParticle());
+		pEmitter->setDrawBuffers(m_pVisibleIndicesBuffer, m_pDrawCommandsBuffer, pEmitter->getFirstVisibleParticle(), pEmitter->getDrawCommandOffset());
+		releaseRenderDescriptorSets(pEmitter);
+	}
+
+	if (m_EmitterCapacity > 0) {
+		writeDescriptorSets();
+	}
+
+	return true;
+}
+
+bool ParticleBatchVK::reserveEmitters(uint32_t emitterCount)
+{
+	if (emitterCount <= m_EmitterCapacity) {
+		return true;
+	}
+
+	if (m_EmitterCapacity > 0) {
+		m_pGraphicsContext->getDevice()->wait();
+	}
+
+	m_EmitterCapacity = std::max(std::max(emitterCount, 2 * m_EmitterCapacity), MIN_EMITTER_CAPACITY);
+
+	// Written by the CPU every frame, device local memory is preferred since the GPU reads them every frame
+	BufferParams bufferParams = {};
+	bufferParams.IsExclusive = true;
+	bufferParams.Usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+	bufferParams.MemoryProperty = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+	bufferParams.PreferredMemoryProperty = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+	bufferParams.SizeInBytes = m_EmitterCapacity * sizeof(BatchedEmitter);
+
+	for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+		SAFEDELETE(m_ppEmittersBuffers[i]);
+
+		m_ppEmittersBuffers[i] = DBG_NEW BufferVK(m_pGraphicsContext->getDevice());
+		if (!m_ppEmittersBuffers[i]->init(bufferParams)) {
+			return false;
+		}
+		else
+		{
+			m_ppEmittersBuffers[i]->setName("Batched Emitters Buffer");
+		}
+
+		m_ppEmittersBuffers[i]->map((void**)&m_ppMappedEmitters[i]);
+	}
+
+	// Read by indirect draws, the commands are copied to it before every update so the old buffer's contents are not kept
+	bufferParams.Usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+	bufferParams.MemoryProperty = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+	bufferParams.PreferredMemoryProperty = 0;
+	bufferParams.SizeInBytes = m_EmitterCapacity * sizeof(VkDrawIndexedIndirectCommand);
+
+	SAFEDELETE(m_pDrawCommandsBuffer);
+
+	m_pDrawCommandsBuffer = DBG_NEW BufferVK(m_pGraphicsContext->getDevice());
+	if (!m_pDrawCommandsBuffer->init(bufferParams)) {
+		return false;
+	}
+	else
+	{
+		m_pDrawCommandsBuffer->setName("Batched Draw Commands Buffer");
+	}
+
+	for (ParticleEmitter* pEmitter : m_Emitters) {
+		pEmitter->setDrawBuffers(m_pVisibleIndicesBuffer, m_pDrawCommandsBuffer, pEmitter->getFirstVisibleParticle(), pEmitter->getDrawCommandOffset());
+	}
+
+	writeDescriptorSets();
+	return true;
+}
+
+bool ParticleBatchVK::growBuffer(BufferVK** ppBuffer, uint64_t newSize, uint64_t copySize, const char* pName)
+{
+	// Doubling keeps the number of times the buffers are grown logarithmic in the number of emitters
+	BufferVK* pOldBuffer = *ppBuffer;
+	if (pOldBuffer != nullptr) {
+		newSize = std::max(newSize, 2 * pOldBuffer->getSizeInBytes());
+	}
+
+	BufferParams bufferParams = {};
+	bufferParams.IsExclusive = true;
+	bufferParams.MemoryProperty = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+	bufferParams.Usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+	bufferParams.SizeInBytes = std::max(newSize, uint64_t(MIN_SHARED_BUFFER_SIZE));
+
+	BufferVK* pNewBuffer = DBG_NEW BufferVK(m_pGraphicsContext->getDevice());
+	if (!pNewBuffer->init(bufferParams)) {
+		SAFEDELETE(pNewBuffer);
+		return false;
+	}
+	else
+	{
+		pNewBuffer->setName(pName);
+	}
+
+	// Keep the particles of the emitters already in the batch
+	if (pOldBuffer != nullptr && copySize > 0) {
+		CommandBufferVK* pTempCommandBuffer = m_ppCommandPools[0]->allocateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+		pTempCommandBuffer->reset(true);
+		pTempCommandBuffer->begin(nullptr, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+
+		pTempCommandBuffer->copyBuffer(pOldBuffer, 0, pNewBuffer, 0, copySize);
+
+		pTempCommandBuffer->end();
+		m_pGraphicsContext->getDevice()->executeCompute(pTempCommandBuffer, nullptr, nullptr, 0, nullptr, 0, m_ComputeQueueIndex);
+
+		// Wait for command buffer to finish executing before deleting it
+		pTempCommandBuffer->reset(true);
+		m_ppCommandPools[0]->freeCommandBuffer(&pTempCommandBuffer);
+	}
+
+	SAFEDELETE(*ppBuffer);
+	*ppBuffer = pNewBuffer;
+	return true;
+}
+
+void ParticleBatchVK::writeDescriptorSets()
+{
+	for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+		m_ppDescriptorSets[i]->writeStorageBufferDescriptor(m_pPositionsBuffer,		POSITIONS_BINDING);
+		m_ppDescriptorSets[i]->writeStorageBufferDescriptor(m_pVelocitiesBuffer,	VELOCITIES_BINDING);
+		m_ppDescriptorSets[i]->writeStorageBufferDescriptor(m_pAgesBuffer,			AGES_BINDING);
+		m_ppDescriptorSets[i]->writeStorageBufferDescriptor(m_ppEmittersBuffers[i],	EMITTERS_BINDING);
+		m_ppDescriptorSets[i]->writeStorageBufferDescriptor(m_pVisibleIndicesBuffer,	VISIBLE_BINDING);
+		m_ppDescriptorSets[i]->writeStorageBufferDescriptor(m_pDrawCommandsBuffer,	DRAW_BINDING);
+	}
+}
+
+void ParticleBatchVK::releaseRenderDescriptorSets(ParticleEmitter* pEmitter)
+{
+	DescriptorSetVK* pDescriptorSetRender = reinterpret_cast<DescriptorSetVK*>(pEmitter->getDescriptorSetRender());
+	if (pDescriptorSetRender != nullptr) {
+		pDescriptorSetRender->getDescriptorPool()->deallocateDescriptorSet(pDescriptorSetRender);
+		pEmitter->setDescriptorSetRender(nullptr);
+	}
+
+	// The mapped positions buffers are the emitter's own, but the sets also bind the visible indices buffer
+	for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+		DescriptorSetVK* pDescriptorSetMapped = reinterpret_cast<DescriptorSetVK*>(pEmitter->getDescriptorSetRenderMapped(i));
+		if (pDescriptorSetMapped != nullptr) {
+			pDescriptorSetMapped->getDescriptorPool()->deallocateDescriptorSet(pDescriptorSetMapped);
+			pEmitter->setDescriptorSetRenderMapped(i, nullptr);
+		}
+	}
+}
+
+void ParticleBatchVK::saveTimestampsToFile()
+{
+	// Same format as the emitters' timestamps
+	m_pProfiler->writeResults();
+	const std::vector<uint64_t>& timestamps = m_pProfiler->getTimestamps();
+
+	std::ofstream file;
+	file.open("results.txt", std::ios::binary | std::ios::out | std::ios::app | std::ios::ate);
+	file.write((char*)timestamps.data(), sizeof(uint64_t) * timestamps.size());
+	file.close();
+}
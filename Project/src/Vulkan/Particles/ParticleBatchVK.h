@@ -0,0 +1,123 @@
+#pragma once
+#include "Core/ParticleEmitter.h"
+#include "Vulkan/DeviceVK.h"
+#include "Vulkan/ProfilerVK.h"
+#include "Vulkan/VulkanCommon.h"
+
+#include <vector>
+
+class BufferVK;
+class CommandBufferVK;
+class CommandPoolVK;
+class DescriptorPoolVK;
+class DescriptorSetLayoutVK;
+class DescriptorSetVK;
+class GraphicsContextVK;
+class PipelineLayoutVK;
+class PipelineVK;
+
+// Matches BatchedEmitter in update_cs.glsl, std430 rounds the struct's size up to a multiple of 16 bytes
+struct BatchedEmitter {
+    EmitterBuffer properties;
+    uint32_t firstParticle;
+    uint32_t firstPositionWord;
+    uint32_t firstWorkGroup;
+    float time;
+    uint32_t positionFormat;
+    // Index of the emitter's command in the draw commands buffer
+    uint32_t drawCommand;
+    // Frame time plus the emitter's catch-up time, which differs between emitters that have just moved from the CPU and the others
+    float dt;
+    uint32_t padding;
+};
+
+struct BatchedPushConstant {
+    // Range of emitters covered by a dispatch
+    uint32_t firstEmitter;
+    uint32_t emitterCount;
+    uint32_t padding[2];
+    glm::vec4 frustumPlanes[6];
+};
+
+/*
+    Updates every emitter added to it with one submission. The emitters' particles are stored in shared buffers where each emitter
+    owns a range, and their properties are written to an array read by update_cs.glsl compiled with BATCHED defined.
+    Integrated and analytic emitters use different pipelines, so a batch records at most two dispatches
+*/
+class ParticleBatchVK
+{
+public:
+    ParticleBatchVK(GraphicsContextVK* pGraphicsContext, uint32_t computeQueueIndex);
+    ~ParticleBatchVK();
+
+    bool init(DescriptorPoolVK* pDescriptorPool, DescriptorSetLayoutVK* pDescriptorSetLayout, PipelineLayoutVK* pPipelineLayout,
+        PipelineVK* pPipeline, PipelineVK* pAnalyticPipeline, uint32_t workGroupSize, uint32_t frameCount);
+
+    // Assigns the emitter ranges of the shared buffers, which are grown when they are full.
+    // Growing waits for the device to be idle, the buffers are sized with room for more emitters to keep it rare
+    bool addEmitter(ParticleEmitter* pEmitter);
+
+    // Particles outside pFrustumPlanes' six planes are not appended to the emitters' visible lists. The submission waits for
+    // renderedFrameWait unless its semaphore is VK_NULL_HANDLE
+    void update(float dt, uint32_t frameIndex, const glm::vec4* pFrustumPlanes, const TimelineWaitVK& renderedFrameWait);
+
+    BufferVK* getPositionsBuffer()      { return m_pPositionsBuffer; }
+    BufferVK* getVisibleIndicesBuffer() { return m_pVisibleIndicesBuffer; }
+    BufferVK* getDrawCommandsBuffer()   { return m_pDrawCommandsBuffer; }
+
+private:
+    bool createCommandBuffers();
+    bool createDescriptorSets();
+
+    bool reserveParticleBuffers(uint64_t positionsSize, uint32_t motionParticleCount, uint32_t visibleParticleCount);
+    bool reserveEmitters(uint32_t emitterCount);
+    // Replaces pBuffer with a larger buffer holding the same first copySize bytes
+    bool growBuffer(BufferVK** ppBuffer, uint64_t newSize, uint64_t copySize, const char* pName);
+    void writeDescriptorSets();
+    // Render descriptor sets bind the shared buffers, they are recreated by the renderer when the emitter is drawn next
+    void releaseRenderDescriptorSets(ParticleEmitter* pEmitter);
+
+    void saveTimestampsToFile();
+
+private:
+    GraphicsContextVK* m_pGraphicsContext;
+
+    CommandPoolVK* m_ppCommandPools[MAX_FRAMES_IN_FLIGHT];
+    CommandBufferVK* m_ppCommandBuffers[MAX_FRAMES_IN_FLIGHT];
+    ProfilerVK* m_pProfiler;
+
+    DescriptorPoolVK* m_pDescriptorPool;
+    DescriptorSetLayoutVK* m_pDescriptorSetLayout;
+    DescriptorSetVK* m_ppDescriptorSets[MAX_FRAMES_IN_FLIGHT];
+
+    PipelineLayoutVK* m_pPipelineLayout;
+    PipelineVK* m_pPipeline;
+    PipelineVK* m_pAnalyticPipeline;
+
+    // Integrated emitters come first, so that each pipeline's emitters are consecutive in the emitter array
+    std::vector<ParticleEmitter*> m_Emitters;
+    uint32_t m_IntegratedEmitterCount;
+
+    // Shared particle buffers, the used parts are [0, m_PositionsSize) and particles [0, m_MotionParticleCount)
+    BufferVK* m_pPositionsBuffer;
+    BufferVK* m_pVelocitiesBuffer;
+    BufferVK* m_pAgesBuffer;
+    uint64_t m_PositionsSize;
+    uint32_t m_MotionParticleCount;
+
+    // Every emitter has a visible list with room for all of its particles, and a draw command counting its visible particles.
+    // Commands are indexed in the order the emitters were added, the emitter array above is ordered by pipeline
+    BufferVK* m_pVisibleIndicesBuffer;
+    BufferVK* m_pDrawCommandsBuffer;
+    uint32_t m_VisibleParticleCount;
+    // Copied to the draw commands buffer before every update, which resets the instance counts
+    std::vector<VkDrawIndexedIndirectCommand> m_DrawCommands;
+
+    // Host visible emitter arrays that stay mapped, one per frame in flight
+    BufferVK* m_ppEmittersBuffers[MAX_FRAMES_IN_FLIGHT];
+    BatchedEmitter* m_ppMappedEmitters[MAX_FRAMES_IN_FLIGHT];
+    uint32_t m_EmitterCapacity;
+
+    uint32_t m_WorkGroupSize;
+    uint32_t m_ComputeQueueIndex;
+};
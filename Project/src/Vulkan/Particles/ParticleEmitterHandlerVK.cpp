@@ -5,6 +5,8 @@
 #include "Common/Debug.h"
 #include "Common/IGraphicsContext.h"
 #include "Common/IShader.h"
+#include "Core/Camera.h"
+#include "Core/ParticlePositionPacker.h"
 #include "Core/TaskDispatcher.h"
 #include "Vulkan/BufferVK.h"
 #include "Vulkan/CommandPoolVK.h"
@@ -12,33 +14,62 @@
 #include "Vulkan/DescriptorPoolVK.h"
 #include "Vulkan/DescriptorSetVK.h"
 #include "Vulkan/DescriptorSetLayoutVK.h"
+#include "Vulkan/FrameSchedulerVK.h"
 #include "Vulkan/GBufferVK.h"
 #include "Vulkan/GraphicsContextVK.h"
+#include "Vulkan/Particles/ParticleBatchVK.h"
+#include "Vulkan/Particles/ParticleHandoffVK.h"
+#include "Vulkan/Particles/ParticleWorkGroupTunerVK.h"
 #include "Vulkan/PipelineLayoutVK.h"
 #include "Vulkan/PipelineVK.h"
 #include "Vulkan/RenderingHandlerVK.h"
 #include "Vulkan/SamplerVK.h"
 #include "Vulkan/ShaderVK.h"
 
+#include <algorithm>
+#include <chrono>
+
 // Compute shader bindings
 #define POSITIONS_BINDING   	0
 #define VELOCITIES_BINDING  	1
 #define AGES_BINDING        	2
 #define EMITTER_BINDING     	3
-
-ParticleEmitterHandlerVK::ParticleEmitterHandlerVK(bool renderingEnabled, uint32_t frameCount, bool useMultipleQueues)
+#define VISIBLE_BINDING     	4
+#define DRAW_BINDING        	5
+
+// Frames between each reassignment of emitters to the CPU and the GPU when scheduling is hybrid
+#define REBALANCE_INTERVAL		60
+// Weight of the latest measurements in the cost per particle
+#define COST_SMOOTHING			0.5
+// Fraction of the estimated update time that has to be saved for emitters to be moved, as moving them copies every particle twice
+#define MIN_REBALANCE_GAIN		0.1
+// Weight of the latest frame in an emitter's GPU update time, which is measured every frame
+#define EMITTER_TIME_SMOOTHING	0.1
+
+ParticleEmitterHandlerVK::ParticleEmitterHandlerVK(bool renderingEnabled, uint32_t frameCount, bool useMultipleQueues, bool batchedCompute)
 	:ParticleEmitterHandler(renderingEnabled),
 	m_pDescriptorPool(nullptr),
 	m_pDescriptorSetLayoutPerEmitter(nullptr),
 	m_pPipelineLayout(nullptr),
 	m_pPipeline(nullptr),
-	m_pCommandPoolGraphics(nullptr),
+	m_pAnalyticPipeline(nullptr),
+	m_pBatch(nullptr),
+	m_pBatchedDescriptorSetLayout(nullptr),
+	m_pBatchedPipelineLayout(nullptr),
+	m_pBatchedPipeline(nullptr),
+	m_pBatchedAnalyticPipeline(nullptr),
 	m_pGBufferSampler(nullptr),
+	m_CPUCost({0.0, 0, -1.0}),
+	m_GPUCost({0.0, 0, -1.0}),
+	m_FramesSinceRebalance(0),
+	m_GPUTimePerParticle(-1.0),
+	m_MeasuredFrameTime(0.0),
+	m_RenderedFrameWait({ VK_NULL_HANDLE, 0 }),
+	m_FramesSinceQueueBalance(0),
 	m_WorkGroupSize(0),
-	m_NextQueueIndex(0),
-	m_CurrentFrame(0),
 	m_FrameCount(frameCount),
-	m_UseMultipleQueues(useMultipleQueues)
+	m_UseMultipleQueues(useMultipleQueues),
+	m_BatchedCompute(batchedCompute)
 {
     for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
         m_ppCommandPools[i] = nullptr;
@@ -47,6 +78,12 @@ ParticleEmitterHandlerVK::ParticleEmitterHandlerVK(bool renderingEnabled, uint32
 
 ParticleEmitterHandlerVK::~ParticleEmitterHandlerVK()
 {
+	logQueueUtilisation();
+
+	for (ParticleHandoffVK* pHandoff : m_Handoffs) {
+		SAFEDELETE(pHandoff);
+	}
+
     for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
         SAFEDELETE(m_ppCommandPools[i]);
     }
@@ -56,28 +93,105 @@ ParticleEmitterHandlerVK::~ParticleEmitterHandlerVK()
 	SAFEDELETE(m_pDescriptorSetLayoutPerEmitter);
 	SAFEDELETE(m_pPipelineLayout);
 	SAFEDELETE(m_pPipeline);
-	SAFEDELETE(m_pCommandPoolGraphics);
+	SAFEDELETE(m_pAnalyticPipeline);
+	SAFEDELETE(m_pBatch);
+	SAFEDELETE(m_pBatchedDescriptorSetLayout);
+	SAFEDELETE(m_pBatchedPipelineLayout);
+	SAFEDELETE(m_pBatchedPipeline);
+	SAFEDELETE(m_pBatchedAnalyticPipeline);
 }
 
 void ParticleEmitterHandlerVK::update(float dt)
 {
+	// Emitters are moved before they are updated, so that they are updated by the device that renders them in this frame
+	if (m_HybridScheduling && ++m_FramesSinceRebalance >= REBALANCE_INTERVAL) {
+		rebalanceEmitters();
+	}
+
+	updateHandoffs();
+
+	m_CPUEmitters.clear();
+	m_GPUEmitters.clear();
+
+	for (ParticleEmitter* pEmitter : m_ParticleEmitters) {
+		if (pEmitter->isGPUComputed()) {
+			m_GPUEmitters.push_back(pEmitter);
+		} else {
+			m_CPUEmitters.push_back(pEmitter);
+		}
+	}
+
+	// A batch updates every emitter on one queue
+	if (m_UseMultipleQueues && !m_BatchedCompute && ++m_FramesSinceQueueBalance >= REBALANCE_INTERVAL) {
+		balanceComputeQueues();
+	}
+
+	// The GPU updates are submitted first, so that the GPU runs them while the CPU updates its emitters
 	if (m_GPUComputed) {
-        updateGPU(dt);
-    } else {
-        for (ParticleEmitter* particleEmitter : m_ParticleEmitters) {
-            particleEmitter->update(dt);
-        }
+		updateGPU(dt);
+	}
+
+	if (!m_CPUEmitters.empty()) {
+		auto updateStart = std::chrono::high_resolution_clock::now();
+		updateCPU(dt);
+
+		if (m_HybridScheduling) {
+			std::chrono::duration<double, std::milli> updateTime = std::chrono::high_resolution_clock::now() - updateStart;
+			m_CPUCost.measuredTime += updateTime.count();
+
+			for (ParticleEmitter* pEmitter : m_CPUEmitters) {
+				m_CPUCost.measuredParticles += pEmitter->getParticleCount();
+			}
+		}
+	}
+
+	// The moving emitters' particles were copied before these updates, so they have to catch up with them on the new device
+	for (ParticleHandoffVK* pHandoff : m_Handoffs) {
+		if (!pHandoff->hasSwitched()) {
+			pHandoff->addElapsedTime(dt);
+		}
+	}
+}
+
+void ParticleEmitterHandlerVK::updateCPU(float dt)
+{
+    // The chunks of all emitters are scheduled as one range, so that both many small emitters and a single large one use every worker
+    m_ChunkOffsets.resize(m_CPUEmitters.size() + 1);
+    m_ChunkOffsets[0] = 0;
+
+    // Positions are written to the mapped buffers of the frame that will render them
+    const bool writeMappedPositions = m_RenderingEnabled && m_pRenderingHandler != nullptr;
+    const uint32_t frameIndex = writeMappedPositions ? reinterpret_cast<RenderingHandlerVK*>(m_pRenderingHandler)->getCurrentFrameIndex() : 0;
+
+    for (size_t emitterIdx = 0; emitterIdx < m_CPUEmitters.size(); emitterIdx++) {
+        ParticleEmitter* pEmitter = m_CPUEmitters[emitterIdx];
+        pEmitter->beginUpdate(dt, writeMappedPositions ? pEmitter->getMappedPositions(frameIndex) : nullptr);
+        m_ChunkOffsets[emitterIdx + 1] = m_ChunkOffsets[emitterIdx] + pEmitter->getChunkCount();
     }
+
+    TaskDispatcher::parallelFor(0, m_ChunkOffsets.back(), 1, [&](uint32_t chunkBegin, uint32_t chunkEnd) {
+        // Find the emitter owning the first chunk, the following chunks are either in the same or in the next emitters
+        size_t emitterIdx = std::upper_bound(m_ChunkOffsets.begin(), m_ChunkOffsets.end(), chunkBegin) - m_ChunkOffsets.begin() - 1;
+
+        for (uint32_t chunkIdx = chunkBegin; chunkIdx < chunkEnd; chunkIdx++) {
+            while (chunkIdx >= m_ChunkOffsets[emitterIdx + 1]) {
+                emitterIdx++;
+            }
+
+            m_CPUEmitters[emitterIdx]->updateChunk(chunkIdx - m_ChunkOffsets[emitterIdx], dt);
+        }
+    });
 }
 
 void ParticleEmitterHandlerVK::updateRenderingBuffers(RenderingHandler* pRenderingHandler)
 {
     RenderingHandlerVK* pRenderingHandlerVK = reinterpret_cast<RenderingHandlerVK*>(pRenderingHandler);
     CommandBufferVK* pCommandBuffer = pRenderingHandlerVK->getCurrentGraphicsCommandBuffer();
+    uint32_t frameIndex = pRenderingHandlerVK->getCurrentFrameIndex();
 
     for (ParticleEmitter* pEmitter : m_ParticleEmitters) {
-		if (!m_GPUComputed) {
-			// Update emitter buffer. If GPU computing is enabled, this will already have been updated
+		if (!pEmitter->isGPUComputed()) {
+			// Update emitter buffer. If the emitter is updated on the GPU, this will already have been updated
 			if (pEmitter->m_EmitterUpdated) {
 				EmitterBuffer emitterBuffer = {};
 				pEmitter->createEmitterBuffer(emitterBuffer);
@@ -88,11 +202,9 @@ void ParticleEmitterHandlerVK::updateRenderingBuffers(RenderingHandler* pRenderi
 				pEmitter->m_EmitterUpdated = false;
 			}
 
-			// Update particle positions buffer
-			const std::vector<glm::vec4>& particlePositions = pEmitter->getParticleStorage().positions;
-			BufferVK* pPositionsBuffer = reinterpret_cast<BufferVK*>(pEmitter->getPositionsBuffer());
-
-			pCommandBuffer->updateBuffer(pPositionsBuffer, 0, particlePositions.data(), sizeof(glm::vec4) * particlePositions.size());
+			// The CPU update has written the positions to this frame's mapped buffer, only the living particles have to be made visible to the GPU
+			BufferVK* pMappedPositionsBuffer = reinterpret_cast<BufferVK*>(pEmitter->getMappedPositionsBuffer(frameIndex));
+			pMappedPositionsBuffer->flush(0, ParticlePositionPacker::getPackedSize(pEmitter->getPositionFormat()) * pEmitter->getMappedParticleCount());
 		}
     }
 }
@@ -118,70 +230,384 @@ bool ParticleEmitterHandlerVK::initializeGPUCompute()
 		return false;
 	}
 
+	if (m_BatchedCompute && !createBatch()) {
+		return false;
+	}
+
 	return true;
 }
 
 void ParticleEmitterHandlerVK::toggleComputationDevice()
 {
-	GraphicsContextVK* pGraphicsContext = reinterpret_cast<GraphicsContextVK*>(m_pGraphicsContext);
-	DeviceVK* pDevice = pGraphicsContext->getDevice();
+	if (!m_Handoffs.empty()) {
+		LOG("Particle emitters are still moving between the CPU and the GPU");
+		return;
+	}
 
-	// Disable GPU-side computing
-	if (m_GPUComputed) {
-		CommandBufferVK* pTempCommandBuffer = m_pCommandPoolGraphics->allocateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY);
-		pTempCommandBuffer->reset(true);
-		pTempCommandBuffer->begin(nullptr, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+	// Every emitter is moved to the other device, m_GPUComputed changes once the emitters have switched
+	const bool toGPU = !m_GPUComputed;
+	m_HybridScheduling = false;
 
-		for (ParticleEmitter* pEmitter : m_ParticleEmitters) {
-			BufferVK* pPositionsBuffer = reinterpret_cast<BufferVK*>(pEmitter->getPositionsBuffer());
-			acquireForGraphics(pPositionsBuffer, pTempCommandBuffer);
+	std::vector<ParticleEmitter*> movedEmitters;
+	for (ParticleEmitter* pEmitter : m_ParticleEmitters) {
+		if (pEmitter->isGPUComputed() != toGPU) {
+			movedEmitters.push_back(pEmitter);
 		}
+	}
 
-		pTempCommandBuffer->end();
-		pDevice->executeGraphics(pTempCommandBuffer, nullptr, nullptr, 0, nullptr, 0);
+	if (movedEmitters.empty()) {
+		m_GPUComputed = toGPU;
+		return;
+	}
 
-		// Wait for command buffer to finish executing before deleting it
-		pTempCommandBuffer->reset(true);
-		m_pCommandPoolGraphics->freeCommandBuffer(&pTempCommandBuffer);
-	} else {
-		// Enable GPU-side computing
-		CommandBufferVK* pTempCmdBufferCompute = m_ppCommandPools[0]->allocateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY);
-		pTempCmdBufferCompute->reset(true);
-		pTempCmdBufferCompute->begin(nullptr, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+	moveEmitters(movedEmitters, toGPU);
+}
+
+void ParticleEmitterHandlerVK::setHybridScheduling(bool hybridScheduling)
+{
+	if (m_BatchedCompute) {
+		LOG("Hybrid scheduling is not supported when particle compute is batched");
+		return;
+	}
+
+	if (hybridScheduling == m_HybridScheduling) {
+		return;
+	}
+
+	m_HybridScheduling = hybridScheduling;
+	m_FramesSinceRebalance = 0;
+
+	// Only measurements made while scheduling count, the costs measured before are kept
+	m_CPUCost.measuredTime = 0.0;
+	m_CPUCost.measuredParticles = 0;
+	m_GPUCost.measuredTime = 0.0;
+	m_GPUCost.measuredParticles = 0;
 
+	if (!hybridScheduling && m_GPUComputed) {
+		// Return every emitter to the GPU, emitters that are already moving are left to finish
+		std::vector<ParticleEmitter*> cpuEmitters;
 		for (ParticleEmitter* pEmitter : m_ParticleEmitters) {
-			// Since ImGui is what triggered this, and ImGui is handled AFTER particles are updated, the particle buffers will be used
-			// for rendering next, and the renderer will try to acquire ownership of the buffers for the rendering queue, the compute queue needs to release them
-			BufferVK* pPositionsBuffer = reinterpret_cast<BufferVK*>(pEmitter->getPositionsBuffer());
-			releaseFromCompute(pPositionsBuffer, pTempCmdBufferCompute);
+			if (!pEmitter->isGPUComputed() && !isMoving(pEmitter)) {
+				cpuEmitters.push_back(pEmitter);
+			}
+		}
+
+		moveEmitters(cpuEmitters, true);
+	}
+}
+
+void ParticleEmitterHandlerVK::moveEmitters(const std::vector<ParticleEmitter*>& emitters, bool toGPU)
+{
+	GraphicsContextVK* pGraphicsContext = reinterpret_cast<GraphicsContextVK*>(m_pGraphicsContext);
+
+	for (ParticleEmitter* pEmitter : emitters) {
+		ParticleHandoffVK* pHandoff = DBG_NEW ParticleHandoffVK(pGraphicsContext, pEmitter, toGPU);
+		if (!pHandoff->init()) {
+			LOG("Failed to start moving particle emitter to the %s", toGPU ? "GPU" : "CPU");
+			SAFEDELETE(pHandoff);
+			continue;
+		}
+
+		m_Handoffs.push_back(pHandoff);
+	}
+}
+
+void ParticleEmitterHandlerVK::updateHandoffs()
+{
+	if (m_Handoffs.empty()) {
+		return;
+	}
+
+	for (ParticleHandoffVK* pHandoff : m_Handoffs) {
+		pHandoff->update();
+	}
+
+	// Batched emitters are all updated by the same device, so they switch together once every handoff has copied its particles
+	const bool batchCopied = m_BatchedCompute && std::all_of(m_Handoffs.begin(), m_Handoffs.end(), [](const ParticleHandoffVK* pHandoff) {
+		return pHandoff->hasSwitched() || pHandoff->isCopied();
+	});
+
+	bool switched = false;
+	std::vector<BufferVK*> renderedBuffers;
+
+	for (ParticleHandoffVK* pHandoff : m_Handoffs) {
+		if (pHandoff->hasSwitched() || !pHandoff->isCopied() || (m_BatchedCompute && !batchCopied)) {
+			continue;
+		}
+
+		// The batch's shared buffers are only released once
+		renderedBuffers.clear();
+		if (pHandoff->isToGPU() && !(m_BatchedCompute && switched)) {
+			getRenderedBuffers({pHandoff->getEmitter()}, renderedBuffers);
+		}
+
+		pHandoff->switchDevice(this, renderedBuffers);
+		switched = true;
+	}
+
+	if (switched) {
+		m_GPUComputed = std::any_of(m_ParticleEmitters.begin(), m_ParticleEmitters.end(), [](const ParticleEmitter* pEmitter) { return pEmitter->isGPUComputed(); });
+	}
+
+	auto retiredBegin = std::partition(m_Handoffs.begin(), m_Handoffs.end(), [](const ParticleHandoffVK* pHandoff) { return !pHandoff->isRetired(); });
+	for (auto handoffItr = retiredBegin; handoffItr != m_Handoffs.end(); handoffItr++) {
+		SAFEDELETE(*handoffItr);
+	}
+
+	m_Handoffs.erase(retiredBegin, m_Handoffs.end());
+}
+
+bool ParticleEmitterHandlerVK::isMoving(const ParticleEmitter* pEmitter) const
+{
+	return std::any_of(m_Handoffs.begin(), m_Handoffs.end(), [pEmitter](const ParticleHandoffVK* pHandoff) {
+		return !pHandoff->hasSwitched() && pHandoff->getEmitter() == pEmitter;
+	});
+}
+
+void ParticleEmitterHandlerVK::measureGPUTimes(float dt)
+{
+	double frameTime = 0.0;
+	uint64_t frameParticles = 0;
+
+	for (ParticleEmitter* pEmitter : m_GPUEmitters) {
+		ProfilerVK* pProfiler = pEmitter->getProfiler();
+
+		uint64_t updateTime = 0;
+		if (!pProfiler->getLatestFrameTime(getFrameInFlightIndex(), updateTime)) {
+			continue;
+		}
+
+		const double updateTimeMs = updateTime * pProfiler->getTimestampToMilli();
+		frameTime += updateTimeMs;
+		frameParticles += pEmitter->getParticleCount();
+		m_QueueBusyTimes[pEmitter->getComputeQueueIndex()] += updateTimeMs;
+
+		auto timeItr = m_EmitterGPUTimes.find(pEmitter);
+		if (timeItr == m_EmitterGPUTimes.end()) {
+			m_EmitterGPUTimes[pEmitter] = updateTimeMs;
+		} else {
+			timeItr->second = glm::mix(timeItr->second, updateTimeMs, EMITTER_TIME_SMOOTHING);
+		}
+	}
+
+	m_MeasuredFrameTime += dt * 1000.0;
+
+	if (frameParticles > 0) {
+		double timePerParticle = frameTime / double(frameParticles);
+		m_GPUTimePerParticle = m_GPUTimePerParticle < 0.0 ? timePerParticle : glm::mix(m_GPUTimePerParticle, timePerParticle, EMITTER_TIME_SMOOTHING);
+	}
+
+	if (m_HybridScheduling) {
+		m_GPUCost.measuredTime += frameTime;
+		m_GPUCost.measuredParticles += frameParticles;
+	}
+}
+
+void ParticleEmitterHandlerVK::rebalanceEmitters()
+{
+	m_FramesSinceRebalance = 0;
+
+	for (DeviceCost* pCost : {&m_CPUCost, &m_GPUCost}) {
+		if (pCost->measuredParticles > 0) {
+			double costPerParticle = pCost->measuredTime / double(pCost->measuredParticles);
+			pCost->costPerParticle = pCost->costPerParticle < 0.0 ? costPerParticle : glm::mix(pCost->costPerParticle, costPerParticle, COST_SMOOTHING);
+		}
+
+		pCost->measuredTime = 0.0;
+		pCost->measuredParticles = 0;
+	}
+
+	// Emitters are not moved again until the previous moves have finished
+	if (m_ParticleEmitters.empty() || !m_Handoffs.empty()) {
+		return;
+	}
+
+	// Largest emitters first
+	std::vector<ParticleEmitter*> emitters = m_ParticleEmitters;
+	std::sort(emitters.begin(), emitters.end(), [](const ParticleEmitter* pEmitterA, const ParticleEmitter* pEmitterB) {
+		return pEmitterA->getParticleCount() > pEmitterB->getParticleCount();
+	});
+
+	const bool cpuMeasured = m_CPUCost.costPerParticle >= 0.0;
+	const bool gpuMeasured = m_GPUCost.costPerParticle >= 0.0;
+	if (!cpuMeasured || !gpuMeasured) {
+		// The smallest emitter is moved to a device that has not been measured yet, so that its cost can be measured
+		ParticleEmitter* pSmallestEmitter = emitters.back();
+		if (cpuMeasured != gpuMeasured && pSmallestEmitter->isGPUComputed() == gpuMeasured) {
+			moveEmitters({pSmallestEmitter}, !gpuMeasured);
+		}
+
+		return;
+	}
+
+	// Each emitter is assigned to the device that would finish its emitters the earliest with it added. The devices update
+	// their emitters in parallel, so the update takes as long as the slowest device
+	double cpuLoad = 0.0, gpuLoad = 0.0;
+	double currentCPULoad = 0.0, currentGPULoad = 0.0;
+	std::vector<ParticleEmitter*> cpuEmitters, gpuEmitters;
+
+	for (ParticleEmitter* pEmitter : emitters) {
+		const double cpuTime = pEmitter->getParticleCount() * m_CPUCost.costPerParticle;
+		const double gpuTime = pEmitter->getParticleCount() * m_GPUCost.costPerParticle;
+
+		if (pEmitter->isGPUComputed()) {
+			currentGPULoad += gpuTime;
+		} else {
+			currentCPULoad += cpuTime;
+		}
+
+		const bool useGPU = gpuLoad + gpuTime <= cpuLoad + cpuTime;
+		if (useGPU) {
+			gpuLoad += gpuTime;
+		} else {
+			cpuLoad += cpuTime;
+		}
+
+		if (useGPU != pEmitter->isGPUComputed()) {
+			(useGPU ? gpuEmitters : cpuEmitters).push_back(pEmitter);
+		}
+	}
+
+	const double currentTime = std::max(currentCPULoad, currentGPULoad);
+	const double balancedTime = std::max(cpuLoad, gpuLoad);
+	if (balancedTime > currentTime * (1.0 - MIN_REBALANCE_GAIN)) {
+		return;
+	}
+
+	D_LOG("Rebalancing particle emitters, estimated update time: %f ms -> %f ms", currentTime, balancedTime);
+
+	if (!cpuEmitters.empty()) {
+		moveEmitters(cpuEmitters, false);
+	}
+
+	if (!gpuEmitters.empty()) {
+		moveEmitters(gpuEmitters, true);
+	}
+}
+
+double ParticleEmitterHandlerVK::estimateGPUTime(const ParticleEmitter* pEmitter) const
+{
+	auto timeItr = m_EmitterGPUTimes.find(pEmitter);
+	if (timeItr != m_EmitterGPUTimes.end()) {
+		return timeItr->second;
+	}
+
+	// Emitters are estimated by the particle count they have once every particle has spawned. Until any emitter has been measured,
+	// every estimate is in particles, which still compares the emitters with each other
+	const double timePerParticle = m_GPUTimePerParticle < 0.0 ? 1.0 : m_GPUTimePerParticle;
+	return pEmitter->getParticlesPerSecond() * pEmitter->getParticleDuration() * timePerParticle;
+}
+
+uint32_t ParticleEmitterHandlerVK::pickComputeQueue(const ParticleEmitter* pNewEmitter) const
+{
+	std::vector<double> queueLoads(m_QueueBusyTimes.size(), 0.0);
+	for (ParticleEmitter* pEmitter : m_ParticleEmitters) {
+		if (pEmitter != pNewEmitter) {
+			queueLoads[pEmitter->getComputeQueueIndex()] += estimateGPUTime(pEmitter);
+		}
+	}
+
+	return uint32_t(std::min_element(queueLoads.begin(), queueLoads.end()) - queueLoads.begin());
+}
+
+void ParticleEmitterHandlerVK::balanceComputeQueues()
+{
+	m_FramesSinceQueueBalance = 0;
+
+	// Moving emitters' copies are submitted to their current queues
+	if (m_GPUEmitters.empty() || !m_Handoffs.empty()) {
+		return;
+	}
+
+	// Longest processing time first: the emitters are sorted by their times, and each is assigned to the queue with the least work so far
+	std::vector<std::pair<double, ParticleEmitter*>> emitterTimes;
+	for (ParticleEmitter* pEmitter : m_GPUEmitters) {
+		emitterTimes.push_back({estimateGPUTime(pEmitter), pEmitter});
+	}
+
+	std::sort(emitterTimes.begin(), emitterTimes.end(), [](const std::pair<double, ParticleEmitter*>& emitterA, const std::pair<double, ParticleEmitter*>& emitterB) {
+		return emitterA.first > emitterB.first;
+	});
+
+	std::vector<double> queueLoads(m_QueueBusyTimes.size(), 0.0);
+	std::vector<double> currentQueueLoads(m_QueueBusyTimes.size(), 0.0);
+	std::vector<uint32_t> assignedQueues;
 
-			// Copy age and velocity data to the GPU buffers
-			const ParticleStorage& particleStorage = pEmitter->getParticleStorage();
+	for (const std::pair<double, ParticleEmitter*>& emitterTime : emitterTimes) {
+		ParticleEmitter* pEmitter = emitterTime.second;
+		currentQueueLoads[pEmitter->getComputeQueueIndex()] += emitterTime.first;
 
-			BufferVK* pAgesBuffer = reinterpret_cast<BufferVK*>(pEmitter->getAgesBuffer());
-			pTempCmdBufferCompute->updateBuffer(pAgesBuffer, 0, (const void*)particleStorage.ages.data(), particleStorage.ages.size() * sizeof(float));
+		// Emitters stay on their queue when it is one of the least busy
+		uint32_t queueIndex = uint32_t(std::min_element(queueLoads.begin(), queueLoads.end()) - queueLoads.begin());
+		if (queueLoads[pEmitter->getComputeQueueIndex()] <= queueLoads[queueIndex]) {
+			queueIndex = pEmitter->getComputeQueueIndex();
+		}
+
+		queueLoads[queueIndex] += emitterTime.first;
+		assignedQueues.push_back(queueIndex);
+	}
 
-			BufferVK* pVelocitiesBuffer = reinterpret_cast<BufferVK*>(pEmitter->getVelocitiesBuffer());
-			pTempCmdBufferCompute->updateBuffer(pVelocitiesBuffer, 0, (const void*)particleStorage.velocities.data(), particleStorage.ages.size() * sizeof(glm::vec4));
+	const double currentTime = *std::max_element(currentQueueLoads.begin(), currentQueueLoads.end());
+	const double balancedTime = *std::max_element(queueLoads.begin(), queueLoads.end());
+	if (balancedTime > currentTime * (1.0 - MIN_REBALANCE_GAIN)) {
+		return;
+	}
 
-			// Update emitter buffer
-			EmitterBuffer emitterBuffer = {};
-			pEmitter->createEmitterBuffer(emitterBuffer);
+	D_LOG("Balancing compute queues, estimated time of the busiest queue: %f -> %f", currentTime, balancedTime);
 
-			BufferVK* pEmitterBuffer = reinterpret_cast<BufferVK*>(pEmitter->getEmitterBuffer());
-			pTempCmdBufferCompute->updateBuffer(pEmitterBuffer, 0, &emitterBuffer, sizeof(EmitterBuffer));
+	for (size_t emitterIdx = 0; emitterIdx < emitterTimes.size(); emitterIdx++) {
+		ParticleEmitter* pEmitter = emitterTimes[emitterIdx].second;
+		if (pEmitter->getComputeQueueIndex() != assignedQueues[emitterIdx]) {
+			setComputeQueue(pEmitter, assignedQueues[emitterIdx]);
 		}
+	}
+}
+
+void ParticleEmitterHandlerVK::setComputeQueue(ParticleEmitter* pEmitter, uint32_t queueIndex)
+{
+	DeviceVK* pDevice = reinterpret_cast<GraphicsContextVK*>(m_pGraphicsContext)->getDevice();
+
+	// The new queue would otherwise update the emitter's buffers while the old one still does. The new queue's next submissions wait
+	// for everything submitted to the old queue so far, which includes the emitter's updates
+	if (pDevice->supportsTimelineSemaphores()) {
+		m_QueueWaits[queueIndex].push_back(pDevice->getComputeTimelineValue(pEmitter->getComputeQueueIndex()));
+		pEmitter->setComputeQueueIndex(queueIndex);
+		return;
+	}
+
+	// Only the emitter's latest updates can still be running
+	VkFence pFences[MAX_FRAMES_IN_FLIGHT];
+	for (uint32_t frameIdx = 0; frameIdx < MAX_FRAMES_IN_FLIGHT; frameIdx++) {
+		pFences[frameIdx] = pEmitter->getCommandBuffer(frameIdx)->getFence();
+	}
 
-		pTempCmdBufferCompute->end();
+	vkWaitForFences(pDevice->getDevice(), MAX_FRAMES_IN_FLIGHT, pFences, VK_TRUE, UINT64_MAX);
 
-		pDevice->executeCompute(pTempCmdBufferCompute, nullptr, nullptr, 0, nullptr, 0);
+	pEmitter->setComputeQueueIndex(queueIndex);
+}
 
-		// Wait for command buffer to finish executing before deleting it
-		pTempCmdBufferCompute->reset(true);
-		m_ppCommandPools[0]->freeCommandBuffer(&pTempCmdBufferCompute);
+void ParticleEmitterHandlerVK::logQueueUtilisation() const
+{
+	if (m_MeasuredFrameTime <= 0.0) {
+		return;
 	}
 
-	m_GPUComputed = !m_GPUComputed;
+	LOG("Compute queue utilisation over %f ms:", m_MeasuredFrameTime);
+
+	for (uint32_t queueIdx = 0; queueIdx < uint32_t(m_QueueBusyTimes.size()); queueIdx++) {
+		uint32_t emitterCount = 0;
+		uint64_t particleCount = 0;
+
+		for (ParticleEmitter* pEmitter : m_ParticleEmitters) {
+			if (pEmitter->isGPUComputed() && pEmitter->getComputeQueueIndex() == queueIdx) {
+				emitterCount++;
+				particleCount += pEmitter->getParticleCount();
+			}
+		}
+
+		LOG("Queue %u: %u emitters, %llu particles, %f ms busy, %.1f%% utilisation", queueIdx, emitterCount, (unsigned long long)particleCount,
+			m_QueueBusyTimes[queueIdx], 100.0 * m_QueueBusyTimes[queueIdx] / m_MeasuredFrameTime);
+	}
 }
 
 void ParticleEmitterHandlerVK::releaseFromGraphics(BufferVK* pBuffer, CommandBufferVK* pCommandBuffer)
@@ -196,10 +622,10 @@ void ParticleEmitterHandlerVK::releaseFromGraphics(BufferVK* pBuffer, CommandBuf
 
 	pCommandBuffer->releaseBufferOwnership(
 		pBuffer,
-		VK_ACCESS_SHADER_READ_BIT,
+		VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT,
 		queueFamilyIndices.GraphicsQueues.value().FamilyIndex,
 		queueFamilyIndices.ComputeQueues.value().FamilyIndex,
-		VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+		VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
 		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT
 	);
 }
@@ -220,7 +646,7 @@ void ParticleEmitterHandlerVK::releaseFromCompute(BufferVK* pBuffer, CommandBuff
 		queueFamilyIndices.ComputeQueues.value().FamilyIndex,
 		queueFamilyIndices.GraphicsQueues.value().FamilyIndex,
 		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-		VK_PIPELINE_STAGE_VERTEX_SHADER_BIT
+		VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT
 	);
 }
 
@@ -236,11 +662,11 @@ void ParticleEmitterHandlerVK::acquireForGraphics(BufferVK* pBuffer, CommandBuff
 
 	pCommandBuffer->acquireBufferOwnership(
 		pBuffer,
-		VK_ACCESS_SHADER_READ_BIT,
+		VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT,
 		queueFamilyIndices.ComputeQueues.value().FamilyIndex,
 		queueFamilyIndices.GraphicsQueues.value().FamilyIndex,
 		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-		VK_PIPELINE_STAGE_VERTEX_SHADER_BIT
+		VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT
 	);
 }
 
@@ -259,19 +685,53 @@ void ParticleEmitterHandlerVK::acquireForCompute(BufferVK* pBuffer, CommandBuffe
 		VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
 		queueFamilyIndices.GraphicsQueues.value().FamilyIndex,
 		queueFamilyIndices.ComputeQueues.value().FamilyIndex,
-		VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+		VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
 		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT
 	);
 }
 
+void ParticleEmitterHandlerVK::releaseParticlesFromGraphics(CommandBufferVK* pCommandBuffer)
+{
+	std::vector<BufferVK*> buffers;
+	getRenderedBuffers(buffers);
+
+	for (BufferVK* pBuffer : buffers) {
+		releaseFromGraphics(pBuffer, pCommandBuffer);
+	}
+}
+
+void ParticleEmitterHandlerVK::acquireParticlesForGraphics(CommandBufferVK* pCommandBuffer)
+{
+	std::vector<BufferVK*> buffers;
+	getRenderedBuffers(buffers);
+
+	for (BufferVK* pBuffer : buffers) {
+		acquireForGraphics(pBuffer, pCommandBuffer);
+	}
+}
+
 void ParticleEmitterHandlerVK::initializeEmitter(ParticleEmitter* pEmitter)
 {
-	pEmitter->initialize(m_pGraphicsContext, m_FrameCount, m_NextQueueIndex);
-	LOG("Next: %d", m_NextQueueIndex);
+	// Emitters created while scheduling is hybrid start on the CPU, they are moved to the GPU like any other emitter
+	pEmitter->setGPUComputed(m_GPUComputed && !m_HybridScheduling);
+
+	// Batched emitters are updated by the batch's submission and store their particles in its buffers
+	if (m_BatchedCompute) {
+		if (!pEmitter->initialize(m_pGraphicsContext, m_FrameCount, 0, false) || !m_pBatch->addEmitter(pEmitter)) {
+			LOG("Failed to add particle emitter to batch");
+			return;
+		}
 
-	DeviceVK* pDevice = reinterpret_cast<GraphicsContextVK*>(m_pGraphicsContext)->getDevice();
-	uint32_t computeQueueCount = pDevice->getQueueFamilyIndices().ComputeQueues.value().QueueCount;
-	m_NextQueueIndex = m_UseMultipleQueues ? (m_NextQueueIndex + 1) % computeQueueCount : 0;
+		// The batch switches device once every emitter has moved, so emitters created while it moves follow the others
+		if (!m_Handoffs.empty()) {
+			moveEmitters({pEmitter}, !m_GPUComputed);
+		}
+
+		return;
+	}
+
+	// The queues are balanced again once the emitter's update time has been measured
+	pEmitter->initialize(m_pGraphicsContext, m_FrameCount, pickComputeQueue(pEmitter));
 
 	// Create descriptor set for the emitter
 	DescriptorSetVK* pEmitterDescriptorSet = m_pDescriptorPool->allocDescriptorSet(m_pDescriptorSetLayoutPerEmitter);
@@ -280,43 +740,87 @@ void ParticleEmitterHandlerVK::initializeEmitter(ParticleEmitter* pEmitter)
 		return;
 	}
 
-	BufferVK* pPositionsBuffer	= reinterpret_cast<BufferVK*>(pEmitter->getPositionsBuffer());
-	BufferVK* pVelocitiesBuffer	= reinterpret_cast<BufferVK*>(pEmitter->getVelocitiesBuffer());
-	BufferVK* pAgesBuffer		= reinterpret_cast<BufferVK*>(pEmitter->getAgesBuffer());
-	BufferVK* pEmitterBuffer	= reinterpret_cast<BufferVK*>(pEmitter->getEmitterBuffer());
+	BufferVK* pPositionsBuffer		= reinterpret_cast<BufferVK*>(pEmitter->getPositionsBuffer());
+	BufferVK* pEmitterBuffer		= reinterpret_cast<BufferVK*>(pEmitter->getEmitterBuffer());
+	BufferVK* pVisibleIndicesBuffer	= reinterpret_cast<BufferVK*>(pEmitter->getVisibleIndicesBuffer());
+	BufferVK* pDrawBuffer			= reinterpret_cast<BufferVK*>(pEmitter->getDrawBuffer());
+
+	pEmitterDescriptorSet->writeStorageBufferDescriptor(pPositionsBuffer,		POSITIONS_BINDING);
+	pEmitterDescriptorSet->writeUniformBufferDescriptor(pEmitterBuffer,			EMITTER_BINDING);
+	pEmitterDescriptorSet->writeStorageBufferDescriptor(pVisibleIndicesBuffer,	VISIBLE_BINDING);
+	pEmitterDescriptorSet->writeStorageBufferDescriptor(pDrawBuffer,			DRAW_BINDING);
 
-	pEmitterDescriptorSet->writeStorageBufferDescriptor(pPositionsBuffer,	POSITIONS_BINDING);
-	pEmitterDescriptorSet->writeStorageBufferDescriptor(pVelocitiesBuffer,	VELOCITIES_BINDING);
-	pEmitterDescriptorSet->writeStorageBufferDescriptor(pAgesBuffer,		AGES_BINDING);
-	pEmitterDescriptorSet->writeUniformBufferDescriptor(pEmitterBuffer,		EMITTER_BINDING);
+	// The analytic pipeline does not use these bindings, so they may be left unwritten
+	if (!pEmitter->isAnalytic()) {
+		BufferVK* pVelocitiesBuffer	= reinterpret_cast<BufferVK*>(pEmitter->getVelocitiesBuffer());
+		BufferVK* pAgesBuffer		= reinterpret_cast<BufferVK*>(pEmitter->getAgesBuffer());
+
+		pEmitterDescriptorSet->writeStorageBufferDescriptor(pVelocitiesBuffer,	VELOCITIES_BINDING);
+		pEmitterDescriptorSet->writeStorageBufferDescriptor(pAgesBuffer,		AGES_BINDING);
+	}
 
 	pEmitter->setDescriptorSetCompute(pEmitterDescriptorSet);
 }
 
 void ParticleEmitterHandlerVK::updateGPU(float dt)
 {
-	for (ParticleEmitter* pEmitter : m_ParticleEmitters) {
-		TaskDispatcher::execute([dt, this, pEmitter]
-		{
-			updateEmitter(pEmitter, dt);
-		});
-    }
+	updateFrustumPlanes();
+
+	// The positions, visible indices, draw commands and emitter buffers are shared by the frames in flight. The latest rendered frame may
+	// still be drawing them on the render queue, which a barrier on the compute queues does not wait for
+	m_RenderedFrameWait = { VK_NULL_HANDLE, 0 };
+	if (m_RenderingEnabled && m_pRenderingHandler != nullptr) {
+		m_RenderedFrameWait = reinterpret_cast<RenderingHandlerVK*>(m_pRenderingHandler)->waitForRenderedFrame();
+	}
+
+	if (m_BatchedCompute) {
+		m_pBatch->update(dt, getFrameInFlightIndex(), m_FrustumPlanes, m_RenderedFrameWait);
+		return;
+	}
+
+	measureGPUTimes(dt);
+
+	// Emitters on the same queue are next to each other, so that each thread's range is submitted in as few batches as possible
+	std::stable_sort(m_GPUEmitters.begin(), m_GPUEmitters.end(), [](ParticleEmitter* pEmitterA, ParticleEmitter* pEmitterB) {
+		return pEmitterA->getComputeQueueIndex() < pEmitterB->getComputeQueueIndex();
+	});
+
+	// Every thread records a contiguous range of emitters and submits it, threads submitting to different queues do not wait for each other
+	const uint32_t emitterCount = uint32_t(m_GPUEmitters.size());
+	const uint32_t threadCount = TaskDispatcher::getWorkerCount() + 1;
+	const uint32_t grainSize = (emitterCount + threadCount - 1) / threadCount;
 
-	TaskDispatcher::waitForTasks();
-	m_CurrentFrame = (m_CurrentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+	TaskDispatcher::parallelFor(0, emitterCount, grainSize, [dt, this](uint32_t emitterBegin, uint32_t emitterEnd)
+	{
+		for (uint32_t emitterIdx = emitterBegin; emitterIdx < emitterEnd; emitterIdx++) {
+			updateEmitter(m_GPUEmitters[emitterIdx], dt);
+		}
+
+		submitEmitters(emitterBegin, emitterEnd);
+	});
+
+	// Every queue that emitters moved to has now waited for their previous queues
+	for (std::vector<TimelineWaitVK>& queueWaits : m_QueueWaits) {
+		queueWaits.clear();
+	}
 }
 
 void ParticleEmitterHandlerVK::updateEmitter(ParticleEmitter* pEmitter, float dt)
 {
-	CommandBufferVK* pCommandBuffer = pEmitter->getCommandBuffer(m_CurrentFrame);
+	CommandBufferVK* pCommandBuffer = pEmitter->getCommandBuffer(getFrameInFlightIndex());
 	beginUpdateFrame(pEmitter);
 
+	pEmitter->updateGPU(dt);
+
+	// Particles that have just moved from the CPU catch up with the emitter
+	const float particleDt = dt + pEmitter->getCatchUpTime();
+	pEmitter->setCatchUpTime(0.0f);
+
 	// Update push-constant
-	PushConstant pushConstant = {dt};
+	PushConstant pushConstant = {particleDt, pEmitter->getSimulationTime(), uint32_t(pEmitter->getGPUPositionFormat())};
+	std::copy_n(m_FrustumPlanes, 6, pushConstant.frustumPlanes);
 	pCommandBuffer->pushConstants(m_pPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstant), (const void*)&pushConstant);
 
-	pEmitter->updateGPU(dt);
-
 	DescriptorSetVK* pDescriptorSet = reinterpret_cast<DescriptorSetVK*>(pEmitter->getDescriptorSetCompute());
 	pCommandBuffer->bindDescriptorSet(VK_PIPELINE_BIND_POINT_COMPUTE, m_pPipelineLayout, 0, 1, &pDescriptorSet, 0, nullptr);
 
@@ -330,8 +834,8 @@ void ParticleEmitterHandlerVK::updateEmitter(ParticleEmitter* pEmitter, float dt
 
 void ParticleEmitterHandlerVK::beginUpdateFrame(ParticleEmitter* pEmitter)
 {
-	CommandBufferVK* pCommandBuffer = pEmitter->getCommandBuffer(m_CurrentFrame);
-	CommandPoolVK* pCommandPool		= pEmitter->getCommandPool(m_CurrentFrame);
+	CommandBufferVK* pCommandBuffer = pEmitter->getCommandBuffer(getFrameInFlightIndex());
+	CommandPoolVK* pCommandPool		= pEmitter->getCommandPool(getFrameInFlightIndex());
 	ProfilerVK* pProfiler			= pEmitter->getProfiler();
 
 	pCommandBuffer->reset(true);
@@ -339,11 +843,21 @@ void ParticleEmitterHandlerVK::beginUpdateFrame(ParticleEmitter* pEmitter)
 
 	pCommandBuffer->begin(nullptr, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
 
-	pProfiler->reset(m_CurrentFrame, pCommandBuffer);
+	pProfiler->reset(getFrameInFlightIndex(), pCommandBuffer);
 
 	pProfiler->beginFrame(pCommandBuffer);
 
-	pCommandBuffer->bindPipeline(m_pPipeline);
+	pCommandBuffer->bindPipeline(pEmitter->isAnalytic() ? m_pAnalyticPipeline : m_pPipeline);
+
+	// The emitter's buffers are shared by the frames in flight, and the previous frame's update may still be running on this queue. Its
+	// dispatch has to finish reading and counting into them before they are overwritten. The rendered frame's draws are on another queue,
+	// the submission waits for them
+	VkMemoryBarrier previousUpdateBarrier = {};
+	previousUpdateBarrier.sType			= VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	previousUpdateBarrier.srcAccessMask	= VK_ACCESS_SHADER_WRITE_BIT;
+	previousUpdateBarrier.dstAccessMask	= VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_UNIFORM_READ_BIT;
+	pCommandBuffer->pipelineBarrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0, 1, &previousUpdateBarrier, 0, nullptr, 0, nullptr);
 
 	// Update emitter's buffers
 	if (pEmitter->m_EmitterUpdated) {
@@ -355,20 +869,107 @@ void ParticleEmitterHandlerVK::beginUpdateFrame(ParticleEmitter* pEmitter)
 
 		pEmitter->m_EmitterUpdated = false;
 	}
+
+	// The update shader counts the visible particles from 0
+	VkDrawIndexedIndirectCommand drawCommand = {};
+	pEmitter->createDrawCommand(drawCommand);
+
+	BufferVK* pDrawBuffer = reinterpret_cast<BufferVK*>(pEmitter->getDrawBuffer());
+	pCommandBuffer->updateBuffer(pDrawBuffer, pEmitter->getDrawCommandOffset(), &drawCommand, sizeof(VkDrawIndexedIndirectCommand));
+
+	VkMemoryBarrier memoryBarrier = {};
+	memoryBarrier.sType			= VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	memoryBarrier.srcAccessMask	= VK_ACCESS_TRANSFER_WRITE_BIT;
+	memoryBarrier.dstAccessMask	= VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_UNIFORM_READ_BIT;
+	pCommandBuffer->pipelineBarrier(VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
 }
 
 void ParticleEmitterHandlerVK::endUpdateFrame(ParticleEmitter* pEmitter)
 {
-	CommandBufferVK* pCommandBuffer = pEmitter->getCommandBuffer(m_CurrentFrame);
+	CommandBufferVK* pCommandBuffer = pEmitter->getCommandBuffer(getFrameInFlightIndex());
 	ProfilerVK* pProfiler			= pEmitter->getProfiler();
 	pProfiler->endFrame();
 
 	pCommandBuffer->end();
+}
 
+void ParticleEmitterHandlerVK::submitEmitters(uint32_t emitterBegin, uint32_t emitterEnd)
+{
 	GraphicsContextVK* pGraphicsContext = reinterpret_cast<GraphicsContextVK*>(m_pGraphicsContext);
     DeviceVK* pDevice = pGraphicsContext->getDevice();
 
-	pDevice->executeCompute(pCommandBuffer, nullptr, nullptr, 0, nullptr, 0, pEmitter->getComputeQueueIndex());
+	std::vector<CommandBufferVK*> commandBuffers;
+	commandBuffers.reserve(emitterEnd - emitterBegin);
+	std::vector<TimelineWaitVK> timelineWaits;
+
+	uint32_t batchBegin = emitterBegin;
+	while (batchBegin < emitterEnd) {
+		const uint32_t queueIndex = m_GPUEmitters[batchBegin]->getComputeQueueIndex();
+
+		commandBuffers.clear();
+		uint32_t batchEnd = batchBegin;
+		while (batchEnd < emitterEnd && m_GPUEmitters[batchEnd]->getComputeQueueIndex() == queueIndex) {
+			commandBuffers.push_back(m_GPUEmitters[batchEnd]->getCommandBuffer(getFrameInFlightIndex()));
+			batchEnd++;
+		}
+
+		const std::vector<TimelineWaitVK>& queueWaits = m_QueueWaits[queueIndex];
+		timelineWaits.assign(queueWaits.begin(), queueWaits.end());
+		if (m_RenderedFrameWait.Semaphore != VK_NULL_HANDLE) {
+			timelineWaits.push_back(m_RenderedFrameWait);
+		}
+
+		pDevice->executeCompute(commandBuffers.data(), uint32_t(commandBuffers.size()), timelineWaits.data(), uint32_t(timelineWaits.size()), queueIndex);
+		batchBegin = batchEnd;
+	}
+}
+
+uint32_t ParticleEmitterHandlerVK::getFrameInFlightIndex() const
+{
+	return reinterpret_cast<GraphicsContextVK*>(m_pGraphicsContext)->getDevice()->getFrameScheduler()->getFrameInFlightIndex();
+}
+
+void ParticleEmitterHandlerVK::updateFrustumPlanes()
+{
+	if (m_FrustumCulling && m_pCamera != nullptr) {
+		m_pCamera->getFrustumPlanes(m_FrustumPlanes);
+		return;
+	}
+
+	for (glm::vec4& plane : m_FrustumPlanes) {
+		plane = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+	}
+}
+
+void ParticleEmitterHandlerVK::getRenderedBuffers(std::vector<BufferVK*>& buffers)
+{
+	// Batched emitters are all updated on the same device
+	if (m_BatchedCompute) {
+		if (m_GPUComputed) {
+			getRenderedBuffers(m_ParticleEmitters, buffers);
+		}
+
+		return;
+	}
+
+	std::vector<ParticleEmitter*> gpuEmitters;
+	std::copy_if(m_ParticleEmitters.begin(), m_ParticleEmitters.end(), std::back_inserter(gpuEmitters), [](const ParticleEmitter* pEmitter) { return pEmitter->isGPUComputed(); });
+
+	getRenderedBuffers(gpuEmitters, buffers);
+}
+
+void ParticleEmitterHandlerVK::getRenderedBuffers(const std::vector<ParticleEmitter*>& emitters, std::vector<BufferVK*>& buffers)
+{
+	if (m_BatchedCompute) {
+		buffers = { m_pBatch->getPositionsBuffer(), m_pBatch->getVisibleIndicesBuffer(), m_pBatch->getDrawCommandsBuffer() };
+		return;
+	}
+
+	for (ParticleEmitter* pEmitter : emitters) {
+		buffers.push_back(reinterpret_cast<BufferVK*>(pEmitter->getPositionsBuffer()));
+		buffers.push_back(reinterpret_cast<BufferVK*>(pEmitter->getVisibleIndicesBuffer()));
+		buffers.push_back(reinterpret_cast<BufferVK*>(pEmitter->getDrawBuffer()));
+	}
 }
 
 bool ParticleEmitterHandlerVK::createCommandPoolAndBuffers()
@@ -378,6 +979,9 @@ bool ParticleEmitterHandlerVK::createCommandPoolAndBuffers()
 
 	const QueueFamilyIndices& queueFamilyIndices = pDevice->getQueueFamilyIndices();
 	const uint32_t computeQueueIndex = queueFamilyIndices.ComputeQueues.value().FamilyIndex;
+	m_QueueBusyTimes.resize(m_UseMultipleQueues ? queueFamilyIndices.ComputeQueues.value().QueueCount : 1, 0.0);
+	m_QueueWaits.resize(m_QueueBusyTimes.size());
+
 	for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
 		m_ppCommandPools[i] = DBG_NEW CommandPoolVK(pDevice, computeQueueIndex);
 
@@ -386,8 +990,7 @@ bool ParticleEmitterHandlerVK::createCommandPoolAndBuffers()
 		}
 	}
 
-	m_pCommandPoolGraphics = DBG_NEW CommandPoolVK(pDevice, queueFamilyIndices.GraphicsQueues.value().FamilyIndex);
-	return m_pCommandPoolGraphics->init();
+	return true;
 }
 
 bool ParticleEmitterHandlerVK::createSamplers()
@@ -417,6 +1020,8 @@ bool ParticleEmitterHandlerVK::createPipelineLayout()
 	m_pDescriptorSetLayoutPerEmitter->addBindingStorageBuffer(VK_SHADER_STAGE_COMPUTE_BIT, VELOCITIES_BINDING, 1);
 	m_pDescriptorSetLayoutPerEmitter->addBindingStorageBuffer(VK_SHADER_STAGE_COMPUTE_BIT, AGES_BINDING, 1);
 	m_pDescriptorSetLayoutPerEmitter->addBindingUniformBuffer(VK_SHADER_STAGE_COMPUTE_BIT, EMITTER_BINDING, 1);
+	m_pDescriptorSetLayoutPerEmitter->addBindingStorageBuffer(VK_SHADER_STAGE_COMPUTE_BIT, VISIBLE_BINDING, 1);
+	m_pDescriptorSetLayoutPerEmitter->addBindingStorageBuffer(VK_SHADER_STAGE_COMPUTE_BIT, DRAW_BINDING, 1);
 
 	if (!m_pDescriptorSetLayoutPerEmitter->finalize()) {
 		LOG("Failed to finalize particle descriptor set layout");
@@ -426,7 +1031,7 @@ bool ParticleEmitterHandlerVK::createPipelineLayout()
 	// Descriptor pool
 	DescriptorCounts descriptorCounts	= {};
 	descriptorCounts.m_SampledImages	= 128;
-	descriptorCounts.m_StorageBuffers	= 128;
+	descriptorCounts.m_StorageBuffers	= 256;
 	descriptorCounts.m_UniformBuffers	= 128;
 
 	m_pDescriptorPool = DBG_NEW DescriptorPoolVK(pDevice);
@@ -442,33 +1047,129 @@ bool ParticleEmitterHandlerVK::createPipelineLayout()
 	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
 	pushConstantRange.offset = 0;
 
-	return m_pPipelineLayout->init({m_pDescriptorSetLayoutPerEmitter}, {pushConstantRange});
+	if (!m_pPipelineLayout->init({m_pDescriptorSetLayoutPerEmitter}, {pushConstantRange})) {
+		return false;
+	}
+
+	if (!m_BatchedCompute) {
+		return true;
+	}
+
+	// Batched layout, the emitter binding holds the properties of every emitter in the batch
+	m_pBatchedDescriptorSetLayout = DBG_NEW DescriptorSetLayoutVK(pDevice);
+
+	m_pBatchedDescriptorSetLayout->addBindingStorageBuffer(VK_SHADER_STAGE_COMPUTE_BIT, POSITIONS_BINDING, 1);
+	m_pBatchedDescriptorSetLayout->addBindingStorageBuffer(VK_SHADER_STAGE_COMPUTE_BIT, VELOCITIES_BINDING, 1);
+	m_pBatchedDescriptorSetLayout->addBindingStorageBuffer(VK_SHADER_STAGE_COMPUTE_BIT, AGES_BINDING, 1);
+	m_pBatchedDescriptorSetLayout->addBindingStorageBuffer(VK_SHADER_STAGE_COMPUTE_BIT, EMITTER_BINDING, 1);
+	m_pBatchedDescriptorSetLayout->addBindingStorageBuffer(VK_SHADER_STAGE_COMPUTE_BIT, VISIBLE_BINDING, 1);
+	m_pBatchedDescriptorSetLayout->addBindingStorageBuffer(VK_SHADER_STAGE_COMPUTE_BIT, DRAW_BINDING, 1);
+
+	if (!m_pBatchedDescriptorSetLayout->finalize()) {
+		LOG("Failed to finalize batched particle descriptor set layout");
+		return false;
+	}
+
+	m_pBatchedPipelineLayout = DBG_NEW PipelineLayoutVK(pDevice);
+	pushConstantRange.size = sizeof(BatchedPushConstant);
+
+	return m_pBatchedPipelineLayout->init({m_pBatchedDescriptorSetLayout}, {pushConstantRange});
 }
 
 bool ParticleEmitterHandlerVK::createPipeline()
+{
+	tuneWorkGroupSize();
+
+	if (!createComputePipeline("assets/shaders/particles/update_cs.spv", m_pPipelineLayout, &m_pPipeline, m_WorkGroupSize) ||
+		!createComputePipeline("assets/shaders/particles/update_analytic_cs.spv", m_pPipelineLayout, &m_pAnalyticPipeline, m_WorkGroupSize)) {
+		return false;
+	}
+
+	return	!m_BatchedCompute ||
+			(createComputePipeline("assets/shaders/particles/update_batched_cs.spv", m_pBatchedPipelineLayout, &m_pBatchedPipeline, m_WorkGroupSize) &&
+			createComputePipeline("assets/shaders/particles/update_batched_analytic_cs.spv", m_pBatchedPipelineLayout, &m_pBatchedAnalyticPipeline, m_WorkGroupSize));
+}
+
+bool ParticleEmitterHandlerVK::createComputePipeline(const char* pShaderPath, PipelineLayoutVK* pPipelineLayout, PipelineVK** ppPipeline, uint32_t workGroupSize)
 {
 	// Create pipeline state
 	IShader* pComputeShader = m_pGraphicsContext->createShader();
-	pComputeShader->initFromFile(EShader::COMPUTE_SHADER, "main", "assets/shaders/particles/update_cs.spv");
+	pComputeShader->initFromFile(EShader::COMPUTE_SHADER, "main", pShaderPath);
 	if (!pComputeShader->finalize()) {
-        LOG("Failed to create compute shader for particle emitter handler");
+        LOG("Failed to create compute shader '%s' for particle emitter handler", pShaderPath);
+		SAFEDELETE(pComputeShader);
 		return false;
 	}
 
-	// Maximize the work group size
 	GraphicsContextVK* pGraphicsContext = reinterpret_cast<GraphicsContextVK*>(m_pGraphicsContext);
     DeviceVK* pDevice = pGraphicsContext->getDevice();
 
-	uint32_t pMaxWorkGroupSize[3];
-	pDevice->getMaxComputeWorkGroupSize(pMaxWorkGroupSize);
-	m_WorkGroupSize = pMaxWorkGroupSize[0];
-
 	ShaderVK* pComputeShaderVK = reinterpret_cast<ShaderVK*>(pComputeShader);
-	pComputeShaderVK->setSpecializationConstant(1, m_WorkGroupSize);
+	pComputeShaderVK->setSpecializationConstant(1, workGroupSize);
 
-	m_pPipeline = DBG_NEW PipelineVK(pDevice);
-	m_pPipeline->finalizeCompute(pComputeShader, m_pPipelineLayout);
+	*ppPipeline = DBG_NEW PipelineVK(pDevice);
+	(*ppPipeline)->finalizeCompute(pComputeShader, pPipelineLayout);
 
 	SAFEDELETE(pComputeShader);
 	return true;
 }
+
+void ParticleEmitterHandlerVK::tuneWorkGroupSize()
+{
+	GraphicsContextVK* pGraphicsContext = reinterpret_cast<GraphicsContextVK*>(m_pGraphicsContext);
+	ParticleWorkGroupTunerVK tuner(pGraphicsContext);
+
+	if (tuner.loadWorkGroupSize(m_WorkGroupSize)) {
+		LOG("Using tuned particle work group size: %u", m_WorkGroupSize);
+		return;
+	}
+
+	// The size tuned for the integrated update is used by every particle pipeline
+	std::vector<uint32_t> workGroupSizes;
+	tuner.getCandidateSizes(workGroupSizes);
+
+	std::vector<PipelineVK*> pipelines;
+	for (uint32_t workGroupSize : workGroupSizes) {
+		PipelineVK* pPipeline = nullptr;
+		if (!createComputePipeline("assets/shaders/particles/update_cs.spv", m_pPipelineLayout, &pPipeline, workGroupSize)) {
+			break;
+		}
+
+		pipelines.push_back(pPipeline);
+	}
+
+	// Planes that contain everything
+	PushConstant pushConstant = {1.0f / 60.0f, 0.0f, uint32_t(EParticlePositionFormat::FLOAT32)};
+	std::fill_n(pushConstant.frustumPlanes, 6, glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+
+	uint32_t fastestPipeline = 0;
+	if (pipelines.size() == workGroupSizes.size() &&
+		tuner.benchmark(pipelines.data(), workGroupSizes.data(), uint32_t(pipelines.size()), m_pPipelineLayout, m_pDescriptorSetLayoutPerEmitter, m_pDescriptorPool,
+			&pushConstant, sizeof(PushConstant), fastestPipeline)) {
+		m_WorkGroupSize = workGroupSizes[fastestPipeline];
+		tuner.saveWorkGroupSize(m_WorkGroupSize);
+
+		LOG("Tuned particle work group size: %u", m_WorkGroupSize);
+	} else {
+		// Maximize the work group size
+		LOG("Failed to tune particle work group size, using the largest size");
+		m_WorkGroupSize = workGroupSizes.back();
+	}
+
+	for (PipelineVK* pPipeline : pipelines) {
+		SAFEDELETE(pPipeline);
+	}
+}
+
+bool ParticleEmitterHandlerVK::createBatch()
+{
+	GraphicsContextVK* pGraphicsContext = reinterpret_cast<GraphicsContextVK*>(m_pGraphicsContext);
+
+	m_pBatch = DBG_NEW ParticleBatchVK(pGraphicsContext, 0);
+	if (!m_pBatch->init(m_pDescriptorPool, m_pBatchedDescriptorSetLayout, m_pBatchedPipelineLayout, m_pBatchedPipeline, m_pBatchedAnalyticPipeline, m_WorkGroupSize, m_FrameCount)) {
+		LOG("Failed to initialize particle batch");
+		return false;
+	}
+
+	return true;
+}
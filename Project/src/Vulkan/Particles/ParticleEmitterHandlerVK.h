@@ -2,9 +2,12 @@
 #include "Common/ParticleEmitterHandler.h"
 #include "Common/ITexture2D.h"
 #include "Core/ParticleEmitter.h"
+#include "Vulkan/DeviceVK.h"
 #include "Vulkan/ProfilerVK.h"
 #include "Vulkan/VulkanCommon.h"
 
+#include <unordered_map>
+
 class BufferVK;
 class CommandBufferVK;
 class CommandPoolVK;
@@ -15,7 +18,9 @@ class IPipeline;
 class IGraphicsContext;
 class IRenderer;
 class ITexture2D;
+class ParticleBatchVK;
 class ParticleEmitter;
+class ParticleHandoffVK;
 class PipelineLayoutVK;
 class PipelineVK;
 class SamplerVK;
@@ -26,7 +31,8 @@ struct ParticleStorage;
 class ParticleEmitterHandlerVK : public ParticleEmitterHandler
 {
 public:
-    ParticleEmitterHandlerVK(bool renderingEnabled, uint32_t frameCount, bool useMultipleQueues);
+    // A batched handler updates every emitter with one submission instead of one per emitter, see ParticleBatchVK
+    ParticleEmitterHandlerVK(bool renderingEnabled, uint32_t frameCount, bool useMultipleQueues, bool batchedCompute);
     ~ParticleEmitterHandlerVK();
 
     virtual void update(float dt) override;
@@ -36,52 +42,146 @@ public:
     virtual bool initializeGPUCompute() override;
 
     virtual void toggleComputationDevice() override;
+    // Not supported by batched handlers, the batch updates every emitter in one dispatch
+    virtual void setHybridScheduling(bool hybridScheduling) override;
 
     void releaseFromGraphics(BufferVK* pBuffer, CommandBufferVK* pCommandBuffer);
     void releaseFromCompute(BufferVK* pBuffer, CommandBufferVK* pCommandBuffer);
     void acquireForGraphics(BufferVK* pBuffer, CommandBufferVK* pCommandBuffer);
     void acquireForCompute(BufferVK* pBuffer, CommandBufferVK* pCommandBuffer);
 
+    // Transfers the buffers the renderer reads from every GPU-updated emitter, batched emitters share theirs
+    void releaseParticlesFromGraphics(CommandBufferVK* pCommandBuffer);
+    void acquireParticlesForGraphics(CommandBufferVK* pCommandBuffer);
+
 private:
     struct PushConstant {
 		float dt;
+		// Emitter's simulation time, used by analytic emitters
+		float time;
+		// EParticlePositionFormat of the positions buffer, used by analytic emitters
+		uint32_t positionFormat;
+		uint32_t padding;
+		// Particles outside these planes are not appended to the visible list
+		glm::vec4 frustumPlanes[6];
 	};
 
+    // Update time measured on a device since the last rebalance, and the cost per particle it amounts to
+    struct DeviceCost {
+        double measuredTime;
+        uint64_t measuredParticles;
+        // Milliseconds per particle and frame, negative until the device has updated any particles
+        double costPerParticle;
+    };
+
     // Initializes an emitter and prepares its buffers for computing or rendering
     virtual void initializeEmitter(ParticleEmitter* pEmitter) override;
 
+    void updateCPU(float dt);
     void updateGPU(float dt);
     void updateEmitter(ParticleEmitter* pEmitter, float dt);
 
+    // Starts moving the emitters to the given device, they keep being updated by their current device until their particles have been copied
+    void moveEmitters(const std::vector<ParticleEmitter*>& emitters, bool toGPU);
+    // Advances the copies of the moving emitters and switches the emitters whose particles have been copied
+    void updateHandoffs();
+    bool isMoving(const ParticleEmitter* pEmitter) const;
+    // Reads the GPU update times of the frame's previous use of the command buffers, for the emitters' times, the compute queues'
+    // utilisation and the GPU's cost when scheduling is hybrid
+    void measureGPUTimes(float dt);
+    // Assigns emitters to the devices so that the slowest device finishes as early as possible
+    void rebalanceEmitters();
+
+    // Measured GPU update time of the emitter, or an estimate from its particle count if it has not been measured
+    double estimateGPUTime(const ParticleEmitter* pEmitter) const;
+    // The compute queue with the least estimated work, for an emitter that has not been assigned one yet
+    uint32_t pickComputeQueue(const ParticleEmitter* pNewEmitter) const;
+    // Reassigns the GPU-updated emitters to the compute queues so that the busiest queue finishes as early as possible
+    void balanceComputeQueues();
+    // Waits for the emitter's updates on its current queue before later updates are submitted to the new one
+    void setComputeQueue(ParticleEmitter* pEmitter, uint32_t queueIndex);
+    void logQueueUtilisation() const;
+
     void beginUpdateFrame(ParticleEmitter* pEmitter);
     void endUpdateFrame(ParticleEmitter* pEmitter);
+    // Submits the recorded updates of the GPU-updated emitters in the range, in one batch per compute queue
+    void submitEmitters(uint32_t emitterBegin, uint32_t emitterEnd);
+
+    // The frame scheduler's frame in flight index, the resources of the frame that last used it are no longer in use
+    uint32_t getFrameInFlightIndex() const;
+
+    // Planes of the camera's frustum, or planes that contain everything when frustum culling is disabled
+    void updateFrustumPlanes();
+    // Positions, visible indices and draw buffers of the GPU-updated emitters
+    void getRenderedBuffers(std::vector<BufferVK*>& buffers);
+    void getRenderedBuffers(const std::vector<ParticleEmitter*>& emitters, std::vector<BufferVK*>& buffers);
 
     bool createCommandPoolAndBuffers();
     bool createSamplers();
     bool createPipelineLayout();
     bool createPipeline();
+    bool createComputePipeline(const char* pShaderPath, PipelineLayoutVK* pPipelineLayout, PipelineVK** ppPipeline, uint32_t workGroupSize);
+    // Loads the work group size tuned for the device, or benchmarks the candidate sizes if there is none
+    void tuneWorkGroupSize();
+    bool createBatch();
 
 private:
     CommandPoolVK* m_ppCommandPools[MAX_FRAMES_IN_FLIGHT];
 
-    // Used for creating temporary graphics command buffers for initializing emitter buffers
-    CommandPoolVK* m_pCommandPoolGraphics;
-
     DescriptorPoolVK* m_pDescriptorPool;
     DescriptorSetLayoutVK* m_pDescriptorSetLayoutPerEmitter;
 
     PipelineLayoutVK* m_pPipelineLayout;
     PipelineVK* m_pPipeline;
+    // update_cs.glsl compiled with ANALYTIC defined, it shares the pipeline layout but does not use the velocity and age bindings
+    PipelineVK* m_pAnalyticPipeline;
+
+    // Used instead of the per-emitter resources when compute is batched. The emitter properties binding is an array of every emitter's properties
+    ParticleBatchVK* m_pBatch;
+    DescriptorSetLayoutVK* m_pBatchedDescriptorSetLayout;
+    PipelineLayoutVK* m_pBatchedPipelineLayout;
+    PipelineVK* m_pBatchedPipeline;
+    PipelineVK* m_pBatchedAnalyticPipeline;
 
     SamplerVK* m_pGBufferSampler;
 
+    // Emitters moving between the CPU and the GPU, a handoff is deleted once its emitter has switched and its submissions have finished
+    std::vector<ParticleHandoffVK*> m_Handoffs;
+
+    // The emitters updated by each device in the current frame
+    std::vector<ParticleEmitter*> m_CPUEmitters;
+    std::vector<ParticleEmitter*> m_GPUEmitters;
+
+    // First update chunk of every CPU-updated emitter in the CPU update's combined chunk range, the last element is the total chunk count
+    std::vector<uint32_t> m_ChunkOffsets;
+
+    DeviceCost m_CPUCost;
+    DeviceCost m_GPUCost;
+    // Frames since the emitters were last rebalanced
+    uint32_t m_FramesSinceRebalance;
+
+    // Smoothed GPU update time of every measured emitter in milliseconds
+    std::unordered_map<const ParticleEmitter*, double> m_EmitterGPUTimes;
+    // Smoothed milliseconds per particle over the measured emitters, negative until an emitter has been measured
+    double m_GPUTimePerParticle;
+    // Milliseconds each compute queue spent updating emitters, and the frame time it was measured over
+    std::vector<double> m_QueueBusyTimes;
+    double m_MeasuredFrameTime;
+    // Timeline values of the queues that emitters have moved away from, waited for by the next submissions to each emitter's new queue
+    std::vector<std::vector<TimelineWaitVK>> m_QueueWaits;
+    // Submission of the latest rendered frame, whose draws read the buffers that the frame's updates overwrite. Waited for by every update
+    // submission, VK_NULL_HANDLE when there is nothing to wait for on the GPU
+    TimelineWaitVK m_RenderedFrameWait;
+    // Frames since the GPU-updated emitters were last assigned to compute queues
+    uint32_t m_FramesSinceQueueBalance;
+
+    glm::vec4 m_FrustumPlanes[6];
+
     // Work items per work group launched in a compute shader dispatch
     uint32_t m_WorkGroupSize;
 
-    uint32_t m_NextQueueIndex;
-
-    uint32_t m_CurrentFrame;
     uint32_t m_FrameCount;
 
     bool m_UseMultipleQueues;
+    bool m_BatchedCompute;
 };
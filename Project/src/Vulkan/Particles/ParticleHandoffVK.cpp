@@ -0,0 +1,328 @@
+#include "ParticleHandoffVK.h"
+
+#include "Core/ParticleEmitter.h"
+#include "Vulkan/BufferVK.h"
+#include "Vulkan/CommandBufferVK.h"
+#include "Vulkan/CommandPoolVK.h"
+#include "Vulkan/GraphicsContextVK.h"
+#include "Vulkan/Particles/ParticleEmitterHandlerVK.h"
+
+#include <algorithm>
+
+// Bytes copied on the transfer queue per frame, a million particles are moved in about five frames
+#define HANDOFF_SLICE_SIZE	MB(8)
+
+ParticleHandoffVK::ParticleHandoffVK(GraphicsContextVK* pGraphicsContext, ParticleEmitter* pEmitter, bool toGPU)
+	:m_pGraphicsContext(pGraphicsContext),
+	m_pEmitter(pEmitter),
+	m_pHostBuffer(nullptr),
+	m_pDeviceBuffer(nullptr),
+	m_pMappedHostBuffer(nullptr),
+	m_pTransferCommandPool(nullptr),
+	m_pTransferCommandBuffer(nullptr),
+	m_pComputeCommandPool(nullptr),
+	m_pComputeCommandBuffer(nullptr),
+	m_Semaphore(VK_NULL_HANDLE),
+	m_ParticleCount(0),
+	m_LivingCount(0),
+	m_TotalBytes(0),
+	m_CopiedBytes(0),
+	m_CatchUpTime(0.0f),
+	m_ToGPU(toGPU),
+	m_Switched(false)
+{}
+
+ParticleHandoffVK::~ParticleHandoffVK()
+{
+	// Wait for command buffers to finish executing before deleting them
+	if (m_pTransferCommandBuffer != nullptr) {
+		m_pTransferCommandBuffer->reset(true);
+		m_pTransferCommandPool->freeCommandBuffer(&m_pTransferCommandBuffer);
+	}
+
+	if (m_pComputeCommandBuffer != nullptr) {
+		m_pComputeCommandBuffer->reset(true);
+		m_pComputeCommandPool->freeCommandBuffer(&m_pComputeCommandBuffer);
+	}
+
+	SAFEDELETE(m_pTransferCommandPool);
+	SAFEDELETE(m_pComputeCommandPool);
+	SAFEDELETE(m_pHostBuffer);
+	SAFEDELETE(m_pDeviceBuffer);
+
+	if (m_Semaphore != VK_NULL_HANDLE) {
+		vkDestroySemaphore(m_pGraphicsContext->getDevice()->getDevice(), m_Semaphore, nullptr);
+		m_Semaphore = VK_NULL_HANDLE;
+	}
+}
+
+bool ParticleHandoffVK::init()
+{
+	// Analytic emitters have no particle state, they compute their particles from the simulation time on either device.
+	// Particles beyond the GPU buffers' capacity are only updated on the CPU
+	if (!m_pEmitter->isAnalytic()) {
+		m_ParticleCount = uint32_t(std::min(m_pEmitter->getParticleStorage().size(), size_t(m_pEmitter->getParticleCapacity())));
+	}
+
+	m_LivingCount = std::min(m_pEmitter->getParticleCount(), m_ParticleCount);
+	m_TotalBytes = m_ParticleCount * (2 * sizeof(glm::vec4) + sizeof(float));
+
+	if (!createCommandBuffers()) {
+		return false;
+	}
+
+	if (m_TotalBytes == 0) {
+		return true;
+	}
+
+	if (!createBuffers()) {
+		return false;
+	}
+
+	if (m_ToGPU) {
+		// The CPU update is not running, so its particles can be packed straight into the host buffer
+		const ParticleStorage& particleStorage = m_pEmitter->getParticleStorage();
+		glm::vec4* pPositions = reinterpret_cast<glm::vec4*>(m_pMappedHostBuffer);
+		glm::vec4* pVelocities = pPositions + m_ParticleCount;
+
+		particleStorage.packPositions(pPositions, 0, m_ParticleCount);
+		particleStorage.packVelocities(pVelocities, 0, m_ParticleCount);
+		std::copy_n(particleStorage.ages.begin(), m_ParticleCount, reinterpret_cast<float*>(pVelocities + m_ParticleCount));
+	} else {
+		submitSnapshot();
+	}
+
+	return true;
+}
+
+void ParticleHandoffVK::update()
+{
+	if (m_CopiedBytes == m_TotalBytes || !m_pTransferCommandBuffer->isFinished()) {
+		return;
+	}
+
+	DeviceVK* pDevice = m_pGraphicsContext->getDevice();
+	const QueueFamilyIndices& queueFamilyIndices = pDevice->getQueueFamilyIndices();
+	const uint32_t transferFamily = queueFamilyIndices.TransferQueues.value().FamilyIndex;
+	const uint32_t computeFamily = queueFamilyIndices.ComputeQueues.value().FamilyIndex;
+
+	const bool firstSlice = m_CopiedBytes == 0;
+	const uint64_t sliceSize = std::min(uint64_t(HANDOFF_SLICE_SIZE), m_TotalBytes - m_CopiedBytes);
+	const bool lastSlice = m_CopiedBytes + sliceSize == m_TotalBytes;
+
+	// The fence has been signaled, so this does not wait
+	m_pTransferCommandBuffer->reset(true);
+	m_pTransferCommandBuffer->begin(nullptr, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+
+	if (!m_ToGPU && firstSlice && transferFamily != computeFamily) {
+		m_pTransferCommandBuffer->acquireBufferOwnership(m_pDeviceBuffer, VK_ACCESS_TRANSFER_READ_BIT, computeFamily, transferFamily, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+	}
+
+	if (m_ToGPU) {
+		m_pTransferCommandBuffer->copyBuffer(m_pHostBuffer, m_CopiedBytes, m_pDeviceBuffer, m_CopiedBytes, sliceSize);
+	} else {
+		m_pTransferCommandBuffer->copyBuffer(m_pDeviceBuffer, m_CopiedBytes, m_pHostBuffer, m_CopiedBytes, sliceSize);
+	}
+
+	m_CopiedBytes += sliceSize;
+
+	if (lastSlice) {
+		if (m_ToGPU && transferFamily != computeFamily) {
+			m_pTransferCommandBuffer->releaseBufferOwnership(m_pDeviceBuffer, VK_ACCESS_TRANSFER_WRITE_BIT, transferFamily, computeFamily, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+		} else if (!m_ToGPU) {
+			// Makes the particles visible to the host once the fence has been signaled
+			VkMemoryBarrier memoryBarrier = {};
+			memoryBarrier.sType			= VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+			memoryBarrier.srcAccessMask	= VK_ACCESS_TRANSFER_WRITE_BIT;
+			memoryBarrier.dstAccessMask	= VK_ACCESS_HOST_READ_BIT;
+			m_pTransferCommandBuffer->pipelineBarrier(VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+		}
+	}
+
+	m_pTransferCommandBuffer->end();
+
+	// The snapshot is waited for before the first slice reads it, and the last slice is waited for before the particles are copied to the emitter
+	const VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+	const uint32_t waitSemaphoreCount = (!m_ToGPU && firstSlice) ? 1 : 0;
+	const uint32_t signalSemaphoreCount = (m_ToGPU && lastSlice) ? 1 : 0;
+
+	pDevice->executeTransfer(m_pTransferCommandBuffer, &m_Semaphore, &waitStage, waitSemaphoreCount, &m_Semaphore, signalSemaphoreCount);
+}
+
+void ParticleHandoffVK::switchDevice(ParticleEmitterHandlerVK* pHandler, const std::vector<BufferVK*>& renderedBuffers)
+{
+	if (m_ToGPU) {
+		submitParticles(pHandler, renderedBuffers);
+		m_pEmitter->setCatchUpTime(m_CatchUpTime);
+	} else if (m_TotalBytes > 0) {
+		unpackParticles();
+	} else {
+		m_pEmitter->setCatchUpTime(m_CatchUpTime);
+	}
+
+	// The emitter's settings may have changed while the particles were copied, the GPU update uploads them again
+	m_pEmitter->m_EmitterUpdated = true;
+	m_pEmitter->setGPUComputed(m_ToGPU);
+	m_Switched = true;
+}
+
+bool ParticleHandoffVK::isCopied() const
+{
+	return m_CopiedBytes == m_TotalBytes && m_pTransferCommandBuffer->isFinished();
+}
+
+bool ParticleHandoffVK::isRetired() const
+{
+	return m_Switched && m_pTransferCommandBuffer->isFinished() && m_pComputeCommandBuffer->isFinished();
+}
+
+bool ParticleHandoffVK::createBuffers()
+{
+	DeviceVK* pDevice = m_pGraphicsContext->getDevice();
+
+	BufferParams bufferParams = {};
+	bufferParams.IsExclusive = true;
+	bufferParams.Usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	bufferParams.SizeInBytes = m_TotalBytes;
+
+	// Particles read back from the GPU are read by the host, which is faster from cached memory
+	bufferParams.MemoryProperty = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+	bufferParams.PreferredMemoryProperty = m_ToGPU ? 0 : VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+
+	m_pHostBuffer = DBG_NEW BufferVK(pDevice);
+	if (!m_pHostBuffer->init(bufferParams)) {
+		LOG("Failed to create particle handoff host buffer");
+		return false;
+	}
+
+	m_pHostBuffer->setName("Particle Handoff Host Buffer");
+	m_pHostBuffer->map(&m_pMappedHostBuffer);
+
+	bufferParams.MemoryProperty = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+	bufferParams.PreferredMemoryProperty = 0;
+
+	m_pDeviceBuffer = DBG_NEW BufferVK(pDevice);
+	if (!m_pDeviceBuffer->init(bufferParams)) {
+		LOG("Failed to create particle handoff device buffer");
+		return false;
+	}
+
+	m_pDeviceBuffer->setName("Particle Handoff Device Buffer");
+	return true;
+}
+
+bool ParticleHandoffVK::createCommandBuffers()
+{
+	DeviceVK* pDevice = m_pGraphicsContext->getDevice();
+	const QueueFamilyIndices& queueFamilyIndices = pDevice->getQueueFamilyIndices();
+
+	m_pTransferCommandPool = DBG_NEW CommandPoolVK(pDevice, queueFamilyIndices.TransferQueues.value().FamilyIndex);
+	m_pComputeCommandPool = DBG_NEW CommandPoolVK(pDevice, queueFamilyIndices.ComputeQueues.value().FamilyIndex);
+	if (!m_pTransferCommandPool->init() || !m_pComputeCommandPool->init()) {
+		LOG("Failed to create particle handoff command pools");
+		return false;
+	}
+
+	m_pTransferCommandBuffer = m_pTransferCommandPool->allocateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+	m_pComputeCommandBuffer = m_pComputeCommandPool->allocateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+	if (m_pTransferCommandBuffer == nullptr || m_pComputeCommandBuffer == nullptr) {
+		LOG("Failed to allocate particle handoff command buffers");
+		return false;
+	}
+
+	VkSemaphoreCreateInfo semaphoreInfo = {};
+	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	semaphoreInfo.pNext = nullptr;
+	semaphoreInfo.flags = 0;
+
+	VK_CHECK_RESULT_RETURN_FALSE(vkCreateSemaphore(pDevice->getDevice(), &semaphoreInfo, nullptr, &m_Semaphore), "Failed to create particle handoff semaphore");
+	return true;
+}
+
+void ParticleHandoffVK::submitSnapshot()
+{
+	DeviceVK* pDevice = m_pGraphicsContext->getDevice();
+	const QueueFamilyIndices& queueFamilyIndices = pDevice->getQueueFamilyIndices();
+	const uint32_t transferFamily = queueFamilyIndices.TransferQueues.value().FamilyIndex;
+	const uint32_t computeFamily = queueFamilyIndices.ComputeQueues.value().FamilyIndex;
+
+	m_pComputeCommandBuffer->reset(true);
+	m_pComputeCommandBuffer->begin(nullptr, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+
+	// The emitter's previous updates on this queue write the particles
+	VkMemoryBarrier memoryBarrier = {};
+	memoryBarrier.sType			= VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	memoryBarrier.srcAccessMask	= VK_ACCESS_SHADER_WRITE_BIT;
+	memoryBarrier.dstAccessMask	= VK_ACCESS_TRANSFER_READ_BIT;
+	m_pComputeCommandBuffer->pipelineBarrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+	// Integrated particles' GPU positions are always stored as floats
+	const uint64_t vec4Bytes = m_ParticleCount * sizeof(glm::vec4);
+	m_pComputeCommandBuffer->copyBuffer(reinterpret_cast<BufferVK*>(m_pEmitter->getPositionsBuffer()), m_pEmitter->getPositionsOffset(), m_pDeviceBuffer, 0, vec4Bytes);
+	m_pComputeCommandBuffer->copyBuffer(reinterpret_cast<BufferVK*>(m_pEmitter->getVelocitiesBuffer()), m_pEmitter->getVelocitiesOffset(), m_pDeviceBuffer, vec4Bytes, vec4Bytes);
+	m_pComputeCommandBuffer->copyBuffer(reinterpret_cast<BufferVK*>(m_pEmitter->getAgesBuffer()), m_pEmitter->getAgesOffset(), m_pDeviceBuffer, 2 * vec4Bytes, m_ParticleCount * sizeof(float));
+
+	if (transferFamily != computeFamily) {
+		m_pComputeCommandBuffer->releaseBufferOwnership(m_pDeviceBuffer, VK_ACCESS_TRANSFER_WRITE_BIT, computeFamily, transferFamily, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+	}
+
+	m_pComputeCommandBuffer->end();
+
+	// Submitted before the emitter's next update on the same queue, whose barriers keep the update from overwriting the particles being copied
+	pDevice->executeCompute(m_pComputeCommandBuffer, nullptr, nullptr, 0, &m_Semaphore, 1, m_pEmitter->getComputeQueueIndex());
+}
+
+void ParticleHandoffVK::submitParticles(ParticleEmitterHandlerVK* pHandler, const std::vector<BufferVK*>& renderedBuffers)
+{
+	DeviceVK* pDevice = m_pGraphicsContext->getDevice();
+	const QueueFamilyIndices& queueFamilyIndices = pDevice->getQueueFamilyIndices();
+	const uint32_t transferFamily = queueFamilyIndices.TransferQueues.value().FamilyIndex;
+	const uint32_t computeFamily = queueFamilyIndices.ComputeQueues.value().FamilyIndex;
+
+	m_pComputeCommandBuffer->reset(true);
+	m_pComputeCommandBuffer->begin(nullptr, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+
+	if (m_TotalBytes > 0) {
+		if (transferFamily != computeFamily) {
+			m_pComputeCommandBuffer->acquireBufferOwnership(m_pDeviceBuffer, VK_ACCESS_TRANSFER_READ_BIT, transferFamily, computeFamily, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+		}
+
+		// The emitter's last GPU updates may still read or write the particle buffers
+		VkMemoryBarrier memoryBarrier = {};
+		memoryBarrier.sType			= VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		memoryBarrier.srcAccessMask	= VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		memoryBarrier.dstAccessMask	= VK_ACCESS_TRANSFER_WRITE_BIT;
+		m_pComputeCommandBuffer->pipelineBarrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+		const uint64_t vec4Bytes = m_ParticleCount * sizeof(glm::vec4);
+		m_pComputeCommandBuffer->copyBuffer(m_pDeviceBuffer, 0, reinterpret_cast<BufferVK*>(m_pEmitter->getPositionsBuffer()), m_pEmitter->getPositionsOffset(), vec4Bytes);
+		m_pComputeCommandBuffer->copyBuffer(m_pDeviceBuffer, vec4Bytes, reinterpret_cast<BufferVK*>(m_pEmitter->getVelocitiesBuffer()), m_pEmitter->getVelocitiesOffset(), vec4Bytes);
+		m_pComputeCommandBuffer->copyBuffer(m_pDeviceBuffer, 2 * vec4Bytes, reinterpret_cast<BufferVK*>(m_pEmitter->getAgesBuffer()), m_pEmitter->getAgesOffset(), m_ParticleCount * sizeof(float));
+
+		memoryBarrier.srcAccessMask	= VK_ACCESS_TRANSFER_WRITE_BIT;
+		memoryBarrier.dstAccessMask	= VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		m_pComputeCommandBuffer->pipelineBarrier(VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+	}
+
+	// The renderer acquires the particle buffers of GPU-updated emitters for the graphics queue before drawing them,
+	// so the compute queue needs to release them
+	for (BufferVK* pBuffer : renderedBuffers) {
+		pHandler->releaseFromCompute(pBuffer, m_pComputeCommandBuffer);
+	}
+
+	m_pComputeCommandBuffer->end();
+
+	// Submitted before the emitter's first GPU update on the same queue
+	const VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+	const uint32_t waitSemaphoreCount = m_TotalBytes > 0 ? 1 : 0;
+	pDevice->executeCompute(m_pComputeCommandBuffer, &m_Semaphore, &waitStage, waitSemaphoreCount, nullptr, 0, m_pEmitter->getComputeQueueIndex());
+}
+
+void ParticleHandoffVK::unpackParticles()
+{
+	const glm::vec4* pPositions = reinterpret_cast<const glm::vec4*>(m_pMappedHostBuffer);
+	const glm::vec4* pVelocities = pPositions + m_ParticleCount;
+	const float* pAges = reinterpret_cast<const float*>(pVelocities + m_ParticleCount);
+
+	m_pEmitter->setParticles(pPositions, pVelocities, pAges, m_ParticleCount, m_LivingCount, m_CatchUpTime);
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include "Vulkan/VulkanCommon.h"
+
+#include <vector>
+
+class BufferVK;
+class CommandBufferVK;
+class CommandPoolVK;
+class GraphicsContextVK;
+class ParticleEmitter;
+class ParticleEmitterHandlerVK;
+
+/*
+    Moves an emitter's particles between the CPU and the GPU without stalling either of them. The particles are copied between a host
+    visible buffer and a device local one on the transfer queue, a slice per frame, while the old device keeps updating the emitter.
+    The compute queue copies between the device local buffer and the emitter's particle buffers, and the queues are synchronized with a
+    semaphore. Once every slice has been copied, the emitter is switched to the new device, and its particles catch up with the time
+    the old device updated the emitter for after they were copied
+*/
+class ParticleHandoffVK
+{
+public:
+    ParticleHandoffVK(GraphicsContextVK* pGraphicsContext, ParticleEmitter* pEmitter, bool toGPU);
+    // Waits for the handoff's submissions to finish
+    ~ParticleHandoffVK();
+
+    DECL_NO_COPY(ParticleHandoffVK);
+
+    // Copies the particles of the device currently updating the emitter, the CPU's are packed right away and the GPU's are copied by a
+    // compute submission before the emitter's next update
+    bool init();
+
+    // Submits the next slice of copies if the previous one has finished, called once per frame
+    void update();
+    // Adds to the time the particles have to catch up with, called once per frame with the time the old device updated the emitter for
+    void addElapsedTime(float dt) { m_CatchUpTime += dt; }
+
+    // Makes the new device update the emitter, once every slice has been copied. Emitters moving to the GPU copy their particles into the
+    // particle buffers and release the rendered buffers to the graphics queue in a compute submission
+    void switchDevice(ParticleEmitterHandlerVK* pHandler, const std::vector<BufferVK*>& renderedBuffers);
+
+    // Every slice has been submitted and has finished executing
+    bool isCopied() const;
+    bool hasSwitched() const { return m_Switched; }
+    // Switched and every submission has finished, the handoff can be deleted without waiting
+    bool isRetired() const;
+
+    bool isToGPU() const                { return m_ToGPU; }
+    ParticleEmitter* getEmitter() const { return m_pEmitter; }
+
+private:
+    bool createBuffers();
+    bool createCommandBuffers();
+
+    // Copies the emitter's particle buffers to the device local buffer and releases it to the transfer queue
+    void submitSnapshot();
+    // Copies the device local buffer to the emitter's particle buffers, after acquiring it from the transfer queue
+    void submitParticles(ParticleEmitterHandlerVK* pHandler, const std::vector<BufferVK*>& renderedBuffers);
+    void unpackParticles();
+
+private:
+    GraphicsContextVK* m_pGraphicsContext;
+    ParticleEmitter* m_pEmitter;
+
+    // Positions, velocities and ages of m_ParticleCount particles, one after another. Positions and velocities are packed as vec4
+    BufferVK* m_pHostBuffer;
+    BufferVK* m_pDeviceBuffer;
+    void* m_pMappedHostBuffer;
+
+    CommandPoolVK* m_pTransferCommandPool;
+    CommandBufferVK* m_pTransferCommandBuffer;
+    CommandPoolVK* m_pComputeCommandPool;
+    CommandBufferVK* m_pComputeCommandBuffer;
+    // Signaled by the compute submission and waited on by the first transfer slice when moving to the CPU, and the other way around
+    VkSemaphore m_Semaphore;
+
+    uint32_t m_ParticleCount;
+    // Particles that had been spawned when the particles were copied
+    uint32_t m_LivingCount;
+    uint64_t m_TotalBytes;
+    uint64_t m_CopiedBytes;
+
+    float m_CatchUpTime;
+    bool m_ToGPU;
+    bool m_Switched;
+};
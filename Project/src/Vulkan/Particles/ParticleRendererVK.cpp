@@ -27,6 +27,7 @@
 #define BINDING_EMITTER 			2
 #define BINDING_PARTICLE_POSITIONS	3
 #define BINDING_PARTICLE_TEXTURE	4
+#define BINDING_VISIBLE_PARTICLES	5
 
 ParticleRendererVK::ParticleRendererVK(GraphicsContextVK* pGraphicsContext, RenderingHandlerVK* pRenderingHandler)
 	:m_pGraphicsContext(pGraphicsContext),
@@ -128,18 +129,27 @@ void ParticleRendererVK::renderUI()
 {
 }
 
-void ParticleRendererVK::submitParticles(ParticleEmitter* pEmitter)
+void ParticleRendererVK::submitParticles(ParticleEmitter* pEmitter, bool useMappedPositions)
 {
 	uint32_t frameIndex = m_pRenderingHandler->getCurrentFrameIndex();
 
-	if (!bindDescriptorSet(pEmitter)) {
+	if (!bindDescriptorSet(pEmitter, useMappedPositions)) {
 		return;
 	}
 
-	uint32_t particleCount = pEmitter->getParticleCount();
+	PushConstant pushConstant = {};
+	pushConstant.positionFormat			= uint32_t(useMappedPositions ? pEmitter->getPositionFormat() : pEmitter->getGPUPositionFormat());
+	pushConstant.drawVisibleParticles	= useMappedPositions ? 0 : 1;
+	m_ppCommandBuffers[frameIndex]->pushConstants(m_pPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PushConstant), (const void*)&pushConstant);
 
 	m_pProfiler->beginTimestamp(&m_TimestampDraw);
-	m_ppCommandBuffers[frameIndex]->drawIndexInstanced(m_pQuadMesh->getIndexCount(), particleCount, 0, 0, 0);
+	if (useMappedPositions) {
+		m_ppCommandBuffers[frameIndex]->drawIndexInstanced(m_pQuadMesh->getIndexCount(), pEmitter->getMappedParticleCount(), 0, 0, 0);
+	} else {
+		// The update shader has counted the visible particles in the draw command
+		BufferVK* pDrawBuffer = reinterpret_cast<BufferVK*>(pEmitter->getDrawBuffer());
+		m_ppCommandBuffers[frameIndex]->drawIndexedIndirect(pDrawBuffer, pEmitter->getDrawCommandOffset(), 1, sizeof(VkDrawIndexedIndirectCommand));
+	}
 	m_pProfiler->endTimestamp(&m_TimestampDraw);
 }
 
@@ -205,6 +215,7 @@ bool ParticleRendererVK::createPipelineLayout()
 	m_pDescriptorSetLayout->addBindingUniformBuffer(VK_SHADER_STAGE_VERTEX_BIT, 			BINDING_EMITTER, 1);
 	m_pDescriptorSetLayout->addBindingStorageBuffer(VK_SHADER_STAGE_VERTEX_BIT, 			BINDING_PARTICLE_POSITIONS, 1);
 	m_pDescriptorSetLayout->addBindingCombinedImage(VK_SHADER_STAGE_FRAGMENT_BIT, &sampler, BINDING_PARTICLE_TEXTURE, 1);
+	m_pDescriptorSetLayout->addBindingStorageBuffer(VK_SHADER_STAGE_VERTEX_BIT, 			BINDING_VISIBLE_PARTICLES, 1);
 
 	if (!m_pDescriptorSetLayout->finalize()) {
 		LOG("Failed to finalize descriptor set layout");
@@ -213,20 +224,26 @@ bool ParticleRendererVK::createPipelineLayout()
 
 	std::vector<const DescriptorSetLayoutVK*> descriptorSetLayouts = { m_pDescriptorSetLayout };
 
-	// Descriptor pool
+	// Descriptor pool, an emitter has one set reading its GPU positions and one per frame in flight reading its mapped positions
+	constexpr uint32_t setsPerEmitter	= 1 + MAX_FRAMES_IN_FLIGHT;
 	DescriptorCounts descriptorCounts	= {};
-	descriptorCounts.m_SampledImages	= 128;
-	descriptorCounts.m_StorageBuffers	= 128;
-	descriptorCounts.m_UniformBuffers	= 128;
+	descriptorCounts.m_SampledImages	= 128 * setsPerEmitter;
+	descriptorCounts.m_StorageBuffers	= 256 * setsPerEmitter;
+	descriptorCounts.m_UniformBuffers	= 128 * setsPerEmitter;
 
 	m_pDescriptorPool = DBG_NEW DescriptorPoolVK(pDevice);
-	if (!m_pDescriptorPool->init(descriptorCounts, 256)) {
+	if (!m_pDescriptorPool->init(descriptorCounts, 256 * setsPerEmitter)) {
 		LOG("Failed to initialize descriptor pool");
 		return false;
 	}
 
 	m_pPipelineLayout = DBG_NEW PipelineLayoutVK(pDevice);
-	return m_pPipelineLayout->init(descriptorSetLayouts, {});
+	VkPushConstantRange pushConstantRange = {};
+	pushConstantRange.size = sizeof(PushConstant);
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	pushConstantRange.offset = 0;
+
+	return m_pPipelineLayout->init(descriptorSetLayouts, {pushConstantRange});
 }
 
 bool ParticleRendererVK::createPipeline()
@@ -299,7 +316,7 @@ bool ParticleRendererVK::createQuadMesh()
 		}
 	}};
 
-	const std::array<uint32_t, 6> pQuadIndices = {0, 1, 2, 2, 3, 0};
+	const std::array<uint32_t, PARTICLE_QUAD_INDEX_COUNT> pQuadIndices = {0, 1, 2, 2, 3, 0};
 
 	m_pQuadMesh = DBG_NEW MeshVK(m_pGraphicsContext->getDevice());
 	return m_pQuadMesh->initFromMemory(pQuadVertices.data(), sizeof(QuadVertex), uint32_t(pQuadVertices.size()), pQuadIndices.data(), uint32_t(pQuadIndices.size()));
@@ -311,42 +328,64 @@ void ParticleRendererVK::createProfiler()
 	// m_pProfiler->initTimestamp(&m_TimestampDraw, "Draw Instanced");
 }
 
-bool ParticleRendererVK::bindDescriptorSet(ParticleEmitter* pEmitter)
+bool ParticleRendererVK::bindDescriptorSet(ParticleEmitter* pEmitter, bool useMappedPositions)
 {
-	if (pEmitter->getDescriptorSetRender() == nullptr) {
-		// Create a descriptor set for the emitter
-		DescriptorSetVK* pDescriptorSet = m_pDescriptorPool->allocDescriptorSet(m_pDescriptorSetLayout);
+	uint32_t frameIndex = m_pRenderingHandler->getCurrentFrameIndex();
+
+	DescriptorSetVK* pDescriptorSet = nullptr;
+	if (useMappedPositions) {
+		pDescriptorSet = reinterpret_cast<DescriptorSetVK*>(pEmitter->getDescriptorSetRenderMapped(frameIndex));
 		if (pDescriptorSet == nullptr) {
-			LOG("Failed to create descriptor set for particle renderer");
-			return false;
+			pDescriptorSet = createDescriptorSet(pEmitter, reinterpret_cast<BufferVK*>(pEmitter->getMappedPositionsBuffer(frameIndex)), 0, VK_WHOLE_SIZE);
+			pEmitter->setDescriptorSetRenderMapped(frameIndex, pDescriptorSet);
 		}
+	} else {
+		pDescriptorSet = reinterpret_cast<DescriptorSetVK*>(pEmitter->getDescriptorSetRender());
+		if (pDescriptorSet == nullptr) {
+			// Batched emitters' positions are a range of a buffer shared by the batch
+			VkDeviceSize positionsSize = pEmitter->getPositionsSize();
+			pDescriptorSet = createDescriptorSet(pEmitter, reinterpret_cast<BufferVK*>(pEmitter->getPositionsBuffer()), pEmitter->getPositionsOffset(), positionsSize > 0 ? positionsSize : VK_WHOLE_SIZE);
+			pEmitter->setDescriptorSetRender(pDescriptorSet);
+		}
+	}
+
+	if (pDescriptorSet == nullptr) {
+		return false;
+	}
 
-		BufferVK* pEmitterBuffer = reinterpret_cast<BufferVK*>(pEmitter->getEmitterBuffer());
-		BufferVK* pPositionsBuffer = reinterpret_cast<BufferVK*>(pEmitter->getPositionsBuffer());
-		Texture2DVK* pParticleTexture = reinterpret_cast<Texture2DVK*>(pEmitter->getParticleTexture());
+	// Bind descriptor set
+	m_ppCommandBuffers[frameIndex]->bindDescriptorSet(VK_PIPELINE_BIND_POINT_GRAPHICS, m_pPipelineLayout, 0, 1, &pDescriptorSet, 0, nullptr);
+	return true;
+}
 
-		// Storage buffer for quad vertices
-		BufferVK* pVertBuffer = reinterpret_cast<BufferVK*>(m_pQuadMesh->getVertexBuffer());
+DescriptorSetVK* ParticleRendererVK::createDescriptorSet(ParticleEmitter* pEmitter, BufferVK* pPositionsBuffer, VkDeviceSize positionsOffset, VkDeviceSize positionsSize)
+{
+	DescriptorSetVK* pDescriptorSet = m_pDescriptorPool->allocDescriptorSet(m_pDescriptorSetLayout);
+	if (pDescriptorSet == nullptr) {
+		LOG("Failed to create descriptor set for particle renderer");
+		return nullptr;
+	}
 
-		// Camera buffers
-		BufferVK* pCameraBuffer = m_pRenderingHandler->getCameraBufferGraphics();
+	BufferVK* pEmitterBuffer = reinterpret_cast<BufferVK*>(pEmitter->getEmitterBuffer());
+	Texture2DVK* pParticleTexture = reinterpret_cast<Texture2DVK*>(pEmitter->getParticleTexture());
 
-		pDescriptorSet->writeStorageBufferDescriptor(pVertBuffer, 		BINDING_VERTEX);
-		pDescriptorSet->writeUniformBufferDescriptor(pCameraBuffer, 	BINDING_CAMERA);
-		pDescriptorSet->writeUniformBufferDescriptor(pEmitterBuffer, 	BINDING_EMITTER);
-		pDescriptorSet->writeStorageBufferDescriptor(pPositionsBuffer,	BINDING_PARTICLE_POSITIONS);
+	// Storage buffer for quad vertices
+	BufferVK* pVertBuffer = reinterpret_cast<BufferVK*>(m_pQuadMesh->getVertexBuffer());
 
-		ImageViewVK* pParticleTextureVIew = pParticleTexture->getImageView();
-		pDescriptorSet->writeCombinedImageDescriptors(&pParticleTextureVIew, &m_pSampler, 1, BINDING_PARTICLE_TEXTURE);
+	// Camera buffers
+	BufferVK* pCameraBuffer = m_pRenderingHandler->getCameraBufferGraphics();
 
-		pEmitter->setDescriptorSetRender(pDescriptorSet);
-	}
+	pDescriptorSet->writeStorageBufferDescriptor(pVertBuffer, 		BINDING_VERTEX);
+	pDescriptorSet->writeUniformBufferDescriptor(pCameraBuffer, 	BINDING_CAMERA);
+	pDescriptorSet->writeUniformBufferDescriptor(pEmitterBuffer, 	BINDING_EMITTER);
+	pDescriptorSet->writeStorageBufferDescriptor(pPositionsBuffer,	BINDING_PARTICLE_POSITIONS, positionsOffset, positionsSize);
 
-	// Bind descriptor set
-	uint32_t frameIndex = m_pRenderingHandler->getCurrentFrameIndex();
+	// Read when drawing indirectly, the draw commands' first instances index into the whole buffer
+	BufferVK* pVisibleIndicesBuffer = reinterpret_cast<BufferVK*>(pEmitter->getVisibleIndicesBuffer());
+	pDescriptorSet->writeStorageBufferDescriptor(pVisibleIndicesBuffer, BINDING_VISIBLE_PARTICLES);
 
-	DescriptorSetVK* pDescriptorSet = reinterpret_cast<DescriptorSetVK*>(pEmitter->getDescriptorSetRender());
-	m_ppCommandBuffers[frameIndex]->bindDescriptorSet(VK_PIPELINE_BIND_POINT_GRAPHICS, m_pPipelineLayout, 0, 1, &pDescriptorSet, 0, nullptr);
+	ImageViewVK* pParticleTextureVIew = pParticleTexture->getImageView();
+	pDescriptorSet->writeCombinedImageDescriptors(&pParticleTextureVIew, &m_pSampler, 1, BINDING_PARTICLE_TEXTURE);
 
-	return true;
+	return pDescriptorSet;
 }
@@ -4,6 +4,7 @@
 #include "Vulkan/ProfilerVK.h"
 #include "Vulkan/VulkanCommon.h"
 
+class BufferVK;
 class CommandBufferVK;
 class CommandPoolVK;
 class DescriptorPoolVK;
@@ -25,6 +26,13 @@ class ParticleRendererVK : public IRenderer
 		glm::vec2 Position, TxCoord;
 	};
 
+	struct PushConstant {
+		// EParticlePositionFormat of the positions buffer being drawn
+		uint32_t positionFormat;
+		// Non-zero when the emitter's visible particles are drawn indirectly
+		uint32_t drawVisibleParticles;
+	};
+
 public:
     ParticleRendererVK(GraphicsContextVK* pGraphicsContext, RenderingHandlerVK* pRenderingHandler);
     ~ParticleRendererVK();
@@ -38,7 +46,9 @@ public:
 	
 	virtual void setViewport(float width, float height, float minDepth, float maxDepth, float topX, float topY) override;
 
-	void submitParticles(ParticleEmitter* pEmitter);
+	// CPU-updated particles are read from the emitter's mapped positions buffer for the current frame.
+	// GPU-updated particles are drawn indirectly, only the ones the update shader appended to the emitter's visible list are drawn
+	void submitParticles(ParticleEmitter* pEmitter, bool useMappedPositions);
 
 	FORCEINLINE CommandBufferVK*	getCommandBuffer(uint32_t frameindex) const { return m_ppCommandBuffers[frameindex]; }
 	FORCEINLINE ProfilerVK*			getProfiler()								{ return m_pProfiler; }
@@ -50,7 +60,8 @@ private:
 	bool createQuadMesh();
 	void createProfiler();
 
-	bool bindDescriptorSet(ParticleEmitter* pEmitter);
+	bool bindDescriptorSet(ParticleEmitter* pEmitter, bool useMappedPositions);
+	DescriptorSetVK* createDescriptorSet(ParticleEmitter* pEmitter, BufferVK* pPositionsBuffer, VkDeviceSize positionsOffset, VkDeviceSize positionsSize);
 
 private:
 	GraphicsContextVK* m_pGraphicsContext;
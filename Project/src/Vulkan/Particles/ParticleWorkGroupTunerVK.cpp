@@ -0,0 +1,267 @@
+#include "ParticleWorkGroupTunerVK.h"
+
+#include "Core/ParticleEmitter.h"
+#include "Vulkan/BufferVK.h"
+#include "Vulkan/CommandBufferVK.h"
+#include "Vulkan/CommandPoolVK.h"
+#include "Vulkan/DescriptorPoolVK.h"
+#include "Vulkan/DescriptorSetVK.h"
+#include "Vulkan/GraphicsContextVK.h"
+#include "Vulkan/PipelineLayoutVK.h"
+#include "Vulkan/PipelineVK.h"
+#include "Vulkan/ProfilerVK.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+// Compute shader bindings, see ParticleEmitterHandlerVK
+#define POSITIONS_BINDING   	0
+#define VELOCITIES_BINDING  	1
+#define AGES_BINDING        	2
+#define EMITTER_BINDING     	3
+#define VISIBLE_BINDING     	4
+#define DRAW_BINDING        	5
+
+// Each line is a device UUID, the driver version the size was tuned with and the size
+#define WORK_GROUP_SIZE_CACHE_FILE	"particle_work_group_sizes.txt"
+
+#define MIN_CANDIDATE_SIZE			32U
+// Large enough to keep every compute unit busy, so that the sizes are compared at full occupancy
+#define BENCHMARK_PARTICLE_COUNT	(1U << 20)
+// Timed dispatches per candidate, preceded by one untimed dispatch
+#define BENCHMARK_ITERATIONS		8U
+
+static void computeBarrier(CommandBufferVK* pCommandBuffer)
+{
+	// Dispatches and the resets between them write the same buffers
+	VkMemoryBarrier memoryBarrier = {};
+	memoryBarrier.sType			= VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	memoryBarrier.srcAccessMask	= VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+	memoryBarrier.dstAccessMask	= VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_UNIFORM_READ_BIT;
+
+	VkPipelineStageFlags stages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+	pCommandBuffer->pipelineBarrier(stages, stages, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+}
+
+ParticleWorkGroupTunerVK::ParticleWorkGroupTunerVK(GraphicsContextVK* pGraphicsContext)
+	:m_pGraphicsContext(pGraphicsContext)
+{
+	const uint8_t* pDeviceUUID = pGraphicsContext->getDevice()->getDeviceUUID();
+
+	std::ostringstream deviceKey;
+	deviceKey << std::hex;
+	for (uint32_t i = 0; i < VK_UUID_SIZE; i++) {
+		deviceKey << (pDeviceUUID[i] >> 4) << (pDeviceUUID[i] & 0xF);
+	}
+
+	m_DeviceKey = deviceKey.str();
+}
+
+void ParticleWorkGroupTunerVK::getCandidateSizes(std::vector<uint32_t>& workGroupSizes) const
+{
+	DeviceVK* pDevice = m_pGraphicsContext->getDevice();
+
+	uint32_t pMaxWorkGroupSize[3];
+	pDevice->getMaxComputeWorkGroupSize(pMaxWorkGroupSize);
+	uint32_t maxSize = std::min(pMaxWorkGroupSize[0], pDevice->getMaxComputeWorkGroupInvocations());
+
+	workGroupSizes.clear();
+	for (uint32_t size = MIN_CANDIDATE_SIZE; size <= maxSize; size *= 2) {
+		workGroupSizes.push_back(size);
+	}
+
+	// The device limit is not necessarily a power of two
+	if (workGroupSizes.empty() || workGroupSizes.back() != maxSize) {
+		workGroupSizes.push_back(maxSize);
+	}
+}
+
+bool ParticleWorkGroupTunerVK::loadWorkGroupSize(uint32_t& workGroupSize) const
+{
+	std::ifstream file(WORK_GROUP_SIZE_CACHE_FILE);
+
+	std::string deviceKey;
+	uint32_t driverVersion = 0, size = 0;
+	while (file >> deviceKey >> driverVersion >> size) {
+		if (deviceKey == m_DeviceKey) {
+			if (driverVersion != m_pGraphicsContext->getDevice()->getDriverVersion() || size == 0) {
+				return false;
+			}
+
+			workGroupSize = size;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void ParticleWorkGroupTunerVK::saveWorkGroupSize(uint32_t workGroupSize) const
+{
+	// Keep the other devices' sizes
+	std::ostringstream entries;
+	{
+		std::ifstream file(WORK_GROUP_SIZE_CACHE_FILE);
+
+		std::string deviceKey;
+		uint32_t driverVersion = 0, size = 0;
+		while (file >> deviceKey >> driverVersion >> size) {
+			if (deviceKey != m_DeviceKey) {
+				entries << deviceKey << ' ' << driverVersion << ' ' << size << '\n';
+			}
+		}
+	}
+
+	entries << m_DeviceKey << ' ' << m_pGraphicsContext->getDevice()->getDriverVersion() << ' ' << workGroupSize << '\n';
+
+	std::ofstream file(WORK_GROUP_SIZE_CACHE_FILE, std::ios::out | std::ios::trunc);
+	file << entries.str();
+}
+
+bool ParticleWorkGroupTunerVK::benchmark(PipelineVK* const* ppPipelines, const uint32_t* pWorkGroupSizes, uint32_t pipelineCount, PipelineLayoutVK* pPipelineLayout,
+	DescriptorSetLayoutVK* pDescriptorSetLayout, DescriptorPoolVK* pDescriptorPool, const void* pPushConstant, uint32_t pushConstantSize, uint32_t& fastestPipeline)
+{
+	DeviceVK* pDevice = m_pGraphicsContext->getDevice();
+
+	// Particles that live for longer than the benchmark, so that every dispatch moves every particle like most updates do
+	EmitterBuffer emitterBuffer = {};
+	emitterBuffer.centeringRotMatrix	= glm::mat4(1.0f);
+	emitterBuffer.direction				= glm::vec4(0.0f, 0.0f, 1.0f, 0.0f);
+	emitterBuffer.particleSize			= glm::vec2(0.1f);
+	emitterBuffer.particleDuration		= 1000.0f;
+	emitterBuffer.initialSpeed			= 1.0f;
+	emitterBuffer.spread				= 0.5f;
+	emitterBuffer.particleCount			= BENCHMARK_PARTICLE_COUNT;
+	emitterBuffer.particlesPerSecond	= BENCHMARK_PARTICLE_COUNT / emitterBuffer.particleDuration;
+	emitterBuffer.boundsExtent			= glm::vec4(1.0f);
+
+	const uint64_t pBufferSizes[] = {
+		BENCHMARK_PARTICLE_COUNT * sizeof(glm::vec4),
+		BENCHMARK_PARTICLE_COUNT * sizeof(glm::vec4),
+		BENCHMARK_PARTICLE_COUNT * sizeof(float),
+		sizeof(EmitterBuffer),
+		BENCHMARK_PARTICLE_COUNT * sizeof(uint32_t),
+		sizeof(VkDrawIndexedIndirectCommand)
+	};
+
+	const uint32_t bufferCount = sizeof(pBufferSizes) / sizeof(uint64_t);
+	BufferVK* ppBuffers[bufferCount] = {};
+
+	bool result = true;
+	for (uint32_t bufferIdx = 0; bufferIdx < bufferCount && result; bufferIdx++) {
+		BufferParams bufferParams = {};
+		bufferParams.IsExclusive = true;
+		bufferParams.MemoryProperty = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+		bufferParams.Usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | (bufferIdx == EMITTER_BINDING ? VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT : VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+		bufferParams.SizeInBytes = pBufferSizes[bufferIdx];
+
+		ppBuffers[bufferIdx] = DBG_NEW BufferVK(pDevice);
+		if (!ppBuffers[bufferIdx]->init(bufferParams)) {
+			LOG("Failed to create work group size benchmark buffer");
+			result = false;
+		}
+	}
+
+	DescriptorSetVK* pDescriptorSet = result ? pDescriptorPool->allocDescriptorSet(pDescriptorSetLayout) : nullptr;
+	CommandPoolVK* pCommandPool = nullptr;
+	CommandBufferVK* pCommandBuffer = nullptr;
+
+	if (result && pDescriptorSet == nullptr) {
+		LOG("Failed to create descriptor set for work group size benchmark");
+		result = false;
+	}
+
+	if (result) {
+		pCommandPool = DBG_NEW CommandPoolVK(pDevice, pDevice->getQueueFamilyIndices().ComputeQueues.value().FamilyIndex);
+		result = pCommandPool->init() && (pCommandBuffer = pCommandPool->allocateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY)) != nullptr;
+	}
+
+	if (result) {
+		pDescriptorSet->writeStorageBufferDescriptor(ppBuffers[POSITIONS_BINDING],	POSITIONS_BINDING);
+		pDescriptorSet->writeStorageBufferDescriptor(ppBuffers[VELOCITIES_BINDING],	VELOCITIES_BINDING);
+		pDescriptorSet->writeStorageBufferDescriptor(ppBuffers[AGES_BINDING],		AGES_BINDING);
+		pDescriptorSet->writeUniformBufferDescriptor(ppBuffers[EMITTER_BINDING],		EMITTER_BINDING);
+		pDescriptorSet->writeStorageBufferDescriptor(ppBuffers[VISIBLE_BINDING],		VISIBLE_BINDING);
+		pDescriptorSet->writeStorageBufferDescriptor(ppBuffers[DRAW_BINDING],		DRAW_BINDING);
+
+		ProfilerVK profiler("Work Group Size Benchmark", pDevice, 2 + 2 * pipelineCount * BENCHMARK_ITERATIONS);
+		std::vector<Timestamp> timestamps(pipelineCount);
+		for (uint32_t pipelineIdx = 0; pipelineIdx < pipelineCount; pipelineIdx++) {
+			profiler.initTimestamp(&timestamps[pipelineIdx], "Work group size " + std::to_string(pWorkGroupSizes[pipelineIdx]));
+		}
+
+		pCommandBuffer->reset(true);
+		pCommandBuffer->begin(nullptr, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+
+		profiler.reset(0, pCommandBuffer);
+		profiler.beginFrame(pCommandBuffer);
+
+		// Zeroed particles at the emitter's position with no velocity, which stay alive throughout the benchmark
+		for (uint32_t bufferIdx = 0; bufferIdx < bufferCount; bufferIdx++) {
+			if (bufferIdx != EMITTER_BINDING) {
+				pCommandBuffer->fillBuffer(ppBuffers[bufferIdx], 0, VK_WHOLE_SIZE, 0);
+			}
+		}
+
+		pCommandBuffer->updateBuffer(ppBuffers[EMITTER_BINDING], 0, &emitterBuffer, sizeof(EmitterBuffer));
+		pCommandBuffer->bindDescriptorSet(VK_PIPELINE_BIND_POINT_COMPUTE, pPipelineLayout, 0, 1, &pDescriptorSet, 0, nullptr);
+
+		for (uint32_t pipelineIdx = 0; pipelineIdx < pipelineCount; pipelineIdx++) {
+			pCommandBuffer->bindPipeline(ppPipelines[pipelineIdx]);
+			pCommandBuffer->pushConstants(pPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, pushConstantSize, pPushConstant);
+
+			glm::u32vec3 workGroupCount((BENCHMARK_PARTICLE_COUNT + pWorkGroupSizes[pipelineIdx] - 1) / pWorkGroupSizes[pipelineIdx], 1, 1);
+
+			for (uint32_t iteration = 0; iteration <= BENCHMARK_ITERATIONS; iteration++) {
+				// Every particle is visible, the visible list is restarted so that it does not overflow
+				computeBarrier(pCommandBuffer);
+				pCommandBuffer->fillBuffer(ppBuffers[DRAW_BINDING], 0, sizeof(VkDrawIndexedIndirectCommand), 0);
+				computeBarrier(pCommandBuffer);
+
+				if (iteration > 0) {
+					profiler.beginTimestamp(&timestamps[pipelineIdx]);
+				}
+
+				pCommandBuffer->dispatch(workGroupCount);
+
+				if (iteration > 0) {
+					profiler.endTimestamp(&timestamps[pipelineIdx]);
+				}
+			}
+		}
+
+		profiler.endFrame();
+		pCommandBuffer->end();
+
+		pDevice->executeCompute(pCommandBuffer, nullptr, nullptr, 0, nullptr, 0);
+
+		// Wait for command buffer to finish executing before reading the timestamps
+		pCommandBuffer->reset(true);
+		result = profiler.resolveTimestamps();
+
+		for (uint32_t pipelineIdx = 0; result && pipelineIdx < pipelineCount; pipelineIdx++) {
+			LOG("Work group size %u: %f ms per update", pWorkGroupSizes[pipelineIdx], timestamps[pipelineIdx].time * profiler.getTimestampToMilli() / BENCHMARK_ITERATIONS);
+
+			if (timestamps[pipelineIdx].time < timestamps[fastestPipeline].time) {
+				fastestPipeline = pipelineIdx;
+			}
+		}
+	}
+
+	if (pCommandBuffer != nullptr) {
+		pCommandPool->freeCommandBuffer(&pCommandBuffer);
+	}
+
+	SAFEDELETE(pCommandPool);
+
+	if (pDescriptorSet != nullptr) {
+		pDescriptorPool->deallocateDescriptorSet(pDescriptorSet);
+	}
+
+	for (BufferVK* pBuffer : ppBuffers) {
+		SAFEDELETE(pBuffer);
+	}
+
+	return result;
+}
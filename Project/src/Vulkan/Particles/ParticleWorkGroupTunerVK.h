@@ -0,0 +1,39 @@
+#pragma once
+#include "Vulkan/VulkanCommon.h"
+
+#include <string>
+#include <vector>
+
+class DescriptorPoolVK;
+class DescriptorSetLayoutVK;
+class GraphicsContextVK;
+class PipelineLayoutVK;
+class PipelineVK;
+
+/*
+    Picks the work group size of the particle update pipelines. Candidate sizes are benchmarked on the device with ProfilerVK timestamps,
+    and the fastest one is stored in a cache file keyed by the device's UUID. The sizes are benchmarked again when the driver version changes
+*/
+class ParticleWorkGroupTunerVK
+{
+public:
+    ParticleWorkGroupTunerVK(GraphicsContextVK* pGraphicsContext);
+    ~ParticleWorkGroupTunerVK() = default;
+
+    // Powers of two from 32, and the largest work group the device supports
+    void getCandidateSizes(std::vector<uint32_t>& workGroupSizes) const;
+
+    // Reads the size tuned for the device, fails if it has not been tuned or if it was tuned with another driver version
+    bool loadWorkGroupSize(uint32_t& workGroupSize) const;
+    void saveWorkGroupSize(uint32_t workGroupSize) const;
+
+    // Times several dispatches of each pipeline updating the same particles. The pipelines use the per-emitter layout of
+    // ParticleEmitterHandlerVK, and pPushConstant is pushed for every dispatch. Writes the index of the fastest pipeline to fastestPipeline
+    bool benchmark(PipelineVK* const* ppPipelines, const uint32_t* pWorkGroupSizes, uint32_t pipelineCount, PipelineLayoutVK* pPipelineLayout,
+        DescriptorSetLayoutVK* pDescriptorSetLayout, DescriptorPoolVK* pDescriptorPool, const void* pPushConstant, uint32_t pushConstantSize, uint32_t& fastestPipeline);
+
+private:
+    GraphicsContextVK* m_pGraphicsContext;
+    // Hexadecimal device UUID
+    std::string m_DeviceKey;
+};
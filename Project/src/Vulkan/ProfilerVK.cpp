@@ -205,6 +205,62 @@ void ProfilerVK::endTimestamp(Timestamp* pTimestamp)
     vkCmdWriteTimestamp(m_pProfiledCommandBuffer->getCommandBuffer(), VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, pCurrentQueryPool->getQueryPool(), pTimestamp->queries.back() + 1);
 }
 
+bool ProfilerVK::resolveTimestamps()
+{
+    uint32_t queryCount = m_pNextQuery[m_CurrentFrame];
+    std::vector<uint64_t> queryResults(queryCount);
+
+    if (vkGetQueryPoolResults(
+        m_pDevice->getDevice(), m_ppQueryPools[m_CurrentFrame]->getQueryPool(),
+        0, queryCount,
+        queryCount * sizeof(uint64_t),
+        queryResults.data(),
+        sizeof(uint64_t),
+        VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT)
+        != VK_SUCCESS)
+    {
+        LOG("Profiler %s: failed to get query pool results", m_Name.c_str());
+        return false;
+    }
+
+    for (Timestamp* pTimestamp : m_Timestamps) {
+        pTimestamp->time = 0;
+
+        for (uint32_t query : pTimestamp->queries) {
+            if (query + 1 < queryCount) {
+                pTimestamp->time += queryResults[query + 1] - queryResults[query];
+            }
+        }
+    }
+
+    return true;
+}
+
+bool ProfilerVK::getLatestFrameTime(uint32_t frameIndex, uint64_t& time) const
+{
+    // The frame's scope is the last two queries written in its pool
+    uint32_t queryCount = m_pNextQuery[frameIndex];
+    if (queryCount < 2) {
+        return false;
+    }
+
+    uint64_t queryResults[2];
+    if (vkGetQueryPoolResults(
+        m_pDevice->getDevice(), m_ppQueryPools[frameIndex]->getQueryPool(),
+        queryCount - 2, 2,
+        sizeof(queryResults),
+        queryResults,
+        sizeof(uint64_t),
+        VK_QUERY_RESULT_64_BIT)
+        != VK_SUCCESS)
+    {
+        return false;
+    }
+
+    time = queryResults[1] - queryResults[0];
+    return true;
+}
+
 void ProfilerVK::findWidestText()
 {
     // Widest string among the profiler and its timestamps, includes the width of the dash-prefix and the name of the profiler/timestamp
@@ -41,6 +41,10 @@ public:
     void initTimestamp(Timestamp* pTimestamp, const std::string name);
     void beginTimestamp(Timestamp* pTimestamp);
     void endTimestamp(Timestamp* pTimestamp);
+    // Waits for the current frame's queries and sets the time of each timestamp to the sum of its queries' durations
+    bool resolveTimestamps();
+    // Duration of the latest beginFrame/endFrame scope recorded for the frame, without waiting. Fails if the GPU has not written it yet
+    bool getLatestFrameTime(uint32_t frameIndex, uint64_t& time) const;
 
     uint32_t getRecurseDepth() const { return m_RecurseDepth; }
 
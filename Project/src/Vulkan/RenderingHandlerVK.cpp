@@ -11,6 +11,7 @@
 #include "CommandBufferVK.h"
 #include "CommandPoolVK.h"
 #include "FrameBufferVK.h"
+#include "FrameSchedulerVK.h"
 #include "GBufferVK.h"
 #include "GraphicsContextVK.h"
 #include "ImageViewVK.h"
@@ -66,8 +67,9 @@ RenderingHandlerVK::RenderingHandlerVK(GraphicsContextVK* pGraphicsContext)
 	m_TransferFinishedGraphicsSemaphore(VK_NULL_HANDLE),
 	m_TransferFinishedComputeSemaphore(VK_NULL_HANDLE),
 	m_TransferStartSemaphore(VK_NULL_HANDLE),
-    m_CurrentFrame(0),
 	m_BackBufferIndex(0),
+	m_pRenderedFrameCommandBuffer(nullptr),
+	m_RenderedFrameValue({ VK_NULL_HANDLE, 0 }),
 	m_ClearColor(),
 	m_ClearDepth(),
 	m_Viewport(),
@@ -192,36 +194,38 @@ void RenderingHandlerVK::render(IScene* pScene)
 	SceneVK* pVulkanScene	= reinterpret_cast<SceneVK*>(pScene);
 	SwapChainVK* pSwapChain = m_pGraphicsContext->getSwapChain();
 
-	pSwapChain->acquireNextImage(m_pImageAvailableSemaphores[m_CurrentFrame]);
+	pSwapChain->acquireNextImage(m_pImageAvailableSemaphores[getCurrentFrameIndex()]);
 	m_BackBufferIndex = pSwapChain->getImageIndex();
 
 	// Prepare for frame
-	m_ppGraphicsCommandBuffers[m_CurrentFrame]->reset(true);
-	//m_ppGraphicsCommandBuffers2[m_CurrentFrame]->reset(true);
-	m_ppGraphicsCommandPools[m_CurrentFrame]->reset();
-	m_ppGraphicsCommandBuffers[m_CurrentFrame]->begin(nullptr, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+	m_ppGraphicsCommandBuffers[getCurrentFrameIndex()]->reset(true);
+	//m_ppGraphicsCommandBuffers2[getCurrentFrameIndex()]->reset(true);
+	m_ppGraphicsCommandPools[getCurrentFrameIndex()]->reset();
+	m_ppGraphicsCommandBuffers[getCurrentFrameIndex()]->begin(nullptr, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
 
-	m_ppComputeCommandBuffers[m_CurrentFrame]->reset(true);
-	m_ppComputeCommandPools[m_CurrentFrame]->reset();
-	m_ppComputeCommandBuffers[m_CurrentFrame]->begin(nullptr, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+	m_ppComputeCommandBuffers[getCurrentFrameIndex()]->reset(true);
+	m_ppComputeCommandPools[getCurrentFrameIndex()]->reset();
+	m_ppComputeCommandBuffers[getCurrentFrameIndex()]->begin(nullptr, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
 
-	m_ppTransferCommandBuffers[m_CurrentFrame]->reset(true);
-	m_ppTransferCommandPools[m_CurrentFrame]->reset();
-	m_ppTransferCommandBuffers[m_CurrentFrame]->begin(nullptr, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+	m_ppTransferCommandBuffers[getCurrentFrameIndex()]->reset(true);
+	m_ppTransferCommandPools[getCurrentFrameIndex()]->reset();
+	m_ppTransferCommandBuffers[getCurrentFrameIndex()]->begin(nullptr, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
 
 	const Camera& camera			= pVulkanScene->getCamera();
 	LightSetup& lightsetup	= pVulkanScene->getLightSetup();
 	updateBuffers(pVulkanScene, camera, lightsetup);
 
 	DeviceVK* pDevice = m_pGraphicsContext->getDevice();
-	m_ppTransferCommandBuffers[m_CurrentFrame]->end();
+	m_ppTransferCommandBuffers[getCurrentFrameIndex()]->end();
 
 	//Render all the meshes
 	FrameBufferVK*		pBackbuffer				= getCurrentBackBuffer();
 	FrameBufferVK*		pBackbufferWithDepth	= getCurrentBackBufferWithDepth();
-	CommandBufferVK*	pSecondaryCommandBuffer = m_ppCommandBuffersSecondary[m_CurrentFrame];
-	CommandPoolVK*		pSecondaryCommandPool	= m_ppCommandPoolsSecondary[m_CurrentFrame];
+	CommandBufferVK*	pSecondaryCommandBuffer = m_ppCommandBuffersSecondary[getCurrentFrameIndex()];
+	CommandPoolVK*		pSecondaryCommandPool	= m_ppCommandPoolsSecondary[getCurrentFrameIndex()];
 
+	//The recording tasks capture locals, they have to finish before this function returns
+	TaskGroup recordingTasks;
 	if (m_pImGuiRenderer) {
 		TaskDispatcher::execute([&, this]
 			{
@@ -235,50 +239,55 @@ void RenderingHandlerVK::render(IScene* pScene)
 				pSecondaryCommandBuffer->reset(false);
 				pSecondaryCommandPool->reset();
 				pSecondaryCommandBuffer->begin(&inheritanceInfo, VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT);
-				m_pImGuiRenderer->render(pSecondaryCommandBuffer, m_CurrentFrame);
+				m_pImGuiRenderer->render(pSecondaryCommandBuffer, getCurrentFrameIndex());
 				pSecondaryCommandBuffer->end();
-			});
+			}, &recordingTasks);
 	}
 
 	if (m_pParticleRenderer) {
-		m_pParticleRenderer->getProfiler()->reset(m_CurrentFrame, m_ppGraphicsCommandBuffers[m_CurrentFrame]);
+		m_pParticleRenderer->getProfiler()->reset(getCurrentFrameIndex(), m_ppGraphicsCommandBuffers[getCurrentFrameIndex()]);
 		m_pParticleRenderer->beginFrame(pVulkanScene);
 		TaskDispatcher::execute([pVulkanScene, this]
 			{
 				submitParticles();
 				m_pParticleRenderer->endFrame(pVulkanScene);
-			});
+			}, &recordingTasks);
 	}
 
-	// m_ppGraphicsCommandBuffers2[m_CurrentFrame]->begin(nullptr, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+	// m_ppGraphicsCommandBuffers2[getCurrentFrameIndex()]->begin(nullptr, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
 
 	// //Render particles
 	// if (m_pParticleRenderer) {
-	// 	m_ppGraphicsCommandBuffers2[m_CurrentFrame]->beginRenderPass(m_pParticleRenderPass, pBackbufferWithDepth, (uint32_t)m_Viewport.width, (uint32_t)m_Viewport.height, nullptr, 0, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
-	// 	m_ppGraphicsCommandBuffers2[m_CurrentFrame]->executeSecondary(m_pParticleRenderer->getCommandBuffer(m_CurrentFrame));
-	// 	m_ppGraphicsCommandBuffers2[m_CurrentFrame]->endRenderPass();
+	// 	m_ppGraphicsCommandBuffers2[getCurrentFrameIndex()]->beginRenderPass(m_pParticleRenderPass, pBackbufferWithDepth, (uint32_t)m_Viewport.width, (uint32_t)m_Viewport.height, nullptr, 0, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+	// 	m_ppGraphicsCommandBuffers2[getCurrentFrameIndex()]->executeSecondary(m_pParticleRenderer->getCommandBuffer(getCurrentFrameIndex()));
+	// 	m_ppGraphicsCommandBuffers2[getCurrentFrameIndex()]->endRenderPass();
 	// }
 
 	// //Render UI
-	// m_ppGraphicsCommandBuffers2[m_CurrentFrame]->beginRenderPass(m_pUIRenderPass, pBackbuffer, (uint32_t)m_Viewport.width, (uint32_t)m_Viewport.height, nullptr, 0, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
-	// m_ppGraphicsCommandBuffers2[m_CurrentFrame]->executeSecondary(pSecondaryCommandBuffer);
-	// m_ppGraphicsCommandBuffers2[m_CurrentFrame]->endRenderPass();
+	// m_ppGraphicsCommandBuffers2[getCurrentFrameIndex()]->beginRenderPass(m_pUIRenderPass, pBackbuffer, (uint32_t)m_Viewport.width, (uint32_t)m_Viewport.height, nullptr, 0, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+	// m_ppGraphicsCommandBuffers2[getCurrentFrameIndex()]->executeSecondary(pSecondaryCommandBuffer);
+	// m_ppGraphicsCommandBuffers2[getCurrentFrameIndex()]->endRenderPass();
 
-	//m_ppGraphicsCommandBuffers2[m_CurrentFrame]->end();
-	m_ppComputeCommandBuffers[m_CurrentFrame]->end();
+	//m_ppGraphicsCommandBuffers2[getCurrentFrameIndex()]->end();
+	m_ppComputeCommandBuffers[getCurrentFrameIndex()]->end();
+	TaskDispatcher::waitForTasks(recordingTasks);
 
 	// Execute commandbuffer
 	{
-		VkSemaphore graphicsSignalSemaphores[]		= { m_pRenderFinishedSemaphores[m_CurrentFrame] };
-		VkSemaphore graphicsWaitSemaphores[]		= { m_pImageAvailableSemaphores[m_CurrentFrame], m_ComputeFinishedGraphicsSemaphore };
+		VkSemaphore graphicsSignalSemaphores[]		= { m_pRenderFinishedSemaphores[getCurrentFrameIndex()] };
+		VkSemaphore graphicsWaitSemaphores[]		= { m_pImageAvailableSemaphores[getCurrentFrameIndex()], m_ComputeFinishedGraphicsSemaphore };
 		VkPipelineStageFlags graphicswaitStages[]	= { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT , VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT };
 
 		// VkSemaphore computeSignalSemaphores[]		= { m_ComputeFinishedGraphicsSemaphore, m_ComputeFinishedTransferSemaphore };
 		// VkSemaphore computeWaitSemaphores[]			= { m_GeometryFinishedSemaphore, m_TransferFinishedComputeSemaphore };
 		// VkPipelineStageFlags computeWaitStages[]	= { VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_NV, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_NV };
 
-		pDevice->executeCompute(m_ppComputeCommandBuffers[m_CurrentFrame], nullptr, nullptr, 0, nullptr, 0);
-		//pDevice->executeGraphics(m_ppGraphicsCommandBuffers2[m_CurrentFrame], graphicsWaitSemaphores, graphicswaitStages, 2, graphicsSignalSemaphores, 1);
+		pDevice->executeCompute(m_ppComputeCommandBuffers[getCurrentFrameIndex()], nullptr, nullptr, 0, nullptr, 0);
+
+		// The next frame's particle updates overwrite the buffers this frame draws from
+		m_pRenderedFrameCommandBuffer	= m_ppComputeCommandBuffers[getCurrentFrameIndex()];
+		m_RenderedFrameValue			= pDevice->getComputeTimelineValue(0);
+		//pDevice->executeGraphics(m_ppGraphicsCommandBuffers2[getCurrentFrameIndex()], graphicsWaitSemaphores, graphicswaitStages, 2, graphicsSignalSemaphores, 1);
 	}
 
 	swapBuffers();
@@ -304,8 +313,26 @@ void RenderingHandlerVK::onSceneUpdated(IScene* pScene)
 
 void RenderingHandlerVK::swapBuffers()
 {
-    m_pGraphicsContext->swapBuffers(m_pRenderFinishedSemaphores[m_CurrentFrame]);
-	m_CurrentFrame = (m_CurrentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+    m_pGraphicsContext->swapBuffers(m_pRenderFinishedSemaphores[getCurrentFrameIndex()]);
+}
+
+uint32_t RenderingHandlerVK::getCurrentFrameIndex() const
+{
+	// The frame scheduler has waited for the index's previous frame, so its resources can be reused
+	return m_pGraphicsContext->getDevice()->getFrameScheduler()->getFrameInFlightIndex();
+}
+
+TimelineWaitVK RenderingHandlerVK::waitForRenderedFrame()
+{
+	if (m_pRenderedFrameCommandBuffer == nullptr || m_RenderedFrameValue.Semaphore != VK_NULL_HANDLE)
+	{
+		return m_RenderedFrameValue;
+	}
+
+	// The fence stays signaled until the command buffer is reset, which happens when its frame in flight index comes around again
+	VkFence fence = m_pRenderedFrameCommandBuffer->getFence();
+	vkWaitForFences(m_pGraphicsContext->getDevice()->getDevice(), 1, &fence, VK_TRUE, UINT64_MAX);
+	return m_RenderedFrameValue;
 }
 
 void RenderingHandlerVK::drawProfilerUI()
@@ -716,15 +743,15 @@ void RenderingHandlerVK::updateBuffers(SceneVK* pScene, const Camera& camera, co
 				VK_ACCESS_MEMORY_READ_BIT, 0, computeQueueFamilyIndex, transferQueueFamilyIndex, 0, VK_WHOLE_SIZE)
 		};
 
-		m_ppGraphicsCommandBuffers[m_CurrentFrame]->bufferMemoryBarrier(VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 2, barriers);
-		m_ppComputeCommandBuffers[m_CurrentFrame]->bufferMemoryBarrier(VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_NV, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 2, &barriers[2]);
+		m_ppGraphicsCommandBuffers[getCurrentFrameIndex()]->bufferMemoryBarrier(VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 2, barriers);
+		m_ppComputeCommandBuffers[getCurrentFrameIndex()]->bufferMemoryBarrier(VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_NV, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 2, &barriers[2]);
 
 		for (uint32_t i = 0; i < barrierCount; i++)
 		{
 			barriers[i].srcAccessMask = 0;
 			barriers[i].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
 		}
-		m_ppTransferCommandBuffers[m_CurrentFrame]->bufferMemoryBarrier(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, barrierCount, barriers);
+		m_ppTransferCommandBuffers[getCurrentFrameIndex()]->bufferMemoryBarrier(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, barrierCount, barriers);
 	}
 
 	// Update camera buffers
@@ -737,14 +764,14 @@ void RenderingHandlerVK::updateBuffers(SceneVK* pScene, const Camera& camera, co
 	m_CameraBuffer.Position			= glm::vec4(camera.getPosition(), 1.0f);
 	m_CameraBuffer.Right			= glm::vec4(camera.getRightVec(), 0.0f);
 	m_CameraBuffer.Up				= glm::vec4(camera.getUpVec(), 0.0f);
-	m_ppTransferCommandBuffers[m_CurrentFrame]->updateBuffer(m_pCameraBufferGraphics, 0, (const void*)&m_CameraBuffer, sizeof(CameraBuffer));
-	m_ppTransferCommandBuffers[m_CurrentFrame]->updateBuffer(m_pCameraBufferCompute, 0, (const void*)&m_CameraBuffer, sizeof(CameraBuffer));
+	m_ppTransferCommandBuffers[getCurrentFrameIndex()]->updateBuffer(m_pCameraBufferGraphics, 0, (const void*)&m_CameraBuffer, sizeof(CameraBuffer));
+	m_ppTransferCommandBuffers[getCurrentFrameIndex()]->updateBuffer(m_pCameraBufferCompute, 0, (const void*)&m_CameraBuffer, sizeof(CameraBuffer));
 
 	const uint32_t lightBufferSize = sizeof(PointLight) * lightSetup.getPointLightCount();
-	m_ppTransferCommandBuffers[m_CurrentFrame]->updateBuffer(m_pLightBufferGraphics, 0, (const void*)lightSetup.getPointLights(), lightBufferSize);
-	m_ppTransferCommandBuffers[m_CurrentFrame]->updateBuffer(m_pLightBufferCompute, 0, (const void*)lightSetup.getPointLights(), lightBufferSize);
+	m_ppTransferCommandBuffers[getCurrentFrameIndex()]->updateBuffer(m_pLightBufferGraphics, 0, (const void*)lightSetup.getPointLights(), lightBufferSize);
+	m_ppTransferCommandBuffers[getCurrentFrameIndex()]->updateBuffer(m_pLightBufferCompute, 0, (const void*)lightSetup.getPointLights(), lightBufferSize);
 
-	pScene->copySceneData(m_ppTransferCommandBuffers[m_CurrentFrame]);
+	pScene->copySceneData(m_ppTransferCommandBuffers[getCurrentFrameIndex()]);
 
 	//Transfer back from transfer queue
 	{
@@ -760,15 +787,15 @@ void RenderingHandlerVK::updateBuffers(SceneVK* pScene, const Camera& camera, co
 			createVkBufferMemoryBarrier(m_pLightBufferCompute->getBuffer(),
 				VK_ACCESS_TRANSFER_WRITE_BIT, 0, transferQueueFamilyIndex, computeQueueFamilyIndex, 0, VK_WHOLE_SIZE)
 		};
-		m_ppTransferCommandBuffers[m_CurrentFrame]->bufferMemoryBarrier(VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, barrierCount, barriers);
+		m_ppTransferCommandBuffers[getCurrentFrameIndex()]->bufferMemoryBarrier(VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, barrierCount, barriers);
 
 		for (uint32_t i = 0; i < barrierCount; i++)
 		{
 			barriers[i].srcAccessMask = 0;
 			barriers[i].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
 		}
-		m_ppGraphicsCommandBuffers[m_CurrentFrame]->bufferMemoryBarrier(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 2, barriers);
-		m_ppComputeCommandBuffers[m_CurrentFrame]->bufferMemoryBarrier(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_NV, 2, &barriers[2]);
+		m_ppGraphicsCommandBuffers[getCurrentFrameIndex()]->bufferMemoryBarrier(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 2, barriers);
+		m_ppComputeCommandBuffers[getCurrentFrameIndex()]->bufferMemoryBarrier(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_NV, 2, &barriers[2]);
 	}
 
 	// Update particle buffers
@@ -783,7 +810,7 @@ void RenderingHandlerVK::submitParticles()
 
 	// Transfer depth buffer and particle buffer ownerships between the compute and graphics queue
 	if (pEmitterHandler->gpuComputed()) {
-		m_ppGraphicsCommandBuffers[m_CurrentFrame]->releaseImageOwnership(
+		m_ppGraphicsCommandBuffers[getCurrentFrameIndex()]->releaseImageOwnership(
 			m_pGBuffer->getDepthImage(),
 			VK_ACCESS_MEMORY_READ_BIT,
 			m_pGraphicsContext->getDevice()->getQueueFamilyIndices().GraphicsQueues.value().FamilyIndex,
@@ -792,15 +819,13 @@ void RenderingHandlerVK::submitParticles()
 			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
 			VK_IMAGE_ASPECT_DEPTH_BIT);
 
-		for (ParticleEmitter* pEmitter : pEmitterHandler->getParticleEmitters()) {
-			// Release buffers from graphics after the geometry pass. This will allow the compute queue to update the particles
-			pEmitterHandler->releaseFromGraphics(reinterpret_cast<BufferVK*>(pEmitter->getPositionsBuffer()), m_ppGraphicsCommandBuffers[m_CurrentFrame]);
+		// Release buffers from graphics after the geometry pass. This will allow the compute queue to update the particles
+		pEmitterHandler->releaseParticlesFromGraphics(m_ppGraphicsCommandBuffers[getCurrentFrameIndex()]);
 
-			// Particle buffers will be acquired once the particles have been updated
-			pEmitterHandler->acquireForGraphics(reinterpret_cast<BufferVK*>(pEmitter->getPositionsBuffer()), m_ppGraphicsCommandBuffers[m_CurrentFrame]);
-		}
+		// Particle buffers will be acquired once the particles have been updated
+		pEmitterHandler->acquireParticlesForGraphics(m_ppGraphicsCommandBuffers[getCurrentFrameIndex()]);
 
-		m_ppGraphicsCommandBuffers[m_CurrentFrame]->acquireImageOwnership(
+		m_ppGraphicsCommandBuffers[getCurrentFrameIndex()]->acquireImageOwnership(
 			m_pGBuffer->getDepthImage(),
 			VK_ACCESS_MEMORY_READ_BIT,
 			m_pGraphicsContext->getDevice()->getQueueFamilyIndices().ComputeQueues.value().FamilyIndex,
@@ -811,7 +836,7 @@ void RenderingHandlerVK::submitParticles()
 	}
 
 	for (ParticleEmitter* pEmitter : pEmitterHandler->getParticleEmitters()) {
-		m_pParticleRenderer->submitParticles(pEmitter);
+		m_pParticleRenderer->submitParticles(pEmitter, !pEmitter->isGPUComputed());
 	}
 }
 
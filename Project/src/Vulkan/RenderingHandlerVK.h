@@ -2,6 +2,7 @@
 #include "Common/RenderingHandler.hpp"
 #include "Core/Camera.h"
 
+#include "Vulkan/DeviceVK.h"
 #include "Vulkan/ImguiVK.h"
 #include "Vulkan/VulkanCommon.h"
 
@@ -48,7 +49,11 @@ public:
     virtual void onWindowResize(uint32_t width, uint32_t height) override;
 	virtual void onSceneUpdated(IScene* pScene) override;
 
-    FORCEINLINE uint32_t                getCurrentFrameIndex() const            { return m_CurrentFrame; }
+    // Frame in flight index of the frame scheduler's current frame
+    uint32_t                            getCurrentFrameIndex() const;
+    // For compute work that overwrites buffers the latest rendered frame draws from. Returns the timeline value of the frame's submission to
+    // wait for on the GPU. Without timeline semaphores the frame is waited for on the CPU instead, and the semaphore is VK_NULL_HANDLE
+    TimelineWaitVK                      waitForRenderedFrame();
     FORCEINLINE FrameBufferVK* const*   getBackBuffers() const                  { return m_ppBackbuffers; }
 	FORCEINLINE RenderPassVK*			getGeometryRenderPass() const			{ return m_pGeometryRenderPass; }
     FORCEINLINE RenderPassVK*           getBackBufferRenderPass() const         { return m_pBackBufferRenderPass; }
@@ -59,7 +64,7 @@ public:
     FORCEINLINE BufferVK*               getLightBufferGraphics() const          { return m_pLightBufferGraphics; }
     FORCEINLINE FrameBufferVK*          getCurrentBackBuffer() const            { return m_ppBackbuffers[m_BackBufferIndex]; }
     FORCEINLINE FrameBufferVK*          getCurrentBackBufferWithDepth() const   { return m_ppBackBuffersWithDepth[m_BackBufferIndex]; }
-    FORCEINLINE CommandBufferVK*        getCurrentGraphicsCommandBuffer() const { return m_ppGraphicsCommandBuffers[m_CurrentFrame]; }
+    FORCEINLINE CommandBufferVK*        getCurrentGraphicsCommandBuffer() const { return m_ppGraphicsCommandBuffers[getCurrentFrameIndex()]; }
 	FORCEINLINE GBufferVK*				getGBuffer() const						{ return m_pGBuffer; }
     FORCEINLINE virtual IImgui* getImguiRenderer() override                     { return m_pImGuiRenderer; }
 
@@ -113,9 +118,12 @@ private:
     RenderPassVK*   m_pUIRenderPass;
     PipelineVK*     m_pPipeline;
 
-    uint32_t m_CurrentFrame;
     uint32_t m_BackBufferIndex;
 
+    // Submission of the latest rendered frame, nullptr and VK_NULL_HANDLE before the first frame
+    CommandBufferVK*    m_pRenderedFrameCommandBuffer;
+    TimelineWaitVK      m_RenderedFrameValue;
+
     VkClearValue m_ClearColor;
 	VkClearValue m_ClearDepth;
 
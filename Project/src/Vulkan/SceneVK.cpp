@@ -65,6 +65,9 @@ SceneVK::SceneVK(IGraphicsContext* pContext, const RenderingHandlerVK* pRenderin
 
 SceneVK::~SceneVK()
 {
+	//Textures may still be loading if the scene never got finalized
+	TaskDispatcher::waitForTasks(m_TextureLoadTasks);
+
 	SAFEDELETE(m_pProfiler);
 
 	if (m_pTempCommandBuffer != nullptr)
@@ -211,7 +214,7 @@ bool SceneVK::loadFromFile(const std::string& dir, const std::string& fileName)
 				TaskDispatcher::execute([=]
 					{
 						pAlbedoMap->initFromFile(filename, ETextureFormat::FORMAT_R8G8B8A8_UNORM);
-					});
+					}, &m_TextureLoadTasks, ETaskPriority::BACKGROUND);
 				pMaterial->setAlbedoMap(pAlbedoMap);
 			}
 			else
@@ -231,7 +234,7 @@ bool SceneVK::loadFromFile(const std::string& dir, const std::string& fileName)
 				TaskDispatcher::execute([=]
 					{
 						pNormalMap->initFromFile(filename, ETextureFormat::FORMAT_R8G8B8A8_UNORM);
-					});
+					}, &m_TextureLoadTasks, ETaskPriority::BACKGROUND);
 				pMaterial->setNormalMap(pNormalMap);
 			}
 			else
@@ -251,7 +254,7 @@ bool SceneVK::loadFromFile(const std::string& dir, const std::string& fileName)
 				TaskDispatcher::execute([=]
 					{
 						pMetallicMap->initFromFile(filename, ETextureFormat::FORMAT_R8G8B8A8_UNORM);
-					});
+					}, &m_TextureLoadTasks, ETaskPriority::BACKGROUND);
 				pMaterial->setMetallicMap(pMetallicMap);
 			}
 			else
@@ -271,7 +274,7 @@ bool SceneVK::loadFromFile(const std::string& dir, const std::string& fileName)
 				TaskDispatcher::execute([=]
 					{
 						pRoughnessMap->initFromFile(filename, ETextureFormat::FORMAT_R8G8B8A8_UNORM);
-					});
+					}, &m_TextureLoadTasks, ETaskPriority::BACKGROUND);
 				pMaterial->setRoughnessMap(pRoughnessMap);
 			}
 			else
@@ -288,68 +291,82 @@ bool SceneVK::loadFromFile(const std::string& dir, const std::string& fileName)
 		m_SceneMaterials[m] = pMaterial;
 	}
 
-	glm::mat4 transform = glm::scale(glm::mat4(1.0f), glm::vec3(0.005f));
-	for (uint32_t s = 0; s < shapes.size(); s++)
-	{
-		tinyobj::shape_t& shape = shapes[s];
-
-		std::vector<Vertex> vertices = {};
-		std::vector<uint32_t> indices = {};
-		std::unordered_map<Vertex, uint32_t> uniqueVertices = {};
+	//Deduplicating vertices and calculating tangents is independent per shape, mesh creation has to stay on this thread
+	std::vector<std::vector<Vertex>> shapeVertices(shapes.size());
+	std::vector<std::vector<uint32_t>> shapeIndices(shapes.size());
 
-		for (const tinyobj::index_t& index : shape.mesh.indices)
+	TaskDispatcher::parallelFor(0, uint32_t(shapes.size()), 1, [&](uint32_t shapeBegin, uint32_t shapeEnd)
 		{
-			Vertex vertex = {};
-
-			//Normals and texcoords are optional, while positions are required
-			ASSERT(index.vertex_index >= 0);
-
-			vertex.Position =
+			for (uint32_t s = shapeBegin; s < shapeEnd; s++)
 			{
-				attributes.vertices[3 * (size_t)index.vertex_index + 0],
-				attributes.vertices[3 * (size_t)index.vertex_index + 1],
-				attributes.vertices[3 * (size_t)index.vertex_index + 2]
-			};
+				tinyobj::shape_t& shape = shapes[s];
 
-			if (index.normal_index >= 0)
-			{
-				vertex.Normal =
-				{
-					attributes.normals[3 * (size_t)index.normal_index + 0],
-					attributes.normals[3 * (size_t)index.normal_index + 1],
-					attributes.normals[3 * (size_t)index.normal_index + 2]
-				};
-			}
+				std::vector<Vertex>& vertices = shapeVertices[s];
+				std::vector<uint32_t>& indices = shapeIndices[s];
+				std::unordered_map<Vertex, uint32_t> uniqueVertices = {};
 
-			if (index.texcoord_index >= 0)
-			{
-				vertex.TexCoord =
+				for (const tinyobj::index_t& index : shape.mesh.indices)
 				{
-					attributes.texcoords[2 * (size_t)index.texcoord_index + 0],
-					1.0f - attributes.texcoords[2 * (size_t)index.texcoord_index + 1]
-				};
-			}
+					Vertex vertex = {};
 
-			if (uniqueVertices.count(vertex) == 0)
-			{
-				uniqueVertices[vertex] = static_cast<uint32_t>(vertices.size());
-				vertices.push_back(vertex);
-			}
+					//Normals and texcoords are optional, while positions are required
+					ASSERT(index.vertex_index >= 0);
 
-			indices.push_back(uniqueVertices[vertex]);
-		}
+					vertex.Position =
+					{
+						attributes.vertices[3 * (size_t)index.vertex_index + 0],
+						attributes.vertices[3 * (size_t)index.vertex_index + 1],
+						attributes.vertices[3 * (size_t)index.vertex_index + 2]
+					};
 
-		//Calculate tangents
-		for (uint32_t index = 0; index < indices.size(); index += 3)
-		{
-			Vertex& v0 = vertices[indices[(size_t)index + 0]];
-			Vertex& v1 = vertices[indices[(size_t)index + 1]];
-			Vertex& v2 = vertices[indices[(size_t)index + 2]];
+					if (index.normal_index >= 0)
+					{
+						vertex.Normal =
+						{
+							attributes.normals[3 * (size_t)index.normal_index + 0],
+							attributes.normals[3 * (size_t)index.normal_index + 1],
+							attributes.normals[3 * (size_t)index.normal_index + 2]
+						};
+					}
 
-			v0.calculateTangent(v1, v2);
-			v1.calculateTangent(v2, v0);
-			v2.calculateTangent(v0, v1);
-		}
+					if (index.texcoord_index >= 0)
+					{
+						vertex.TexCoord =
+						{
+							attributes.texcoords[2 * (size_t)index.texcoord_index + 0],
+							1.0f - attributes.texcoords[2 * (size_t)index.texcoord_index + 1]
+						};
+					}
+
+					if (uniqueVertices.count(vertex) == 0)
+					{
+						uniqueVertices[vertex] = static_cast<uint32_t>(vertices.size());
+						vertices.push_back(vertex);
+					}
+
+					indices.push_back(uniqueVertices[vertex]);
+				}
+
+				//Calculate tangents
+				for (uint32_t index = 0; index < indices.size(); index += 3)
+				{
+					Vertex& v0 = vertices[indices[(size_t)index + 0]];
+					Vertex& v1 = vertices[indices[(size_t)index + 1]];
+					Vertex& v2 = vertices[indices[(size_t)index + 2]];
+
+					v0.calculateTangent(v1, v2);
+					v1.calculateTangent(v2, v0);
+					v2.calculateTangent(v0, v1);
+				}
+			}
+		});
+
+	glm::mat4 transform = glm::scale(glm::mat4(1.0f), glm::vec3(0.005f));
+	for (uint32_t s = 0; s < shapes.size(); s++)
+	{
+		tinyobj::shape_t& shape = shapes[s];
+		std::vector<Vertex>& vertices = shapeVertices[s];
+		std::vector<uint32_t>& indices = shapeIndices[s];
 
 		MeshVK* pMesh = reinterpret_cast<MeshVK*>(m_pContext->createMesh());
 		pMesh->initFromMemory(vertices.data(), sizeof(Vertex), uint32_t(vertices.size()), indices.data(), uint32_t(indices.size()));
@@ -379,6 +396,8 @@ bool SceneVK::init()
 
 bool SceneVK::finalize()
 {
+	TaskDispatcher::waitForTasks(m_TextureLoadTasks);
+
 	m_pTempCommandPool = DBG_NEW CommandPoolVK(m_pContext->getDevice(), m_pContext->getDevice()->getQueueFamilyIndices().ComputeQueues.value().FamilyIndex);
 	m_pTempCommandPool->init();
 
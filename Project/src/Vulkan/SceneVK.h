@@ -2,6 +2,7 @@
 #include "Common/IScene.h"
 
 #include "Core/Material.h"
+#include "Core/TaskDispatcher.h"
 #include "Vulkan/MeshVK.h"
 #include "Vulkan/ProfilerVK.h"
 #include "Vulkan/Texture2DVK.h"
@@ -227,6 +228,7 @@ private:
 
 	std::vector<MeshVK*> m_SceneMeshes;
 	std::unordered_map<std::string, ITexture2D*> m_SceneTextures;
+	TaskGroup m_TextureLoadTasks;
 	std::vector<Material*> m_SceneMaterials;
 	std::vector<GraphicsObjectVK> m_GraphicsObjects;
 	std::vector<GeometryInstance> m_GeometryInstances;
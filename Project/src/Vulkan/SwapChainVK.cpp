@@ -100,7 +100,7 @@ VkResult SwapChainVK::present(VkSemaphore renderSemaphore)
 	presentInfo.pResults			= nullptr;
 	presentInfo.pImageIndices		= &m_ImageIndex;
 
-	return vkQueuePresentKHR(m_pDevice->getPresentQueue(), &presentInfo);
+	return m_pDevice->present(presentInfo);
 }
 
 VkResult SwapChainVK::presentNoWait()
@@ -111,7 +111,7 @@ VkResult SwapChainVK::presentNoWait()
 	presentInfo.pSwapchains			= &m_SwapChain;
 	presentInfo.pImageIndices		= &m_ImageIndex;
 
-	return vkQueuePresentKHR(m_pDevice->getPresentQueue(), &presentInfo);
+	return m_pDevice->present(presentInfo);
 }
 
 void SwapChainVK::resize(uint32_t width, uint32_t height)
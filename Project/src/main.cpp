@@ -1,30 +1,142 @@
 #include "Common/Debug.h"
 #include "Core/Application.h"
 
+#include "Benchmarks/DeviceMemoryAllocatorBenchmark.h"
+#include "Benchmarks/ParticleIntegrationBenchmark.h"
+#include "Benchmarks/ParticlePositionBenchmark.h"
+#include "Benchmarks/ParticleRespawnBenchmark.h"
+#include "Benchmarks/ParticleSpawnBenchmark.h"
+#include "Benchmarks/TaskDispatcherBenchmark.h"
+
+#include <string>
+#include <vector>
+#include <sstream>
+
+// Parses a comma separated list of core indices, e.g. "2,3,4"
+static std::vector<uint32_t> parseCoreList(const std::string& list)
+{
+	std::vector<uint32_t> cores;
+	std::stringstream stream(list);
+	std::string core;
+	while (std::getline(stream, core, ',')) {
+		if (!core.empty()) {
+			cores.push_back((uint32_t)std::stoi(core));
+		}
+	}
+
+	return cores;
+}
+
 // Arg 0: Emitter count
 // Arg 1: Frame count
 // Arg 2: Enable/Disable multiple queues (1 or 0)
+// Arg 3: Particles per second per emitter
+// --analytic can be placed anywhere to evaluate the emitters' particles from their spawn times instead of integrating them
+// --quantized-positions can be placed anywhere to send positions to the GPU with 16 bits per axis instead of as floats
+// --batched-compute can be placed anywhere to update every emitter on the GPU with one submission instead of one per emitter
+// Or: --bench-tasks [task count] to run the TaskDispatcher microbenchmark, sweeping worker counts up to --workers
+// Or: --bench-task-allocations [frame count] to count heap allocations made by task dispatch
+// Or: --bench-particles [particle count] to compare the SIMD particle integration kernels with the previous vec4 loop
+// Or: --bench-respawn [particle count] to compare respawning by scanning all particles with the age-ordered ring
+// Or: --bench-spawn [particle count] to compare sampling spawn directions with std::mt19937 and with the batched counter-based generator
+// Or: --bench-positions [particle count] to compare packing positions as floats and as quantized 16-bit values
+// Or: --bench-memory-allocator [allocation count] to check DeviceMemoryAllocatorVK against a mock driver and time it on several threads
+// TaskDispatcher options, can be placed anywhere:
+// --workers [count]				Worker thread count, 0 uses one per core
+// --background-workers [count]		Max workers running background tasks at once
+// --main-core [core]				Pins the main thread to a core and keeps the workers off it
+// --worker-cores [core,core,...]	Pins worker i to the i-th core in the list
 int main(int argc, const char* argv[])
 {
+	TaskDispatcherInfo dispatcherInfo = {};
+	EParticleSimulation simulation = EParticleSimulation::INTEGRATED;
+	EParticlePositionFormat positionFormat = EParticlePositionFormat::FLOAT32;
+	bool batchedCompute = false;
+	std::vector<std::string> args;
+
+	for (int argIdx = 1; argIdx < argc; argIdx++) {
+		std::string arg = argv[argIdx];
+		bool hasValue = argIdx + 1 < argc;
+
+		if (arg == "--workers" && hasValue) {
+			dispatcherInfo.WorkerCount = (uint32_t)std::stoi(argv[++argIdx]);
+		} else if (arg == "--background-workers" && hasValue) {
+			dispatcherInfo.MaxBackgroundWorkers = (uint32_t)std::stoi(argv[++argIdx]);
+		} else if (arg == "--main-core" && hasValue) {
+			dispatcherInfo.MainThreadCore = std::stoi(argv[++argIdx]);
+		} else if (arg == "--worker-cores" && hasValue) {
+			dispatcherInfo.WorkerCores = parseCoreList(argv[++argIdx]);
+		} else if (arg == "--analytic") {
+			simulation = EParticleSimulation::ANALYTIC;
+		} else if (arg == "--quantized-positions") {
+			positionFormat = EParticlePositionFormat::QUANTIZED16;
+		} else if (arg == "--batched-compute") {
+			batchedCompute = true;
+		} else {
+			args.push_back(arg);
+		}
+	}
+
+	if (!args.empty() && args[0] == "--bench-tasks") {
+		uint32_t taskCount = args.size() > 1 ? (uint32_t)std::stoi(args[1]) : 100000;
+		benchmarkTaskDispatcher(taskCount, 256, dispatcherInfo);
+		return 0;
+	}
+
+	if (!args.empty() && args[0] == "--bench-task-allocations") {
+		uint32_t frameCount = args.size() > 1 ? (uint32_t)std::stoi(args[1]) : 1000;
+		benchmarkTaskAllocations(frameCount, 64, dispatcherInfo);
+		return 0;
+	}
+
+	if (!args.empty() && args[0] == "--bench-particles") {
+		uint32_t particleCount = args.size() > 1 ? (uint32_t)std::stoi(args[1]) : 1000000;
+		benchmarkParticleIntegration(particleCount, 200);
+		return 0;
+	}
+
+	if (!args.empty() && args[0] == "--bench-respawn") {
+		uint32_t particleCount = args.size() > 1 ? (uint32_t)std::stoi(args[1]) : 1000000;
+		benchmarkParticleRespawn(particleCount, 600);
+		return 0;
+	}
+
+	if (!args.empty() && args[0] == "--bench-spawn") {
+		uint32_t particleCount = args.size() > 1 ? (uint32_t)std::stoi(args[1]) : 100000;
+		benchmarkParticleSpawn(particleCount, 200);
+		return 0;
+	}
+
+	if (!args.empty() && args[0] == "--bench-positions") {
+		uint32_t particleCount = args.size() > 1 ? (uint32_t)std::stoi(args[1]) : 10000000;
+		benchmarkParticlePositions(particleCount, 50);
+		return 0;
+	}
+
+	if (!args.empty() && args[0] == "--bench-memory-allocator") {
+		uint32_t allocationCount = args.size() > 1 ? (uint32_t)std::stoi(args[1]) : 100000;
+		return benchmarkDeviceMemoryAllocator(allocationCount, 4) ? 0 : 1;
+	}
+
 	size_t emitterCount = 2;
 	size_t frameCount = 3;
 	float particleCount = 100.0f;
 	bool multipleQueues = true;
 
-	if (argc > 1) {
-		emitterCount = std::stoi(argv[1]);
+	if (args.size() > 0) {
+		emitterCount = std::stoi(args[0]);
 	}
 
-	if (argc > 2) {
-		frameCount = std::stoi(argv[2]);
+	if (args.size() > 1) {
+		frameCount = std::stoi(args[1]);
 	}
 
-	if (argc > 3) {
-		multipleQueues = std::stoi(argv[3]);
+	if (args.size() > 2) {
+		multipleQueues = std::stoi(args[2]);
 	}
 
-	if (argc > 4) {
-		particleCount = std::stof(argv[4]);
+	if (args.size() > 3) {
+		particleCount = std::stof(args[3]);
 	}
 
 #if defined(_DEBUG) && defined(_WIN32)
@@ -32,7 +144,7 @@ int main(int argc, const char* argv[])
 #endif
 
 	Application app;
-	app.init(emitterCount, frameCount, multipleQueues, particleCount);
+	app.init(emitterCount, frameCount, multipleQueues, particleCount, simulation, positionFormat, batchedCompute, dispatcherInfo);
 	app.run();
 	app.release();
 	return 0;